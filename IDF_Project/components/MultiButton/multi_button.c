@@ -8,8 +8,19 @@
 #define EVENT_CB(ev)   if(handle->cb[ev])handle->cb[ev]((void*)handle)
 #define PRESS_REPEAT_MAX_NUM  15 /*!< The maximum value of the repeat counter */
 
-//button handle list head.
-static struct Button* head_handle = NULL;
+/*
+ * Started buttons live in a dense array, button_list[i] owns bit i ("lane i") of
+ * every scan mask below. One tick samples all lanes into a single word, runs the
+ * debounce for all of them with a few bitwise operations, and only enters the
+ * per-button state machine for lanes that are not quiet.
+ */
+static struct Button* button_list[BUTTON_MAX_NUM];
+static uint8_t button_count = 0;
+static uint32_t (*input_reader)(void) = NULL;
+
+static uint32_t levels = 0;              // debounced level of each lane
+static uint32_t debounce_planes[3] = {0}; // vertical counter, plane n holds bit n of every lane's count
+static uint32_t quiet = 0;               // lanes that have nothing to do until their pin level changes
 
 static void button_handler(struct Button* handle);
 
@@ -31,6 +42,31 @@ void button_init(struct Button* handle, uint8_t(*pin_level)(uint8_t), uint8_t ac
 	handle->button_id = button_id;
 }
 
+/**
+  * @brief  Initializes a button read from the shared input register word.
+  * @param  handle: the button handle struct.
+  * @param  input_mask: bit of the word returned by the input reader, the button
+  *         level is 1 when any bit of the mask is set.
+  * @param  active_level: pressed GPIO level.
+  * @param  button_id: the button id.
+  * @retval None
+  */
+void button_init_input(struct Button* handle, uint32_t input_mask, uint8_t active_level, uint8_t button_id)
+{
+	button_init(handle, NULL, active_level, button_id);
+	handle->input_mask = input_mask;
+}
+
+/**
+  * @brief  Set the function reading the whole input register, called once per tick.
+  * @param  read_inputs: returns the input levels of all pins as one word.
+  * @retval None
+  */
+void button_set_input_reader(uint32_t (*read_inputs)(void))
+{
+	input_reader = read_inputs;
+}
+
 /**
   * @brief  Attach the button event callback function.
   * @param  handle: the button handle struct.
@@ -40,9 +76,24 @@ void button_init(struct Button* handle, uint8_t(*pin_level)(uint8_t), uint8_t ac
   */
 void button_attach(struct Button* handle, PressEvent event, BtnCallback cb)
 {
+	if(event >= number_of_event) return; // NONE_PRESS has no callback slot
 	handle->cb[event] = cb;
 }
 
+/**
+  * @brief  Set the hold durations that fire LONG_PRESS_MILESTONE during a long press.
+  * @param  handle: the button handle struct.
+  * @param  milestones: ascending tick counts since press down, each greater than
+  *         LONG_TICKS. The array is not copied and must outlive the button.
+  * @param  milestone_num: number of entries, 0 disables milestones.
+  * @retval None
+  */
+void button_set_hold_milestones(struct Button* handle, const uint16_t* milestones, uint8_t milestone_num)
+{
+	handle->milestones = milestones;
+	handle->milestone_num = milestones ? milestone_num : 0;
+}
+
 /**
   * @brief  Inquire the button event happen.
   * @param  handle: the button handle struct.
@@ -55,27 +106,14 @@ PressEvent get_button_event(struct Button* handle)
 
 /**
   * @brief  Button driver core function, driver state machine.
-  * @param  handle: the button handle struct.
+  * @param  handle: the button handle struct, button_level already debounced.
   * @retval None
   */
 static void button_handler(struct Button* handle)
 {
-	uint8_t read_gpio_level = handle->hal_button_Level(handle->button_id);
-
 	//ticks counter working..
 	if((handle->state) > 0) handle->ticks++;
 
-	/*------------button debounce handle---------------*/
-	if(read_gpio_level != handle->button_level) { //not equal to prev one
-		//continue read 3 times same new level change
-		if(++(handle->debounce_cnt) >= DEBOUNCE_TICKS) {
-			handle->button_level = read_gpio_level;
-			handle->debounce_cnt = 0;
-		}
-	} else { //level not change ,counter reset.
-		handle->debounce_cnt = 0;
-	}
-
 	/*-----------------State machine-------------------*/
 	switch (handle->state) {
 	case 0:
@@ -99,6 +137,7 @@ static void button_handler(struct Button* handle)
 		} else if(handle->ticks > LONG_TICKS) {
 			handle->event = (uint8_t)LONG_PRESS_START;
 			EVENT_CB(LONG_PRESS_START);
+			handle->milestone = 0;
 			handle->state = 5;
 		}
 		break;
@@ -145,6 +184,12 @@ static void button_handler(struct Button* handle)
 			//continue hold trigger
 			handle->event = (uint8_t)LONG_PRESS_HOLD;
 			EVENT_CB(LONG_PRESS_HOLD);
+			// same tick counter as LONG_PRESS_START, so milestones land on an exact tick
+			if(handle->milestone < handle->milestone_num && handle->ticks >= handle->milestones[handle->milestone]) {
+				handle->event = (uint8_t)LONG_PRESS_MILESTONE;
+				EVENT_CB(LONG_PRESS_MILESTONE); // handle->milestone is the index reached
+				handle->milestone++;
+			}
 		} else { //released
 			handle->event = (uint8_t)PRESS_UP;
 			EVENT_CB(PRESS_UP);
@@ -157,20 +202,92 @@ static void button_handler(struct Button* handle)
 	}
 }
 
+/**
+  * @brief  Whether the button is resting: released, not inside a click sequence
+  *         and its last event already reported as NONE_PRESS.
+  * @param  handle: the button handle struct.
+  * @retval 1: the state machine would do nothing while the level stays the same.
+  */
+static int button_is_quiet(struct Button* handle)
+{
+	return handle->state == 0 && handle->event == (uint8_t)NONE_PRESS && handle->button_level != handle->active_level;
+}
+
+/**
+  * @brief  Copy bit "from" of word to bit "to", used when a lane moves.
+  */
+static uint32_t move_bit(uint32_t word, uint8_t from, uint8_t to)
+{
+	word &= ~(1u << to);
+	return word | (((word >> from) & 1u) << to);
+}
+
+/**
+  * @brief  Read the raw level of every lane, the input register at most once.
+  * @retval one bit per lane.
+  */
+static uint32_t sample_levels(void)
+{
+	uint32_t inputs = input_reader ? input_reader() : 0;
+	uint32_t raw = 0;
+	uint8_t i;
+	for(i = 0; i < button_count; i++) {
+		struct Button* handle = button_list[i];
+		uint8_t level = handle->input_mask ? (inputs & handle->input_mask) != 0 : handle->hal_button_Level(handle->button_id);
+		raw |= (uint32_t)(level & 1) << i;
+	}
+	return raw;
+}
+
+/**
+  * @brief  Debounce all lanes at once: a lane whose raw level differs from its
+  *         debounced level counts up, DEBOUNCE_TICKS equal reads in a row flip it,
+  *         a lane reading its debounced level again restarts from 0.
+  * @param  raw: raw level of every lane.
+  * @retval lanes whose debounced level flipped on this tick.
+  */
+static uint32_t debounce_lanes(uint32_t raw)
+{
+	uint32_t diff = raw ^ levels;
+	uint32_t c0 = debounce_planes[0], c1 = debounce_planes[1], c2 = debounce_planes[2];
+
+	// count + 1 on the lanes in diff, 0 on the others
+	uint32_t n2 = (c2 ^ (c1 & c0)) & diff;
+	uint32_t n1 = (c1 ^ c0) & diff;
+	uint32_t n0 = ~c0 & diff;
+
+	uint32_t flipped = diff
+		& ((DEBOUNCE_TICKS & 1) ? n0 : ~n0)
+		& ((DEBOUNCE_TICKS & 2) ? n1 : ~n1)
+		& ((DEBOUNCE_TICKS & 4) ? n2 : ~n2);
+
+	debounce_planes[0] = n0 & ~flipped;
+	debounce_planes[1] = n1 & ~flipped;
+	debounce_planes[2] = n2 & ~flipped;
+	levels ^= flipped;
+	return flipped;
+}
+
 /**
   * @brief  Start the button work, add the handle into work list.
   * @param  handle: target handle struct.
-  * @retval 0: succeed. -1: already exist.
+  * @retval 0: succeed. -1: already exist or BUTTON_MAX_NUM buttons started.
   */
 int button_start(struct Button* handle)
 {
-	struct Button* target = head_handle;
-	while(target) {
-		if(target == handle) return -1;	//already exist.
-		target = target->next;
+	uint8_t i;
+	for(i = 0; i < button_count; i++) {
+		if(button_list[i] == handle) return -1;	//already exist.
 	}
-	handle->next = head_handle;
-	head_handle = handle;
+	if(button_count >= BUTTON_MAX_NUM) return -1;
+
+	i = button_count++;
+	button_list[i] = handle;
+	levels = (levels & ~(1u << i)) | ((uint32_t)handle->button_level << i);
+	debounce_planes[0] &= ~(1u << i);
+	debounce_planes[1] &= ~(1u << i);
+	debounce_planes[2] &= ~(1u << i);
+	quiet = (quiet & ~(1u << i)) | ((uint32_t)button_is_quiet(handle) << i);
 	return 0;
 }
 
@@ -181,28 +298,53 @@ int button_start(struct Button* handle)
   */
 void button_stop(struct Button* handle)
 {
-	struct Button** curr;
-	for(curr = &head_handle; *curr; ) {
-		struct Button* entry = *curr;
-		if(entry == handle) {
-			*curr = entry->next;
-//			free(entry);
-			return;//glacier add 2021-8-18
-		} else {
-			curr = &entry->next;
+	uint8_t i;
+	for(i = 0; i < button_count; i++) {
+		if(button_list[i] == handle) {
+			// keep the array dense: the last lane takes the freed slot
+			uint8_t last = --button_count;
+			button_list[i] = button_list[last];
+			levels = move_bit(levels, last, i);
+			debounce_planes[0] = move_bit(debounce_planes[0], last, i);
+			debounce_planes[1] = move_bit(debounce_planes[1], last, i);
+			debounce_planes[2] = move_bit(debounce_planes[2], last, i);
+			quiet = move_bit(quiet, last, i);
+			return;
 		}
 	}
 }
 
 /**
-  * @brief  background ticks, timer repeat invoking interval 5ms.
+  * @brief  background ticks, timer repeat invoking interval TICKS_INTERVAL.
   * @param  None.
-  * @retval None
+  * @retval number of buttons still in a press sequence, 0 means the tick timer
+  *         can be stopped until the next pin edge.
   */
-void button_ticks(void)
+int button_ticks(void)
 {
-	struct Button* target;
-	for(target=head_handle; target; target=target->next) {
-		button_handler(target);
+	uint32_t lanes = button_count >= 32 ? 0xffffffffu : (1u << button_count) - 1;
+	uint32_t raw = sample_levels();
+
+	uint32_t diff = (raw ^ levels) & lanes;
+
+	// nothing pressed, bouncing or pending anywhere: no state machine to run
+	if(diff == 0 && (quiet & lanes) == lanes) return 0;
+
+	debounce_lanes(raw);
+
+	uint32_t pending = (raw ^ levels) & lanes; // lanes still counting their debounce
+	uint32_t run = (~quiet | diff) & lanes;
+	while(run) {
+		uint8_t i = (uint8_t)__builtin_ctz(run);
+		struct Button* handle = button_list[i];
+		run &= run - 1;
+		handle->button_level = (levels >> i) & 1u;
+		button_handler(handle);
+		if(button_is_quiet(handle) && !(pending & (1u << i))) {
+			quiet |= 1u << i;
+		} else {
+			quiet &= ~(1u << i);
+		}
 	}
+	return __builtin_popcount(~quiet & lanes);
 }
@@ -14,6 +14,7 @@
 #define DEBOUNCE_TICKS 3  // MAX 7 (0 ~ 7)
 #define SHORT_TICKS (200 / TICKS_INTERVAL)
 #define LONG_TICKS (1100 / TICKS_INTERVAL)
+#define BUTTON_MAX_NUM 32 // MAX 32, one bit lane of the scan masks per started button
 
 typedef void (*BtnCallback)(void *);
 
@@ -26,6 +27,7 @@ typedef enum
 	DOUBLE_CLICK,
 	LONG_PRESS_START,
 	LONG_PRESS_HOLD,
+	LONG_PRESS_MILESTONE,
 	number_of_event,
 	NONE_PRESS
 } PressEvent;
@@ -36,13 +38,15 @@ typedef struct Button
 	uint8_t repeat : 4;
 	uint8_t event : 4;
 	uint8_t state : 3;
-	uint8_t debounce_cnt : 3;
 	uint8_t active_level : 1;
 	uint8_t button_level : 1;
 	uint8_t button_id;
+	uint32_t input_mask; // bit(s) of the input register word, 0: read through hal_button_Level
+	const uint16_t *milestones; // hold durations in ticks since press down, ascending
+	uint8_t milestone_num;
+	uint8_t milestone;          // milestones reached in the current long press
 	uint8_t (*hal_button_Level)(uint8_t button_id_);
 	BtnCallback cb[number_of_event];
-	struct Button *next;
 } Button;
 
 #ifdef __cplusplus
@@ -51,11 +55,14 @@ extern "C"
 #endif
 
 	void button_init(struct Button *handle, uint8_t (*pin_level)(uint8_t), uint8_t active_level, uint8_t button_id);
+	void button_init_input(struct Button *handle, uint32_t input_mask, uint8_t active_level, uint8_t button_id);
+	void button_set_input_reader(uint32_t (*read_inputs)(void));
 	void button_attach(struct Button *handle, PressEvent event, BtnCallback cb);
+	void button_set_hold_milestones(struct Button *handle, const uint16_t *milestones, uint8_t milestone_num);
 	PressEvent get_button_event(struct Button *handle);
 	int button_start(struct Button *handle);
 	void button_stop(struct Button *handle);
-	void button_ticks(void);
+	int button_ticks(void);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,344 @@
+#include "audit_log.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/param.h>
+#include <time.h>
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#define AUDIT_LOG_TAG "AUDIT_LOG"
+
+#define AUDIT_RECORD_SIZE sizeof(audit_record_t)
+#define AUDIT_SEQ_EMPTY 0xFFFFFFFF // flash 擦除后的值
+#define AUDIT_RAM_MASK (AUDIT_LOG_RAM_RECORDS - 1)
+
+_Static_assert((AUDIT_LOG_RAM_RECORDS & AUDIT_RAM_MASK) == 0, "AUDIT_LOG_RAM_RECORDS must be a power of two");
+_Static_assert(AUDIT_LOG_FLUSH_RECORDS <= AUDIT_LOG_RAM_RECORDS, "flush page larger than the RAM ring");
+
+/*
+ * 记录按序号连续存放：RAM 环形缓冲里是 [flash_next_seq, next_seq) 这些还没写下去的记录，
+ * flash 分区也是一个环，write_offset 是 flash_next_seq 这条记录将要写入的位置。
+ * 写到一个扇区的开头时才擦除这个扇区，所以整个分区的扇区轮流擦写，磨损是均匀的，
+ * 代价是每转一圈丢掉最老的一个扇区的记录。
+ */
+static const esp_partition_t *audit_partition = NULL;
+static portMUX_TYPE audit_lock = portMUX_INITIALIZER_UNLOCKED;
+static audit_record_t ram_ring[AUDIT_LOG_RAM_RECORDS];
+static uint32_t next_seq = 0;       // 下一条记录的序号
+static uint32_t flash_next_seq = 0; // 下一条要写进 flash 的记录序号
+static uint32_t write_offset = 0;   // flash_next_seq 在分区里的偏移
+static uint32_t dropped_count = 0;
+static uint32_t ble_bda_hash = 0;
+static int8_t ble_rssi = 0;
+
+static TaskHandle_t flush_task_handle = NULL;
+static SemaphoreHandle_t flush_mutex = NULL; // flush 任务和 audit_log_flush() 不能同时写 flash
+
+/**
+ * @brief FNV-1a，把 6 字节的蓝牙地址压成 4 字节，日志里不存完整地址
+ */
+static uint32_t hash_bda(const uint8_t bda[6])
+{
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < 6; i++)
+    {
+        hash = (hash ^ bda[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t sector_size(void)
+{
+    return audit_partition->erase_size;
+}
+
+static uint32_t read_seq_at(uint32_t offset)
+{
+    audit_record_t record;
+    if (esp_partition_read(audit_partition, offset, &record, AUDIT_RECORD_SIZE) != ESP_OK)
+    {
+        return AUDIT_SEQ_EMPTY;
+    }
+    return record.seq;
+}
+
+/**
+ * @brief 上电时找到最新的记录：先比较每个扇区第一条记录找到最新的扇区，再在扇区里找到第一个断开的位置
+ */
+static void recover_write_position(void)
+{
+    uint32_t sectors = audit_partition->size / sector_size();
+    int32_t newest_sector = -1;
+    uint32_t newest_seq = 0;
+
+    for (uint32_t sector = 0; sector < sectors; sector++)
+    {
+        uint32_t seq = read_seq_at(sector * sector_size());
+        if (seq != AUDIT_SEQ_EMPTY && (newest_sector < 0 || seq > newest_seq))
+        {
+            newest_sector = sector;
+            newest_seq = seq;
+        }
+    }
+
+    if (newest_sector < 0)
+    {
+        write_offset = 0;
+        next_seq = flash_next_seq = 0;
+        return;
+    }
+
+    uint32_t sector_start = newest_sector * sector_size();
+    uint32_t offset = sector_start + AUDIT_RECORD_SIZE;
+    uint32_t expected = newest_seq + 1;
+    while (offset < sector_start + sector_size() && read_seq_at(offset) == expected)
+    {
+        offset += AUDIT_RECORD_SIZE;
+        expected++;
+    }
+
+    // 断电时写了一半的记录会让这个位置既不是空的也不连续，只能跳到下一个扇区重新开始
+    if (offset < sector_start + sector_size() && read_seq_at(offset) != AUDIT_SEQ_EMPTY)
+    {
+        ESP_LOGW(AUDIT_LOG_TAG, "Torn record at 0x%lx, skipping to the next sector", (unsigned long)offset);
+        offset = sector_start + sector_size();
+    }
+
+    write_offset = offset % audit_partition->size;
+    next_seq = flash_next_seq = expected;
+}
+
+/**
+ * @brief 把 RAM 里攒下的记录写到 flash，每次最多写一页，并且不跨扇区
+ */
+static void flush_pending(void)
+{
+    audit_record_t page[AUDIT_LOG_FLUSH_RECORDS];
+
+    xSemaphoreTake(flush_mutex, portMAX_DELAY);
+    while (1)
+    {
+        uint32_t records_left_in_sector = (sector_size() - write_offset % sector_size()) / AUDIT_RECORD_SIZE;
+
+        portENTER_CRITICAL(&audit_lock);
+        uint32_t count = next_seq - flash_next_seq;
+        count = MIN(count, AUDIT_LOG_FLUSH_RECORDS);
+        count = MIN(count, records_left_in_sector);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            page[i] = ram_ring[(flash_next_seq + i) & AUDIT_RAM_MASK];
+        }
+        portEXIT_CRITICAL(&audit_lock);
+
+        if (count == 0)
+        {
+            break;
+        }
+
+        esp_err_t err = ESP_OK;
+        if (write_offset % sector_size() == 0)
+        {
+            err = esp_partition_erase_range(audit_partition, write_offset, sector_size());
+        }
+        if (err == ESP_OK)
+        {
+            err = esp_partition_write(audit_partition, write_offset, page, count * AUDIT_RECORD_SIZE);
+        }
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(AUDIT_LOG_TAG, "Failed to write audit records at 0x%lx: %s", (unsigned long)write_offset, esp_err_to_name(err));
+            break; // 记录还留在 RAM 里，下次再试
+        }
+
+        portENTER_CRITICAL(&audit_lock);
+        flash_next_seq += count;
+        write_offset = (write_offset + count * AUDIT_RECORD_SIZE) % audit_partition->size;
+        portEXIT_CRITICAL(&audit_lock);
+    }
+    xSemaphoreGive(flush_mutex);
+}
+
+static void audit_log_flush_task(void *arg)
+{
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(AUDIT_LOG_FLUSH_INTERVAL_MS));
+        flush_pending();
+    }
+}
+
+esp_err_t audit_log_init(void)
+{
+    audit_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, AUDIT_LOG_PARTITION_SUBTYPE, AUDIT_LOG_PARTITION_LABEL);
+    if (audit_partition == NULL)
+    {
+        ESP_LOGE(AUDIT_LOG_TAG, "Partition '%s' not found, audit records will only be kept in RAM", AUDIT_LOG_PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    recover_write_position();
+    ESP_LOGI(AUDIT_LOG_TAG, "Audit log resumes at seq %lu, offset 0x%lx", (unsigned long)next_seq, (unsigned long)write_offset);
+
+    flush_mutex = xSemaphoreCreateMutex();
+    xTaskCreate(audit_log_flush_task, "audit_log_flush", 2560, NULL, AUDIT_LOG_FLUSH_TASK_PRIORITY, &flush_task_handle);
+    return ESP_OK;
+}
+
+void audit_log_record(uint8_t from_state, uint8_t to_state, audit_cause_t cause, uint32_t source, int8_t rssi)
+{
+    bool notify = false;
+    uint32_t now = (uint32_t)time(NULL); // time() 内部会拿锁，不能放进临界区
+
+    portENTER_CRITICAL(&audit_lock);
+    if (next_seq - flash_next_seq >= AUDIT_LOG_RAM_RECORDS)
+    {
+        if (audit_partition != NULL)
+        {
+            dropped_count++; // flush 任务跟不上，宁可丢新记录也不能让序号断开
+            portEXIT_CRITICAL(&audit_lock);
+            return;
+        }
+        flash_next_seq++; // 没有 flash 分区时 RAM 缓冲就是一个普通的覆盖式环
+    }
+
+    audit_record_t *record = &ram_ring[next_seq & AUDIT_RAM_MASK];
+    record->seq = next_seq;
+    record->timestamp = now;
+    record->source = source;
+    record->from_state = from_state;
+    record->to_state = to_state;
+    record->cause = cause;
+    record->rssi = rssi;
+    next_seq++;
+    notify = (next_seq - flash_next_seq) >= AUDIT_LOG_FLUSH_RECORDS;
+    portEXIT_CRITICAL(&audit_lock);
+
+    if (notify && flush_task_handle != NULL)
+    {
+        xTaskNotifyGive(flush_task_handle);
+    }
+}
+
+void audit_log_note_ble_unlock(const uint8_t bda[6], int8_t rssi)
+{
+    uint32_t hash = hash_bda(bda);
+    portENTER_CRITICAL(&audit_lock);
+    ble_bda_hash = hash;
+    ble_rssi = rssi;
+    portEXIT_CRITICAL(&audit_lock);
+}
+
+void audit_log_get_ble_context(uint32_t *bda_hash, int8_t *rssi)
+{
+    portENTER_CRITICAL(&audit_lock);
+    *bda_hash = ble_bda_hash;
+    *rssi = ble_rssi;
+    portEXIT_CRITICAL(&audit_lock);
+}
+
+/**
+ * @brief flash 里最老的一条记录的序号；紧跟在写指针所在扇区后面的扇区就是最老的扇区，还没写满一圈时就是分区开头
+ */
+static uint32_t oldest_flash_seq(void)
+{
+    portENTER_CRITICAL(&audit_lock);
+    uint32_t offset = write_offset;
+    uint32_t fns = flash_next_seq;
+    portEXIT_CRITICAL(&audit_lock);
+
+    uint32_t next_sector = (offset / sector_size() + 1) * sector_size() % audit_partition->size;
+    uint32_t seq = read_seq_at(next_sector);
+    if (seq == AUDIT_SEQ_EMPTY)
+    {
+        seq = read_seq_at(0);
+    }
+    return (seq == AUDIT_SEQ_EMPTY || seq > fns) ? fns : seq;
+}
+
+size_t audit_log_read(uint32_t start_seq, audit_record_t *out, size_t max_records)
+{
+    size_t count = 0;
+    uint32_t seq = start_seq;
+
+    if (audit_partition != NULL)
+    {
+        seq = MAX(seq, oldest_flash_seq());
+    }
+
+    while (count < max_records)
+    {
+        bool in_ram = false;
+        portENTER_CRITICAL(&audit_lock);
+        uint32_t fns = flash_next_seq;
+        uint32_t offset = write_offset;
+        if (seq < fns && audit_partition == NULL)
+        {
+            seq = fns; // 没有分区时，比 RAM 里最老的还早的记录已经被覆盖了
+        }
+        if (seq >= fns && seq < next_seq)
+        {
+            out[count] = ram_ring[seq & AUDIT_RAM_MASK];
+            in_ram = true;
+        }
+        portEXIT_CRITICAL(&audit_lock);
+
+        if (!in_ram)
+        {
+            if (seq >= fns)
+            {
+                break; // 已经读到最新
+            }
+            uint32_t back = (fns - seq) * AUDIT_RECORD_SIZE;
+            uint32_t record_offset = (offset + audit_partition->size - back % audit_partition->size) % audit_partition->size;
+            if (esp_partition_read(audit_partition, record_offset, &out[count], AUDIT_RECORD_SIZE) != ESP_OK || out[count].seq != seq)
+            {
+                break; // 这条记录刚好被擦掉了
+            }
+        }
+        count++;
+        seq++;
+    }
+    return count;
+}
+
+uint32_t audit_log_next_seq(void)
+{
+    portENTER_CRITICAL(&audit_lock);
+    uint32_t seq = next_seq;
+    portEXIT_CRITICAL(&audit_lock);
+    return seq;
+}
+
+uint32_t audit_log_dropped(void)
+{
+    return dropped_count;
+}
+
+void audit_log_flush(void)
+{
+    if (audit_partition != NULL && flush_mutex != NULL)
+    {
+        flush_pending();
+    }
+}
+
+void audit_log_dump_uart(void)
+{
+    audit_record_t batch[AUDIT_LOG_FLUSH_RECORDS];
+    uint32_t seq = 0;
+    size_t count;
+
+    printf("seq,timestamp,from,to,cause,source,rssi\n");
+    while ((count = audit_log_read(seq, batch, AUDIT_LOG_FLUSH_RECORDS)) > 0)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            printf("%lu,%lu,%u,%u,%u,0x%08lx,%d\n", (unsigned long)batch[i].seq, (unsigned long)batch[i].timestamp,
+                   batch[i].from_state, batch[i].to_state, batch[i].cause, (unsigned long)batch[i].source, batch[i].rssi);
+        }
+        seq = batch[count - 1].seq + 1;
+    }
+}
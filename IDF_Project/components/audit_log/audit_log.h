@@ -0,0 +1,95 @@
+#ifndef AUDIT_LOG_H
+#define AUDIT_LOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define AUDIT_LOG_PARTITION_LABEL "audit"  // partitions.csv 里审计日志分区的名字
+#define AUDIT_LOG_PARTITION_SUBTYPE 0x99   // 自定义 data 分区子类型
+#define AUDIT_LOG_RAM_RECORDS 64           // RAM 环形缓冲的记录数，必须是 2 的幂
+#define AUDIT_LOG_FLUSH_RECORDS 16         // 攒够一页（16 * 16 = 256 字节）就写一次 flash
+#define AUDIT_LOG_FLUSH_INTERVAL_MS 5000   // 没攒够一页时，最多等这么久也要写下去
+#define AUDIT_LOG_FLUSH_TASK_PRIORITY 2    // 比状态机和灯效都低，擦写 flash 不会拖慢开门
+
+typedef enum
+{
+    AUDIT_CAUSE_BOOT = 0, // 上电
+    AUDIT_CAUSE_BUTTON,   // 实体按键，source 是 button_event_t
+    AUDIT_CAUSE_BLE,      // 蓝牙靠近开门，source 是蓝牙地址的哈希，rssi 是平滑后的 RSSI
+    AUDIT_CAUSE_TIMER,    // 恢复定时器到期
+    AUDIT_CAUSE_REMOTE,   // 远程命令（MQTT 等），source 是命令里带的请求号
+    AUDIT_CAUSE_SCHEDULE, // 定时计划，source 是 schedule_action_t
+} audit_cause_t;
+
+/**
+ * @brief 一条审计记录，固定 16 字节，RAM 和 flash 里都是这个格式
+ *
+ * flash 擦除后全是 0xFF，所以 seq == 0xFFFFFFFF 表示空记录
+ */
+typedef struct __attribute__((packed))
+{
+    uint32_t seq;       // 单调递增的序号，重启后接着上次的编号
+    uint32_t timestamp; // time(NULL)，还没对时的话是开机以来的秒数
+    uint32_t source;    // 见 audit_cause_t
+    uint8_t from_state; // lock_status_t
+    uint8_t to_state;   // lock_status_t
+    uint8_t cause;      // audit_cause_t
+    int8_t rssi;        // 只有蓝牙开门有意义，其它为 0
+} audit_record_t;
+
+_Static_assert(sizeof(audit_record_t) == 16, "audit_record_t must stay 16 bytes");
+
+/**
+ * @brief 找到审计日志分区，恢复写指针和序号，启动后台写 flash 的任务
+ *
+ * 找不到分区时返回 ESP_ERR_NOT_FOUND，此后的记录只保存在 RAM 里
+ */
+esp_err_t audit_log_init(void);
+
+/**
+ * @brief 记录一次状态切换，只拷贝到 RAM 环形缓冲里，不碰 flash，可以在任意任务和定时器回调里调用
+ */
+void audit_log_record(uint8_t from_state, uint8_t to_state, audit_cause_t cause, uint32_t source, int8_t rssi);
+
+/**
+ * @brief 蓝牙模块在发出靠近开门事件之前调用，记下是哪台设备、RSSI 多少，之后 AUDIT_CAUSE_BLE 的记录会带上这些信息
+ */
+void audit_log_note_ble_unlock(const uint8_t bda[6], int8_t rssi);
+
+/**
+ * @brief 取出最近一次 audit_log_note_ble_unlock 记下的地址哈希和 RSSI
+ */
+void audit_log_get_ble_context(uint32_t *bda_hash, int8_t *rssi);
+
+/**
+ * @brief 从 start_seq 开始按顺序读出记录（flash 里的和还在 RAM 里的都算），用于 BLE / UART 导出
+ *
+ * start_seq 比最老的记录还早时从最老的记录开始
+ *
+ * @return 实际读出的记录数
+ */
+size_t audit_log_read(uint32_t start_seq, audit_record_t *out, size_t max_records);
+
+/**
+ * @brief 下一条记录将要使用的序号
+ */
+uint32_t audit_log_next_seq(void);
+
+/**
+ * @brief 因为 RAM 缓冲满了被丢掉的记录数
+ */
+uint32_t audit_log_dropped(void);
+
+/**
+ * @brief 把 RAM 里还没写下去的记录马上写到 flash，会阻塞到写完，重启前调用
+ */
+void audit_log_flush(void);
+
+/**
+ * @brief 通过串口把所有记录按 CSV 打印出来：seq,timestamp,from,to,cause,source,rssi
+ */
+void audit_log_dump_uart(void);
+
+#endif // AUDIT_LOG_H
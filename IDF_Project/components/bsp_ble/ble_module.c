@@ -32,6 +32,11 @@
 #include "button.h"
 
 #include "ble_module.h"
+#include "audit_log.h"
+#include "lock_schedule.h"
+#include "lock_latency.h"
+#include "ws2812b_led.h"
+#include "telemetry.h"
 
 /**
  * BRIEF:
@@ -78,9 +83,13 @@ static uint16_t hid_conn_id = 0;
 #define SERVICE_UUID 0xFF69
 #define CHAR_UUID_WIFI_SSID 0xFF70 // Wi-Fi SSID 特性 UUID
 #define CHAR_UUID_WIFI_PASS 0xFF71 // Wi-Fi 密码特性 UUID
+#define CHAR_UUID_AUDIT_LOG 0xFF72 // 审计日志导出特性 UUID，写 4 字节小端起始序号，读返回之后的若干条 16 字节记录
+#define CHAR_UUID_SCHEDULE 0xFF73  // 定时计划特性 UUID，写入格式见 lock_schedule_set_from_ble，读返回 schedule_config_t
+#define CHAR_UUID_LATENCY 0xFF74   // 开门延迟特性 UUID，写 1 字节 lock_latency_kind_t 选择触发方式，读返回这种方式的 lock_latency_stats_t
 
-#define GATTS_NUM_HANDLE 8
+#define GATTS_NUM_HANDLE 12 // 服务声明 1 个 + 每个特性 2 个（声明和值）
 #define CHARACTERISTIC_VAL_LEN 512
+#define AUDIT_LOG_BLE_BATCH_RECORDS 16 // 每次读审计日志特性返回的记录数，256 字节，MTU 不够时靠 Read Blob 分段读
 
 #define TIME_BACK_TO_GAP_WHITELIST 10 * 1000 // 不动或离开后，从GAP白名单里删除，回到广播白名单的时间
 
@@ -95,6 +104,12 @@ static esp_ble_addr_type_t last_con_bda_type = 0; // 已连接蓝牙设备地址
 const int8_t k_rssi_threshold = -65;              // RSSI 阈值，超过这个值则开门
 SemaphoreHandle_t pairing_semaphore = NULL;
 
+static uint32_t audit_read_cursor = 0;                                   // 下一次读审计日志特性从哪条记录开始
+static audit_record_t audit_read_batch[AUDIT_LOG_BLE_BATCH_RECORDS] = {0}; // Read Blob 分段读的时候要从同一批数据里取
+static uint16_t audit_read_batch_len = 0;
+static lock_latency_kind_t latency_read_kind = LOCK_LATENCY_SINGLE_CLICK; // 读延迟特性返回哪种触发方式的分布
+static lock_latency_stats_t latency_read_stats;                            // Read Blob 分段读的时候要从同一份数据里取
+
 static void hidd_event_callback(esp_hidd_cb_event_t event, esp_hidd_cb_param_t *param);
 
 // GATT 服务结构体
@@ -108,8 +123,14 @@ static struct gatts_profile_inst
     esp_gatt_srvc_id_t service_id;
     uint16_t char_handle_ssid;
     uint16_t char_handle_pass;
+    uint16_t char_handle_audit;
+    uint16_t char_handle_schedule;
+    uint16_t char_handle_latency;
     esp_bt_uuid_t char_uuid_ssid;
     esp_bt_uuid_t char_uuid_pass;
+    esp_bt_uuid_t char_uuid_audit;
+    esp_bt_uuid_t char_uuid_schedule;
+    esp_bt_uuid_t char_uuid_latency;
 } gl_profile = {
     .gatts_cb = NULL,
     .gatts_if = ESP_GATT_IF_NONE,
@@ -779,12 +800,14 @@ static void hidd_event_callback(esp_hidd_cb_event_t event, esp_hidd_cb_param_t *
     return;
 }
 
-static void unlock_if_rssi_valid(int8_t rssi)
+static void unlock_if_rssi_valid(int8_t rssi, esp_bd_addr_t remote_bda)
 {
     if (rssi > k_rssi_threshold)
     {
         ESP_LOGI(BLE_TAG, "RSSI value is valid, unlocking door.");
 
+        audit_log_note_ble_unlock(remote_bda, rssi); // 审计日志记下是哪台设备开的门
+
         send_button_event(BLE_BUTTON_EVENT_SINGLE_CLICK); // 在此执行开门操作
     }
     else
@@ -818,7 +841,7 @@ static void monitor_rssi_task(void *pvParameters)
 
             if (rssi_task_list[j].ble_rssi_trend == RSSI_TREND_APPROACHING)
             {
-                unlock_if_rssi_valid(rssi_task_list[j].smoothed_rssi);
+                unlock_if_rssi_valid(rssi_task_list[j].smoothed_rssi, remote_bda);
             }
             else // 保持不动或者远离
             {
@@ -916,6 +939,7 @@ static void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param
         int j = find_i_in_rssi_task_list(param->read_rssi_cmpl.remote_addr);
 
         rssi_task_list[j].smoothed_rssi = calculate_sliding_average(param->read_rssi_cmpl.rssi, param->read_rssi_cmpl.remote_addr);
+        telemetry_note_rssi(param->read_rssi_cmpl.rssi); // 每个样本都单独发会把 MQTT 堵死，这里只进周期汇总
         ESP_LOGI(BLE_GAP_TAG, "ESP_GAP_BLE_READ_RSSI_COMPLETE_EVT, smoothed RSSI of the remote device %d: %d", j, rssi_task_list[j].smoothed_rssi);
         rssi_task_list[j].ble_rssi_trend = evaluate_rssi_trend_regression(rssi_task_list[j].smoothed_rssi, param->read_rssi_cmpl.remote_addr);
 
@@ -990,6 +1014,39 @@ static void gatts_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_
         {
             ESP_LOGE(BLE_GATT_TAG, "Failed to add WIFI PASS characteristic");
         }
+
+        // 添加审计日志导出特性
+        gl_profile.char_uuid_audit.len = ESP_UUID_LEN_16;
+        gl_profile.char_uuid_audit.uuid.uuid16 = CHAR_UUID_AUDIT_LOG;
+        if (esp_ble_gatts_add_char(gl_profile.service_handle, &gl_profile.char_uuid_audit,
+                                   ESP_GATT_PERM_READ_ENCRYPTED | ESP_GATT_PERM_WRITE_ENCRYPTED,
+                                   ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE,
+                                   NULL, NULL))
+        {
+            ESP_LOGE(BLE_GATT_TAG, "Failed to add AUDIT LOG characteristic");
+        }
+
+        // 添加定时计划特性，能改门锁行为，和审计日志一样要求加密连接
+        gl_profile.char_uuid_schedule.len = ESP_UUID_LEN_16;
+        gl_profile.char_uuid_schedule.uuid.uuid16 = CHAR_UUID_SCHEDULE;
+        if (esp_ble_gatts_add_char(gl_profile.service_handle, &gl_profile.char_uuid_schedule,
+                                   ESP_GATT_PERM_READ_ENCRYPTED | ESP_GATT_PERM_WRITE_ENCRYPTED,
+                                   ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE,
+                                   NULL, NULL))
+        {
+            ESP_LOGE(BLE_GATT_TAG, "Failed to add SCHEDULE characteristic");
+        }
+
+        // 添加开门延迟特性，只读统计，和审计日志一样要求加密连接
+        gl_profile.char_uuid_latency.len = ESP_UUID_LEN_16;
+        gl_profile.char_uuid_latency.uuid.uuid16 = CHAR_UUID_LATENCY;
+        if (esp_ble_gatts_add_char(gl_profile.service_handle, &gl_profile.char_uuid_latency,
+                                   ESP_GATT_PERM_READ_ENCRYPTED | ESP_GATT_PERM_WRITE_ENCRYPTED,
+                                   ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE,
+                                   NULL, NULL))
+        {
+            ESP_LOGE(BLE_GATT_TAG, "Failed to add LATENCY characteristic");
+        }
         break;
 
     case ESP_GATTS_ADD_CHAR_EVT:
@@ -1006,6 +1063,80 @@ static void gatts_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_
         {
             gl_profile.char_handle_pass = param->add_char.attr_handle;
         }
+        else if (param->add_char.char_uuid.uuid.uuid16 == CHAR_UUID_AUDIT_LOG)
+        {
+            gl_profile.char_handle_audit = param->add_char.attr_handle;
+        }
+        else if (param->add_char.char_uuid.uuid.uuid16 == CHAR_UUID_SCHEDULE)
+        {
+            gl_profile.char_handle_schedule = param->add_char.attr_handle;
+        }
+        else if (param->add_char.char_uuid.uuid.uuid16 == CHAR_UUID_LATENCY)
+        {
+            gl_profile.char_handle_latency = param->add_char.attr_handle;
+        }
+        break;
+
+    case ESP_GATTS_READ_EVT:
+        if (param->read.handle == gl_profile.char_handle_audit)
+        {
+            // offset 为 0 是一次新的读取，取下一批记录；否则是 Read Blob，继续发同一批数据的后半段
+            if (param->read.offset == 0)
+            {
+                size_t count = audit_log_read(audit_read_cursor, audit_read_batch, AUDIT_LOG_BLE_BATCH_RECORDS);
+                audit_read_batch_len = count * sizeof(audit_record_t);
+                if (count > 0)
+                {
+                    audit_read_cursor = audit_read_batch[count - 1].seq + 1;
+                }
+            }
+
+            esp_gatt_rsp_t rsp;
+            memset(&rsp, 0, sizeof(esp_gatt_rsp_t));
+            rsp.attr_value.handle = param->read.handle;
+            rsp.attr_value.offset = param->read.offset;
+            if (param->read.offset < audit_read_batch_len)
+            {
+                rsp.attr_value.len = audit_read_batch_len - param->read.offset;
+                memcpy(rsp.attr_value.value, (uint8_t *)audit_read_batch + param->read.offset, rsp.attr_value.len);
+            }
+            esp_ble_gatts_send_response(gatts_if, param->read.conn_id, param->read.trans_id, ESP_GATT_OK, &rsp);
+        }
+        else if (param->read.handle == gl_profile.char_handle_schedule)
+        {
+            schedule_config_t config;
+            lock_schedule_get(&config);
+
+            esp_gatt_rsp_t rsp;
+            memset(&rsp, 0, sizeof(esp_gatt_rsp_t));
+            rsp.attr_value.handle = param->read.handle;
+            rsp.attr_value.offset = param->read.offset;
+            if (param->read.offset < sizeof(schedule_config_t))
+            {
+                rsp.attr_value.len = sizeof(schedule_config_t) - param->read.offset;
+                memcpy(rsp.attr_value.value, (uint8_t *)&config + param->read.offset, rsp.attr_value.len);
+            }
+            esp_ble_gatts_send_response(gatts_if, param->read.conn_id, param->read.trans_id, ESP_GATT_OK, &rsp);
+        }
+        else if (param->read.handle == gl_profile.char_handle_latency)
+        {
+            // 和审计日志一样，offset 为 0 时取一份新的统计，Read Blob 继续发同一份的后半段
+            if (param->read.offset == 0)
+            {
+                lock_latency_get(latency_read_kind, &latency_read_stats);
+            }
+
+            esp_gatt_rsp_t rsp;
+            memset(&rsp, 0, sizeof(esp_gatt_rsp_t));
+            rsp.attr_value.handle = param->read.handle;
+            rsp.attr_value.offset = param->read.offset;
+            if (param->read.offset < sizeof(lock_latency_stats_t))
+            {
+                rsp.attr_value.len = sizeof(lock_latency_stats_t) - param->read.offset;
+                memcpy(rsp.attr_value.value, (uint8_t *)&latency_read_stats + param->read.offset, rsp.attr_value.len);
+            }
+            esp_ble_gatts_send_response(gatts_if, param->read.conn_id, param->read.trans_id, ESP_GATT_OK, &rsp);
+        }
         break;
 
     case ESP_GATTS_WRITE_EVT:
@@ -1025,6 +1156,25 @@ static void gatts_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_
             // ESP_LOGI(BLE_GATT_TAG, "Received Wi-Fi Password: %s", wifi_pass);
             print_utf32_as_utf8(wifi_pass);
         }
+        else if (param->write.handle == gl_profile.char_handle_audit && param->write.len == sizeof(uint32_t))
+        {
+            memcpy(&audit_read_cursor, param->write.value, sizeof(uint32_t)); // 小端起始序号，写 0 就从最老的记录开始
+            audit_read_batch_len = 0;
+            ESP_LOGI(BLE_GATT_TAG, "Audit log export starts at seq %lu", (unsigned long)audit_read_cursor);
+        }
+        else if (param->write.handle == gl_profile.char_handle_schedule)
+        {
+            esp_err_t err = lock_schedule_set_from_ble(param->write.value, param->write.len);
+            if (err != ESP_OK)
+            {
+                ESP_LOGE(BLE_GATT_TAG, "Failed to set schedule: %s", esp_err_to_name(err));
+            }
+        }
+        else if (param->write.handle == gl_profile.char_handle_latency && param->write.len == 1 && param->write.value[0] < LOCK_LATENCY_KIND_COUNT)
+        {
+            latency_read_kind = (lock_latency_kind_t)param->write.value[0];
+            ESP_LOGI(BLE_GATT_TAG, "Latency export selects %s", lock_latency_kind_name(latency_read_kind));
+        }
 
         if (param->write.need_rsp)
         {
@@ -1061,6 +1211,9 @@ static void gatts_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_
         ESP_LOGI(BLE_GATT_TAG, "BLE address type: %d", param->connect.ble_addr_type);
         ESP_LOGI(BLE_GATT_TAG, "");
 
+        // 在当前灯效上闪一下蓝色，不打断正在播的效果
+        ws2812b_set_overlay(WS2812B_OVERLAY_STATUS, ws2812b_overlay_ble_connected, LED_BLEND_ADD, 255);
+
         // 动态分配任务参数
         rssi_monitor_params_t *params = malloc(sizeof(rssi_monitor_params_t));
         if (!params)
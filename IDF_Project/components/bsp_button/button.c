@@ -6,6 +6,7 @@
 // 宏定义
 #define BUTTON_TAG "BUTTON"
 #define LIGHT_EFFECT_DEMO 0
+#define LONG_PRESS_START_TICKS (LONG_TICKS + 1) // multi_button 在按下之后第几个节拍发 LONG_PRESS_START
 
 // 定义全局变量
 uint32_t led_state_mask = 0; // 在这里初始化，位图，记录每个 GPIO 的当前状态
@@ -13,49 +14,87 @@ struct Button btn1;
 QueueHandle_t button_event_queue = NULL;
 
 // 定义局部变量
+static TaskHandle_t button_task_handle = NULL; // 按键引脚的边沿中断唤醒这个任务
+static volatile int64_t button_edge_us = 0;    // 空闲时第一个边沿的时间，0 表示这次按键过程不是从中断开始的
+static int64_t sequence_press_us = 0;          // 这一串按键里第一次按下的时间，单击、双击、长按的延迟都从这里算
 static bool flag_long_press_start = false;
-static TimerHandle_t long_press_timer = NULL; // 长按计时器，用来判断长按的时间
-static int16_t long_press_duration = 0;       // 用于记录长按的时间
+static bool speculation_pending = false; // 发了 SPECULATIVE_CLICK，这一串按键还没有结论
 
-// 函数声明
+// 长按里程碑：从按下开始数的节拍，依次对应 HOLD_3S、HOLD_4S、HOLD_6S，也就是长按开始之后 3s、4s、6s
+static const uint16_t long_press_milestones[] = {
+    LONG_PRESS_START_TICKS + 3000 / TICKS_INTERVAL,
+    LONG_PRESS_START_TICKS + 4000 / TICKS_INTERVAL,
+    LONG_PRESS_START_TICKS + 6000 / TICKS_INTERVAL,
+};
+static const button_event_t long_press_milestone_events[] = {
+    BUTTON_EVENT_LONG_PRESS_HOLD_3S,
+    BUTTON_EVENT_LONG_PRESS_HOLD_4S,
+    BUTTON_EVENT_LONG_PRESS_HOLD_6S,
+};
 
 /**
- * @brief 开始蓝牙配对，发送给ble_module一个信号量
+ * @brief 发送 button_event_t 事件给lock_control状态机，输入时间就是现在
  *
+ * @param event
  */
-void ble_start_pairing(void);
+void send_button_event(button_event_t event)
+{
+    send_button_event_at(event, esp_timer_get_time());
+}
 
 /**
- * @brief 新增的计时器回调函数，每秒给lock_control发送一个长按事件
+ * @brief 同上，带上触发这个事件的输入时间，状态机用它统计从按下到开门的延迟
  *
+ * @param event
+ * @param input_us 输入发生的 esp_timer_get_time()
  */
-void long_press_timer_callback();
+void send_button_event_at(button_event_t event, int64_t input_us)
+{
+    if (button_event_queue != NULL)
+    {
+        button_event_msg_t msg = {.event = event, .input_us = input_us, .event_us = esp_timer_get_time()};
+        xQueueSend(button_event_queue, &msg, 0);
+    }
+}
 
 /**
- * @brief 用来启动长按计时器回调函数，每秒重载一次，给lock_control发送长按事件
- *
+ * @brief 这一串按键既不是单击也不是双击，撤回 SPECULATIVE_CLICK
  */
-void start_long_press_timer();
-
-// 停止长按计时器，结束给lock_control发送长按事件
-void stop_long_press_timer();
+static void cancel_speculation(void)
+{
+    if (speculation_pending)
+    {
+        speculation_pending = false;
+        ESP_LOGI(BUTTON_TAG, "Speculative click cancelled");
+        send_button_event_at(BUTTON_EVENT_SPECULATION_CANCEL, sequence_press_us);
+    }
+}
 
 /**
- * @brief 发送 button_event_t 事件给lock_control状态机
+ * @brief 一次读出所有 GPIO 的输入电平（bit n 是 GPIOn），MultiButton 每个节拍只调用一次
  *
- * @param event
+ * 按键、门磁、干簧管、出门按钮都从这一个字里按掩码取电平，多一个输入不会多一次 gpio_get_level
  */
-void send_button_event(button_event_t event)
+uint32_t read_button_inputs(void)
 {
-    if (button_event_queue != NULL)
-    {
-        xQueueSend(button_event_queue, &event, 0);
-    }
+    return REG_READ(GPIO_IN_REG);
 }
 
-uint8_t read_button_GPIO(uint8_t button_id)
+/**
+ * @brief 按键引脚的边沿中断：关掉中断（抖动期间不再进来），叫醒 button_task 开始扫描
+ *
+ * 扫描期间电平变化由 button_ticks 自己读，等状态机回到空闲再由 button_task 重新打开中断
+ */
+static void IRAM_ATTR button_gpio_isr_handler(void *arg)
 {
-    return gpio_get_level(PAIRING_BUTTON_GPIO);
+    gpio_intr_disable(PAIRING_BUTTON_GPIO);
+    button_edge_us = esp_timer_get_time(); // 手指按下的时刻，比消抖之后的 PRESS_DOWN 早 DEBOUNCE_TICKS 个节拍
+    if (button_task_handle != NULL)
+    {
+        BaseType_t higher_priority_task_woken = pdFALSE;
+        vTaskNotifyGiveFromISR(button_task_handle, &higher_priority_task_woken);
+        portYIELD_FROM_ISR(higher_priority_task_woken);
+    }
 }
 
 void freedorm_button_init()
@@ -76,18 +115,29 @@ void freedorm_button_init()
         .mode = GPIO_MODE_INPUT,              // 输入模式
         .pull_up_en = GPIO_PULLUP_DISABLE,    // 上拉
         .pull_down_en = GPIO_PULLDOWN_ENABLE, // 不需要下拉
-        .intr_type = GPIO_INTR_DISABLE        // 不需要中断
+        .intr_type = GPIO_INTR_ANYEDGE        // 按下和松开都能唤醒 button_task，空闲时不用轮询
     };
     gpio_config(&input_io_conf);
+    gpio_intr_disable(PAIRING_BUTTON_GPIO); // button_task 起来之后再打开
+
+    esp_err_t err = gpio_install_isr_service(0);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) // ESP_ERR_INVALID_STATE 表示别的组件已经装过了
+    {
+        ESP_LOGE(BUTTON_TAG, "Failed to install GPIO ISR service: %s", esp_err_to_name(err));
+    }
+    ESP_ERROR_CHECK(gpio_isr_handler_add(PAIRING_BUTTON_GPIO, button_gpio_isr_handler, NULL));
 
     // 初始化按键对象
-    button_init(&btn1, read_button_GPIO, 1, 0); // 第三个参数为有效电平 0（低电平有效），第四个参数为按键 ID 艹，tmd debug半天结果是这里参考电平的问题，艹
+    button_set_input_reader(read_button_inputs);
+    button_init_input(&btn1, 1UL << PAIRING_BUTTON_GPIO, 1, 0); // 第三个参数为有效电平 0（低电平有效），第四个参数为按键 ID 艹，tmd debug半天结果是这里参考电平的问题，艹
 
     button_attach(&btn1, PRESS_REPEAT, BTN1_PRESS_REPEAT_Handler);
     button_attach(&btn1, SINGLE_CLICK, BTN1_SINGLE_CLICK_Handler);
     button_attach(&btn1, DOUBLE_CLICK, BTN1_DOUBLE_CLICK_Handler);
     button_attach(&btn1, LONG_PRESS_START, BTN1_LONG_PRESS_START_Handler);
     button_attach(&btn1, LONG_PRESS_HOLD, BTN1_LONG_PRESS_HOLD_Handler);
+    button_set_hold_milestones(&btn1, long_press_milestones, sizeof(long_press_milestones) / sizeof(long_press_milestones[0]));
+    button_attach(&btn1, LONG_PRESS_MILESTONE, BTN1_LONG_PRESS_MILESTONE_Handler);
     button_attach(&btn1, NONE_PRESS, BTN1_NONE_PRESS_HOLD_Handler);
     button_attach(&btn1, PRESS_DOWN, BTN1_PRESS_DOWN_Handler);
     button_attach(&btn1, PRESS_UP, BTN1_PRESS_UP_Handler);
@@ -95,12 +145,33 @@ void freedorm_button_init()
     button_start(&btn1);
 }
 
+/**
+ * @brief 按键任务：空闲时阻塞在边沿中断上，一次按键过程中每 TICKS_INTERVAL 调用一次 button_ticks
+ *
+ * 单击、双击、长按的判定都在 button_ticks 的计数里，只要一次按键过程中的节拍和以前一样，判定结果就一样；
+ * 状态机回到空闲之后（松开、消抖完成、连击窗口也过了）节拍停下来，直到下一次边沿
+ */
 void button_task(void *arg)
 {
+    button_task_handle = xTaskGetCurrentTaskHandle();
+    gpio_intr_enable(PAIRING_BUTTON_GPIO);
+
     while (1)
     {
-        button_ticks();                // 按键状态检测
-        vTaskDelay(pdMS_TO_TICKS(10)); // 每 5 毫秒调用一次
+        if (button_ticks() == 0) // 按键状态检测
+        {
+            cancel_speculation(); // 第二次按得太久，multi_button 回到空闲但没有任何点击事件
+            button_edge_us = 0;
+            // 先开中断再看一次电平：上一次检测之后、开中断之前按下的，这里也能发现
+            gpio_intr_enable(PAIRING_BUTTON_GPIO);
+            if (gpio_get_level(PAIRING_BUTTON_GPIO) != btn1.active_level)
+            {
+                ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+                continue; // 边沿来了马上检测一次，不等下一个节拍
+            }
+            gpio_intr_disable(PAIRING_BUTTON_GPIO);
+        }
+        vTaskDelay(pdMS_TO_TICKS(TICKS_INTERVAL));
     }
 }
 
@@ -113,9 +184,13 @@ uint16_t button_get_multi_click_count()
 void BTN1_PRESS_REPEAT_Handler(void *btn)
 {
     ESP_LOGI(BUTTON_TAG, "Press repeat detected, repeat count: %d", btn1.repeat);
+    if (btn1.repeat == 3) // 第三次按下就不可能是单击或双击了，按连按处理
+    {
+        cancel_speculation();
+    }
     if (btn1.repeat == 10)
     {
-        send_button_event(BUTTON_EVENT_MULTI_CLICK); // 10 次点击，发送锁门信号
+        send_button_event_at(BUTTON_EVENT_MULTI_CLICK, sequence_press_us); // 10 次点击，发送锁门信号
     }
 }
 
@@ -123,21 +198,23 @@ void BTN1_PRESS_REPEAT_Handler(void *btn)
 void BTN1_SINGLE_CLICK_Handler(void *btn)
 {
     ESP_LOGI(BUTTON_TAG, "Single click detected");
-    send_button_event(BUTTON_EVENT_SINGLE_CLICK);
+    speculation_pending = false;
+    send_button_event_at(BUTTON_EVENT_SINGLE_CLICK, sequence_press_us);
 }
 
 // 双击进入常开模式
 void BTN1_DOUBLE_CLICK_Handler(void *btn)
 {
     ESP_LOGI(BUTTON_TAG, "Double click detected");
-    send_button_event(BUTTON_EVENT_DOUBLE_CLICK);
+    speculation_pending = false;
+    send_button_event_at(BUTTON_EVENT_DOUBLE_CLICK, sequence_press_us);
 }
 
 void BTN1_LONG_PRESS_START_Handler(void *btn)
 {
     ESP_LOGI(BUTTON_TAG, "Long press start detected");
-    send_button_event(BUTTON_EVENT_LONG_PRESS_START);
-    start_long_press_timer();
+    cancel_speculation(); // 点一下再按住，按长按处理
+    send_button_event_at(BUTTON_EVENT_LONG_PRESS_START, sequence_press_us);
 
     flag_long_press_start = true;
 }
@@ -147,6 +224,14 @@ void BTN1_LONG_PRESS_HOLD_Handler(void *btn)
     ESP_LOGI(BUTTON_TAG, "Long press hold detected");
 }
 
+// 按住到了 long_press_milestones 里的某个时长，和长按开始在同一个节拍计数上，不会有定时器相位带来的抖动
+void BTN1_LONG_PRESS_MILESTONE_Handler(void *btn)
+{
+    uint8_t milestone = ((struct Button *)btn)->milestone;
+    ESP_LOGI(BUTTON_TAG, "Long press milestone %d detected", milestone);
+    send_button_event_at(long_press_milestone_events[milestone], sequence_press_us);
+}
+
 void BTN1_NONE_PRESS_HOLD_Handler(void *btn)
 {
     ESP_LOGI(BUTTON_TAG, "None press hold detected");
@@ -155,6 +240,10 @@ void BTN1_NONE_PRESS_HOLD_Handler(void *btn)
 void BTN1_PRESS_DOWN_Handler(void *btn)
 {
     ESP_LOGI(BUTTON_TAG, "Press down detected");
+    if (((struct Button *)btn)->state == 0) // 一串按键里的第一次按下，回调在状态机切换之前
+    {
+        sequence_press_us = button_edge_us != 0 ? button_edge_us : esp_timer_get_time();
+    }
 }
 
 void BTN1_PRESS_UP_Handler(void *btn)
@@ -165,52 +254,14 @@ void BTN1_PRESS_UP_Handler(void *btn)
     {
         ESP_LOGI(BUTTON_TAG, "Long press end detected");
         send_button_event(BUTTON_EVENT_LONG_PRESS_END); // 发送长按结束事件给状态机，让状态机处理
-        stop_long_press_timer();                        // 停止长按计时器，结束计时
         flag_long_press_start = false;
     }
-}
-
-void long_press_timer_callback()
-{
-    long_press_duration++;
-    if (long_press_duration == 3)
-    {
-        send_button_event(BUTTON_EVENT_LONG_PRESS_HOLD_3S);
-        ESP_LOGI(BUTTON_TAG, "Long press hold 3s detected");
-    }
-    else if (long_press_duration == 4)
-    {
-        send_button_event(BUTTON_EVENT_LONG_PRESS_HOLD_4S);
-        ESP_LOGI(BUTTON_TAG, "Long press hold 4s detected");
-    }
-    else if (long_press_duration == 6)
-    {
-        send_button_event(BUTTON_EVENT_LONG_PRESS_HOLD_6S);
-        ESP_LOGI(BUTTON_TAG, "Long press hold 6s detected");
-    }
-}
-
-void start_long_press_timer()
-{
-    // 自动重载定时器，每秒触发一次
-    long_press_timer = xTimerCreate("long_press_timer", 1000 / portTICK_PERIOD_MS, pdTRUE, NULL, long_press_timer_callback);
-    if (long_press_timer != NULL)
-    {
-        xTimerStart(long_press_timer, 0);
-    }
-    else
-    {
-        ESP_LOGE(BUTTON_TAG, "Failed to create long press timer");
-    }
-}
-
-void stop_long_press_timer()
-{
-    if (long_press_timer != NULL)
+#if BUTTON_SPECULATIVE_CLICK
+    else if (((struct Button *)btn)->state == 1 && ((struct Button *)btn)->repeat == 1) // 第一次短按松开，回调在状态机切换之前
     {
-        xTimerStop(long_press_timer, 0);
-        xTimerDelete(long_press_timer, 0);
-        long_press_timer = NULL;
-        long_press_duration = 0;
+        ESP_LOGI(BUTTON_TAG, "Speculative single click");
+        speculation_pending = true;
+        send_button_event_at(BUTTON_EVENT_SPECULATIVE_CLICK, sequence_press_us);
     }
+#endif
 }
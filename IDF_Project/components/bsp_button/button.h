@@ -4,46 +4,73 @@
 #include "button.h"
 #include "esp_log.h"
 #include "driver/gpio.h"
+#include "soc/soc.h"
+#include "soc/gpio_reg.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
 #include "multi_button.h"
 #include "esp_mac.h"
+#include "esp_timer.h"
 
 #define PAIRING_BUTTON_GPIO GPIO_NUM_0 // 修改为您的按键GPIO编号
+#define BUTTON_SPECULATIVE_CLICK 1     // 1：第一次短按松开就先按单击开门，不等 SHORT_TICKS 的双击窗口；0：和以前一样等窗口过去
 
 // 定义按键事件枚举
 typedef enum
 {
-    BUTTON_EVENT_SINGLE_CLICK,            // 单击
-    BUTTON_EVENT_DOUBLE_CLICK,            // 双击
-    BUTTON_EVENT_MULTI_CLICK,             // 大于三次点击
-    BUTTON_EVENT_LONG_PRESS_START,        // 长按开始
-    BUTTON_EVENT_LONG_PRESS_HOLD_3S,      // 这里是hold 3s，加上长按开始的2s，总共按下5s后会触发
-    BUTTON_EVENT_LONG_PRESS_HOLD_4S,      // 同上
-    BUTTON_EVENT_LONG_PRESS_HOLD_6S,      // 同上
-    BUTTON_EVENT_LONG_PRESS_END,          // 长按结束
-    BUTTON_EVENT_PRESS_DOWN,              // 按下按钮
-    BUTTON_EVENT_PRESS_UP,                // 释放按钮
-    BLE_BUTTON_EVENT_SINGLE_CLICK,        // BLE靠近开门
-    BUTTON_EVENT_NONE_UPDATE_LOCK_CONTROL // 没有按键事件，用来更新lock_control状态机
+    BUTTON_EVENT_SINGLE_CLICK,             // 单击
+    BUTTON_EVENT_DOUBLE_CLICK,             // 双击
+    BUTTON_EVENT_MULTI_CLICK,              // 大于三次点击
+    BUTTON_EVENT_LONG_PRESS_START,         // 长按开始
+    BUTTON_EVENT_LONG_PRESS_HOLD_3S,       // 这里是hold 3s，加上长按开始的2s，总共按下5s后会触发
+    BUTTON_EVENT_LONG_PRESS_HOLD_4S,       // 同上
+    BUTTON_EVENT_LONG_PRESS_HOLD_6S,       // 同上
+    BUTTON_EVENT_LONG_PRESS_END,           // 长按结束
+    BUTTON_EVENT_PRESS_DOWN,               // 按下按钮
+    BUTTON_EVENT_PRESS_UP,                 // 释放按钮
+    BLE_BUTTON_EVENT_SINGLE_CLICK,         // BLE靠近开门
+    BUTTON_EVENT_NONE_UPDATE_LOCK_CONTROL, // 没有按键事件，用来更新lock_control状态机
+    SCHEDULE_EVENT_UPDATE,                 // 定时计划跨过了窗口边界，状态机重新读取计划要求的动作
+    ACTUATOR_EVENT_HOLD_EXPIRED,           // 开门或锁定的保持时间到了，lock_actuator 已经恢复了引脚
+    PAIRING_EVENT_TIMEOUT,                 // 蓝牙配对超时，pairing_timer 发出，状态切换在状态机任务里做
+    BUTTON_EVENT_SPECULATIVE_CLICK,        // 一串按键里第一次短按松开，可能是单击；之后一定跟着 SINGLE_CLICK、DOUBLE_CLICK 或 SPECULATION_CANCEL 之一
+    BUTTON_EVENT_SPECULATION_CANCEL,       // 这一串按键不是单击也不是双击（连按、点一下再长按……），撤回按单击做的动作
+    REMOTE_EVENT_NORMAL,                   // 远程命令：回到正常状态，REMOTE_EVENT_xxx 的顺序和 lock_command_t 一致
+    REMOTE_EVENT_OPEN,                     // 远程命令：临时开门，锁定状态下先解除锁定
+    REMOTE_EVENT_LOCK,                     // 远程命令：锁定
+    REMOTE_EVENT_ALWAYS_OPEN,              // 远程命令：常开
+    REMOTE_EVENT_STATUS                    // 远程命令：不改状态，只回报当前状态
 } button_event_t;
 
+/**
+ * @brief button_event_queue 里的一条消息，时间都是 esp_timer_get_time() 的 us
+ */
+typedef struct
+{
+    button_event_t event;
+    int64_t input_us; // 触发这个事件的输入：按键是这一串按键里第一次按下的边沿，其它来源等于 event_us
+    int64_t event_us; // 事件判定出来、发给状态机的时间
+    uint32_t request_id; // 远程命令的请求号，原样带回确认消息里，其它来源为 0
+} button_event_msg_t;
+
 extern uint32_t led_state_mask; // 在这里初始化，位图，记录每个 GPIO 的当前状态
 
 // 函数声明
 
-uint8_t read_button_GPIO(uint8_t button_id);
+uint32_t read_button_inputs(void);
 void freedorm_button_init();
 void button_task(void *arg);
 uint16_t button_get_multi_click_count(void);
 void send_button_event(button_event_t event);
+void send_button_event_at(button_event_t event, int64_t input_us);
 
 void BTN1_PRESS_REPEAT_Handler(void *btn);
 void BTN1_SINGLE_CLICK_Handler(void *btn);
 void BTN1_DOUBLE_CLICK_Handler(void *btn);
 void BTN1_LONG_PRESS_START_Handler(void *btn);
 void BTN1_LONG_PRESS_HOLD_Handler(void *btn);
+void BTN1_LONG_PRESS_MILESTONE_Handler(void *btn);
 void BTN1_NONE_PRESS_HOLD_Handler(void *btn);
 void BTN1_PRESS_DOWN_Handler(void *btn);
 void BTN1_PRESS_UP_Handler(void *btn);
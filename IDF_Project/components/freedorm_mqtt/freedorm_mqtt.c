@@ -1,82 +1,299 @@
+#include <string.h>
+
 #include "freedorm_mqtt.h"
 #include "mqtt_client.h"
+#include "mqtt_command.h"
+#include "lock_control.h"
+#include "telemetry.h"
+#include "offline_queue.h"
 #include "esp_log.h"
+#include "esp_mac.h"
 #include "esp_system.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+#define MQTT_TAG "MQTT"
+#define MQTT_OUTBOX_LIMIT 2048 // 发送队列里还没发出去的字节超过这么多就不再放遥测，等网络消化，TCP 发送缓冲默认 5744 字节
+#define MQTT_SPOOL_TELEMETRY 0 // 离线队列里的消息发到哪个 topic，存在槽头里
 
 // MQTT 客户端对象
 static esp_mqtt_client_handle_t client;
 
+// 这台设备的命令和状态 topic，mqtt_start 里按 MAC 拼出来
+static char command_topic[MQTT_TOPIC_MAX_LEN];
+static char state_topic[MQTT_TOPIC_MAX_LEN];
+static char status_topic[MQTT_TOPIC_MAX_LEN];
+static char telemetry_topic[MQTT_TOPIC_MAX_LEN];
+static volatile bool connected = false;
+static uint8_t device_mac[6]; // 命令签名里带着 MAC
+
+// 命令签名的密钥和重放计数器都放在 RAM 里，收命令时不读写 NVS；
+// NVS 里只存计数器的上限，每次往前预留 MQTT_COMMAND_COUNTER_BLOCK 条，用掉一半才在执行之后再写一次
+static uint8_t command_key[MQTT_COMMAND_KEY_LEN];
+static bool command_key_loaded = false;
+static uint32_t command_counter = 0;  // 最近一条收下的命令的计数器
+static uint32_t reserved_counter = 0; // NVS 里存的上限，重启之后不大于它的命令都不收
+
 // MQTT 配置结构体
 static esp_mqtt_client_config_t mqtt_cfg = {
     .broker =
         {
             .address =
                 {
-                    .uri = "mqtt://",                     // 使用一个公共的 MQTT Broker
-                    .port = 1883,                         // 设置端口号，默认为 1883
-                    .transport = MQTT_TRANSPORT_OVER_TCP, // 设置传输方式，TCP 是常见的选项
+                    .uri = "mqtts://",                    // 必须用 TLS，命令签名不防窃听，见 mqtt_command.h
+                    .port = 8883,                         // MQTT over TLS 的默认端口
+                    .transport = MQTT_TRANSPORT_OVER_SSL,
                 },
+            // 配网时在 .verification.certificate 里填 broker 的 CA 证书；broker 上用 ACL 限制只有后端能往 freedorm/+/cmd 发布
         },
     // 你可以在此添加更多配置，比如用户名、密码等
 };
 
+/**
+ * @brief 远程命令处理完之后在状态机任务里调用，只放进发送队列，由 MQTT 任务去发，状态机不等网络
+ *
+ * 每条命令的回报不 retain，否则 broker 会把旧命令的回报当成新的发给之后订阅的客户端；最后已知的状态单独 retain 在 status 上
+ */
+static void publish_state(uint32_t request_id, lock_command_t command, lock_status_t state, int64_t latency_us)
+{
+    char payload[MQTT_ACK_MAX_LEN];
+    int len = mqtt_command_format_ack(payload, sizeof(payload), request_id, command, get_lock_state_name(state), latency_us);
+    esp_mqtt_client_enqueue(client, state_topic, payload, len, 1, 0, true);
+    len = mqtt_command_format_status(payload, sizeof(payload), get_lock_state_name(state));
+    esp_mqtt_client_enqueue(client, status_topic, payload, len, 1, 1, true);
+}
+
+/**
+ * @brief 遥测任务打好的一批记录
+ *
+ * 没连上时存进离线队列，离线队列还没补发完时也排到它后面，保证接收端按顺序收到；
+ * 连着但发送队列太长时不收，记录留在遥测缓冲里
+ */
+static bool publish_telemetry(const uint8_t *batch, size_t len, int qos)
+{
+    if (!connected || offline_queue_has_pending())
+    {
+        return offline_queue_push(MQTT_SPOOL_TELEMETRY, batch, len) == ESP_OK;
+    }
+    if (esp_mqtt_client_get_outbox_size(client) > MQTT_OUTBOX_LIMIT)
+    {
+        return false;
+    }
+    return esp_mqtt_client_enqueue(client, telemetry_topic, (const char *)batch, len, qos, 0, true) >= 0;
+}
+
+/**
+ * @brief 离线队列补发存下来的消息，都用 QoS 1，收到 PUBACK 才从 flash 里删掉
+ */
+static int publish_spooled(uint8_t topic, const uint8_t *payload, size_t len)
+{
+    if (!connected || topic != MQTT_SPOOL_TELEMETRY || esp_mqtt_client_get_outbox_size(client) > MQTT_OUTBOX_LIMIT)
+    {
+        return -1;
+    }
+    return esp_mqtt_client_enqueue(client, telemetry_topic, (const char *)payload, len, 1, 0, true);
+}
+
+/**
+ * @brief 把 NVS 里的计数器上限推到 counter + MQTT_COMMAND_COUNTER_BLOCK
+ */
+static esp_err_t reserve_counters(uint32_t counter)
+{
+    uint32_t reserved = counter > UINT32_MAX - MQTT_COMMAND_COUNTER_BLOCK ? UINT32_MAX : counter + MQTT_COMMAND_COUNTER_BLOCK;
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(MQTT_COMMAND_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK)
+    {
+        err = nvs_set_u32(handle, MQTT_COMMAND_NVS_COUNTER, reserved);
+        if (err == ESP_OK)
+        {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(MQTT_TAG, "Failed to reserve command counters: %s", esp_err_to_name(err));
+        return err;
+    }
+    reserved_counter = reserved;
+    return ESP_OK;
+}
+
+static void load_command_key(void)
+{
+    nvs_handle_t handle;
+    if (nvs_open(MQTT_COMMAND_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+    {
+        return;
+    }
+    size_t key_len = sizeof(command_key);
+    command_key_loaded = nvs_get_blob(handle, MQTT_COMMAND_NVS_KEY, command_key, &key_len) == ESP_OK && key_len == sizeof(command_key);
+    nvs_close(handle);
+}
+
+/**
+ * @brief 开机时读密钥和计数器上限：上次用到哪一条不知道，只能从上限接着收，再往前预留一块
+ */
+static void load_command_state(void)
+{
+    load_command_key();
+    nvs_handle_t handle;
+    if (nvs_open(MQTT_COMMAND_NVS_NAMESPACE, NVS_READONLY, &handle) == ESP_OK)
+    {
+        nvs_get_u32(handle, MQTT_COMMAND_NVS_COUNTER, &reserved_counter); // 还没收过命令时没有这个键，从 0 开始
+        nvs_close(handle);
+    }
+    command_counter = reserved_counter;
+    reserve_counters(command_counter);
+}
+
+/**
+ * @brief 用 RAM 里的密钥和计数器检查命令，通过之后计数器马上在 RAM 里往前走，NVS 由 handle_command 在执行之后再写
+ *
+ * @return ESP_ERR_INVALID_STATE 没有写过密钥，其余见 mqtt_command_verify；超出预留的块又存不进 NVS 时也不执行
+ */
+static esp_err_t authenticate_command(const char *data, const mqtt_command_t *cmd)
+{
+    if (!command_key_loaded)
+    {
+        load_command_key(); // 产线写完密钥之后不用重启
+    }
+    if (!command_key_loaded)
+    {
+        ESP_LOGW(MQTT_TAG, "No command key provisioned, remote commands disabled");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_err_t err = mqtt_command_verify(data, cmd, command_key, device_mac, command_counter);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    // 后端的计数器一下跳出了预留的块，只能先存下来再执行，否则断电重启之后这条命令还能再用一次
+    if (cmd->counter > reserved_counter && reserve_counters(cmd->counter) != ESP_OK)
+    {
+        return ESP_FAIL;
+    }
+    command_counter = cmd->counter;
+    return ESP_OK;
+}
+
+/**
+ * @brief 命令 topic 上的消息：解析、验签之后直接发进状态机的队列，结果由 publish_state 回报
+ *
+ * @param input_us 进 MQTT_EVENT_DATA 的时间，命令到动作的延迟从这里算起
+ */
+static void handle_command(esp_mqtt_event_handle_t event, int64_t input_us)
+{
+    if (event->topic_len != (int)strlen(command_topic) || memcmp(event->topic, command_topic, event->topic_len) != 0)
+    {
+        return;
+    }
+
+    mqtt_command_t cmd;
+    esp_err_t err = ESP_ERR_INVALID_SIZE; // 命令都很短，分片收到的一定不是合法命令
+    if (event->current_data_offset == 0 && event->data_len == event->total_data_len)
+    {
+        err = mqtt_command_parse(event->data, event->data_len, &cmd);
+    }
+    if (err == ESP_OK)
+    {
+        err = authenticate_command(event->data, &cmd);
+    }
+    if (err == ESP_OK)
+    {
+        err = lock_control_remote_command(cmd.command, cmd.request_id, input_us);
+    }
+    if (reserved_counter - command_counter < MQTT_COMMAND_COUNTER_BLOCK / 2)
+    {
+        reserve_counters(command_counter); // 预留的块用掉一半了，命令已经进了状态机，这时写 NVS 不拖慢开门
+    }
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(MQTT_TAG, "Command rejected: %s", esp_err_to_name(err));
+        char payload[MQTT_ACK_MAX_LEN];
+        int len = mqtt_command_format_error(payload, sizeof(payload), err);
+        esp_mqtt_client_enqueue(client, state_topic, payload, len, 1, 0, true);
+    }
+}
+
 // MQTT 事件处理回调
-static esp_err_t mqtt_event_handler(esp_mqtt_event_handle_t event)
+static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data)
 {
-    switch (event->event_id)
+    esp_mqtt_event_handle_t event = event_data;
+    switch ((esp_mqtt_event_id_t)event_id)
     {
     case MQTT_EVENT_CONNECTED:
-        ESP_LOGI("MQTT", "MQTT Connected");
+        ESP_LOGI(MQTT_TAG, "MQTT Connected");
+        connected = true;
+        esp_mqtt_client_subscribe(client, command_topic, 1);
+        lock_control_remote_command(LOCK_CMD_STATUS, 0, esp_timer_get_time()); // 连上之后先报一次当前状态
+        offline_queue_set_connected(true);                                     // 断线期间存进 flash 的消息按顺序补发
+        telemetry_flush();                                                     // 还在 RAM 里的遥测
         break;
     case MQTT_EVENT_DISCONNECTED:
-        ESP_LOGI("MQTT", "MQTT Disconnected");
+        ESP_LOGI(MQTT_TAG, "MQTT Disconnected");
+        connected = false;
+        offline_queue_set_connected(false);
         break;
     case MQTT_EVENT_SUBSCRIBED:
-        ESP_LOGI("MQTT", "Subscribed to topic: %s", event->topic);
+        ESP_LOGI(MQTT_TAG, "Subscribed, msg_id=%d", event->msg_id);
         break;
     case MQTT_EVENT_UNSUBSCRIBED:
-        ESP_LOGI("MQTT", "Unsubscribed from topic");
+        ESP_LOGI(MQTT_TAG, "Unsubscribed from topic");
         break;
     case MQTT_EVENT_PUBLISHED:
-        ESP_LOGI("MQTT", "Message Published");
+        ESP_LOGI(MQTT_TAG, "Message Published, msg_id=%d", event->msg_id);
+        offline_queue_acked(event->msg_id);
         break;
     case MQTT_EVENT_DATA:
-        ESP_LOGI("MQTT", "Received Data: %s", event->data);
+        handle_command(event, esp_timer_get_time());
         break;
     case MQTT_EVENT_ERROR:
-        ESP_LOGE("MQTT", "MQTT Error: %d", event->error_handle->error_type);
+        ESP_LOGE(MQTT_TAG, "MQTT Error: %d", event->error_handle->error_type);
         break;
     default:
-        ESP_LOGI("MQTT", "Unhandled event: %d", event->event_id);
+        ESP_LOGI(MQTT_TAG, "Unhandled event: %ld", (long)event_id);
         break;
     }
-    return ESP_OK;
 }
 
 // mqtt_start函数，初始化并启动 MQTT 客户端
 esp_err_t mqtt_start(void)
 {
-    ESP_LOGI("MQTT", "Starting MQTT Client...");
+    ESP_LOGI(MQTT_TAG, "Starting MQTT Client...");
+
+    esp_read_mac(device_mac, ESP_MAC_WIFI_STA);
+    mqtt_command_topic(command_topic, sizeof(command_topic), device_mac, "cmd");
+    mqtt_command_topic(state_topic, sizeof(state_topic), device_mac, "state");
+    mqtt_command_topic(status_topic, sizeof(status_topic), device_mac, "status");
+    mqtt_command_topic(telemetry_topic, sizeof(telemetry_topic), device_mac, "telemetry");
+    load_command_state();
 
     // 初始化 MQTT 客户端
     client = esp_mqtt_client_init(&mqtt_cfg);
 
     if (client == NULL)
     {
-        ESP_LOGE("MQTT", "Failed to create MQTT client");
+        ESP_LOGE(MQTT_TAG, "Failed to create MQTT client");
         return ESP_ERR_NO_MEM;
     }
 
-    // 注册 MQTT 事件处理回调
+    // 注册 MQTT 事件处理回调，远程命令的结果由状态机回调 publish_state
     esp_mqtt_client_register_event(client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
+    lock_control_set_remote_ack(publish_state);
+    telemetry_set_sink(publish_telemetry);
+    offline_queue_set_sender(publish_spooled);
 
     // 启动 MQTT 客户端
     esp_err_t err = esp_mqtt_client_start(client);
     if (err != ESP_OK)
     {
-        ESP_LOGE("MQTT", "Failed to start MQTT client: %s", esp_err_to_name(err));
+        ESP_LOGE(MQTT_TAG, "Failed to start MQTT client: %s", esp_err_to_name(err));
         return err;
     }
 
+    ESP_LOGI(MQTT_TAG, "Commands on %s, state on %s", command_topic, state_topic);
     return ESP_OK;
 }
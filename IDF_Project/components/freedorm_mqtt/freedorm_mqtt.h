@@ -3,7 +3,10 @@
 
 #include "esp_err.h"
 
-// 初始化 MQTT 客户端并启动
+#define FREEDORM_MQTT_ENABLE 0 // 还没有配网，Wi-Fi 连上之后改成 1，app_main 里才会启动 MQTT
+
+// 远程命令要签名，设备上要先写好密钥；broker 必须用 TLS 和 ACL，见 mqtt_command.h
+// 初始化 MQTT 客户端并启动，要在 lock_control_init 之后调用，远程命令发进状态机的队列
 esp_err_t mqtt_start(void);
 
 #endif // FREEDORM_MQTT_H
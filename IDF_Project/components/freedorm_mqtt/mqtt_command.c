@@ -0,0 +1,186 @@
+/**
+ * @file mqtt_command.c
+ * @brief 远程命令的解析和回报格式，协议见 mqtt_command.h
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "mqtt_command.h"
+#include "mbedtls/md.h"
+
+#define MQTT_COMMAND_FIELDS 4 // <命令> <请求号> <计数器> <签名>
+
+static const char *const command_names[] = {
+    [LOCK_CMO_NORMAL] = "normal",
+    [LOCK_CMD_SINGLE_OPEN] = "unlock",
+    [LOCK_CMD_LOCK] = "lock",
+    [LOCK_CMD_ALWAYS_OPEN] = "always_open",
+    [LOCK_CMD_STATUS] = "status",
+};
+
+static bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+/**
+ * @brief 十进制的 uint32，最多 10 位
+ */
+static bool parse_u32(const char *digits, int len, uint32_t *out)
+{
+    if (len == 0 || len > 10)
+    {
+        return false;
+    }
+    uint64_t value = 0;
+    for (int i = 0; i < len; i++)
+    {
+        if (digits[i] < '0' || digits[i] > '9')
+        {
+            return false;
+        }
+        value = value * 10 + (digits[i] - '0');
+    }
+    if (value > UINT32_MAX)
+    {
+        return false;
+    }
+    *out = (uint32_t)value;
+    return true;
+}
+
+/**
+ * @brief 小写十六进制，和 mqtt_command.h 里说的一样不认大写
+ */
+static bool parse_hex(const char *hex, int len, uint8_t *out, int out_len)
+{
+    if (len != out_len * 2)
+    {
+        return false;
+    }
+    for (int i = 0; i < len; i++)
+    {
+        char c = hex[i];
+        int nibble = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+        if (nibble < 0)
+        {
+            return false;
+        }
+        out[i / 2] = (i % 2 == 0) ? (uint8_t)(nibble << 4) : (uint8_t)(out[i / 2] | nibble);
+    }
+    return true;
+}
+
+esp_err_t mqtt_command_parse(const char *data, int len, mqtt_command_t *cmd)
+{
+    if (data == NULL || len > MQTT_COMMAND_MAX_LEN)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    while (len > 0 && is_space(data[len - 1]))
+    {
+        len--; // mosquitto_pub 手敲的命令经常带换行
+    }
+    if (len <= 0)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // <命令> <请求号> <计数器> <签名>，字段之间正好一个空格，多一个空格就是空字段
+    const char *fields[MQTT_COMMAND_FIELDS];
+    int field_lens[MQTT_COMMAND_FIELDS];
+    int count = 0;
+    for (int start = 0, i = 0; i <= len; i++)
+    {
+        if (i == len || data[i] == ' ')
+        {
+            if (count == MQTT_COMMAND_FIELDS)
+            {
+                return ESP_ERR_INVALID_ARG;
+            }
+            fields[count] = data + start;
+            field_lens[count] = i - start;
+            count++;
+            start = i + 1;
+        }
+    }
+
+    lock_command_t command = 0;
+    while (command <= LOCK_CMD_STATUS &&
+           (strlen(command_names[command]) != (size_t)field_lens[0] || memcmp(command_names[command], fields[0], field_lens[0]) != 0))
+    {
+        command++;
+    }
+    if (command > LOCK_CMD_STATUS)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (count != MQTT_COMMAND_FIELDS || !parse_u32(fields[1], field_lens[1], &cmd->request_id) || !parse_u32(fields[2], field_lens[2], &cmd->counter) ||
+        !parse_hex(fields[3], field_lens[3], cmd->signature, MQTT_COMMAND_MAC_LEN))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    cmd->command = command;
+    cmd->signed_len = (uint8_t)(fields[3] - data - 1);
+    return ESP_OK;
+}
+
+esp_err_t mqtt_command_verify(const char *data, const mqtt_command_t *cmd, const uint8_t key[MQTT_COMMAND_KEY_LEN], const uint8_t mac[6],
+                              uint32_t last_counter)
+{
+    // 签过名的原文前面加上 MAC，"<12 位 MAC> " 占 13 个字节
+    char message[13 + MQTT_COMMAND_MAX_LEN];
+    int len = snprintf(message, sizeof(message), "%02x%02x%02x%02x%02x%02x ", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    memcpy(message + len, data, cmd->signed_len);
+    len += cmd->signed_len;
+
+    uint8_t expected[MQTT_COMMAND_MAC_LEN];
+    if (mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), key, MQTT_COMMAND_KEY_LEN, (const unsigned char *)message, len, expected) != 0)
+    {
+        return ESP_FAIL;
+    }
+    // 逐字节比完再判断，比较的时间和签名在第几个字节上不对无关
+    uint8_t diff = 0;
+    for (int i = 0; i < MQTT_COMMAND_MAC_LEN; i++)
+    {
+        diff |= expected[i] ^ cmd->signature[i];
+    }
+    if (diff != 0)
+    {
+        return ESP_ERR_INVALID_CRC;
+    }
+    // 签名对了才看计数器，没有密钥的人试不出设备现在的计数器
+    if (cmd->counter <= last_counter)
+    {
+        return ESP_ERR_INVALID_VERSION;
+    }
+    return ESP_OK;
+}
+
+const char *mqtt_command_name(lock_command_t command)
+{
+    return command <= LOCK_CMD_STATUS ? command_names[command] : "unknown";
+}
+
+void mqtt_command_topic(char *buf, size_t size, const uint8_t mac[6], const char *leaf)
+{
+    snprintf(buf, size, MQTT_TOPIC_PREFIX "%02x%02x%02x%02x%02x%02x/%s", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], leaf);
+}
+
+int mqtt_command_format_ack(char *buf, size_t size, uint32_t request_id, lock_command_t command, const char *state, int64_t latency_us)
+{
+    return snprintf(buf, size, "{\"id\":%lu,\"cmd\":\"%s\",\"state\":\"%s\",\"latency_us\":%lld}", (unsigned long)request_id,
+                    mqtt_command_name(command), state, (long long)latency_us);
+}
+
+int mqtt_command_format_status(char *buf, size_t size, const char *state)
+{
+    return snprintf(buf, size, "{\"state\":\"%s\"}", state);
+}
+
+int mqtt_command_format_error(char *buf, size_t size, esp_err_t err)
+{
+    return snprintf(buf, size, "{\"error\":\"%s\"}", esp_err_to_name(err));
+}
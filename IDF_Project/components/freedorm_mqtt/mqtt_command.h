@@ -0,0 +1,95 @@
+/**
+ * @file mqtt_command.h
+ * @brief 远程命令的解析和回报格式，不依赖 MQTT 客户端，主机仿真里也能直接用
+ *
+ * 命令发到 freedorm/<MAC>/cmd，负载是一行文本：<命令> <请求号> <计数器> <签名>，例如
+ *   "unlock 42 1007 5f0c...（64 位十六进制）"
+ *   命令：normal / unlock / lock / always_open / status
+ *   请求号：十进制的 uint32，原样带回回报里，也记进审计日志
+ *   计数器：十进制的 uint32，每条命令加 1，设备只收比上一条收下的命令大的计数器，重放和过期的命令都会被拒绝；
+ *           设备重启之后只收比 NVS 里的上限大的计数器，后端收到 ESP_ERR_INVALID_VERSION 时把计数器加 MQTT_COMMAND_COUNTER_BLOCK 重发
+ *   签名：HMAC-SHA256(密钥, "<12 位小写十六进制 MAC> <命令> <请求号> <计数器>")，小写十六进制，
+ *         签名里带着 MAC，发给一台设备的命令拿到另一台设备上也用不了
+ * 密钥是 32 字节，由后端生成后在产线写进 NVS（MQTT_COMMAND_NVS_NAMESPACE / MQTT_COMMAND_NVS_KEY），
+ * 没有写过密钥的设备不执行任何远程命令
+ *
+ * 签名只防伪造和重放，不防窃听，也挡不住别人往 cmd topic 上灌垃圾消息：
+ * broker 必须用 TLS（mqtts://），并用 ACL 限制只有后端能往 freedorm/+/cmd 发布、每台设备只能订阅自己的 cmd topic
+ * 处理完之后在 freedorm/<MAC>/state 上回报（不 retain，只给发命令的后端看），例如
+ *   {"id":42,"cmd":"unlock","state":"STATE_TEMP_OPEN","latency_us":180}
+ * latency_us 是收到命令到控制线动作的时间，控制线没有动作时为 -1
+ * 同时在 freedorm/<MAC>/status 上发一条 retain 的 {"state":"STATE_TEMP_OPEN"}，新订阅的客户端马上能拿到最后已知的状态
+ *
+ * 遥测批次发到 freedorm/<MAC>/telemetry，格式见 telemetry.h
+ */
+#ifndef MQTT_COMMAND_H
+#define MQTT_COMMAND_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "lock_control.h"
+
+#define MQTT_TOPIC_PREFIX "freedorm/" // 每台设备的 topic 都是 freedorm/<MAC>/...
+#define MQTT_TOPIC_MAX_LEN 32         // freedorm/ + 12 位 MAC + /telemetry，留一点余量
+#define MQTT_COMMAND_MAX_LEN 128      // 命令负载最长的字节数，更长的不解析
+#define MQTT_COMMAND_KEY_LEN 32       // 命令签名密钥的字节数
+#define MQTT_COMMAND_MAC_LEN 32       // HMAC-SHA256 的字节数，负载里写成 64 位十六进制
+#define MQTT_COMMAND_COUNTER_BLOCK 32 // 计数器在 NVS 里一次预留这么多条，重启之后最多跳过这么多
+#define MQTT_COMMAND_NVS_NAMESPACE "freedorm_mqtt"
+#define MQTT_COMMAND_NVS_KEY "cmd_key"         // 命令签名密钥，32 字节的 blob
+#define MQTT_COMMAND_NVS_COUNTER "cmd_counter" // 计数器的上限，u32，重启之后不大于它的命令都不收
+#define MQTT_ACK_MAX_LEN 128          // 回报负载最长的字节数
+
+typedef struct
+{
+    lock_command_t command;
+    uint32_t request_id;
+    uint32_t counter;
+    uint8_t signature[MQTT_COMMAND_MAC_LEN];
+    uint8_t signed_len; // 负载里签名之前那一段（<命令> <请求号> <计数器>）的长度
+} mqtt_command_t;
+
+/**
+ * @brief 解析命令负载，data 不需要以 0 结尾，末尾的空白和换行会被忽略
+ *
+ * 只检查格式，签名和计数器由 mqtt_command_verify 检查
+ *
+ * @return ESP_ERR_INVALID_SIZE 空的或者太长，ESP_ERR_NOT_FOUND 不认识的命令，
+ *         ESP_ERR_INVALID_ARG 缺字段、请求号或计数器不是合法的 uint32、签名不是 64 位十六进制
+ */
+esp_err_t mqtt_command_parse(const char *data, int len, mqtt_command_t *cmd);
+
+/**
+ * @brief 检查 mqtt_command_parse 解析出来的命令的签名和计数器，data 是同一段负载
+ *
+ * @param last_counter 最近一条收下的命令的计数器，cmd->counter 必须比它大
+ * @return ESP_ERR_INVALID_CRC 签名不对，ESP_ERR_INVALID_VERSION 计数器没有比 last_counter 大（重放或过期）
+ */
+esp_err_t mqtt_command_verify(const char *data, const mqtt_command_t *cmd, const uint8_t key[MQTT_COMMAND_KEY_LEN], const uint8_t mac[6],
+                              uint32_t last_counter);
+
+const char *mqtt_command_name(lock_command_t command);
+
+/**
+ * @brief 拼出这台设备的 topic：freedorm/<12 位小写十六进制 MAC>/<leaf>
+ */
+void mqtt_command_topic(char *buf, size_t size, const uint8_t mac[6], const char *leaf);
+
+/**
+ * @brief 拼出回报的 JSON，返回长度
+ */
+int mqtt_command_format_ack(char *buf, size_t size, uint32_t request_id, lock_command_t command, const char *state, int64_t latency_us);
+
+/**
+ * @brief 最后已知状态的 JSON，发到 retain 的 status topic，返回长度
+ */
+int mqtt_command_format_status(char *buf, size_t size, const char *state);
+
+/**
+ * @brief 命令没有进状态机时的回报，返回长度
+ */
+int mqtt_command_format_error(char *buf, size_t size, esp_err_t err);
+
+#endif // MQTT_COMMAND_H
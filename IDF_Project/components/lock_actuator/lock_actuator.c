@@ -0,0 +1,175 @@
+#include "lock_actuator.h"
+#include <stdint.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+#define LOCK_ACTUATOR_TAG "LOCK_ACTUATOR"
+
+/*
+ * 保持时间由 esp_timer 计时，到期回调在优先级最高的 esp_timer 任务里直接恢复引脚，精度是 us 级，
+ * 不受 FreeRTOS 的 10ms tick 和状态机任务有没有卡住的影响。状态机收到回调通知后再跟着切换状态。
+ *
+ * 引脚电平和 status 都在 actuator_lock 里改：定时器回调可能在 esp_timer_stop 之前已经开始执行，
+ * 所以回调里要再确认一次 deadline 确实到了，重新 assert / release 过的线不会被旧的定时器恢复。
+ */
+static lock_actuator_line_config_t line_config[LOCK_ACTUATOR_LINE_COUNT];
+static lock_actuator_status_t line_status[LOCK_ACTUATOR_LINE_COUNT];
+static esp_timer_handle_t hold_timers[LOCK_ACTUATOR_LINE_COUNT];
+static lock_actuator_timeout_cb_t timeout_callback = NULL;
+static portMUX_TYPE actuator_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *const line_names[LOCK_ACTUATOR_LINE_COUNT] = {"CTL_LOCK", "CTL_D0"};
+
+static void hold_timeout_callback(void *arg)
+{
+    lock_actuator_line_t line = (lock_actuator_line_t)(intptr_t)arg;
+    lock_actuator_status_t *status = &line_status[line];
+    int64_t now = esp_timer_get_time();
+    bool expired = false;
+
+    portENTER_CRITICAL(&actuator_lock);
+    if (status->asserted && status->deadline_us != 0 && now >= status->deadline_us)
+    {
+        gpio_set_level(line_config[line].gpio, !line_config[line].active_level);
+        int64_t lateness = now - status->deadline_us;
+        if (lateness > status->max_release_lateness_us)
+        {
+            status->max_release_lateness_us = lateness;
+        }
+        status->asserted = false;
+        status->released_us = now;
+        status->deadline_us = 0;
+        status->timeout_releases++;
+        expired = true;
+    }
+    portEXIT_CRITICAL(&actuator_lock);
+
+    if (expired)
+    {
+        ESP_LOGI(LOCK_ACTUATOR_TAG, "%s released by hold timeout at %lld us, held %lld us", line_names[line],
+                 (long long)now, (long long)(now - status->asserted_us));
+        if (timeout_callback != NULL)
+        {
+            timeout_callback(line);
+        }
+    }
+}
+
+esp_err_t lock_actuator_init(const lock_actuator_line_config_t config[LOCK_ACTUATOR_LINE_COUNT], lock_actuator_timeout_cb_t timeout_cb)
+{
+    timeout_callback = timeout_cb;
+    for (int i = 0; i < LOCK_ACTUATOR_LINE_COUNT; i++)
+    {
+        line_config[i] = config[i];
+
+        gpio_config_t io_conf = {
+            .pin_bit_mask = 1ULL << config[i].gpio,
+            .mode = config[i].mode,
+            .pull_up_en = GPIO_PULLUP_DISABLE,     // 不需要上拉
+            .pull_down_en = GPIO_PULLDOWN_DISABLE, // 不需要下拉
+            .intr_type = GPIO_INTR_DISABLE         // 不需要中断
+        };
+        esp_err_t err = gpio_config(&io_conf);
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(LOCK_ACTUATOR_TAG, "Failed to configure %s: %s", line_names[i], esp_err_to_name(err));
+            return err;
+        }
+        gpio_set_level(config[i].gpio, !config[i].active_level); // 上电先恢复到无效电平，不对门锁模块产生影响
+
+        const esp_timer_create_args_t timer_args = {
+            .callback = hold_timeout_callback,
+            .arg = (void *)(intptr_t)i,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = line_names[i],
+        };
+        err = esp_timer_create(&timer_args, &hold_timers[i]);
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(LOCK_ACTUATOR_TAG, "Failed to create hold timer for %s: %s", line_names[i], esp_err_to_name(err));
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t lock_actuator_assert(lock_actuator_line_t line, uint32_t max_hold_ms)
+{
+    if (line >= LOCK_ACTUATOR_LINE_COUNT)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_timer_stop(hold_timers[line]); // 没在计时会返回 ESP_ERR_INVALID_STATE，不用管
+
+    lock_actuator_status_t *status = &line_status[line];
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&actuator_lock);
+    gpio_set_level(line_config[line].gpio, line_config[line].active_level);
+    if (!status->asserted)
+    {
+        status->asserted = true;
+        status->asserted_us = now;
+    }
+    status->deadline_us = max_hold_ms == LOCK_ACTUATOR_NO_TIMEOUT ? 0 : now + (int64_t)max_hold_ms * 1000;
+    portEXIT_CRITICAL(&actuator_lock);
+
+    if (max_hold_ms != LOCK_ACTUATOR_NO_TIMEOUT)
+    {
+        esp_err_t err = esp_timer_start_once(hold_timers[line], (uint64_t)max_hold_ms * 1000);
+        if (err != ESP_OK)
+        {
+            // 定时恢复是安全保障，启动不了就不保持，宁可马上恢复也不能让门一直开着
+            ESP_LOGE(LOCK_ACTUATOR_TAG, "Failed to start hold timer for %s: %s", line_names[line], esp_err_to_name(err));
+            lock_actuator_release(line);
+            return err;
+        }
+    }
+    ESP_LOGI(LOCK_ACTUATOR_TAG, "%s asserted at %lld us, max hold %lu ms", line_names[line], (long long)now, (unsigned long)max_hold_ms);
+    return ESP_OK;
+}
+
+esp_err_t lock_actuator_release(lock_actuator_line_t line)
+{
+    if (line >= LOCK_ACTUATOR_LINE_COUNT)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_timer_stop(hold_timers[line]);
+
+    lock_actuator_status_t *status = &line_status[line];
+    int64_t now = esp_timer_get_time();
+    bool was_asserted;
+    portENTER_CRITICAL(&actuator_lock);
+    gpio_set_level(line_config[line].gpio, !line_config[line].active_level);
+    was_asserted = status->asserted;
+    if (was_asserted)
+    {
+        status->asserted = false;
+        status->released_us = now;
+    }
+    status->deadline_us = 0;
+    portEXIT_CRITICAL(&actuator_lock);
+
+    if (was_asserted)
+    {
+        ESP_LOGI(LOCK_ACTUATOR_TAG, "%s released at %lld us, held %lld us", line_names[line], (long long)now, (long long)(now - status->asserted_us));
+    }
+    return ESP_OK;
+}
+
+bool lock_actuator_is_asserted(lock_actuator_line_t line)
+{
+    return line < LOCK_ACTUATOR_LINE_COUNT && line_status[line].asserted;
+}
+
+void lock_actuator_get_status(lock_actuator_line_t line, lock_actuator_status_t *status)
+{
+    if (line >= LOCK_ACTUATOR_LINE_COUNT)
+    {
+        return;
+    }
+    portENTER_CRITICAL(&actuator_lock);
+    *status = line_status[line];
+    portEXIT_CRITICAL(&actuator_lock);
+}
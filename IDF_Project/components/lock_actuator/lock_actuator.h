@@ -0,0 +1,66 @@
+#ifndef LOCK_ACTUATOR_H
+#define LOCK_ACTUATOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "driver/gpio.h"
+
+#define LOCK_ACTUATOR_NO_TIMEOUT 0 // 保持到显式释放为止，只给常开、计划锁定这种用户明确要求长期保持的状态用
+
+typedef enum
+{
+    LOCK_ACTUATOR_LINE_LOCK = 0, // CTL_LOCK，有效时门锁模块开门
+    LOCK_ACTUATOR_LINE_D0,       // CTL_D0，有效时刷卡数据被短接，门锁锁定
+    LOCK_ACTUATOR_LINE_COUNT,
+} lock_actuator_line_t;
+
+typedef struct
+{
+    gpio_num_t gpio;
+    gpio_mode_t mode;     // LOCK 线必须是开漏，不能主动拉高门锁模块的信号
+    uint8_t active_level; // 有效电平
+} lock_actuator_line_config_t;
+
+/**
+ * @brief 一条控制线最近的动作时间，都是 esp_timer_get_time() 的 us
+ */
+typedef struct
+{
+    bool asserted;
+    int64_t asserted_us;             // 最近一次切到有效电平的时间
+    int64_t released_us;             // 最近一次恢复的时间
+    int64_t deadline_us;             // 当前这次保持最晚什么时候恢复，0 表示没有限制或者没有在保持
+    int64_t max_release_lateness_us; // 到期恢复比 deadline 晚的最大值，用来确认时序
+    uint32_t timeout_releases;       // 保持时间到期、由定时器恢复的次数
+} lock_actuator_status_t;
+
+/**
+ * @brief 保持时间到期、控制线已经恢复之后的回调，在 esp_timer 任务里执行，不能阻塞
+ */
+typedef void (*lock_actuator_timeout_cb_t)(lock_actuator_line_t line);
+
+/**
+ * @brief 配置两条控制线并恢复到无效电平，给每条线创建一个 esp_timer 用来定时恢复
+ */
+esp_err_t lock_actuator_init(const lock_actuator_line_config_t config[LOCK_ACTUATOR_LINE_COUNT], lock_actuator_timeout_cb_t timeout_cb);
+
+/**
+ * @brief 马上把控制线切到有效电平，并在 max_hold_ms 后由 esp_timer 恢复，不依赖调用它的任务之后能不能被调度到
+ *
+ * 已经在保持的线再调用一次会从现在开始重新计算保持时间
+ *
+ * @param max_hold_ms 最长保持时间，LOCK_ACTUATOR_NO_TIMEOUT 表示一直保持
+ */
+esp_err_t lock_actuator_assert(lock_actuator_line_t line, uint32_t max_hold_ms);
+
+/**
+ * @brief 马上恢复控制线，同时取消还没到期的定时恢复
+ */
+esp_err_t lock_actuator_release(lock_actuator_line_t line);
+
+bool lock_actuator_is_asserted(lock_actuator_line_t line);
+
+void lock_actuator_get_status(lock_actuator_line_t line, lock_actuator_status_t *status);
+
+#endif // LOCK_ACTUATOR_H
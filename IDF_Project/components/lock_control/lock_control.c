@@ -4,6 +4,11 @@
 #include "freertos/queue.h"
 #include "ble_module.h"
 #include "esp_mac.h"
+#include "audit_log.h"
+#include "lock_schedule.h"
+#include "lock_actuator.h"
+#include "lock_latency.h"
+#include "telemetry.h"
 
 #define LOCK_CONTROL_TAG "LOCK_CONTROL"
 
@@ -15,16 +20,25 @@ typedef enum
 } open_mode_t;
 
 static lock_status_t current_lock_state = STATE_NORAML_DEFAULT;
-static TimerHandle_t temp_open_timer = NULL;      // 用来恢复临时开门状态的定时器
-static TimerHandle_t ble_temp_open_timer = NULL;  // 用来恢复蓝牙临时开门状态的定时器
-static TimerHandle_t lock_timer = NULL;           // 用来恢复锁定状态的定时器
-static TimerHandle_t long_press_ble_timer = NULL; // 蓝牙长按计时器，用来判断是否进入蓝牙配对模式
+static TimerHandle_t pairing_timer = NULL; // 蓝牙配对超时定时器，超时后退出配对状态
+
+static TaskHandle_t lock_control_task_handle = NULL;
+static audit_cause_t audit_cause = AUDIT_CAUSE_BOOT; // 正在处理的事件来源，transition_to_state 写审计日志用
+static uint32_t audit_source = 0;
+
+static bool speculative_open = false; // 第一次短按松开就按单击开了门，还在等按键给出结论
+
+static lock_remote_ack_t remote_ack = NULL; // 远程命令处理完之后回报结果
+
+static bool schedule_pending = false;                             // 计划动作变了，还没来得及执行
+static schedule_action_t schedule_applied = SCHEDULE_ACTION_NONE; // 当前状态是不是由计划带进来的，窗口结束时只退出计划自己进入的状态
 
 // 状态切换函数声明
 void transition_to_state(lock_status_t new_state);
 
 void transition_to_STATE_TEMP_OPEN_END();
 void transition_to_STATE_BLE_TEMP_OPEN_END();
+void transition_to_STATE_BLE_PAIRING_TIME_OUT();
 
 // 状态处理函数声明
 void handle_power_on_black();
@@ -45,43 +59,41 @@ void lock_set_open(open_mode_t open_mode);
 /**
  * @brief 让门锁进入锁定状态，通过拉高或拉低D0线，使数据无法被传输，因为D0和ESP32电平不匹配，这里是用了一个MOSFET来对地短接，所以GPIO高电平使MOSFET打开，对地短接，导致数据无法传输。
  *
- *
+ * @param max_hold_ms 多久之后由定时器恢复 D0，按键和远程锁定是 TIME_RECOVER_LOCK，计划锁定是 LOCK_ACTUATOR_NO_TIMEOUT
  */
-void lock_set_lock();
+void lock_set_lock(uint32_t max_hold_ms);
 
 /**
- * @brief 进入临时开门状态后启用的定时器，TIME_RECOVER_TEMP_OPEN秒后恢复到正常状态
+ * @brief 停止并删除定时器，同时把句柄置空
  *
  */
-void start_timer_temp_open();
+void reset_timer(TimerHandle_t *timer);
 
 /**
- * @brief 开始蓝牙长按计时器，6s之后进入蓝牙配对模式，同时蓝牙进入配对灯效在这里开始播放
+ * @brief 恢复出厂设置，忘记蓝牙、WI-FI
  *
+ * TODO: 具体的恢复出厂设置操作，蓝牙和WI-FI的操作
  */
-void start_ble_long_press_timer();
+void factory_reset_start(void);
 
 /**
- * @brief 停止蓝牙长按计时器，不用进入蓝牙配对模式
- *
+ * @brief 按定时计划切换常开 / 锁定，只在正常、常开、锁定三个稳定状态下执行，
+ * 临时开门、配对、恢复出厂的流程走完回到正常状态之后再补上
  */
-void stop_ble_long_press_timer();
+static void apply_schedule(void);
 
 /**
- * @brief 发送一个蓝牙配对信号量，让ble_module进入配对模式
- *
+ * @brief 执行远程命令，和计划一样直接切到目标状态，已经在目标状态就什么都不做
  */
-void ble_start_pairing(void);
+static void apply_remote_command(button_event_t event);
 
-/**
- * @brief 恢复出厂设置，忘记蓝牙、WI-FI
- *
- * TODO: 具体的恢复出厂设置操作，蓝牙和WI-FI的操作
- */
-void factory_reset_start(void);
+static bool is_remote_event(button_event_t event)
+{
+    return event >= REMOTE_EVENT_NORMAL && event <= REMOTE_EVENT_STATUS;
+}
 
 /* 工具函数声明和定义 */
-static const char *get_lock_state_name(lock_status_t state)
+const char *get_lock_state_name(lock_status_t state)
 {
     switch (state)
     {
@@ -119,31 +131,60 @@ static const char *get_lock_state_name(lock_status_t state)
     }
 }
 
-void start_timer_temp_open()
+/**
+ * @brief 处理完一个事件之后，看控制线有没有在处理期间动作，有的话记一次从输入到动作的延迟
+ *
+ * @param handled_us 开始处理这个事件的时间，之前的动作不算
+ * @return 控制线动作的时间，不统计的事件或者控制线没有动作时返回 0
+ */
+static int64_t record_actuation_latency(const button_event_msg_t *msg, int64_t handled_us)
 {
-    if (temp_open_timer == NULL)
+    lock_latency_kind_t kind = lock_latency_kind(msg->event);
+    if (kind == LOCK_LATENCY_KIND_COUNT)
     {
-        temp_open_timer = xTimerCreate("TempOpenTimer", pdMS_TO_TICKS(TIME_RECOVER_TEMP_OPEN), pdFALSE, NULL, (TimerCallbackFunction_t)transition_to_STATE_TEMP_OPEN_END);
+        return 0;
     }
-    xTimerStart(temp_open_timer, 0);
+    int64_t actuate_us = 0;
+    for (lock_actuator_line_t line = 0; line < LOCK_ACTUATOR_LINE_COUNT; line++)
+    {
+        lock_actuator_status_t status;
+        lock_actuator_get_status(line, &status);
+        int64_t changed_us = status.asserted ? status.asserted_us : status.released_us;
+        if (changed_us >= handled_us && (actuate_us == 0 || changed_us < actuate_us))
+        {
+            actuate_us = changed_us;
+        }
+    }
+    if (actuate_us != 0)
+    {
+        lock_latency_record(kind, msg->input_us, msg->event_us, actuate_us);
+    }
+    return actuate_us;
 }
 
-void start_timer_ble_temp_open()
+/**
+ * @brief 开门 / 锁定的保持时间到了，引脚已经在 esp_timer 里恢复，通知状态机跟着切换状态
+ */
+static void lock_hold_expired(lock_actuator_line_t line)
 {
-    if (ble_temp_open_timer == NULL)
-    {
-        ble_temp_open_timer = xTimerCreate("BleTempOpenTimer", pdMS_TO_TICKS(TIME_BLE_RECOVER_TEMP_OPEN), pdFALSE, NULL, (TimerCallbackFunction_t)transition_to_STATE_BLE_TEMP_OPEN_END);
-    }
-    xTimerStart(ble_temp_open_timer, 0);
+    send_button_event(ACTUATOR_EVENT_HOLD_EXPIRED);
+}
+
+/**
+ * @brief 配对超时，在定时器任务里调用，只通知状态机，不在这里改状态
+ */
+static void pairing_timeout(TimerHandle_t timer)
+{
+    send_button_event(PAIRING_EVENT_TIMEOUT);
 }
 
-void start_timer_lock()
+void start_timer_pairing()
 {
-    if (lock_timer == NULL)
+    if (pairing_timer == NULL)
     {
-        lock_timer = xTimerCreate("LockTimer", pdMS_TO_TICKS(TIME_RECOVER_LOCK), pdFALSE, NULL, (TimerCallbackFunction_t)lock_set_normal);
+        pairing_timer = xTimerCreate("PairingTimer", pdMS_TO_TICKS(TIME_BLE_PAIRING_TIMEOUT), pdFALSE, NULL, pairing_timeout);
     }
-    xTimerStart(lock_timer, 0);
+    xTimerStart(pairing_timer, 0);
 }
 
 void reset_timer(TimerHandle_t *timer)
@@ -161,7 +202,7 @@ void lock_control_init(void)
 {
 
     // 初始化 GPIO
-    uint64_t gpio_output_sel = (1ULL << OUTPUT_LED_D4) | (1ULL << OUTPUT_LED_D5) | (1ULL << CTL_D0);
+    uint64_t gpio_output_sel = (1ULL << OUTPUT_LED_D4) | (1ULL << OUTPUT_LED_D5);
     gpio_config_t output_io_conf = {
         .pin_bit_mask = gpio_output_sel,
         .mode = GPIO_MODE_OUTPUT,              // 输出模式
@@ -171,24 +212,19 @@ void lock_control_init(void)
     };
     gpio_config(&output_io_conf);
 
-    // 单独配置锁控制引脚，因为不希望外表LOCK信号被单片机主动拉高，这样会导致开不了门
-    uint64_t lock_ctl_output_sel = (1ULL << CTL_LOCK);
-    gpio_config_t lock_ctl_io_conf = {
-        .pin_bit_mask = lock_ctl_output_sel,
-        .mode = GPIO_MODE_OUTPUT_OD,           // 输出模式
-        .pull_up_en = GPIO_PULLUP_DISABLE,     // 不需要上拉
-        .pull_down_en = GPIO_PULLDOWN_DISABLE, // 不需要下拉
-        .intr_type = GPIO_INTR_DISABLE         // 不需要中断
+    // 门锁的两条控制线交给 lock_actuator，开门和锁定的保持时间由 esp_timer 计时
+    const lock_actuator_line_config_t actuator_lines[LOCK_ACTUATOR_LINE_COUNT] = {
+        [LOCK_ACTUATOR_LINE_LOCK] = {.gpio = CTL_LOCK, .mode = GPIO_MODE_OUTPUT_OD, .active_level = 0}, // 不希望外部LOCK信号被单片机主动拉高，这样会导致开不了门
+        [LOCK_ACTUATOR_LINE_D0] = {.gpio = CTL_D0, .mode = GPIO_MODE_OUTPUT, .active_level = 1},        // 高电平打开MOSFET，把D0对地短接
     };
-    gpio_config(&lock_ctl_io_conf);
-
-    gpio_set_level(CTL_LOCK, 1); // 默认恢复LOCK线到开漏状态，不对门锁模块产生影响
+    ESP_ERROR_CHECK(lock_actuator_init(actuator_lines, lock_hold_expired));
 
     // 初始化状态为上电之后的黑屏状态，但是具体的上电灯效是在ws2812component里做的
+    audit_source = esp_reset_reason(); // 上电这条审计记录带上复位原因
     transition_to_state(STATE_POWER_ON_BLACK);
 
     // 初始化按键事件队列
-    button_event_queue = xQueueCreate(10, sizeof(button_event_t));
+    button_event_queue = xQueueCreate(10, sizeof(button_event_msg_t));
     if (button_event_queue == NULL)
     {
         ESP_LOGE(LOCK_CONTROL_TAG, "Failed to create button event queue");
@@ -196,7 +232,7 @@ void lock_control_init(void)
     }
 
     // 创建任务
-    xTaskCreate(lock_control_task, "lock_control_task", 2048, NULL, 10, NULL);
+    xTaskCreate(lock_control_task, "lock_control_task", 2048, NULL, 10, &lock_control_task_handle);
 }
 
 /**
@@ -209,12 +245,67 @@ void lock_control_init(void)
  */
 void lock_control_task(void *pvParameters)
 {
-    button_event_t event;
+    button_event_msg_t msg;
 
     while (1)
     {
-        if (xQueueReceive(button_event_queue, &event, portMAX_DELAY))
+        if (xQueueReceive(button_event_queue, &msg, portMAX_DELAY))
         {
+            button_event_t event = msg.event;
+            int64_t handled_us = esp_timer_get_time();
+
+            // NONE_UPDATE 是状态机自己发的后续事件，沿用触发它的那个来源
+            if (event == SCHEDULE_EVENT_UPDATE)
+            {
+                schedule_pending = true;
+            }
+            else if (event == BLE_BUTTON_EVENT_SINGLE_CLICK)
+            {
+                audit_cause = AUDIT_CAUSE_BLE;
+            }
+            else if (event == ACTUATOR_EVENT_HOLD_EXPIRED || event == PAIRING_EVENT_TIMEOUT)
+            {
+                audit_cause = AUDIT_CAUSE_TIMER;
+                audit_source = 0;
+            }
+            else if (is_remote_event(event))
+            {
+                audit_cause = AUDIT_CAUSE_REMOTE;
+                audit_source = msg.request_id;
+            }
+            else if (event != BUTTON_EVENT_NONE_UPDATE_LOCK_CONTROL)
+            {
+                audit_cause = AUDIT_CAUSE_BUTTON;
+                audit_source = event;
+            }
+
+            // 按单击先开了门：单击确认之后门已经开着，不用再做什么；双击按临时开门转常开处理，门不用再动；撤回就恢复到正常状态
+            if (speculative_open && (event == BUTTON_EVENT_SINGLE_CLICK || event == BUTTON_EVENT_DOUBLE_CLICK || event == BUTTON_EVENT_SPECULATION_CANCEL))
+            {
+                speculative_open = false;
+                if (current_lock_state != STATE_TEMP_OPEN)
+                {
+                    event = BUTTON_EVENT_NONE_UPDATE_LOCK_CONTROL; // 先行开的门已经被远程命令改掉了，这一串按键作废
+                }
+                else if (event == BUTTON_EVENT_SINGLE_CLICK)
+                {
+                    event = BUTTON_EVENT_NONE_UPDATE_LOCK_CONTROL; // 临时开门状态里什么都不做
+                }
+                else if (event == BUTTON_EVENT_SPECULATION_CANCEL)
+                {
+                    lock_set_normal();
+                }
+                else
+                {
+                    handled_us = msg.input_us; // 控制线在先行开门时就动了，双击的延迟算到那一刻
+                }
+            }
+
+            if (is_remote_event(event))
+            {
+                apply_remote_command(event);
+            }
+
             switch (current_lock_state)
             {
             case STATE_POWER_ON_BLACK:
@@ -229,13 +320,18 @@ void lock_control_task(void *pvParameters)
                 {
                     lock_set_open(OPEN_MODE_ONCE); // 单击打开门
                 }
+                else if (event == BUTTON_EVENT_SPECULATIVE_CLICK)
+                {
+                    lock_set_open(OPEN_MODE_ONCE); // 不等双击窗口，先按单击开门，之后的 SINGLE / DOUBLE / CANCEL 在上面收尾
+                    speculative_open = true;
+                }
                 else if (event == BUTTON_EVENT_DOUBLE_CLICK)
                 {
                     lock_set_open(OPEN_MODE_ALWAYS); // 双击进入常开模式
                 }
                 else if (event == BUTTON_EVENT_MULTI_CLICK)
                 {
-                    lock_set_lock();
+                    lock_set_lock(TIME_RECOVER_LOCK);
                 }
                 else if (event == BLE_BUTTON_EVENT_SINGLE_CLICK)
                 {
@@ -243,13 +339,13 @@ void lock_control_task(void *pvParameters)
                 }
                 else if (event == BUTTON_EVENT_LONG_PRESS_START)
                 {
-                    start_ble_long_press_timer();
+                    ws2812b_switch_effect(LED_EFFECT_BLE_TRY_PAIRING); // 配对准备灯效正好 6s，放完时按键发来 HOLD_6S
                     transition_to_state(STATE_BLE_PAIRING_PREPARE);
                 }
 
                 break;
             case STATE_TEMP_OPEN:
-                if (event == BUTTON_EVENT_SINGLE_CLICK)
+                if (event == BUTTON_EVENT_SINGLE_CLICK || (event == ACTUATOR_EVENT_HOLD_EXPIRED && !lock_actuator_is_asserted(LOCK_ACTUATOR_LINE_LOCK)))
                 {
                     transition_to_STATE_TEMP_OPEN_END();
                 }
@@ -275,13 +371,14 @@ void lock_control_task(void *pvParameters)
             case STATE_LOCKED:
                 if (event == BUTTON_EVENT_SINGLE_CLICK || event == BUTTON_EVENT_DOUBLE_CLICK) // 单击或双击都可以关闭锁定模式🔒
                 {
-                    reset_timer(&lock_timer); // 关闭锁定设置的定时器
+                    lock_set_normal();
+                }
+                else if (event == ACTUATOR_EVENT_HOLD_EXPIRED && !lock_actuator_is_asserted(LOCK_ACTUATOR_LINE_D0)) // TIME_RECOVER_LOCK 到了，D0 已经恢复
+                {
                     lock_set_normal();
                 }
                 else if (event == BUTTON_EVENT_LONG_PRESS_START) // 长按进入恢复出厂设置状态
                 {
-
-                    reset_timer(&lock_timer); // 关闭锁定设置的定时器
                     lock_set_normal();
                     ws2812b_switch_effect(LED_EFFECT_CONFIRM_FACTORY_RESET);
                     transition_to_state(STATE_RESTORY_FACTORY_SETTINGS_PREPARE);
@@ -289,7 +386,7 @@ void lock_control_task(void *pvParameters)
                 break;
 
             case STATE_BLE_TEMP_OPEN:
-                if (event == BUTTON_EVENT_SINGLE_CLICK)
+                if (event == BUTTON_EVENT_SINGLE_CLICK || (event == ACTUATOR_EVENT_HOLD_EXPIRED && !lock_actuator_is_asserted(LOCK_ACTUATOR_LINE_LOCK)))
                 {
                     transition_to_STATE_BLE_TEMP_OPEN_END();
                 }
@@ -309,13 +406,14 @@ void lock_control_task(void *pvParameters)
             case STATE_BLE_PAIRING_PREPARE:
                 if (event == BUTTON_EVENT_LONG_PRESS_HOLD_6S) // 灯效播放完了（6s），正好能够进入配对模式
                 {
+                    xSemaphoreGive(pairing_semaphore); // 蓝牙开始配对广播，和状态切换在同一个事件里，不会有两个 6s 各走各的
+                    start_timer_pairing();             // 配对模式没有按键可以退出，只能等超时
                     transition_to_state(STATE_BLE_PAIRING_IN_PROGRESS);
                     ws2812b_switch_effect(LED_EFFECT_BLE_PAIRING_MODE);
                 }
                 else if (event == BUTTON_EVENT_LONG_PRESS_END)
                 {
                     ESP_LOGI(LOCK_CONTROL_TAG, "Long press end detected, stop pairing");
-                    stop_ble_long_press_timer();
                     transition_to_state(STATE_NORAML_DEFAULT);
                     ws2812b_switch_effect(LED_EFFECT_DEFAULT_STATE);
                 }
@@ -323,18 +421,14 @@ void lock_control_task(void *pvParameters)
                 break;
 
             case STATE_BLE_PAIRING_IN_PROGRESS:
-                // if (event == BUTTON_EVENT_LONG_PRESS_HOLD_6S)
-                // {
-                //     transition_to_state(STATE_BLE_PAIRING_TIME_OUT);
-                //     ws2812b_switch_effect(LED_EFFECT_BLE_PAIRING_TIMEOUT);
-                // }
+                // 配对中忽略按键，TIME_BLE_PAIRING_TIMEOUT 之后 pairing_timer 发来超时事件
+                if (event == PAIRING_EVENT_TIMEOUT)
+                {
+                    transition_to_STATE_BLE_PAIRING_TIME_OUT();
+                }
                 break;
             case STATE_BLE_PAIRING_TIME_OUT:
-                // if (event == BUTTON_EVENT_SINGLE_CLICK)
-                // {
-                //     transition_to_state(STATE_NORAML_DEFAULT);
-                //     ws2812b_switch_effect(LED_EFFECT_DEFAULT_STATE);
-                // }
+                lock_set_normal(); // 配对结束，回到正常状态
                 break;
             case STATE_RESTORY_FACTORY_SETTINGS_PREPARE:
                 if (event == BUTTON_EVENT_LONG_PRESS_HOLD_6S)
@@ -361,31 +455,188 @@ void lock_control_task(void *pvParameters)
             default:
                 break;
             }
+
+            int64_t actuate_us = record_actuation_latency(&msg, handled_us);
+            if (is_remote_event(msg.event) && remote_ack != NULL)
+            {
+                remote_ack(msg.request_id, (lock_command_t)(msg.event - REMOTE_EVENT_NORMAL), current_lock_state, actuate_us != 0 ? actuate_us - msg.input_us : -1);
+            }
+
+            if (schedule_pending)
+            {
+                apply_schedule();
+            }
+        }
+    }
+}
+
+static void apply_schedule(void)
+{
+    if (current_lock_state != STATE_NORAML_DEFAULT && current_lock_state != STATE_ALWAYS_OPEN && current_lock_state != STATE_LOCKED)
+    {
+        return;
+    }
+    schedule_pending = false;
+
+    schedule_action_t action = lock_schedule_current_action();
+    audit_cause = AUDIT_CAUSE_SCHEDULE;
+    audit_source = action;
+
+    if (action == SCHEDULE_ACTION_ALWAYS_OPEN && current_lock_state != STATE_ALWAYS_OPEN)
+    {
+        if (current_lock_state == STATE_LOCKED)
+        {
+            lock_set_normal();
+        }
+        lock_set_open(OPEN_MODE_ALWAYS);
+        schedule_applied = action;
+    }
+    else if (action == SCHEDULE_ACTION_LOCK && current_lock_state != STATE_LOCKED)
+    {
+        if (current_lock_state == STATE_ALWAYS_OPEN)
+        {
+            lock_set_normal();
+        }
+        lock_set_lock(LOCK_ACTUATOR_NO_TIMEOUT); // 计划锁定一直保持到窗口结束，不用 TIME_RECOVER_LOCK 恢复
+        schedule_applied = action;
+    }
+    else if (action == SCHEDULE_ACTION_NONE && schedule_applied != SCHEDULE_ACTION_NONE)
+    {
+        // 窗口里被按键手动退出的话这里什么都不用做
+        if (schedule_applied == SCHEDULE_ACTION_ALWAYS_OPEN && current_lock_state == STATE_ALWAYS_OPEN)
+        {
+            transition_to_STATE_TEMP_OPEN_END();
+        }
+        else if (schedule_applied == SCHEDULE_ACTION_LOCK && current_lock_state == STATE_LOCKED)
+        {
+            lock_set_normal();
+        }
+        schedule_applied = SCHEDULE_ACTION_NONE;
+    }
+}
+
+static void apply_remote_command(button_event_t event)
+{
+    if (current_lock_state != STATE_NORAML_DEFAULT && current_lock_state != STATE_TEMP_OPEN && current_lock_state != STATE_BLE_TEMP_OPEN &&
+        current_lock_state != STATE_ALWAYS_OPEN && current_lock_state != STATE_LOCKED)
+    {
+        if (event != REMOTE_EVENT_STATUS)
+        {
+            ESP_LOGW(LOCK_CONTROL_TAG, "Remote command ignored in state %s", get_lock_state_name(current_lock_state));
+        }
+        return;
+    }
+
+    switch (event)
+    {
+    case REMOTE_EVENT_NORMAL:
+        if (current_lock_state != STATE_NORAML_DEFAULT)
+        {
+            lock_set_normal();
+        }
+        break;
+    case REMOTE_EVENT_OPEN:
+        if (current_lock_state == STATE_LOCKED)
+        {
+            lock_set_normal();
+        }
+        if (current_lock_state == STATE_NORAML_DEFAULT)
+        {
+            lock_set_open(OPEN_MODE_ONCE); // 临时开门和常开状态下门本来就开着
+        }
+        break;
+    case REMOTE_EVENT_LOCK:
+        if (current_lock_state != STATE_LOCKED)
+        {
+            if (current_lock_state != STATE_NORAML_DEFAULT)
+            {
+                lock_set_normal(); // 先松开 LOCK 线
+            }
+            lock_set_lock(TIME_RECOVER_LOCK);
         }
+        break;
+    case REMOTE_EVENT_ALWAYS_OPEN:
+        if (current_lock_state != STATE_ALWAYS_OPEN)
+        {
+            if (current_lock_state == STATE_LOCKED)
+            {
+                lock_set_normal();
+            }
+            lock_set_open(OPEN_MODE_ALWAYS);
+        }
+        break;
+    default:
+        break;
     }
 }
 
+esp_err_t lock_control_remote_command(lock_command_t command, uint32_t request_id, int64_t input_us)
+{
+    if (command > LOCK_CMD_STATUS)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (button_event_queue == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    button_event_msg_t msg = {
+        .event = (button_event_t)(REMOTE_EVENT_NORMAL + command),
+        .input_us = input_us,
+        .event_us = esp_timer_get_time(),
+        .request_id = request_id,
+    };
+    // 状态机任务优先级比 MQTT 任务高，发进队列之后马上就会被处理
+    return xQueueSend(button_event_queue, &msg, 0) == pdTRUE ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+void lock_control_set_remote_ack(lock_remote_ack_t ack)
+{
+    remote_ack = ack;
+}
+
 // 状态切换
 void transition_to_state(lock_status_t new_state)
 {
     ESP_LOGI(LOCK_CONTROL_TAG, "Transitioning from state %s to state %s", get_lock_state_name(current_lock_state), get_lock_state_name(new_state));
+
+    // 不在状态机任务里调用的只有定时器回调
+    if (lock_control_task_handle != NULL && xTaskGetCurrentTaskHandle() != lock_control_task_handle)
+    {
+        audit_cause = AUDIT_CAUSE_TIMER;
+        audit_source = 0;
+    }
+    uint32_t source = audit_source;
+    int8_t rssi = 0;
+    if (audit_cause == AUDIT_CAUSE_BLE)
+    {
+        audit_log_get_ble_context(&source, &rssi);
+    }
+    audit_log_record(current_lock_state, new_state, audit_cause, source, rssi);
+    telemetry_record(TELEMETRY_TRANSITION, audit_cause, current_lock_state | new_state << 8 | (source & 0xffff) << 16);
+
     current_lock_state = new_state;
 }
 
 void transition_to_STATE_TEMP_OPEN_END()
 {
-    reset_timer(&temp_open_timer); // 关闭单次开门设置的定时器
     transition_to_state(STATE_TEMP_OPEN_END);
     send_button_event(BUTTON_EVENT_NONE_UPDATE_LOCK_CONTROL);
 }
 
 void transition_to_STATE_BLE_TEMP_OPEN_END()
 {
-    reset_timer(&ble_temp_open_timer); // 关闭单次开门设置的定时器
     transition_to_state(STATE_BLE_TEMP_OPEN_END);
     send_button_event(BUTTON_EVENT_NONE_UPDATE_LOCK_CONTROL);
 }
 
+void transition_to_STATE_BLE_PAIRING_TIME_OUT()
+{
+    reset_timer(&pairing_timer);
+    transition_to_state(STATE_BLE_PAIRING_TIME_OUT);
+    send_button_event(BUTTON_EVENT_NONE_UPDATE_LOCK_CONTROL);
+}
+
 void handle_power_on_black()
 {
     vTaskDelay(pdMS_TO_TICKS(666));
@@ -395,16 +646,14 @@ void handle_power_on_black()
     ws2812b_switch_effect(LED_EFFECT_DEFAULT_STATE);
 }
 
-void lock_set_lock(void)
+void lock_set_lock(uint32_t max_hold_ms)
 {
     ESP_LOGI(LOCK_CONTROL_TAG, "Locking door, lockstate:  %s", get_lock_state_name(current_lock_state));
-    gpio_set_level(CTL_D0, 1); // 通过开启MOSFET，拉低D0线，使数据无法传输
+    lock_actuator_assert(LOCK_ACTUATOR_LINE_D0, max_hold_ms); // 通过开启MOSFET，拉低D0线，使数据无法传输，max_hold_ms 后由定时器恢复
     // 打开两个板载LED
     gpio_set_level(OUTPUT_LED_D5, 1);
     gpio_set_level(OUTPUT_LED_D4, 1);
 
-    start_timer_lock(); // 开启定时器，TIME_RECOVER_LOCK秒后恢复到正常状态
-
     // 灯效和状态机切换到锁定状态
     ws2812b_switch_effect(LED_EFFECT_LOCK_DOOR);
     transition_to_state(STATE_LOCKED);
@@ -413,7 +662,17 @@ void lock_set_lock(void)
 void lock_set_open(open_mode_t open_mode)
 {
     ESP_LOGI(LOCK_CONTROL_TAG, "Opening door, lockstate:  %s", get_lock_state_name(current_lock_state));
-    gpio_set_level(CTL_LOCK, 0); // 通过拉低LOCK线，使宿舍门锁模块进入开门状态
+    // 通过拉低LOCK线，使宿舍门锁模块进入开门状态，临时开门到时间后由定时器恢复，常开模式一直保持
+    uint32_t max_hold_ms = LOCK_ACTUATOR_NO_TIMEOUT;
+    if (open_mode == OPEN_MODE_ONCE)
+    {
+        max_hold_ms = TIME_RECOVER_TEMP_OPEN;
+    }
+    else if (open_mode == OPEN_MODE_ONCE_BLE)
+    {
+        max_hold_ms = TIME_BLE_RECOVER_TEMP_OPEN;
+    }
+    lock_actuator_assert(LOCK_ACTUATOR_LINE_LOCK, max_hold_ms);
     // 打开一个板载LED
     gpio_set_level(OUTPUT_LED_D4, 0);
     gpio_set_level(OUTPUT_LED_D5, 1);
@@ -421,18 +680,17 @@ void lock_set_open(open_mode_t open_mode)
     // 灯效和状态机切换到对应开门状态
     if (open_mode == OPEN_MODE_ONCE)
     {
-        start_timer_temp_open();                            // 开启定时器，TIME_RECOVER_TEMP_OPEN秒后恢复到正常状态
         ws2812b_switch_effect(LED_EFFECT_SINGLE_OPEN_DOOR); // 同时开启LED效果
         transition_to_state(STATE_TEMP_OPEN);               // 然后进入临时开门状态
     }
     else if (open_mode == OPEN_MODE_ALWAYS)
     {
+        // 从临时开门切过来的时候，上面重新 assert 已经取消了临时开门的定时恢复
         ws2812b_switch_effect(LED_EFFECT_ALWAYS_OPEN_MODE);
         transition_to_state(STATE_ALWAYS_OPEN);
     }
     else if (open_mode == OPEN_MODE_ONCE_BLE)
     {
-        start_timer_ble_temp_open(); // 开启定时器，TIME_RECOVER_TEMP_OPEN秒后恢复到正常状态
         ws2812b_switch_effect(LED_EFFECT_OPEN_BLUETOOTH_NEARBY);
         transition_to_state(STATE_BLE_TEMP_OPEN);
     }
@@ -441,8 +699,8 @@ void lock_set_open(open_mode_t open_mode)
 void lock_set_normal(void)
 {
     ESP_LOGI(LOCK_CONTROL_TAG, "Setting door to normal, from lockstate:  %s", get_lock_state_name(current_lock_state));
-    gpio_set_level(CTL_LOCK, 1); // 恢复LOCK线到开漏状态
-    gpio_set_level(CTL_D0, 0);   // 通过关闭MOSFET，恢复D0线到正常状态
+    lock_actuator_release(LOCK_ACTUATOR_LINE_LOCK); // 恢复LOCK线到开漏状态
+    lock_actuator_release(LOCK_ACTUATOR_LINE_D0);   // 通过关闭MOSFET，恢复D0线到正常状态
     // 关闭两个板载LED
     gpio_set_level(OUTPUT_LED_D4, 0);
     gpio_set_level(OUTPUT_LED_D5, 0);
@@ -457,40 +715,6 @@ lock_status_t get_current_lock_state()
     return current_lock_state;
 }
 
-void start_ble_long_press_timer()
-{
-    long_press_ble_timer = xTimerCreate("long_press_ble_timer", 6000 / portTICK_PERIOD_MS, pdFALSE, NULL, (TimerCallbackFunction_t)ble_start_pairing);
-    if (long_press_ble_timer != NULL)
-    {
-        xTimerStart(long_press_ble_timer, 0);
-    }
-    else
-    {
-        ESP_LOGE(LOCK_CONTROL_TAG, "Failed to create long press timer");
-    }
-
-    ws2812b_switch_effect(LED_EFFECT_BLE_TRY_PAIRING); // 播放蓝牙配对灯效
-}
-
-void stop_ble_long_press_timer()
-{
-    if (long_press_ble_timer != NULL)
-    {
-        xTimerStop(long_press_ble_timer, 0);
-        xTimerDelete(long_press_ble_timer, 0);
-        long_press_ble_timer = NULL;
-    }
-}
-
-void ble_start_pairing(void)
-{
-    xTimerStop(long_press_ble_timer, 0);
-    xTimerDelete(long_press_ble_timer, 0);
-
-    xSemaphoreGive(pairing_semaphore);
-    ws2812b_switch_effect(LED_EFFECT_BLE_PAIRING_MODE);
-}
-
 void factory_reset_start(void)
 {
 
@@ -515,6 +739,7 @@ void factory_reset_start(void)
     //     ESP_LOGE(LOCK_CONTROL_TAG, "Failed to restore Bluetooth to factory settings");
     // }
 
-    // 重启设备
+    // 重启设备，重启前把审计日志写完
+    audit_log_flush();
     esp_restart();
 }
\ No newline at end of file
@@ -18,6 +18,7 @@
 #define TIME_RECOVER_TEMP_OPEN 10 * 60 * 1000      // 定义超时时间 (ms)
 #define TIME_BLE_RECOVER_TEMP_OPEN 0.5 * 60 * 1000 // 定义超时时间 (ms)
 #define TIME_RECOVER_LOCK 10 * 60 * 1000           // 定义超时时间 (ms)
+#define TIME_BLE_PAIRING_TIMEOUT 60 * 1000         // 配对超时时间 (ms)，和 ble_module 里配对模式持续的时间一致
 
 typedef enum
 {
@@ -43,9 +44,19 @@ typedef enum
     LOCK_CMO_NORMAL,
     LOCK_CMD_SINGLE_OPEN, // 开门
     LOCK_CMD_LOCK,        // 关门
-    LOCK_CMD_ALWAYS_OPEN  // 常开模式
+    LOCK_CMD_ALWAYS_OPEN, // 常开模式
+    LOCK_CMD_STATUS,      // 查询状态
 } lock_command_t;
 
+/**
+ * @brief 远程命令处理完之后的回报，在状态机任务里调用，不能阻塞
+ *
+ * @param request_id 命令里带的请求号
+ * @param state 处理完之后的状态
+ * @param latency_us 收到命令到控制线动作的时间，控制线没有动作时为 -1
+ */
+typedef void (*lock_remote_ack_t)(uint32_t request_id, lock_command_t command, lock_status_t state, int64_t latency_us);
+
 extern QueueHandle_t button_event_queue;
 
 // 门锁模块相关函数
@@ -53,5 +64,21 @@ void lock_control_init(void);
 void lock_control_task(void *pvParameters);
 void transition_to_state(lock_status_t new_state);
 lock_status_t get_current_lock_state();
+const char *get_lock_state_name(lock_status_t state);
+
+/**
+ * @brief 远程命令（MQTT 等）进状态机的入口，和按键事件走同一个队列，不等待
+ *
+ * 只在正常、临时开门、常开、锁定这几个稳定状态下执行，其它状态下（配对、恢复出厂……）只回报当前状态
+ *
+ * @param input_us 收到命令的 esp_timer_get_time()，用来统计命令到动作的延迟
+ * @return ESP_ERR_INVALID_STATE 状态机还没初始化，ESP_ERR_TIMEOUT 队列满了
+ */
+esp_err_t lock_control_remote_command(lock_command_t command, uint32_t request_id, int64_t input_us);
+
+/**
+ * @brief 注册远程命令的回报函数，NULL 表示不回报
+ */
+void lock_control_set_remote_ack(lock_remote_ack_t ack);
 
 #endif // LOCK_CONTROL_H
\ No newline at end of file
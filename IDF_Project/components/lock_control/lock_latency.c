@@ -0,0 +1,113 @@
+/**
+ * @file lock_latency.c
+ * @brief 按键 / 蓝牙到门锁控制线动作的延迟分布
+ *
+ * 桶按 2 的幂划分，记录只做一次 clz，不需要浮点也不需要排序；最小、最大和总和是精确值
+ */
+#include <string.h>
+
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "lock_latency.h"
+#include "telemetry.h"
+
+#define LOCK_LATENCY_TAG "LOCK_LATENCY"
+
+static lock_latency_stats_t latency_stats[LOCK_LATENCY_KIND_COUNT];
+static portMUX_TYPE latency_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *const kind_names[LOCK_LATENCY_KIND_COUNT] = {
+    [LOCK_LATENCY_SINGLE_CLICK] = "SINGLE_CLICK",
+    [LOCK_LATENCY_DOUBLE_CLICK] = "DOUBLE_CLICK",
+    [LOCK_LATENCY_MULTI_CLICK] = "MULTI_CLICK",
+    [LOCK_LATENCY_LONG_PRESS] = "LONG_PRESS",
+    [LOCK_LATENCY_BLE] = "BLE",
+    [LOCK_LATENCY_REMOTE] = "REMOTE",
+};
+
+lock_latency_kind_t lock_latency_kind(button_event_t event)
+{
+    switch (event)
+    {
+    case BUTTON_EVENT_SINGLE_CLICK:
+    case BUTTON_EVENT_SPECULATIVE_CLICK:
+        return LOCK_LATENCY_SINGLE_CLICK;
+    case BUTTON_EVENT_DOUBLE_CLICK:
+        return LOCK_LATENCY_DOUBLE_CLICK;
+    case BUTTON_EVENT_MULTI_CLICK:
+        return LOCK_LATENCY_MULTI_CLICK;
+    case BUTTON_EVENT_LONG_PRESS_START:
+        return LOCK_LATENCY_LONG_PRESS;
+    case BLE_BUTTON_EVENT_SINGLE_CLICK:
+        return LOCK_LATENCY_BLE;
+    case REMOTE_EVENT_NORMAL:
+    case REMOTE_EVENT_OPEN:
+    case REMOTE_EVENT_LOCK:
+    case REMOTE_EVENT_ALWAYS_OPEN:
+        return LOCK_LATENCY_REMOTE;
+    default:
+        return LOCK_LATENCY_KIND_COUNT;
+    }
+}
+
+const char *lock_latency_kind_name(lock_latency_kind_t kind)
+{
+    return kind < LOCK_LATENCY_KIND_COUNT ? kind_names[kind] : "UNKNOWN";
+}
+
+static uint8_t bucket_of(uint32_t latency_us)
+{
+    uint32_t ms = latency_us / 1000;
+    uint8_t bucket = ms == 0 ? 0 : 32 - __builtin_clz(ms);
+    return bucket < LOCK_LATENCY_BUCKETS ? bucket : LOCK_LATENCY_BUCKETS - 1;
+}
+
+static void hist_add(lock_latency_hist_t *hist, int64_t latency_us)
+{
+    uint32_t us = latency_us < 0 ? 0 : latency_us > UINT32_MAX ? UINT32_MAX : (uint32_t)latency_us;
+    if (hist->count == 0 || us < hist->min_us)
+    {
+        hist->min_us = us;
+    }
+    if (us > hist->max_us)
+    {
+        hist->max_us = us;
+    }
+    hist->count++;
+    hist->sum_us += us;
+    hist->buckets[bucket_of(us)]++;
+}
+
+void lock_latency_record(lock_latency_kind_t kind, int64_t input_us, int64_t event_us, int64_t actuate_us)
+{
+    if (kind >= LOCK_LATENCY_KIND_COUNT)
+    {
+        return;
+    }
+    portENTER_CRITICAL(&latency_lock);
+    hist_add(&latency_stats[kind].detect, event_us - input_us);
+    hist_add(&latency_stats[kind].actuate, actuate_us - input_us);
+    portEXIT_CRITICAL(&latency_lock);
+    int64_t actuate_latency_us = actuate_us - input_us;
+    telemetry_record(TELEMETRY_LATENCY, kind, actuate_latency_us < 0 ? 0 : actuate_latency_us > UINT32_MAX ? UINT32_MAX : (uint32_t)actuate_latency_us);
+    ESP_LOGI(LOCK_LATENCY_TAG, "%s: detect %lld us, actuate %lld us", kind_names[kind], (long long)(event_us - input_us), (long long)(actuate_us - input_us));
+}
+
+void lock_latency_get(lock_latency_kind_t kind, lock_latency_stats_t *stats)
+{
+    if (kind >= LOCK_LATENCY_KIND_COUNT)
+    {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    portENTER_CRITICAL(&latency_lock);
+    *stats = latency_stats[kind];
+    portEXIT_CRITICAL(&latency_lock);
+}
+
+void lock_latency_reset(void)
+{
+    portENTER_CRITICAL(&latency_lock);
+    memset(latency_stats, 0, sizeof(latency_stats));
+    portEXIT_CRITICAL(&latency_lock);
+}
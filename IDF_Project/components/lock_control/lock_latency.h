@@ -0,0 +1,71 @@
+#ifndef LOCK_LATENCY_H
+#define LOCK_LATENCY_H
+
+#include <stdint.h>
+#include "button.h"
+
+#define LOCK_LATENCY_BUCKETS 14 // 桶 0 是不到 1ms，桶 i 是 [2^(i-1), 2^i) ms，最后一个桶放 4s 以上的
+
+/**
+ * @brief 按触发方式分开统计，双击、连按要等按键序列结束，和其它方式的延迟不在一个量级
+ */
+typedef enum
+{
+    LOCK_LATENCY_SINGLE_CLICK = 0, // 单击开门 / 关闭常开 / 解除锁定
+    LOCK_LATENCY_DOUBLE_CLICK,     // 双击常开
+    LOCK_LATENCY_MULTI_CLICK,      // 连按锁门
+    LOCK_LATENCY_LONG_PRESS,       // 锁定状态下长按解除锁定
+    LOCK_LATENCY_BLE,              // 蓝牙靠近开门，从 RSSI 达标算起
+    LOCK_LATENCY_REMOTE,           // 远程命令，从 MQTT 客户端收到命令算起
+    LOCK_LATENCY_KIND_COUNT,
+} lock_latency_kind_t;
+
+/**
+ * @brief 一个延迟分布，时间都是 us；蓝牙特性原样读出去，所以是 packed，多字节字段都是小端
+ */
+typedef struct __attribute__((packed))
+{
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t sum_us;
+    uint32_t buckets[LOCK_LATENCY_BUCKETS];
+} lock_latency_hist_t;
+
+_Static_assert(sizeof(lock_latency_hist_t) == 76, "lock_latency_hist_t must stay 76 bytes");
+
+/**
+ * @brief 一种触发方式的两段延迟：
+ * detect 是手指按下到按键事件判定出来（单击在第一次松开时就先行开门，不等双击窗口），
+ * actuate 是手指按下到控制线真的动作
+ */
+typedef struct __attribute__((packed))
+{
+    lock_latency_hist_t detect;
+    lock_latency_hist_t actuate;
+} lock_latency_stats_t;
+
+/**
+ * @brief 事件对应的统计类型，不统计的事件返回 LOCK_LATENCY_KIND_COUNT
+ */
+lock_latency_kind_t lock_latency_kind(button_event_t event);
+
+const char *lock_latency_kind_name(lock_latency_kind_t kind);
+
+/**
+ * @brief 记一次从输入到动作的延迟，时间都是 esp_timer_get_time() 的 us
+ *
+ * @param input_us 手指按下（或者蓝牙 RSSI 达标、收到远程命令）的时间
+ * @param event_us 按键事件判定出来、发给状态机的时间
+ * @param actuate_us 控制线动作的时间
+ */
+void lock_latency_record(lock_latency_kind_t kind, int64_t input_us, int64_t event_us, int64_t actuate_us);
+
+/**
+ * @brief 拷贝一份统计，可以在任意任务里调用；蓝牙的延迟特性就是读这个
+ */
+void lock_latency_get(lock_latency_kind_t kind, lock_latency_stats_t *stats);
+
+void lock_latency_reset(void);
+
+#endif // LOCK_LATENCY_H
@@ -0,0 +1,383 @@
+#include "lock_schedule.h"
+#include <string.h>
+#include <sys/time.h>
+#include "esp_log.h"
+#include "nvs_flash.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/timers.h"
+#include "button.h"
+
+#define LOCK_SCHEDULE_TAG "LOCK_SCHEDULE"
+
+#define SCHEDULE_MAX_BOUNDARIES (SCHEDULE_MAX_WINDOWS * 7 * 2) // 每个窗口每天最多一个开始一个结束
+#define SCHEDULE_TIMER_SLACK_MS 500                            // 晚一点点醒来，保证醒来时已经跨过边界
+#define SCHEDULE_BLE_HEADER_SIZE 7                             // u32 时间 + i16 时区 + u8 窗口数
+
+/*
+ * 计划预编译成一张按周内分钟排好序的分段表：从 boundaries[i] 开始到下一个边界之前，计划要求的动作都是 actions[i]，
+ * 最后一段绕回到下一周的第一个边界。相邻两段动作相同的边界在编译时就合并掉，所以每个边界都是一次真正的动作变化，
+ * 定时器只需要在下一个边界醒来一次。num_boundaries 为 0 表示整周都是 constant_action。
+ */
+static schedule_config_t schedule_config = {0};
+static uint16_t boundaries[SCHEDULE_MAX_BOUNDARIES];
+static uint8_t actions[SCHEDULE_MAX_BOUNDARIES];
+static uint16_t num_boundaries = 0;
+static uint8_t constant_action = SCHEDULE_ACTION_NONE;
+static portMUX_TYPE schedule_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static TimerHandle_t schedule_timer = NULL;
+static schedule_action_t last_notified_action = SCHEDULE_ACTION_NONE;
+
+/**
+ * @brief 窗口在一周内的持续分钟数，end <= start 表示跨过午夜
+ */
+static uint16_t window_length(const schedule_window_t *window)
+{
+    if (window->end_min > window->start_min)
+    {
+        return window->end_min - window->start_min;
+    }
+    return window->end_min + SCHEDULE_MINUTES_PER_DAY - window->start_min;
+}
+
+static bool window_contains(const schedule_window_t *window, uint16_t minute_of_week)
+{
+    uint16_t length = window_length(window);
+    for (int day = 0; day < 7; day++)
+    {
+        if (window->weekdays & (1 << day))
+        {
+            uint16_t start = day * SCHEDULE_MINUTES_PER_DAY + window->start_min;
+            uint16_t offset = (minute_of_week + SCHEDULE_MINUTES_PER_WEEK - start) % SCHEDULE_MINUTES_PER_WEEK;
+            if (offset < length)
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief 逐个窗口检查某一分钟的动作，只在编译分段表时用，锁定优先于常开
+ */
+static uint8_t action_at(const schedule_config_t *config, uint16_t minute_of_week)
+{
+    uint8_t action = SCHEDULE_ACTION_NONE;
+    for (int i = 0; i < config->num_windows; i++)
+    {
+        if (window_contains(&config->windows[i], minute_of_week))
+        {
+            if (config->windows[i].action == SCHEDULE_ACTION_LOCK)
+            {
+                return SCHEDULE_ACTION_LOCK;
+            }
+            action = config->windows[i].action;
+        }
+    }
+    return action;
+}
+
+static bool config_is_valid(const schedule_config_t *config)
+{
+    if (config->num_windows > SCHEDULE_MAX_WINDOWS)
+    {
+        return false;
+    }
+    for (int i = 0; i < config->num_windows; i++)
+    {
+        const schedule_window_t *window = &config->windows[i];
+        if ((window->action != SCHEDULE_ACTION_ALWAYS_OPEN && window->action != SCHEDULE_ACTION_LOCK) ||
+            (window->weekdays & 0x7F) == 0 || (window->weekdays & 0x80) ||
+            window->start_min >= SCHEDULE_MINUTES_PER_DAY || window->end_min >= SCHEDULE_MINUTES_PER_DAY)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief 把窗口列表编译成分段表，然后替换掉正在用的那一份
+ */
+static void compile_schedule(const schedule_config_t *config)
+{
+    uint16_t points[SCHEDULE_MAX_BOUNDARIES];
+    uint8_t point_actions[SCHEDULE_MAX_BOUNDARIES];
+    uint16_t count = 0;
+
+    // 收集所有窗口的开始和结束分钟，插入排序并去重，最多 112 个点
+    for (int i = 0; i < config->num_windows; i++)
+    {
+        const schedule_window_t *window = &config->windows[i];
+        for (int day = 0; day < 7; day++)
+        {
+            if (!(window->weekdays & (1 << day)))
+            {
+                continue;
+            }
+            uint16_t start = day * SCHEDULE_MINUTES_PER_DAY + window->start_min;
+            uint16_t edges[2] = {start, (start + window_length(window)) % SCHEDULE_MINUTES_PER_WEEK};
+            for (int e = 0; e < 2; e++)
+            {
+                int pos = count;
+                while (pos > 0 && points[pos - 1] > edges[e])
+                {
+                    pos--;
+                }
+                if (pos > 0 && points[pos - 1] == edges[e])
+                {
+                    continue;
+                }
+                memmove(&points[pos + 1], &points[pos], (count - pos) * sizeof(points[0]));
+                points[pos] = edges[e];
+                count++;
+            }
+        }
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        point_actions[i] = action_at(config, points[i]);
+    }
+
+    // 合并动作没有变化的边界（包括绕回周首的那一段）
+    uint16_t merged = 0;
+    for (int i = 0; i < count; i++)
+    {
+        uint8_t previous = point_actions[(i + count - 1) % count];
+        if (point_actions[i] != previous)
+        {
+            points[merged] = points[i];
+            point_actions[merged] = point_actions[i];
+            merged++;
+        }
+    }
+
+    portENTER_CRITICAL(&schedule_lock);
+    memcpy(boundaries, points, merged * sizeof(points[0]));
+    memcpy(actions, point_actions, merged);
+    num_boundaries = merged;
+    constant_action = count > 0 ? point_actions[0] : SCHEDULE_ACTION_NONE;
+    portEXIT_CRITICAL(&schedule_lock);
+
+    ESP_LOGI(LOCK_SCHEDULE_TAG, "Schedule compiled: %d windows, %d boundaries per week", config->num_windows, merged);
+}
+
+schedule_action_t lock_schedule_evaluate(time_t now, uint32_t *seconds_to_next)
+{
+    if (seconds_to_next != NULL)
+    {
+        *seconds_to_next = 0;
+    }
+    if (now < SCHEDULE_MIN_VALID_TIME)
+    {
+        return SCHEDULE_ACTION_NONE;
+    }
+
+    portENTER_CRITICAL(&schedule_lock);
+    int64_t local = (int64_t)now + schedule_config.tz_offset_min * 60;
+    uint32_t days = local / 86400;
+    uint32_t second_of_day = local % 86400;
+    uint16_t minute_of_week = ((days + 4) % 7) * SCHEDULE_MINUTES_PER_DAY + second_of_day / 60; // 1970-01-01 是周四
+
+    schedule_action_t action = constant_action;
+    if (num_boundaries > 0)
+    {
+        // 找到第一个大于当前分钟的边界，当前所在的是它前面那一段
+        uint16_t low = 0;
+        uint16_t high = num_boundaries;
+        while (low < high)
+        {
+            uint16_t mid = (low + high) / 2;
+            if (boundaries[mid] <= minute_of_week)
+            {
+                low = mid + 1;
+            }
+            else
+            {
+                high = mid;
+            }
+        }
+        action = actions[(low + num_boundaries - 1) % num_boundaries];
+
+        uint32_t next = low < num_boundaries ? boundaries[low] : boundaries[0] + SCHEDULE_MINUTES_PER_WEEK;
+        if (seconds_to_next != NULL)
+        {
+            *seconds_to_next = (next - minute_of_week) * 60 - second_of_day % 60;
+        }
+    }
+    portEXIT_CRITICAL(&schedule_lock);
+
+    return action;
+}
+
+schedule_action_t lock_schedule_current_action(void)
+{
+    return lock_schedule_evaluate(time(NULL), NULL);
+}
+
+/**
+ * @brief 重新计算下一个边界并启动定时器，动作变了就通知状态机
+ *
+ * 没对时或者计划没有边界时定时器保持停止，不会有任何唤醒
+ *
+ * @param force_notify 动作没变也通知状态机，换了计划之后用
+ */
+static void schedule_rearm(bool force_notify)
+{
+    uint32_t seconds_to_next = 0;
+    schedule_action_t action = lock_schedule_evaluate(time(NULL), &seconds_to_next);
+
+    if (seconds_to_next > 0)
+    {
+        xTimerChangePeriod(schedule_timer, pdMS_TO_TICKS(seconds_to_next * 1000 + SCHEDULE_TIMER_SLACK_MS), 0);
+        ESP_LOGI(LOCK_SCHEDULE_TAG, "Next schedule boundary in %lu s", (unsigned long)seconds_to_next);
+    }
+    else
+    {
+        xTimerStop(schedule_timer, 0);
+    }
+
+    if (force_notify || action != last_notified_action)
+    {
+        last_notified_action = action;
+        send_button_event(SCHEDULE_EVENT_UPDATE);
+    }
+}
+
+static void schedule_timer_callback(TimerHandle_t timer)
+{
+    schedule_rearm(false);
+}
+
+static esp_err_t load_schedule_from_nvs(schedule_config_t *config)
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(SCHEDULE_NVS_NAMESPACE, NVS_READONLY, &nvs_handle);
+    if (err == ESP_OK)
+    {
+        size_t required_size = sizeof(schedule_config_t);
+        err = nvs_get_blob(nvs_handle, SCHEDULE_NVS_KEY, config, &required_size);
+        nvs_close(nvs_handle);
+    }
+
+    if (err == ESP_ERR_NVS_NOT_FOUND)
+    {
+        ESP_LOGI(LOCK_SCHEDULE_TAG, "No schedule in NVS");
+        memset(config, 0, sizeof(schedule_config_t));
+        return ESP_OK;
+    }
+    else if (err != ESP_OK)
+    {
+        ESP_LOGE(LOCK_SCHEDULE_TAG, "Failed to load schedule from NVS: %s", esp_err_to_name(err));
+    }
+    else if (!config_is_valid(config))
+    {
+        ESP_LOGE(LOCK_SCHEDULE_TAG, "Schedule in NVS is corrupted, ignoring it");
+        memset(config, 0, sizeof(schedule_config_t));
+        err = ESP_ERR_INVALID_STATE;
+    }
+    return err;
+}
+
+static esp_err_t save_schedule_to_nvs(const schedule_config_t *config)
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(SCHEDULE_NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(LOCK_SCHEDULE_TAG, "Failed to open NVS: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    err = nvs_set_blob(nvs_handle, SCHEDULE_NVS_KEY, config, sizeof(schedule_config_t));
+    if (err == ESP_OK)
+    {
+        err = nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(LOCK_SCHEDULE_TAG, "Failed to save schedule to NVS: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+esp_err_t lock_schedule_init(void)
+{
+    schedule_config_t config;
+    esp_err_t err = load_schedule_from_nvs(&config);
+
+    schedule_config = config;
+    compile_schedule(&schedule_config);
+
+    schedule_timer = xTimerCreate("ScheduleTimer", pdMS_TO_TICKS(1000), pdFALSE, NULL, schedule_timer_callback);
+    if (schedule_timer == NULL)
+    {
+        ESP_LOGE(LOCK_SCHEDULE_TAG, "Failed to create schedule timer");
+        return ESP_ERR_NO_MEM;
+    }
+    schedule_rearm(false); // 上电时已经在窗口里的话马上通知状态机
+    return err;
+}
+
+esp_err_t lock_schedule_set(const schedule_config_t *config)
+{
+    if (!config_is_valid(config))
+    {
+        ESP_LOGE(LOCK_SCHEDULE_TAG, "Rejecting invalid schedule");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t err = save_schedule_to_nvs(config);
+
+    // 存不进 NVS 也先按新计划执行，只是重启之后会丢
+    portENTER_CRITICAL(&schedule_lock);
+    schedule_config = *config;
+    memset(&schedule_config.windows[config->num_windows], 0, (SCHEDULE_MAX_WINDOWS - config->num_windows) * sizeof(schedule_window_t));
+    portEXIT_CRITICAL(&schedule_lock);
+    compile_schedule(&schedule_config);
+
+    if (schedule_timer != NULL)
+    {
+        schedule_rearm(true);
+    }
+    return err;
+}
+
+esp_err_t lock_schedule_set_from_ble(const uint8_t *data, size_t len)
+{
+    if (len < SCHEDULE_BLE_HEADER_SIZE)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    uint32_t unix_time;
+    schedule_config_t config = {0};
+    memcpy(&unix_time, data, sizeof(unix_time));
+    memcpy(&config.tz_offset_min, data + 4, sizeof(config.tz_offset_min));
+    config.num_windows = data[6];
+    if (config.num_windows > SCHEDULE_MAX_WINDOWS || len != SCHEDULE_BLE_HEADER_SIZE + config.num_windows * sizeof(schedule_window_t))
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(config.windows, data + SCHEDULE_BLE_HEADER_SIZE, config.num_windows * sizeof(schedule_window_t));
+
+    if (unix_time != 0)
+    {
+        struct timeval tv = {.tv_sec = unix_time, .tv_usec = 0};
+        settimeofday(&tv, NULL);
+        ESP_LOGI(LOCK_SCHEDULE_TAG, "Clock set to %lu", (unsigned long)unix_time);
+    }
+    return lock_schedule_set(&config);
+}
+
+void lock_schedule_get(schedule_config_t *config)
+{
+    portENTER_CRITICAL(&schedule_lock);
+    *config = schedule_config;
+    portEXIT_CRITICAL(&schedule_lock);
+}
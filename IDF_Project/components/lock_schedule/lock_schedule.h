@@ -0,0 +1,86 @@
+#ifndef LOCK_SCHEDULE_H
+#define LOCK_SCHEDULE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include "esp_err.h"
+
+#define SCHEDULE_MAX_WINDOWS 8                    // 最多保存的时间窗口数
+#define SCHEDULE_MINUTES_PER_DAY (24 * 60)
+#define SCHEDULE_MINUTES_PER_WEEK (7 * 24 * 60)   // 一周按分钟编号，0 是周日 00:00
+#define SCHEDULE_MIN_VALID_TIME 1704067200        // 2024-01-01，早于这个时间说明还没对时，计划不生效
+#define SCHEDULE_NVS_NAMESPACE "storage"          // 和白名单放在同一个命名空间
+#define SCHEDULE_NVS_KEY "schedule"
+
+typedef enum
+{
+    SCHEDULE_ACTION_NONE = 0,    // 不在任何窗口里，门锁由按键和蓝牙控制
+    SCHEDULE_ACTION_ALWAYS_OPEN, // 窗口内保持常开
+    SCHEDULE_ACTION_LOCK,        // 窗口内保持锁定，和常开窗口重叠时锁定优先
+} schedule_action_t;
+
+/**
+ * @brief 一个每周重复的时间窗口，固定 6 字节，NVS 和 BLE 里都是这个格式
+ *
+ * end_min <= start_min 表示跨过午夜，比如 23:00 - 07:00 写成 start 1380, end 420，
+ * 从 weekdays 里勾选的那天 23:00 开始，到第二天 07:00 结束；start == end 表示整天
+ */
+typedef struct __attribute__((packed))
+{
+    uint8_t action;     // schedule_action_t
+    uint8_t weekdays;   // bit0 = 周日 ... bit6 = 周六，和 struct tm 的 tm_wday 一致
+    uint16_t start_min; // 当天 00:00 起的分钟数，0 - 1439
+    uint16_t end_min;   // 同上
+} schedule_window_t;
+
+_Static_assert(sizeof(schedule_window_t) == 6, "schedule_window_t must stay 6 bytes");
+
+/**
+ * @brief 保存在 NVS 里的完整计划
+ */
+typedef struct __attribute__((packed))
+{
+    int16_t tz_offset_min; // 本地时间相对 UTC 的分钟数，东八区是 480
+    uint8_t num_windows;
+    schedule_window_t windows[SCHEDULE_MAX_WINDOWS];
+} schedule_config_t;
+
+/**
+ * @brief 从 NVS 读出计划并编译，对过时之后启动边界定时器，要在 lock_control_init 之后调用
+ */
+esp_err_t lock_schedule_init(void);
+
+/**
+ * @brief 检查并保存新的计划，重新编译后马上通知状态机按新计划执行
+ *
+ * @return 窗口参数不合法返回 ESP_ERR_INVALID_ARG，此时旧计划保持不变
+ */
+esp_err_t lock_schedule_set(const schedule_config_t *config);
+
+/**
+ * @brief 处理 BLE 写入的计划：[u32 当前 UNIX 时间][i16 时区分钟][u8 窗口数][窗口 * n]
+ *
+ * 手机写计划的同时把时钟也对上，UNIX 时间写 0 表示只改计划不对时
+ */
+esp_err_t lock_schedule_set_from_ble(const uint8_t *data, size_t len);
+
+/**
+ * @brief 取出当前计划，BLE 读特性用
+ */
+void lock_schedule_get(schedule_config_t *config);
+
+/**
+ * @brief 按当前时间算出计划要求的动作，没对时或者没有计划时返回 SCHEDULE_ACTION_NONE
+ */
+schedule_action_t lock_schedule_current_action(void);
+
+/**
+ * @brief 计算 now 时刻计划要求的动作，以及下一个窗口边界距离 now 的秒数（没有边界时为 0）
+ *
+ * 不依赖定时器和 NVS，仿真和单元测试直接调用
+ */
+schedule_action_t lock_schedule_evaluate(time_t now, uint32_t *seconds_to_next);
+
+#endif // LOCK_SCHEDULE_H
@@ -0,0 +1,535 @@
+/**
+ * @file offline_queue.c
+ * @brief 离线队列：MQTT 断线时要发的消息先存进 flash 里的环形日志，重连之后按顺序限速补发，收到 PUBACK 才删
+ *
+ * 分区按 OFFLINE_QUEUE_SLOT_SIZE 切成槽，序号为 seq 的消息固定放在 seq % 槽数 的槽里，
+ * 所以 [tail_seq, next_seq) 就是还没送到的消息，上电时扫一遍槽头就能恢复。
+ * 和审计日志一样，写到一个扇区的开头时才擦除这个扇区，分区写满一圈时覆盖最老的一个扇区。
+ *
+ * 调用方只往 RAM 里的几个槽拷贝，擦写 flash 和补发都在优先级很低的后台任务里做，
+ * 状态机、蓝牙和遥测任务都不会等 flash 或者网络。
+ */
+#include <stddef.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "offline_queue.h"
+
+#define OFFLINE_QUEUE_TAG "OFFLINE_QUEUE"
+
+#define OFFLINE_SEQ_EMPTY 0xFFFFFFFF // flash 擦除后的值
+#define OFFLINE_ACKED 0x00
+
+typedef enum
+{
+    INFLIGHT_SENT = 0, // 等 PUBACK
+    INFLIGHT_ACKED,    // PUBACK 到了，还没在 flash 里标记
+    INFLIGHT_DONE,     // flash 里已经标记（或者这个槽本来就是坏的），等前面的都完成之后出队
+} inflight_state_t;
+
+static const esp_partition_t *queue_partition = NULL;
+static portMUX_TYPE queue_lock = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t queue_task_handle = NULL;
+static offline_queue_send_t queue_sender = NULL;
+
+// 调用方拷进来、还没写进 flash 的消息，头里的 seq 和 crc 由后台任务填
+static uint8_t ram_slots[OFFLINE_QUEUE_RAM_MESSAGES][OFFLINE_QUEUE_SLOT_SIZE];
+static uint8_t ram_head = 0;
+static uint8_t ram_count = 0;
+
+static uint32_t next_seq = 0; // 下一条消息的序号
+static uint32_t tail_seq = 0; // 最老的还没送到的消息
+static uint32_t send_seq = 0; // 下一条要补发的消息，只有后台任务用
+
+// 发出去还没完成的消息，按 seq 排列，第一条总是 tail_seq；mqtt 任务收到 PUBACK 时也会改
+static struct
+{
+    uint32_t seq;
+    int msg_id;
+    inflight_state_t state;
+    int64_t sent_us; // 交给 MQTT 客户端的时间，OFFLINE_QUEUE_ACK_TIMEOUT_MS 之后还是 INFLIGHT_SENT 就算过期
+} inflight[OFFLINE_QUEUE_INFLIGHT];
+static uint8_t inflight_count = 0;
+
+static bool link_up = false;
+static uint32_t link_generation = 0; // 每次连上或者断开都加一，后台任务据此重发还没确认的消息
+static int64_t last_send_us = 0;
+static offline_queue_stats_t stats;
+
+static uint8_t slot_buf[OFFLINE_QUEUE_SLOT_SIZE]; // 只有后台任务用
+
+static uint32_t slot_count(void)
+{
+    return queue_partition->size / OFFLINE_QUEUE_SLOT_SIZE;
+}
+
+static uint32_t slots_per_sector(void)
+{
+    return queue_partition->erase_size / OFFLINE_QUEUE_SLOT_SIZE;
+}
+
+static uint32_t slot_offset(uint32_t seq)
+{
+    return (seq % slot_count()) * OFFLINE_QUEUE_SLOT_SIZE;
+}
+
+static uint32_t slot_crc(const offline_queue_header_t *header, const uint8_t *payload)
+{
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *)header, offsetof(offline_queue_header_t, acked));
+    return esp_rom_crc32_le(crc, payload, header->len);
+}
+
+/**
+ * @brief 把序号为 seq 的消息读进 slot_buf
+ *
+ * @return false 表示槽里不是这条消息，或者是断电时写了一半的
+ */
+static bool read_slot(uint32_t seq)
+{
+    offline_queue_header_t *header = (offline_queue_header_t *)slot_buf;
+    uint32_t offset = slot_offset(seq);
+    if (esp_partition_read(queue_partition, offset, header, sizeof(*header)) != ESP_OK || header->seq != seq ||
+        header->len > OFFLINE_QUEUE_MAX_PAYLOAD)
+    {
+        return false;
+    }
+    if (esp_partition_read(queue_partition, offset + sizeof(*header), slot_buf + sizeof(*header), header->len) != ESP_OK)
+    {
+        return false;
+    }
+    return header->crc == slot_crc(header, slot_buf + sizeof(*header));
+}
+
+/**
+ * @brief 上电时找到最新的消息接着编号，再从一圈以内最老的开始找第一条还没送到的
+ */
+static void recover_queue(void)
+{
+    const offline_queue_header_t *header = (const offline_queue_header_t *)slot_buf;
+    bool found = false;
+    uint32_t newest_seq = 0;
+
+    for (uint32_t slot = 0; slot < slot_count(); slot++)
+    {
+        uint32_t seq;
+        if (esp_partition_read(queue_partition, slot * OFFLINE_QUEUE_SLOT_SIZE, &seq, sizeof(seq)) != ESP_OK ||
+            seq == OFFLINE_SEQ_EMPTY || seq % slot_count() != slot || !read_slot(seq))
+        {
+            continue;
+        }
+        if (!found || seq > newest_seq)
+        {
+            found = true;
+            newest_seq = seq;
+        }
+    }
+
+    next_seq = found ? newest_seq + 1 : 0;
+    tail_seq = next_seq;
+    for (uint32_t seq = next_seq > slot_count() ? next_seq - slot_count() : 0; seq < next_seq; seq++)
+    {
+        if (read_slot(seq) && header->acked != OFFLINE_ACKED)
+        {
+            tail_seq = seq;
+            break;
+        }
+    }
+    send_seq = tail_seq;
+}
+
+/**
+ * @brief 擦掉 next_seq 所在的扇区之前，上一圈留在这个扇区里还没送到的消息都算丢掉
+ */
+static void drop_overwritten_sector(void)
+{
+    if (next_seq < slot_count())
+    {
+        return;
+    }
+    uint32_t lap_end = next_seq - slot_count() + slots_per_sector();
+    if (tail_seq >= lap_end)
+    {
+        return;
+    }
+    ESP_LOGW(OFFLINE_QUEUE_TAG, "Queue full, dropping %lu undelivered messages", (unsigned long)(lap_end - tail_seq));
+    portENTER_CRITICAL(&queue_lock);
+    stats.dropped += lap_end - tail_seq;
+    tail_seq = lap_end;
+    inflight_count = 0; // 它们的 PUBACK 不用再等了
+    portEXIT_CRITICAL(&queue_lock);
+    send_seq = MAX(send_seq, tail_seq);
+}
+
+/**
+ * @brief 把 RAM 里最老的一条消息写进 flash
+ *
+ * @return false 表示扇区擦不掉，消息还留在 RAM 里，隔 OFFLINE_QUEUE_RETRY_MS 再试
+ */
+static bool write_pending(void)
+{
+    offline_queue_header_t *header = (offline_queue_header_t *)slot_buf;
+
+    portENTER_CRITICAL(&queue_lock);
+    memcpy(slot_buf, ram_slots[ram_head], OFFLINE_QUEUE_SLOT_SIZE);
+    portEXIT_CRITICAL(&queue_lock);
+
+    while (1)
+    {
+        uint32_t offset = slot_offset(next_seq);
+        if (offset % queue_partition->erase_size == 0)
+        {
+            drop_overwritten_sector();
+            if (esp_partition_erase_range(queue_partition, offset, queue_partition->erase_size) != ESP_OK)
+            {
+                ESP_LOGE(OFFLINE_QUEUE_TAG, "Failed to erase sector at 0x%lx", (unsigned long)offset);
+                return false; // 消息还留在 RAM 里，下次再试
+            }
+            break;
+        }
+        uint32_t seq;
+        if (esp_partition_read(queue_partition, offset, &seq, sizeof(seq)) == ESP_OK && seq == OFFLINE_SEQ_EMPTY)
+        {
+            break;
+        }
+        // 断电时写了一半的槽既不是空的也不能再写，只能跳到下一个扇区重新开始
+        ESP_LOGW(OFFLINE_QUEUE_TAG, "Slot at 0x%lx is not empty, skipping to the next sector", (unsigned long)offset);
+        portENTER_CRITICAL(&queue_lock);
+        bool empty = tail_seq == next_seq;
+        next_seq = (next_seq / slots_per_sector() + 1) * slots_per_sector();
+        if (empty)
+        {
+            tail_seq = next_seq; // 跳过的序号没有消息，不用等它们
+        }
+        portEXIT_CRITICAL(&queue_lock);
+        send_seq = MAX(send_seq, tail_seq);
+    }
+
+    header->seq = next_seq;
+    header->acked = 0xFF;
+    header->crc = slot_crc(header, slot_buf + sizeof(*header));
+    esp_err_t err = esp_partition_write(queue_partition, slot_offset(next_seq), slot_buf, sizeof(*header) + header->len);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(OFFLINE_QUEUE_TAG, "Failed to write message %lu: %s", (unsigned long)next_seq, esp_err_to_name(err));
+    }
+
+    portENTER_CRITICAL(&queue_lock);
+    ram_head = (ram_head + 1) % OFFLINE_QUEUE_RAM_MESSAGES;
+    ram_count--;
+    next_seq++; // 写失败的槽也占掉这个序号，补发时读不出来会直接跳过
+    stats.stored += err == ESP_OK;
+    portEXIT_CRITICAL(&queue_lock);
+    return true;
+}
+
+/**
+ * @brief 收到 PUBACK 的消息在 flash 里标记成已送到，再把前面都完成了的消息出队
+ */
+static void retire_acked(void)
+{
+    static const uint8_t acked = OFFLINE_ACKED;
+
+    for (uint8_t i = 0; i < OFFLINE_QUEUE_INFLIGHT; i++)
+    {
+        portENTER_CRITICAL(&queue_lock);
+        bool mark = i < inflight_count && inflight[i].state == INFLIGHT_ACKED;
+        uint32_t seq = mark ? inflight[i].seq : 0;
+        portEXIT_CRITICAL(&queue_lock);
+        if (!mark)
+        {
+            continue;
+        }
+
+        // 只改 acked 这一个字节，0xFF 改成 0x00 不用擦除；槽已经被新消息覆盖的话就不动
+        uint32_t slot_seq;
+        uint32_t offset = slot_offset(seq);
+        if (esp_partition_read(queue_partition, offset, &slot_seq, sizeof(slot_seq)) == ESP_OK && slot_seq == seq)
+        {
+            esp_partition_write(queue_partition, offset + offsetof(offline_queue_header_t, acked), &acked, sizeof(acked));
+        }
+
+        portENTER_CRITICAL(&queue_lock);
+        if (i < inflight_count && inflight[i].seq == seq)
+        {
+            inflight[i].state = INFLIGHT_DONE;
+            stats.acked++;
+        }
+        portEXIT_CRITICAL(&queue_lock);
+    }
+
+    portENTER_CRITICAL(&queue_lock);
+    while (inflight_count > 0 && inflight[0].state == INFLIGHT_DONE)
+    {
+        tail_seq = inflight[0].seq + 1;
+        memmove(&inflight[0], &inflight[1], (inflight_count - 1) * sizeof(inflight[0]));
+        inflight_count--;
+    }
+    portEXIT_CRITICAL(&queue_lock);
+}
+
+/**
+ * @brief 连着的时候每个间隔补发一条，读不出来的槽和已经送到的消息直接跳过，不占间隔
+ */
+static void drain_step(void)
+{
+    const offline_queue_header_t *header = (const offline_queue_header_t *)slot_buf;
+    int64_t now_us = esp_timer_get_time();
+
+    if (!link_up || queue_sender == NULL || now_us - last_send_us < OFFLINE_QUEUE_DRAIN_INTERVAL_MS * 1000LL)
+    {
+        return;
+    }
+    while (inflight_count < OFFLINE_QUEUE_INFLIGHT && send_seq < next_seq)
+    {
+        // 从 tail_seq 重发时，后面已经收到 PUBACK、在 flash 里标记过的消息不用再发
+        bool valid = read_slot(send_seq) && header->acked != OFFLINE_ACKED;
+        int msg_id = -1;
+        if (valid)
+        {
+            msg_id = queue_sender(header->topic, slot_buf + sizeof(*header), header->len);
+            if (msg_id < 0)
+            {
+                last_send_us = now_us; // 发送队列满了或者刚断开，等下一个间隔
+                return;
+            }
+        }
+
+        portENTER_CRITICAL(&queue_lock);
+        inflight[inflight_count].seq = send_seq;
+        inflight[inflight_count].msg_id = msg_id;
+        // 坏槽和已经送到的直接算完成；msg_id 为 0 说明是 QoS 0 发出去的，不会有 PUBACK
+        inflight[inflight_count].state = !valid ? INFLIGHT_DONE : msg_id == 0 ? INFLIGHT_ACKED : INFLIGHT_SENT;
+        inflight[inflight_count].sent_us = now_us;
+        inflight_count++;
+        stats.sent += valid;
+        portEXIT_CRITICAL(&queue_lock);
+        send_seq++;
+
+        if (valid)
+        {
+            last_send_us = now_us;
+            break;
+        }
+    }
+    retire_acked();
+}
+
+/**
+ * @brief 最早发出去、还在等 PUBACK 的消息什么时候过期，没有在等的返回 -1
+ */
+static int64_t ack_deadline_us(void)
+{
+    int64_t deadline_us = -1;
+    portENTER_CRITICAL(&queue_lock);
+    for (uint8_t i = 0; i < inflight_count; i++)
+    {
+        if (inflight[i].state == INFLIGHT_SENT)
+        {
+            deadline_us = inflight[i].sent_us + OFFLINE_QUEUE_ACK_TIMEOUT_MS * 1000LL;
+            break; // 按 seq 排列，发送时间也是递增的
+        }
+    }
+    portEXIT_CRITICAL(&queue_lock);
+    return deadline_us;
+}
+
+/**
+ * @brief ESP-MQTT 的 QoS 1 消息在发送队列里过期时悄悄丢掉，不会有 MQTT_EVENT_PUBLISHED，
+ * 连着的时候等不到 PUBACK 的窗口永远不会空出来；过了期限就和重连一样，从最老的一条开始重发
+ */
+static void expire_inflight(void)
+{
+    int64_t deadline_us = ack_deadline_us();
+    if (!link_up || deadline_us < 0 || esp_timer_get_time() < deadline_us)
+    {
+        return;
+    }
+    ESP_LOGW(OFFLINE_QUEUE_TAG, "No PUBACK within %d ms, resending from message %lu", OFFLINE_QUEUE_ACK_TIMEOUT_MS, (unsigned long)tail_seq);
+    portENTER_CRITICAL(&queue_lock);
+    inflight_count = 0; // 过期消息的 PUBACK 不会再来了，晚到的也对不上新的 msg_id
+    portEXIT_CRITICAL(&queue_lock);
+    send_seq = tail_seq;
+    last_send_us = 0;
+}
+
+/**
+ * @brief 向上取整到 tick，不足一个 tick 时按 0 等会在任务里空转到下一个 tick
+ */
+static TickType_t ticks_until(int64_t deadline_us)
+{
+    int64_t wait_us = deadline_us - esp_timer_get_time();
+    return wait_us > 0 ? (TickType_t)((wait_us + portTICK_PERIOD_MS * 1000 - 1) / (portTICK_PERIOD_MS * 1000)) : 0;
+}
+
+/**
+ * @brief 下次什么时候该补发：还有消息、窗口没满、连着的时候等到下一个间隔，否则一直睡到有新消息或者 PUBACK
+ */
+static TickType_t drain_wakeup(void)
+{
+    if (!link_up || queue_sender == NULL || send_seq >= next_seq || inflight_count >= OFFLINE_QUEUE_INFLIGHT)
+    {
+        return portMAX_DELAY;
+    }
+    return ticks_until(last_send_us + OFFLINE_QUEUE_DRAIN_INTERVAL_MS * 1000LL);
+}
+
+/**
+ * @brief 任务睡多久：RAM 里还有没写进 flash 的消息（擦除失败了）时最多睡 OFFLINE_QUEUE_RETRY_MS，
+ * 连着并且有消息在等 PUBACK 时最晚在它过期的时候醒
+ */
+static TickType_t next_wakeup(void)
+{
+    TickType_t wait = drain_wakeup();
+    int64_t deadline_us = ack_deadline_us();
+    if (link_up && deadline_us >= 0)
+    {
+        wait = MIN(wait, ticks_until(deadline_us));
+    }
+    return ram_count > 0 ? MIN(wait, pdMS_TO_TICKS(OFFLINE_QUEUE_RETRY_MS)) : wait;
+}
+
+static void offline_queue_task(void *arg)
+{
+    uint32_t seen_generation = 0;
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, next_wakeup());
+
+        while (ram_count > 0)
+        {
+            if (!write_pending())
+            {
+                break; // 擦不掉的扇区不在这里空转，隔一段时间再试
+            }
+        }
+
+        // 断开过的话，还没确认的消息从最老的一条开始重发；ESP-MQTT 自己也可能重发，接收端按遥测序号去重
+        portENTER_CRITICAL(&queue_lock);
+        bool relink = seen_generation != link_generation;
+        seen_generation = link_generation;
+        if (relink)
+        {
+            inflight_count = 0;
+        }
+        portEXIT_CRITICAL(&queue_lock);
+        if (relink)
+        {
+            send_seq = tail_seq;
+            last_send_us = 0;
+        }
+
+        retire_acked();
+        expire_inflight();
+        drain_step();
+    }
+}
+
+esp_err_t offline_queue_init(void)
+{
+    queue_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, OFFLINE_QUEUE_PARTITION_SUBTYPE, OFFLINE_QUEUE_PARTITION_LABEL);
+    if (queue_partition == NULL)
+    {
+        ESP_LOGE(OFFLINE_QUEUE_TAG, "Partition '%s' not found, messages will not be kept while offline", OFFLINE_QUEUE_PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    recover_queue();
+    ESP_LOGI(OFFLINE_QUEUE_TAG, "%lu undelivered messages, next seq %lu", (unsigned long)(next_seq - tail_seq), (unsigned long)next_seq);
+
+    if (xTaskCreate(offline_queue_task, "offline_queue", 2560, NULL, OFFLINE_QUEUE_TASK_PRIORITY, &queue_task_handle) != pdPASS)
+    {
+        ESP_LOGE(OFFLINE_QUEUE_TAG, "Failed to create offline queue task");
+        queue_partition = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void offline_queue_set_sender(offline_queue_send_t send)
+{
+    queue_sender = send;
+}
+
+esp_err_t offline_queue_push(uint8_t topic, const uint8_t *payload, size_t len)
+{
+    if (queue_task_handle == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (len > OFFLINE_QUEUE_MAX_PAYLOAD)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    portENTER_CRITICAL(&queue_lock);
+    if (ram_count == OFFLINE_QUEUE_RAM_MESSAGES)
+    {
+        portEXIT_CRITICAL(&queue_lock);
+        return ESP_ERR_NO_MEM;
+    }
+    uint8_t *slot = ram_slots[(ram_head + ram_count) % OFFLINE_QUEUE_RAM_MESSAGES];
+    offline_queue_header_t *header = (offline_queue_header_t *)slot;
+    header->len = len;
+    header->topic = topic;
+    memcpy(slot + sizeof(*header), payload, len);
+    ram_count++;
+    portEXIT_CRITICAL(&queue_lock);
+
+    xTaskNotifyGive(queue_task_handle);
+    return ESP_OK;
+}
+
+void offline_queue_set_connected(bool connected)
+{
+    portENTER_CRITICAL(&queue_lock);
+    link_up = connected;
+    link_generation++;
+    portEXIT_CRITICAL(&queue_lock);
+
+    if (queue_task_handle != NULL)
+    {
+        xTaskNotifyGive(queue_task_handle);
+    }
+}
+
+void offline_queue_acked(int msg_id)
+{
+    bool found = false;
+    portENTER_CRITICAL(&queue_lock);
+    for (uint8_t i = 0; i < inflight_count; i++)
+    {
+        if (inflight[i].state == INFLIGHT_SENT && inflight[i].msg_id == msg_id)
+        {
+            inflight[i].state = INFLIGHT_ACKED;
+            found = true;
+        }
+    }
+    portEXIT_CRITICAL(&queue_lock);
+
+    if (found)
+    {
+        xTaskNotifyGive(queue_task_handle);
+    }
+}
+
+bool offline_queue_has_pending(void)
+{
+    portENTER_CRITICAL(&queue_lock);
+    bool pending = ram_count > 0 || tail_seq != next_seq;
+    portEXIT_CRITICAL(&queue_lock);
+    return pending;
+}
+
+void offline_queue_get_stats(offline_queue_stats_t *out)
+{
+    portENTER_CRITICAL(&queue_lock);
+    *out = stats;
+    out->pending = ram_count + (next_seq - tail_seq);
+    portEXIT_CRITICAL(&queue_lock);
+}
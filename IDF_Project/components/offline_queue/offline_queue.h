@@ -0,0 +1,90 @@
+#ifndef OFFLINE_QUEUE_H
+#define OFFLINE_QUEUE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define OFFLINE_QUEUE_PARTITION_LABEL "outbox" // partitions.csv 里离线队列分区的名字
+#define OFFLINE_QUEUE_PARTITION_SUBTYPE 0x9a   // 自定义 data 分区子类型，审计日志是 0x99
+#define OFFLINE_QUEUE_SLOT_SIZE 512            // 每条消息占一个固定大小的槽，一个扇区 8 条
+#define OFFLINE_QUEUE_RAM_MESSAGES 4           // 等着写 flash 的消息，满了 offline_queue_push 直接返回错误
+#define OFFLINE_QUEUE_INFLIGHT 4               // 发出去还没等到 PUBACK 的消息最多这么多条
+#define OFFLINE_QUEUE_DRAIN_INTERVAL_MS 200    // 重连之后每隔这么久才补发一条，不和新消息抢链路
+#define OFFLINE_QUEUE_ACK_TIMEOUT_MS 30000     // 和 ESP-MQTT 发送队列默认的过期时间一样，发出去这么久还没 PUBACK 就从 tail_seq 开始重发
+#define OFFLINE_QUEUE_TASK_PRIORITY 2          // 和审计日志写 flash 的任务一样，比状态机、蓝牙和灯效都低
+#define OFFLINE_QUEUE_RETRY_MS 5000            // 擦除失败时消息留在 RAM 里，隔这么久再试，和审计日志的写入间隔一样
+
+/**
+ * @brief flash 里每个槽开头的头，后面紧跟 len 字节负载
+ *
+ * flash 擦除后全是 0xFF，所以 seq == 0xFFFFFFFF 表示空槽；
+ * 收到 PUBACK 之后只把 acked 从 0xFF 写成 0x00，不用擦除
+ */
+typedef struct __attribute__((packed))
+{
+    uint32_t seq;   // 单调递增的序号，重启后接着上次的编号，所在的槽是 seq % 槽数
+    uint16_t len;   // 负载字节数
+    uint8_t topic;  // 由调用方定义，发送时原样交给 offline_queue_send_t
+    uint8_t acked;  // 0xFF 还没送到，0x00 已经送到
+    uint32_t crc;   // seq、len、topic 和负载的 CRC32，断电时写了一半的槽对不上
+} offline_queue_header_t;
+
+_Static_assert(sizeof(offline_queue_header_t) == 12, "offline_queue_header_t must stay 12 bytes");
+
+#define OFFLINE_QUEUE_MAX_PAYLOAD (OFFLINE_QUEUE_SLOT_SIZE - sizeof(offline_queue_header_t))
+
+/**
+ * @brief 补发一条存下来的消息，在离线队列的任务里调用，不能阻塞
+ *
+ * @return 发出去的 QoS 1 消息的 msg_id，之后用 offline_queue_acked 确认；-1 表示现在发不了，等下次再试
+ */
+typedef int (*offline_queue_send_t)(uint8_t topic, const uint8_t *payload, size_t len);
+
+typedef struct
+{
+    uint32_t stored;  // 开机以来写进 flash 的消息数
+    uint32_t sent;    // 开机以来补发的次数（断线重发的也算）
+    uint32_t acked;   // 开机以来收到 PUBACK 删掉的消息数
+    uint32_t dropped; // 开机以来因为分区写满了被覆盖的还没送到的消息数
+    uint32_t pending; // 现在还没送到的消息数，包括还在 RAM 里等写 flash 的
+} offline_queue_stats_t;
+
+/**
+ * @brief 找到离线队列分区，恢复上次没送到的消息，启动后台任务
+ *
+ * 找不到分区时返回 ESP_ERR_NOT_FOUND，此后 offline_queue_push 一直返回错误
+ */
+esp_err_t offline_queue_init(void);
+
+/**
+ * @brief 设置补发消息的函数，NULL 表示只存不发
+ */
+void offline_queue_set_sender(offline_queue_send_t send);
+
+/**
+ * @brief 存一条消息，只拷贝到 RAM 里交给后台任务写 flash，不等 flash 也不等网络
+ *
+ * @return ESP_ERR_INVALID_SIZE 负载太长，ESP_ERR_NO_MEM 后台任务还没写完前面的消息，ESP_ERR_INVALID_STATE 没有分区
+ */
+esp_err_t offline_queue_push(uint8_t topic, const uint8_t *payload, size_t len);
+
+/**
+ * @brief MQTT 连上 / 断开时调用；连上之后按顺序限速补发，断开时还没确认的消息下次连上重发
+ */
+void offline_queue_set_connected(bool connected);
+
+/**
+ * @brief MQTT_EVENT_PUBLISHED 里调用，msg_id 是补发的消息时从 flash 里删掉
+ */
+void offline_queue_acked(int msg_id);
+
+/**
+ * @brief 还有没送到的消息时，新消息也要排到队尾，不然会比存下来的旧消息先到
+ */
+bool offline_queue_has_pending(void);
+
+void offline_queue_get_stats(offline_queue_stats_t *stats);
+
+#endif // OFFLINE_QUEUE_H
@@ -0,0 +1,260 @@
+/**
+ * @file telemetry.c
+ * @brief 遥测聚合：各模块的记录先攒在 RAM 里，按数量或者时间门限打成固定格式的二进制批次交给 MQTT
+ *
+ * 记录按到达顺序放在一个数组里，按 QoS 分成两类各自打包，sink 收下之后才从数组里删掉，
+ * 所以没连上或者发送队列太长时记录原样留着，缓冲满了再按优先级丢。
+ * RSSI 这种高频的样本不单独成记录，每个周期汇总成一条
+ */
+#include <string.h>
+#include <sys/param.h>
+#include <time.h>
+
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "telemetry.h"
+
+#define TELEMETRY_TAG "TELEMETRY"
+
+// 状态切换丢了就对不上审计日志，要 broker 确认；其它都是统计，丢一批无所谓
+static const uint8_t type_qos[TELEMETRY_TYPE_COUNT] = {
+    [TELEMETRY_HEAP] = 0,
+    [TELEMETRY_RSSI] = 0,
+    [TELEMETRY_LATENCY] = 0,
+    [TELEMETRY_TRANSITION] = 1,
+};
+
+static portMUX_TYPE telemetry_lock = portMUX_INITIALIZER_UNLOCKED;
+static telemetry_record_t records[TELEMETRY_MAX_RECORDS];
+static uint16_t record_count = 0;
+static uint16_t next_seq = 0;
+static uint16_t shed_unreported = 0; // 还没在批次头里报告过的丢弃数
+static telemetry_stats_t stats;
+
+static struct
+{
+    uint32_t count;
+    int32_t sum;
+    int8_t min;
+    int8_t max;
+} rssi_summary;
+
+static telemetry_sink_t telemetry_sink = NULL;
+static TaskHandle_t telemetry_task_handle = NULL;
+
+static void remove_record(uint16_t index)
+{
+    memmove(&records[index], &records[index + 1], (record_count - index - 1) * sizeof(telemetry_record_t));
+    record_count--;
+}
+
+void telemetry_record(telemetry_type_t type, uint8_t arg, uint32_t value)
+{
+    if (type >= TELEMETRY_TYPE_COUNT)
+    {
+        return;
+    }
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    bool notify = false;
+
+    portENTER_CRITICAL(&telemetry_lock);
+    if (record_count == TELEMETRY_MAX_RECORDS)
+    {
+        int victim = -1;
+        for (int i = 0; i < record_count; i++)
+        {
+            if (records[i].type <= type && (victim < 0 || records[i].type < records[victim].type))
+            {
+                victim = i;
+            }
+        }
+        stats.shed[victim < 0 ? type : records[victim].type]++;
+        shed_unreported += shed_unreported < UINT16_MAX;
+        if (victim < 0)
+        {
+            portEXIT_CRITICAL(&telemetry_lock);
+            return;
+        }
+        remove_record(victim);
+    }
+    records[record_count++] = (telemetry_record_t){
+        .seq = next_seq++,
+        .type = type,
+        .arg = arg,
+        .time_ms = now_ms,
+        .value = value,
+    };
+    stats.recorded[type]++;
+    notify = record_count >= TELEMETRY_BATCH_RECORDS;
+    portEXIT_CRITICAL(&telemetry_lock);
+
+    if (notify && telemetry_task_handle != NULL)
+    {
+        xTaskNotifyGive(telemetry_task_handle);
+    }
+}
+
+void telemetry_note_rssi(int8_t rssi)
+{
+    portENTER_CRITICAL(&telemetry_lock);
+    if (rssi_summary.count == 0 || rssi < rssi_summary.min)
+    {
+        rssi_summary.min = rssi;
+    }
+    if (rssi_summary.count == 0 || rssi > rssi_summary.max)
+    {
+        rssi_summary.max = rssi;
+    }
+    rssi_summary.count++;
+    rssi_summary.sum += rssi;
+    portEXIT_CRITICAL(&telemetry_lock);
+}
+
+/**
+ * @brief 每个周期结束时把 RSSI 汇总和堆内存变成记录
+ */
+static void sample_periodic(void)
+{
+    portENTER_CRITICAL(&telemetry_lock);
+    uint32_t count = rssi_summary.count;
+    int8_t mean = count ? (int8_t)(rssi_summary.sum / (int32_t)count) : 0;
+    int8_t min = rssi_summary.min;
+    int8_t max = rssi_summary.max;
+    memset(&rssi_summary, 0, sizeof(rssi_summary));
+    portEXIT_CRITICAL(&telemetry_lock);
+
+    if (count > 0)
+    {
+        telemetry_record(TELEMETRY_RSSI, MIN(count, UINT8_MAX), (uint8_t)min | (uint8_t)max << 8 | (uint32_t)(uint8_t)mean << 16);
+    }
+    uint32_t free_kb = MIN(esp_get_free_heap_size() / 1024, UINT16_MAX);
+    uint32_t min_free_kb = MIN(esp_get_minimum_free_heap_size() / 1024, UINT16_MAX);
+    telemetry_record(TELEMETRY_HEAP, 0, free_kb | min_free_kb << 16);
+}
+
+/**
+ * @brief 把一类记录按到达顺序打包发出去，每批最多 TELEMETRY_BATCH_RECORDS 条
+ *
+ * @return false 表示 sink 不收，剩下的记录等下次
+ */
+static bool flush_class(uint8_t qos)
+{
+    uint8_t batch[TELEMETRY_BATCH_MAX_BYTES];
+    telemetry_record_t *out = (telemetry_record_t *)(batch + sizeof(telemetry_batch_header_t));
+
+    while (1)
+    {
+        uint32_t unix_time = (uint32_t)time(NULL); // time() 内部会拿锁，不能放进临界区
+        uint8_t count = 0;
+
+        portENTER_CRITICAL(&telemetry_lock);
+        for (uint16_t i = 0; i < record_count && count < TELEMETRY_BATCH_RECORDS; i++)
+        {
+            if (type_qos[records[i].type] == qos)
+            {
+                out[count++] = records[i];
+            }
+        }
+        uint16_t shed = shed_unreported;
+        portEXIT_CRITICAL(&telemetry_lock);
+
+        if (count == 0)
+        {
+            return true;
+        }
+        telemetry_batch_header_t header = {
+            .version = TELEMETRY_BATCH_VERSION,
+            .count = count,
+            .shed = shed,
+            .unix_time = unix_time,
+            .now_ms = (uint32_t)(esp_timer_get_time() / 1000),
+        };
+        memcpy(batch, &header, sizeof(header));
+        size_t len = sizeof(header) + count * sizeof(telemetry_record_t);
+        if (telemetry_sink == NULL || !telemetry_sink(batch, len, qos))
+        {
+            return false;
+        }
+
+        // 打包之后新来的记录序号更大；打包的记录里可能有刚被丢掉的，所以按序号范围删，不按下标
+        uint16_t first_seq = out[0].seq;
+        uint16_t span = out[count - 1].seq - first_seq;
+        portENTER_CRITICAL(&telemetry_lock);
+        for (uint16_t i = 0; i < record_count;)
+        {
+            if (type_qos[records[i].type] == qos && (uint16_t)(records[i].seq - first_seq) <= span)
+            {
+                remove_record(i);
+            }
+            else
+            {
+                i++;
+            }
+        }
+        for (uint8_t i = 0; i < count; i++)
+        {
+            stats.sent[out[i].type]++;
+        }
+        shed_unreported -= shed;
+        stats.batches++;
+        stats.bytes += len;
+        portEXIT_CRITICAL(&telemetry_lock);
+
+        if (count < TELEMETRY_BATCH_RECORDS)
+        {
+            return true;
+        }
+    }
+}
+
+static void telemetry_task(void *arg)
+{
+    int64_t next_sample_us = esp_timer_get_time() + TELEMETRY_FLUSH_INTERVAL_MS * 1000LL;
+    bool backlog = false; // 上次有记录没发出去
+    while (1)
+    {
+        int64_t wait_us = MIN(next_sample_us - esp_timer_get_time(), backlog ? TELEMETRY_RETRY_MS * 1000LL : INT64_MAX);
+        ulTaskNotifyTake(pdTRUE, wait_us > 0 ? pdMS_TO_TICKS((wait_us + 999) / 1000) : 0);
+
+        if (esp_timer_get_time() >= next_sample_us)
+        {
+            sample_periodic();
+            next_sample_us += TELEMETRY_FLUSH_INTERVAL_MS * 1000LL;
+        }
+        // 状态切换先发；sink 不收说明发送队列已经堵了，另一类也不用试了，过 TELEMETRY_RETRY_MS 再来
+        backlog = !flush_class(1) || !flush_class(0);
+    }
+}
+
+esp_err_t telemetry_init(void)
+{
+    if (xTaskCreate(telemetry_task, "telemetry", 2560, NULL, TELEMETRY_TASK_PRIORITY, &telemetry_task_handle) != pdPASS)
+    {
+        ESP_LOGE(TELEMETRY_TAG, "Failed to create telemetry task");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void telemetry_set_sink(telemetry_sink_t sink)
+{
+    telemetry_sink = sink;
+}
+
+void telemetry_flush(void)
+{
+    if (telemetry_task_handle != NULL)
+    {
+        xTaskNotifyGive(telemetry_task_handle);
+    }
+}
+
+void telemetry_get_stats(telemetry_stats_t *out)
+{
+    portENTER_CRITICAL(&telemetry_lock);
+    *out = stats;
+    portEXIT_CRITICAL(&telemetry_lock);
+}
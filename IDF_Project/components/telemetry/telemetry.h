@@ -0,0 +1,105 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define TELEMETRY_MAX_RECORDS 64          // RAM 里最多攒多少条，满了按优先级丢
+#define TELEMETRY_BATCH_RECORDS 32        // 攒够这么多条就发一批，一批 12 + 32 * 12 = 396 字节，一个 TCP 段装得下
+#define TELEMETRY_FLUSH_INTERVAL_MS 30000 // 没攒够一批时最多等这么久也要发，RSSI 汇总和堆内存也按这个周期采样
+#define TELEMETRY_RETRY_MS 1000          // sink 不收的时候隔这么久再试，发送队列消化了就接着发
+#define TELEMETRY_TASK_PRIORITY 2         // 和审计日志写 flash 的任务一样，比状态机和灯效都低
+#define TELEMETRY_BATCH_VERSION 1         // 批次格式改了就加一
+
+/**
+ * @brief 记录类型，数值越大优先级越高，缓冲满了先丢优先级低的
+ */
+typedef enum
+{
+    TELEMETRY_HEAP = 0,   // 堆内存：value 低 16 位是当前空闲 KB，高 16 位是开机以来最少的空闲 KB
+    TELEMETRY_RSSI,       // 一个周期里蓝牙 RSSI 的汇总：arg 是样本数（最多 255），value 是 最小 | 最大 << 8 | 平均 << 16，都是 int8
+    TELEMETRY_LATENCY,    // 开门延迟：arg 是 lock_latency_kind_t，value 是输入到控制线动作的 us
+    TELEMETRY_TRANSITION, // 状态切换：arg 是 audit_cause_t，value 是 from | to << 8 | (source & 0xffff) << 16
+    TELEMETRY_TYPE_COUNT,
+} telemetry_type_t;
+
+/**
+ * @brief 一条记录，固定 12 字节，RAM 里和发出去的批次里都是这个格式
+ */
+typedef struct __attribute__((packed))
+{
+    uint16_t seq;     // 每条记录递增，接收端靠它发现丢掉的记录
+    uint8_t type;     // telemetry_type_t
+    uint8_t arg;      // 见 telemetry_type_t
+    uint32_t time_ms; // 开机以来的 ms
+    uint32_t value;   // 见 telemetry_type_t
+} telemetry_record_t;
+
+_Static_assert(sizeof(telemetry_record_t) == 12, "telemetry_record_t must stay 12 bytes");
+
+/**
+ * @brief 一批记录的头，后面紧跟 count 条 telemetry_record_t，多字节字段都是小端
+ */
+typedef struct __attribute__((packed))
+{
+    uint8_t version;    // TELEMETRY_BATCH_VERSION
+    uint8_t count;      // 这一批的记录数
+    uint16_t shed;      // 上一批发出去之后因为缓冲满了丢掉的记录数
+    uint32_t unix_time; // 打包时的 time(NULL)，还没对时的话是开机以来的秒数
+    uint32_t now_ms;    // 打包时开机以来的 ms，和 unix_time 一起把记录的 time_ms 换算成绝对时间
+} telemetry_batch_header_t;
+
+_Static_assert(sizeof(telemetry_batch_header_t) == 12, "telemetry_batch_header_t must stay 12 bytes");
+
+#define TELEMETRY_BATCH_MAX_BYTES (sizeof(telemetry_batch_header_t) + TELEMETRY_BATCH_RECORDS * sizeof(telemetry_record_t))
+
+/**
+ * @brief 发出一批记录，在遥测任务里调用
+ *
+ * 状态切换用 QoS 1，其它都是 QoS 0
+ *
+ * @return false 表示现在发不了（没连上、发送队列太长），记录留在缓冲里下次再发
+ */
+typedef bool (*telemetry_sink_t)(const uint8_t *batch, size_t len, int qos);
+
+typedef struct
+{
+    uint32_t recorded[TELEMETRY_TYPE_COUNT]; // 进过缓冲的记录数
+    uint32_t sent[TELEMETRY_TYPE_COUNT];     // 发出去的记录数
+    uint32_t shed[TELEMETRY_TYPE_COUNT];     // 因为缓冲满了丢掉的记录数
+    uint32_t batches;                        // 发出去的批次数
+    uint32_t bytes;                          // 发出去的字节数
+} telemetry_stats_t;
+
+/**
+ * @brief 启动遥测任务；之前记下的记录也会保留
+ */
+esp_err_t telemetry_init(void);
+
+/**
+ * @brief 设置批次的去向，NULL 表示先攒着
+ */
+void telemetry_set_sink(telemetry_sink_t sink);
+
+/**
+ * @brief 记一条记录，只拷贝到 RAM 里，不等网络，可以在任意任务和定时器回调里调用
+ *
+ * 缓冲满了丢最老的一条优先级最低的记录；新记录的优先级比缓冲里的都低时丢新记录
+ */
+void telemetry_record(telemetry_type_t type, uint8_t arg, uint32_t value);
+
+/**
+ * @brief 记一个 RSSI 样本，只更新这个周期的汇总，周期结束时才变成一条记录
+ */
+void telemetry_note_rssi(int8_t rssi);
+
+/**
+ * @brief 让遥测任务马上发一次攒下的记录，不等时间或者数量的门限，不阻塞
+ */
+void telemetry_flush(void);
+
+void telemetry_get_stats(telemetry_stats_t *stats);
+
+#endif // TELEMETRY_H
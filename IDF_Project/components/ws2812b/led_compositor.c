@@ -0,0 +1,247 @@
+/**
+ * @file led_compositor.c
+ * @brief 灯效合成器：每个图层由解释器渲染，再按字节并行（SWAR）混合到一起
+ *
+ * GRB 三个通道的混合方式完全一样，所以不用拆像素，直接把帧缓冲当成 32 位字的数组，
+ * 偶数字节和奇数字节分别放进两个 16 位的通道里算乘法，一次处理 4 个字节，中间结果不会溢出到相邻通道
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "led_compositor.h"
+
+#define LED_SWAR_LANES 0x00ff00ffu // 每个 16 位通道的低字节
+#define LED_SWAR_CARRY 0x00010001u // 每个 16 位通道相加后的进位
+#define LED_DITHER_PHASES 8        // 时间抖动一个周期的帧数，低 8 位按 1/8 的精度补出来，必须是 2 的幂
+#define LED_DITHER_SPREAD 5        // 相邻的灯错开的相位，和 LED_DITHER_PHASES 互质，整条灯带不会同时跳
+
+// 3 位倒序的帧计数对应的阈值，低 8 位超过阈值的帧进一位，一个周期里进位的帧数和低 8 位成正比、而且尽量分散
+static const uint8_t dither_thresholds[LED_DITHER_PHASES] = {15, 143, 79, 207, 47, 175, 111, 239};
+
+/**
+ * @brief 按字节插值：weight = 0 返回 a，256 返回 b
+ *
+ * 每个通道最大是 255 * 256 = 0xff00，放得进 16 位
+ */
+static inline uint32_t swar_lerp(uint32_t a, uint32_t b, uint32_t weight)
+{
+    uint32_t even = ((a & LED_SWAR_LANES) * (256 - weight) + (b & LED_SWAR_LANES) * weight) >> 8;
+    uint32_t odd = ((a >> 8) & LED_SWAR_LANES) * (256 - weight) + ((b >> 8) & LED_SWAR_LANES) * weight;
+    return (even & LED_SWAR_LANES) | (odd & ~LED_SWAR_LANES);
+}
+
+/**
+ * @brief 按字节缩放：weight = 256 原样返回
+ */
+static inline uint32_t swar_scale(uint32_t a, uint32_t weight)
+{
+    uint32_t even = ((a & LED_SWAR_LANES) * weight) >> 8;
+    uint32_t odd = ((a >> 8) & LED_SWAR_LANES) * weight;
+    return (even & LED_SWAR_LANES) | (odd & ~LED_SWAR_LANES);
+}
+
+/**
+ * @brief 按字节饱和相加，超过 255 的字节停在 255
+ */
+static inline uint32_t swar_add_saturate(uint32_t a, uint32_t b)
+{
+    uint32_t even = (a & LED_SWAR_LANES) + (b & LED_SWAR_LANES);
+    uint32_t odd = ((a >> 8) & LED_SWAR_LANES) + ((b >> 8) & LED_SWAR_LANES);
+    even |= ((even >> 8) & LED_SWAR_CARRY) * 0xff;
+    odd |= ((odd >> 8) & LED_SWAR_CARRY) * 0xff;
+    return (even & LED_SWAR_LANES) | ((odd & LED_SWAR_LANES) << 8);
+}
+
+/**
+ * @brief 8 位 alpha 换成 0 - 256 的权重，255 对应 256，不透明时结果和原图完全一样
+ */
+static inline uint32_t alpha_weight(uint8_t alpha)
+{
+    return alpha + (alpha >> 7);
+}
+
+/**
+ * @brief 渲染一个图层，返回它下一次变化的绝对时间；fraction 不为 NULL 时同时写低 8 位
+ */
+static int64_t render_layer(const led_compositor_t *comp, const led_layer_t *layer, int64_t now_us, uint32_t *words, uint8_t *fraction)
+{
+    if (layer->pixels != NULL)
+    {
+        memcpy(words, layer->pixels, comp->count * 3);
+        if (fraction != NULL)
+        {
+            memset(fraction, 0, comp->count * 3);
+        }
+        return LED_PROGRAM_STATIC;
+    }
+    led_frame_t frame = {.pixels = (uint8_t *)words, .fraction = fraction, .count = comp->count};
+    int64_t change_us = led_program_render(layer->program, now_us - layer->start_us, &frame);
+    return change_us == LED_PROGRAM_STATIC ? LED_PROGRAM_STATIC : layer->start_us + change_us;
+}
+
+static int64_t earliest(int64_t a, int64_t b)
+{
+    return a < b ? a : b;
+}
+
+/**
+ * @brief 有序时间抖动：高 8 位加上按帧轮换的进位写进 pixels
+ *
+ * @return 有没有低 8 位大到会进位的通道
+ */
+static bool dither_frame(led_compositor_t *comp, uint8_t *pixels)
+{
+    const uint8_t *frame = (const uint8_t *)comp->frame;
+    const uint8_t *fraction = comp->fraction;
+    uint8_t phase = comp->dither_frame++;
+    bool active = false;
+    for (uint16_t i = 0; i < comp->count; i++)
+    {
+        uint8_t threshold = dither_thresholds[(phase + i * LED_DITHER_SPREAD) & (LED_DITHER_PHASES - 1)];
+        for (int c = 0; c < 3; c++)
+        {
+            uint16_t b = i * 3 + c;
+            active |= fraction[b] > dither_thresholds[0];
+            pixels[b] = frame[b] + (fraction[b] > threshold && frame[b] < 255);
+        }
+    }
+    return active;
+}
+
+esp_err_t led_compositor_init(led_compositor_t *comp, uint16_t count)
+{
+    memset(comp, 0, sizeof(*comp));
+    comp->count = count;
+    comp->words = (count * 3 + 3) / 4;
+    comp->frame = calloc(comp->words ? comp->words : 1, sizeof(uint32_t));
+    comp->scratch = calloc(comp->words ? comp->words : 1, sizeof(uint32_t));
+    comp->fraction = calloc(comp->words ? comp->words : 1, sizeof(uint32_t));
+    if (comp->frame == NULL || comp->scratch == NULL || comp->fraction == NULL)
+    {
+        free(comp->frame);
+        free(comp->scratch);
+        free(comp->fraction);
+        comp->frame = NULL;
+        comp->scratch = NULL;
+        comp->fraction = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+static void switch_base(led_compositor_t *comp, led_layer_t base, int64_t now_us, uint32_t fade_us)
+{
+    comp->outgoing = comp->base;
+    comp->base = base;
+    comp->fade_start_us = now_us;
+    comp->fade_us = fade_us;
+}
+
+void led_compositor_set_base(led_compositor_t *comp, const led_insn_t *program, int64_t now_us, uint32_t fade_us)
+{
+    switch_base(comp, (led_layer_t){.program = program, .start_us = now_us, .blend = LED_BLEND_ALPHA, .alpha = 255}, now_us, fade_us);
+}
+
+void led_compositor_set_base_pixels(led_compositor_t *comp, const uint8_t *pixels, int64_t now_us, uint32_t fade_us)
+{
+    switch_base(comp, (led_layer_t){.pixels = pixels, .start_us = now_us, .blend = LED_BLEND_ALPHA, .alpha = 255}, now_us, fade_us);
+}
+
+void led_compositor_set_overlay(led_compositor_t *comp, uint8_t layer, const led_insn_t *program, led_blend_t blend, uint8_t alpha, int64_t now_us)
+{
+    if (layer >= LED_COMPOSITOR_OVERLAYS)
+    {
+        return;
+    }
+    comp->overlays[layer] = (led_layer_t){
+        .program = program,
+        .start_us = now_us,
+        .blend = blend,
+        .alpha = alpha,
+    };
+}
+
+int64_t led_compositor_render(led_compositor_t *comp, int64_t now_us, uint8_t *pixels)
+{
+    int64_t change_us = LED_PROGRAM_STATIC;
+    uint32_t *frame = comp->frame;
+    uint32_t *scratch = comp->scratch;
+
+    bool fine = comp->base.program != NULL || comp->base.pixels != NULL; // 只画了底层，低 8 位有效
+    if (fine)
+    {
+        change_us = render_layer(comp, &comp->base, now_us, frame, comp->fraction);
+    }
+    else
+    {
+        memset(frame, 0, comp->words * sizeof(uint32_t));
+    }
+
+    // 交叉淡化：旧底层接着播，按时间从旧的画面插值到新的画面，淡化期间每一帧都在变
+    if (comp->fade_us > 0 && now_us - comp->fade_start_us >= comp->fade_us)
+    {
+        comp->fade_us = 0;
+        comp->outgoing.program = NULL;
+        comp->outgoing.pixels = NULL;
+    }
+    if (comp->fade_us > 0)
+    {
+        if (comp->outgoing.program != NULL || comp->outgoing.pixels != NULL)
+        {
+            render_layer(comp, &comp->outgoing, now_us, scratch, NULL);
+        }
+        else
+        {
+            memset(scratch, 0, comp->words * sizeof(uint32_t));
+        }
+        uint32_t weight = (uint32_t)((now_us - comp->fade_start_us) * 256 / comp->fade_us);
+        for (uint16_t i = 0; i < comp->words; i++)
+        {
+            frame[i] = swar_lerp(scratch[i], frame[i], weight);
+        }
+        change_us = now_us;
+        fine = false;
+    }
+
+    for (int layer = 0; layer < LED_COMPOSITOR_OVERLAYS; layer++)
+    {
+        led_layer_t *overlay = &comp->overlays[layer];
+        if (overlay->program == NULL)
+        {
+            continue;
+        }
+
+        // 播完的叠加层直接移除，不再画它的最后一帧；它还在动的时候返回的是下一帧，所以移除之后马上会重画
+        int64_t overlay_change_us = render_layer(comp, overlay, now_us, scratch, NULL);
+        if (overlay_change_us == LED_PROGRAM_STATIC)
+        {
+            overlay->program = NULL;
+            continue;
+        }
+        change_us = earliest(change_us, overlay_change_us);
+        fine = false;
+
+        uint32_t weight = alpha_weight(overlay->alpha);
+        if (overlay->blend == LED_BLEND_ADD)
+        {
+            for (uint16_t i = 0; i < comp->words; i++)
+            {
+                frame[i] = swar_add_saturate(frame[i], swar_scale(scratch[i], weight));
+            }
+        }
+        else
+        {
+            for (uint16_t i = 0; i < comp->words; i++)
+            {
+                frame[i] = swar_lerp(frame[i], scratch[i], weight);
+            }
+        }
+    }
+
+    comp->dithering = fine && dither_frame(comp, pixels);
+    if (!fine)
+    {
+        memcpy(pixels, frame, comp->count * 3);
+    }
+    return change_us;
+}
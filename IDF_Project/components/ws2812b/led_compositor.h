@@ -0,0 +1,89 @@
+#ifndef LED_COMPOSITOR_H
+#define LED_COMPOSITOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "led_program.h"
+
+#define LED_COMPOSITOR_OVERLAYS 2 // 叠加层数量，画在底层之上，编号小的先画
+
+/**
+ * @brief 叠加层和下面已经画好的画面怎么混合
+ */
+typedef enum
+{
+    LED_BLEND_ALPHA = 0, // 按 alpha 在下层和这一层之间插值，整条灯带都会被盖住
+    LED_BLEND_ADD,       // 按 alpha 缩放后饱和相加，黑色的像素等于透明，适合在底层效果上闪一下
+} led_blend_t;
+
+/**
+ * @brief 一个图层：播放一段灯效程序，程序时间从 start_us 开始算；或者直接显示一块像素缓冲
+ */
+typedef struct
+{
+    const led_insn_t *program; // program 和 pixels 都是 NULL 表示这一层是空的
+    const uint8_t *pixels;     // 不为 NULL 时这一层是静止的像素（count * 3 字节，G, B, R 顺序），不看 program
+    int64_t start_us;
+    uint8_t blend; // led_blend_t
+    uint8_t alpha; // 255 为不透明
+} led_layer_t;
+
+/**
+ * @brief 合成器：底层 + 叠加层，切换底层时旧的底层会在 fade_us 内淡出
+ *
+ * 帧缓冲按 32 位字对齐并补齐到整字，混合一次处理 4 个字节，不区分是哪个颜色通道
+ *
+ * 底层还有一块同样大小的低 8 位（见 led_frame_t::fraction）：只画底层时输出前按时间抖动把它加回去，
+ * 在交叉淡化或者有叠加层时画面本来就在变，只用高 8 位
+ */
+typedef struct
+{
+    uint16_t count; // 灯的数量
+    uint16_t words; // 一帧占多少个 32 位字
+    led_layer_t base;
+    led_layer_t outgoing; // 正在淡出的上一个底层，空的时候淡出的是黑色
+    int64_t fade_start_us;
+    uint32_t fade_us; // 0 表示没有在交叉淡化
+    led_layer_t overlays[LED_COMPOSITOR_OVERLAYS];
+    uint32_t *frame;      // 合成结果
+    uint32_t *scratch;    // 渲染单个图层用
+    uint8_t *fraction;    // 底层每个通道的低 8 位
+    uint8_t dither_frame; // 时间抖动的帧计数
+    bool dithering;       // 最近一帧用到了低 8 位，画面静止也要按抖动的帧率接着画
+} led_compositor_t;
+
+/**
+ * @brief 按灯的数量分配帧缓冲
+ *
+ * @return 内存不够返回 ESP_ERR_NO_MEM
+ */
+esp_err_t led_compositor_init(led_compositor_t *comp, uint16_t count);
+
+/**
+ * @brief 换底层程序，fade_us 为 0 时直接切换，否则从当前的底层交叉淡化过去
+ *
+ * 上一次淡化还没结束时，从上一次的目标开始淡化，跳变只会发生在被打断的淡出层上
+ */
+void led_compositor_set_base(led_compositor_t *comp, const led_insn_t *program, int64_t now_us, uint32_t fade_us);
+
+/**
+ * @brief 把底层换成一块像素缓冲，其余和 led_compositor_set_base 一样
+ *
+ * 合成器不拷贝 pixels，它的内容变了之后调用者要自己安排重画
+ */
+void led_compositor_set_base_pixels(led_compositor_t *comp, const uint8_t *pixels, int64_t now_us, uint32_t fade_us);
+
+/**
+ * @brief 设置叠加层，program 为 NULL 时清空；叠加层的程序播完（停在最后一帧）后自动移除
+ */
+void led_compositor_set_overlay(led_compositor_t *comp, uint8_t layer, const led_insn_t *program, led_blend_t blend, uint8_t alpha, int64_t now_us);
+
+/**
+ * @brief 合成 now_us 时刻的一帧，写入 pixels（count * 3 字节，G, B, R 顺序）
+ *
+ * @return 画面下一次变化的绝对时间，不会再变时返回 LED_PROGRAM_STATIC
+ */
+int64_t led_compositor_render(led_compositor_t *comp, int64_t now_us, uint8_t *pixels);
+
+#endif // LED_COMPOSITOR_H
@@ -0,0 +1,49 @@
+/**
+ * @file led_power.c
+ * @brief 灯带电流估算和限流：灯带和 ESP32-C3 的射频、锁控用同一路电源，全白的画面会在蓝牙发包时把电压拉低
+ *
+ * 估算只用整数：电流 = 通道值之和 * LED_POWER_CHANNEL_MA / 255 + 灯数 * LED_POWER_IDLE_MA，
+ * 预算提前换算成允许的通道值之和，每一帧只比较不做除法，超了才算一次缩放系数
+ */
+#include <string.h>
+
+#include "led_power.h"
+
+esp_err_t led_power_init(led_power_t *power, uint16_t count, uint32_t budget_ma)
+{
+    memset(power, 0, sizeof(*power));
+    power->count = count;
+
+    // 静态电流就已经超预算时只能全黑
+    uint32_t idle_ma = (uint32_t)count * LED_POWER_IDLE_MA;
+    power->budget = budget_ma > idle_ma ? (budget_ma - idle_ma) * 255 / LED_POWER_CHANNEL_MA : 0;
+    power->estimate_ma = idle_ma;
+    power->scale = 255;
+    return ESP_OK;
+}
+
+bool led_power_limit(led_power_t *power, uint8_t *pixels)
+{
+    // 合成器每一帧都整帧重画，不知道哪些灯变了；直接加一遍整帧比和上一帧逐颗比较再增减还便宜
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < (uint32_t)power->count * 3; i++)
+    {
+        sum += pixels[i];
+    }
+    power->estimate_ma = sum * LED_POWER_CHANNEL_MA / 255 + (uint32_t)power->count * LED_POWER_IDLE_MA;
+
+    if (sum <= power->budget)
+    {
+        power->scale = 255;
+        return false;
+    }
+
+    // 缩放系数 0 - 256，缩放之后的和不超过预算
+    uint32_t weight = power->budget * 256 / sum;
+    for (uint16_t i = 0; i < power->count * 3; i++)
+    {
+        pixels[i] = (pixels[i] * weight) >> 8;
+    }
+    power->scale = (uint8_t)(weight > 255 ? 255 : weight);
+    return true;
+}
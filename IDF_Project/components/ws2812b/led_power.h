@@ -0,0 +1,37 @@
+#ifndef LED_POWER_H
+#define LED_POWER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define LED_POWER_CHANNEL_MA 20 // 一个颜色通道为 255 时的电流，按 WS2812B 手册的典型值
+#define LED_POWER_IDLE_MA 1     // 每颗灯全黑时的静态电流
+
+/**
+ * @brief 灯带电流估算和限流
+ *
+ * 电流按所有通道值之和线性估算；合成器每一帧都整帧重画，每一帧直接把整帧加一遍
+ */
+typedef struct
+{
+    uint16_t count;        // 灯的数量
+    uint32_t budget;       // 电流预算扣掉静态电流之后，允许的通道值之和
+    uint32_t estimate_ma;  // 最近一帧限流之前的估算电流
+    uint8_t scale;         // 最近一帧的缩放系数，255 表示没有限流
+} led_power_t;
+
+/**
+ * @brief 按灯的数量换算预算，budget_ma 是整条灯带允许的电流
+ */
+esp_err_t led_power_init(led_power_t *power, uint16_t count, uint32_t budget_ma);
+
+/**
+ * @brief 更新电流估算，超过预算时把整帧按同一个比例调暗，写回 pixels
+ *
+ * @param pixels count * 3 字节，通道顺序无关
+ * @return 这一帧被调暗了返回 true
+ */
+bool led_power_limit(led_power_t *power, uint8_t *pixels);
+
+#endif // LED_POWER_H
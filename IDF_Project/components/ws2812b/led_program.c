@@ -0,0 +1,444 @@
+/**
+ * @file led_program.c
+ * @brief 灯效程序解释器：按时间找到当前的关键帧指令，把它画进帧缓冲
+ *
+ * 渲染路径只用整数和 led_tables 里的查找表，每帧的开销和程序长度、灯的数量成正比，和效果本身的复杂度无关
+ */
+#include <string.h>
+
+#include "led_program.h"
+#include "led_tables.h"
+
+/**
+ * @brief 一条指令渲染时需要的上下文
+ */
+typedef struct
+{
+    const led_insn_t *insn;
+    led_rgb8_t from;     // 上一条指令的颜色，渐变类指令的起点
+    uint32_t t_ms;       // 这条指令开始以来的时间
+    uint32_t span_ms;    // 这条指令的总时长（含重复）
+    uint32_t program_ms; // 程序开始以来的时间，乱闪用它做种子，循环播放时每一遍的颜色也不一样
+} led_op_ctx_t;
+
+/**
+ * @brief 指令的渲染函数，返回画出来的这一帧还能保持多少毫秒不变，0 表示下一帧就会变
+ */
+typedef uint32_t (*led_op_fn_t)(const led_op_ctx_t *ctx, led_frame_t *frame);
+
+static void set_pixel(led_frame_t *frame, int index, led_rgb8_t color)
+{
+    // LED 的 RGB 数据是按照 Green, Blue, Red 顺序存储的
+    frame->pixels[index * 3 + 0] = color.green;
+    frame->pixels[index * 3 + 1] = color.blue;
+    frame->pixels[index * 3 + 2] = color.red;
+}
+
+static void fill_pixels(led_frame_t *frame, led_rgb8_t color)
+{
+    for (int i = 0; i < frame->count; i++)
+    {
+        set_pixel(frame, i, color);
+    }
+}
+
+/**
+ * @brief 写一颗 8.8 定点的灯，顺序是 G, B, R；高 8 位进 pixels，低 8 位进 fraction
+ */
+static void set_pixel_fine(led_frame_t *frame, int index, const uint16_t grb[3])
+{
+    for (int c = 0; c < 3; c++)
+    {
+        frame->pixels[index * 3 + c] = grb[c] >> 8;
+        if (frame->fraction != NULL)
+        {
+            frame->fraction[index * 3 + c] = grb[c] & 0xff;
+        }
+    }
+}
+
+static void fill_pixels_fine(led_frame_t *frame, const uint16_t grb[3])
+{
+    for (int i = 0; i < frame->count; i++)
+    {
+        set_pixel_fine(frame, i, grb);
+    }
+}
+
+/**
+ * @brief 按 16 位亮度缩放颜色，结果是 8.8 定点：brightness = 65535 时高 8 位正好是原来的颜色，低 8 位是 0
+ */
+static void scale_color_fine(led_rgb8_t color, uint16_t brightness, uint16_t grb[3])
+{
+    uint32_t scale = brightness + (brightness >> 15); // 0 - 65536
+    grb[0] = (color.green * scale) >> 8;
+    grb[1] = (color.blue * scale) >> 8;
+    grb[2] = (color.red * scale) >> 8;
+}
+
+/**
+ * @brief 两个颜色之间按 16 位的 weight 插值，结果是 8.8 定点，weight = 0 是 from，65535 是 to
+ */
+static void lerp_color_fine(led_rgb8_t from, led_rgb8_t to, uint16_t weight, uint16_t grb[3])
+{
+    int32_t w = weight + (weight >> 15); // 0 - 65536
+    grb[0] = (from.green << 8) + (((to.green - from.green) * w) >> 8);
+    grb[1] = (from.blue << 8) + (((to.blue - from.blue) * w) >> 8);
+    grb[2] = (from.red << 8) + (((to.red - from.red) * w) >> 8);
+}
+
+static void clear_pixels(led_frame_t *frame)
+{
+    memset(frame->pixels, 0, frame->count * 3);
+}
+
+static void clear_fraction(led_frame_t *frame)
+{
+    if (frame->fraction != NULL)
+    {
+        memset(frame->fraction, 0, frame->count * 3);
+    }
+}
+
+static led_rgb8_t insn_color(const led_insn_t *insn)
+{
+    return (led_rgb8_t){insn->red, insn->green, insn->blue};
+}
+
+static led_rgb8_t scale_color(led_rgb8_t color, uint8_t brightness)
+{
+    return (led_rgb8_t){led_scale8(color.red, brightness), led_scale8(color.green, brightness), led_scale8(color.blue, brightness)};
+}
+
+/**
+ * @brief 两个颜色之间插值，weight = 0 是 from，255 是 to
+ */
+static led_rgb8_t lerp_color(led_rgb8_t from, led_rgb8_t to, uint8_t weight)
+{
+    // weight 扩展到 0 - 256，两端正好落在 from 和 to 上
+    int w = weight + (weight >> 7);
+    return (led_rgb8_t){
+        from.red + (((to.red - from.red) * w) >> 8),
+        from.green + (((to.green - from.green) * w) >> 8),
+        from.blue + (((to.blue - from.blue) * w) >> 8),
+    };
+}
+
+/**
+ * @brief 32 位整数哈希，给乱闪效果用，代替 rand() 让渲染结果只取决于时间
+ */
+static uint32_t hash32(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+static uint32_t insn_duration_ms(const led_insn_t *insn)
+{
+    return (uint32_t)insn->duration * LED_DURATION_UNIT_MS;
+}
+
+static uint32_t insn_repeat(const led_insn_t *insn)
+{
+    return insn->arg ? insn->arg : 1;
+}
+
+/**
+ * @brief 一条指令一共要播多久
+ */
+static uint32_t insn_span_ms(const led_insn_t *insn, uint16_t led_count)
+{
+    switch (insn->op)
+    {
+    case LED_OP_BREATH:
+    case LED_OP_BLINK:
+    case LED_OP_RANDOM:
+        return insn_duration_ms(insn) * insn_repeat(insn);
+    case LED_OP_METEOR:
+        // 第一轮只有流星，之后每轮多堆积一颗，一共 led_count + 1 轮
+        return insn_duration_ms(insn) * insn_repeat(insn) * (led_count + 1);
+    default:
+        return insn_duration_ms(insn);
+    }
+}
+
+/**
+ * @brief 静止的指令一直保持到这条指令结束
+ */
+static uint32_t static_until_end(const led_op_ctx_t *ctx)
+{
+    return ctx->span_ms - ctx->t_ms;
+}
+
+static uint32_t op_off(const led_op_ctx_t *ctx, led_frame_t *frame)
+{
+    clear_pixels(frame);
+    return static_until_end(ctx);
+}
+
+static uint32_t op_hold(const led_op_ctx_t *ctx, led_frame_t *frame)
+{
+    fill_pixels(frame, insn_color(ctx->insn));
+    return static_until_end(ctx);
+}
+
+static uint32_t op_fade(const led_op_ctx_t *ctx, led_frame_t *frame)
+{
+    uint16_t grb[3];
+    lerp_color_fine(ctx->from, insn_color(ctx->insn), led_gamma16[ctx->t_ms * 255 / ctx->span_ms], grb);
+    fill_pixels_fine(frame, grb);
+    return 0;
+}
+
+static uint32_t op_breath(const led_op_ctx_t *ctx, led_frame_t *frame)
+{
+    // 呼吸曲线（从最亮到 1% 再回来，2.2 次幂）已经离线算进了 led_breath16
+    uint32_t duration_ms = insn_duration_ms(ctx->insn);
+    uint32_t index = ctx->t_ms % duration_ms * LED_BREATH_STEPS / duration_ms;
+    uint16_t grb[3];
+    scale_color_fine(insn_color(ctx->insn), led_breath16[index], grb);
+    fill_pixels_fine(frame, grb);
+    return 0;
+}
+
+static uint32_t op_sweep(const led_op_ctx_t *ctx, led_frame_t *frame)
+{
+    // 从顶端到底端逐个点亮，亮起后的轨迹不会消失
+    uint32_t lit = ctx->t_ms * frame->count / ctx->span_ms + 1;
+    bool reverse = ctx->insn->flags & LED_FLAG_REVERSE;
+    led_rgb8_t color = insn_color(ctx->insn);
+
+    clear_pixels(frame);
+    for (uint32_t i = 0; i < lit && i < frame->count; i++)
+    {
+        set_pixel(frame, reverse ? frame->count - 1 - i : i, color);
+    }
+
+    // 下一颗灯亮起之前画面不变
+    if (lit >= frame->count)
+    {
+        return static_until_end(ctx);
+    }
+    return (lit * ctx->span_ms + frame->count - 1) / frame->count - ctx->t_ms;
+}
+
+static uint32_t op_blink(const led_op_ctx_t *ctx, led_frame_t *frame)
+{
+    uint32_t duration_ms = insn_duration_ms(ctx->insn);
+    uint32_t phase_ms = ctx->t_ms % duration_ms;
+    if (phase_ms < duration_ms / 2)
+    {
+        fill_pixels(frame, insn_color(ctx->insn));
+        return duration_ms / 2 - phase_ms;
+    }
+    clear_pixels(frame);
+    return duration_ms - phase_ms;
+}
+
+static uint32_t op_gradient(const led_op_ctx_t *ctx, led_frame_t *frame)
+{
+    led_rgb8_t to = insn_color(ctx->insn);
+    int last = frame->count > 1 ? frame->count - 1 : 1;
+    for (int i = 0; i < frame->count; i++)
+    {
+        set_pixel(frame, i, lerp_color(ctx->from, to, i * 255 / last));
+    }
+    return static_until_end(ctx);
+}
+
+static uint32_t op_rainbow(const led_op_ctx_t *ctx, led_frame_t *frame)
+{
+    // 可配置变量
+    const uint32_t brightness_min = 26;  // 最低亮度，约 10%
+    const uint32_t brightness_max = 255; // 最高亮度
+
+    uint32_t half_ms = ctx->span_ms / 2;
+
+    // Hue 线性走完一圈，亮度前半段增加、后半段减少
+    uint32_t hue = ctx->t_ms * 360 / ctx->span_ms;
+    uint32_t value = ctx->t_ms <= half_ms ? brightness_min + ctx->t_ms * (brightness_max - brightness_min) / half_ms
+                                          : brightness_max - (ctx->t_ms - half_ms) * (brightness_max - brightness_min) / half_ms;
+    fill_pixels(frame, scale_color(led_hue_wheel[hue % 360], value));
+    return 0;
+}
+
+static uint32_t op_meteor(const led_op_ctx_t *ctx, led_frame_t *frame)
+{
+    const uint32_t TAIL_LENGTH = 2;             // 流星尾巴长度
+    const uint8_t tail_brightness[] = {84, 13}; // 尾巴亮度（约 33% 和 5%），紧跟流星头的那颗最亮
+
+    uint32_t sweep_ms = insn_duration_ms(ctx->insn);
+    int stacked = ctx->t_ms / sweep_ms / insn_repeat(ctx->insn);
+    uint32_t head = ctx->t_ms % sweep_ms * frame->count / sweep_ms;
+    bool reverse = ctx->insn->flags & LED_FLAG_REVERSE;
+    led_rgb8_t color = insn_color(ctx->insn);
+
+    clear_pixels(frame);
+    for (uint32_t tail_pos = 0; tail_pos <= TAIL_LENGTH && tail_pos <= head; tail_pos++) // 流星头在第一颗灯上时还没有尾巴
+    {
+        int index = head - tail_pos;
+        set_pixel(frame, reverse ? frame->count - 1 - index : index, tail_pos ? scale_color(color, tail_brightness[tail_pos - 1]) : color);
+    }
+
+    // 堆积的灯从另一端往回长，盖住流星
+    for (int i = 0; i < stacked && i < frame->count; i++)
+    {
+        set_pixel(frame, reverse ? i : frame->count - 1 - i, color);
+    }
+
+    // 流星头移到下一颗灯之前画面不变
+    uint32_t sweep_phase_ms = ctx->t_ms % sweep_ms;
+    return ((head + 1) * sweep_ms + frame->count - 1) / frame->count - sweep_phase_ms;
+}
+
+static uint32_t op_random(const led_op_ctx_t *ctx, led_frame_t *frame)
+{
+    uint32_t seed = ctx->program_ms / insn_duration_ms(ctx->insn) * frame->count;
+
+    for (int i = 0; i < frame->count; i++)
+    {
+        uint32_t random = hash32(seed + i);
+
+        // 随机熄灭这次的LED
+        if ((random >> 24) % 4 == 0)
+        {
+            set_pixel(frame, i, (led_rgb8_t){0, 0, 0});
+            continue;
+        }
+        set_pixel(frame, i, (led_rgb8_t){random & 0xff, (random >> 8) & 0xff, (random >> 16) & 0xff});
+    }
+    return insn_duration_ms(ctx->insn) - ctx->program_ms % insn_duration_ms(ctx->insn);
+}
+
+static uint32_t op_sunrise(const led_op_ctx_t *ctx, led_frame_t *frame)
+{
+    // 每颗灯从暗到亮的时间占总时长的 1 / 灯数，下面的灯比上面的晚这么久开始变亮
+    uint32_t led_ms = ctx->span_ms / frame->count;
+    led_rgb8_t color = insn_color(ctx->insn);
+    if (led_ms == 0)
+    {
+        fill_pixels(frame, color);
+        return static_until_end(ctx);
+    }
+
+    for (int i = 0; i < frame->count; i++)
+    {
+        // 线性的进度经过 gamma 曲线，暗处的变化看起来也是均匀的
+        uint32_t start_ms = i * led_ms;
+        uint32_t progress = 0;
+        if (ctx->t_ms >= start_ms + led_ms)
+        {
+            progress = 255;
+        }
+        else if (ctx->t_ms > start_ms)
+        {
+            progress = (ctx->t_ms - start_ms) * 255 / led_ms;
+        }
+        uint16_t grb[3];
+        scale_color_fine(color, led_gamma16[progress], grb);
+        set_pixel_fine(frame, i, grb);
+    }
+    return 0;
+}
+
+static const led_op_fn_t op_table[LED_OP_COUNT] = {
+    [LED_OP_OFF] = op_off,
+    [LED_OP_HOLD] = op_hold,
+    [LED_OP_FADE] = op_fade,
+    [LED_OP_BREATH] = op_breath,
+    [LED_OP_SWEEP] = op_sweep,
+    [LED_OP_BLINK] = op_blink,
+    [LED_OP_GRADIENT] = op_gradient,
+    [LED_OP_RAINBOW] = op_rainbow,
+    [LED_OP_METEOR] = op_meteor,
+    [LED_OP_RANDOM] = op_random,
+    [LED_OP_SUNRISE] = op_sunrise,
+};
+
+esp_err_t led_program_validate(const led_insn_t *program, size_t count)
+{
+    if (program == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 0; i < count && i < LED_PROGRAM_MAX_INSNS; i++)
+    {
+        if (program[i].op == LED_OP_END)
+        {
+            return program[i].arg <= 1 ? ESP_OK : ESP_ERR_INVALID_ARG;
+        }
+        if (program[i].op >= LED_OP_COUNT || program[i].duration == 0)
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    return ESP_ERR_INVALID_ARG; // 没有以 LED_OP_END 结尾
+}
+
+int64_t led_program_render(const led_insn_t *program, int64_t t_us, led_frame_t *frame)
+{
+    uint32_t total_ms = 0;
+    size_t end = 0;
+    for (; program[end].op != LED_OP_END; end++)
+    {
+        total_ms += insn_span_ms(&program[end], frame->count);
+    }
+    if (total_ms == 0 || frame->count == 0)
+    {
+        clear_pixels(frame);
+        clear_fraction(frame);
+        return LED_PROGRAM_STATIC;
+    }
+
+    // 循环的程序按总时长取模，不循环的停在最后一刻
+    uint64_t elapsed_ms = t_us > 0 ? (uint64_t)t_us / 1000 : 0;
+    bool finished = false;
+    uint32_t t_ms;
+    if (program[end].arg == 0)
+    {
+        t_ms = elapsed_ms % total_ms;
+    }
+    else if (elapsed_ms >= total_ms)
+    {
+        t_ms = total_ms - 1;
+        finished = true;
+    }
+    else
+    {
+        t_ms = elapsed_ms;
+    }
+
+    uint32_t stable_ms = 0;
+    led_op_ctx_t ctx = {.from = {0, 0, 0}, .program_ms = (uint32_t)elapsed_ms};
+    clear_fraction(frame);
+    for (size_t i = 0; i < end; i++)
+    {
+        uint32_t span_ms = insn_span_ms(&program[i], frame->count);
+        if (t_ms < span_ms)
+        {
+            ctx.insn = &program[i];
+            ctx.t_ms = t_ms;
+            ctx.span_ms = span_ms;
+            stable_ms = op_table[program[i].op](&ctx, frame);
+            break;
+        }
+        t_ms -= span_ms;
+        ctx.from = insn_color(&program[i]);
+    }
+
+    if (finished)
+    {
+        // 停住的最后一帧不再抖动，否则静止的画面也要一直按抖动的帧率重画
+        clear_fraction(frame);
+        return LED_PROGRAM_STATIC;
+    }
+    if (stable_ms == 0)
+    {
+        return t_us;
+    }
+    return (int64_t)(elapsed_ms + stable_ms) * 1000;
+}
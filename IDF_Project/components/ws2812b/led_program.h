@@ -0,0 +1,87 @@
+#ifndef LED_PROGRAM_H
+#define LED_PROGRAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define LED_PROGRAM_MAX_INSNS 16     // 一个灯效程序最多的指令数（含结尾的 LED_OP_END）
+#define LED_DURATION_UNIT_MS 10      // 指令时长的单位，16 位最长约 655 秒，够覆盖 10 分钟的开门保持
+#define LED_PROGRAM_STATIC INT64_MAX // led_program_render 的返回值：画面不会再变
+
+/**
+ * @brief 灯效指令
+ *
+ * 每条指令是一个关键帧：在 duration 内把灯带画成某个样子，color 是这一帧的颜色，
+ * 渐变类指令（FADE / GRADIENT）从上一条指令的颜色过渡到这条的颜色，第一条指令的上一个颜色是黑色
+ */
+typedef enum
+{
+    LED_OP_END = 0,  // 程序结束，arg = 0 从头循环，arg = 1 停在最后一帧
+    LED_OP_OFF,      // 全灭
+    LED_OP_HOLD,     // 整条灯带保持 color
+    LED_OP_FADE,     // 整条灯带从上一个颜色线性渐变到 color（经过 gamma 曲线）
+    LED_OP_BREATH,   // 呼吸，duration 是一次完整的暗下去再亮起来，重复 arg 次
+    LED_OP_SWEEP,    // 从顶端到底端逐颗点亮并保持，flags 里 LED_FLAG_REVERSE 表示从底端开始
+    LED_OP_BLINK,    // 亮灭闪烁，duration 是一次亮灭，占空比 50%，重复 arg 次
+    LED_OP_GRADIENT, // 静止的逐像素渐变，顶端是上一个颜色，底端是 color
+    LED_OP_RAINBOW,  // 走一圈色环，亮度从 10% 升到 100% 再降回来，不用 color
+    LED_OP_METEOR,   // 流星划过，每划 arg 遍在另一端堆积一颗灯，堆满为止；duration 是划过一遍的时长
+    LED_OP_RANDOM,   // 每 duration 随机换一次颜色，重复 arg 次，颜色只取决于时间
+    LED_OP_SUNRISE,  // 日出，从顶端到底端依次渐亮
+    LED_OP_COUNT,
+} led_opcode_t;
+
+#define LED_FLAG_REVERSE 0x01 // 方向从底端到顶端
+
+/**
+ * @brief 一条指令，固定 8 字节，flash 里的程序表和 BLE / MQTT 下发的程序都是这个格式
+ */
+typedef struct __attribute__((packed))
+{
+    uint8_t op;        // led_opcode_t
+    uint8_t arg;       // 重复次数等，含义见各指令，0 和 1 一样表示一次
+    uint16_t duration; // 单位 LED_DURATION_UNIT_MS
+    uint8_t red;
+    uint8_t green;
+    uint8_t blue;
+    uint8_t flags; // LED_FLAG_xxx
+} led_insn_t;
+
+_Static_assert(sizeof(led_insn_t) == 8, "led_insn_t must stay 8 bytes");
+
+#define LED_MS(ms) ((uint16_t)((ms) / LED_DURATION_UNIT_MS))
+#define LED_INSN(op, arg, ms, r, g, b, flags) {(op), (arg), LED_MS(ms), (r), (g), (b), (flags)}
+
+/**
+ * @brief 一帧的像素缓冲，按 WS2812B 的 G, B, R 顺序每颗灯 3 字节
+ *
+ * fraction 不为 NULL 时和 pixels 一起组成 8.8 定点的 16 位通道：呼吸、渐变、日出会写亮度的低 8 位，
+ * 其余指令写 0；暗处 8 位只剩几级，合成器靠时间抖动把低 8 位补出来
+ */
+typedef struct
+{
+    uint8_t *pixels;
+    uint8_t *fraction; // 可以为 NULL，和 pixels 一样大
+    uint16_t count;
+} led_frame_t;
+
+/**
+ * @brief 检查一段外部下发的程序：指令都认识、时长不为 0、在 LED_PROGRAM_MAX_INSNS 以内以 LED_OP_END 结尾
+ *
+ * @return 不合法返回 ESP_ERR_INVALID_ARG
+ */
+esp_err_t led_program_validate(const led_insn_t *program, size_t count);
+
+/**
+ * @brief 渲染程序在 t_us（程序开始以来的时间）时刻的一帧
+ *
+ * 解释器不保存状态，每一帧都按时间重新找到当前指令，所以任何一帧都可以切走，掉帧也不会拖慢动画
+ *
+ * @return 画面下一次变化的时间（同样从程序开始算）：返回 t_us 表示动画在进行、下一帧就要重画；
+ *         纯色保持、闪烁的亮灭段等返回这一段结束的时间；程序播完停在最后一帧返回 LED_PROGRAM_STATIC
+ */
+int64_t led_program_render(const led_insn_t *program, int64_t t_us, led_frame_t *frame);
+
+#endif // LED_PROGRAM_H
@@ -9,6 +9,41 @@
 
 static const char *TAG = "led_encoder";
 
+static const led_strip_chip_profile_t chip_profiles[LED_STRIP_CHIP_COUNT] = {
+    // byte order is what this firmware has always sent to the WS2812 strips already installed
+    [LED_STRIP_CHIP_WS2812] = {
+        .name = "WS2812",
+        .t0h_ns = 300, .t0l_ns = 900, .t1h_ns = 900, .t1l_ns = 300,
+        .reset_us = 50,
+        .bytes_per_pixel = 3,
+        .order = {LED_STRIP_CHANNEL_G, LED_STRIP_CHANNEL_B, LED_STRIP_CHANNEL_R},
+    },
+    [LED_STRIP_CHIP_SK6812_RGBW] = {
+        .name = "SK6812 RGBW",
+        .t0h_ns = 300, .t0l_ns = 900, .t1h_ns = 600, .t1l_ns = 600,
+        .reset_us = 80,
+        .bytes_per_pixel = 4,
+        .order = {LED_STRIP_CHANNEL_G, LED_STRIP_CHANNEL_R, LED_STRIP_CHANNEL_B, LED_STRIP_CHANNEL_W},
+    },
+    [LED_STRIP_CHIP_WS2811] = {
+        .name = "WS2811",
+        .t0h_ns = 250, .t0l_ns = 1000, .t1h_ns = 600, .t1l_ns = 650,
+        .reset_us = 280, // newer WS2811 batches need far more than the 50us of the datasheet
+        .bytes_per_pixel = 3,
+        .order = {LED_STRIP_CHANNEL_R, LED_STRIP_CHANNEL_G, LED_STRIP_CHANNEL_B},
+    },
+};
+
+const led_strip_chip_profile_t *led_strip_chip_profile(led_strip_chip_t chip)
+{
+    return (unsigned)chip < LED_STRIP_CHIP_COUNT ? &chip_profiles[chip] : NULL;
+}
+
+static uint32_t ns_to_ticks(uint32_t ns, uint32_t resolution)
+{
+    return (uint64_t)ns * resolution / 1000000000;
+}
+
 typedef struct
 {
     rmt_encoder_t base;
@@ -82,32 +117,34 @@ esp_err_t rmt_new_led_strip_encoder(const led_strip_encoder_config_t *config, rm
     esp_err_t ret = ESP_OK;
     rmt_led_strip_encoder_t *led_encoder = NULL;
     ESP_GOTO_ON_FALSE(config && ret_encoder, ESP_ERR_INVALID_ARG, err, TAG, "invalid argument");
+    const led_strip_chip_profile_t *chip = led_strip_chip_profile(config->chip);
+    ESP_GOTO_ON_FALSE(chip, ESP_ERR_INVALID_ARG, err, TAG, "unknown led chip");
     led_encoder = rmt_alloc_encoder_mem(sizeof(rmt_led_strip_encoder_t));
     ESP_GOTO_ON_FALSE(led_encoder, ESP_ERR_NO_MEM, err, TAG, "no mem for led strip encoder");
     led_encoder->base.encode = rmt_encode_led_strip;
     led_encoder->base.del = rmt_del_led_strip_encoder;
     led_encoder->base.reset = rmt_led_strip_encoder_reset;
-    // different led strip might have its own timing requirements, following parameter is for WS2812
+    // different led strips have their own timing requirements, they come from the chip profile
     rmt_bytes_encoder_config_t bytes_encoder_config = {
         .bit0 = {
             .level0 = 1,
-            .duration0 = 0.3 * config->resolution / 1000000, // T0H=0.3us
+            .duration0 = ns_to_ticks(chip->t0h_ns, config->resolution),
             .level1 = 0,
-            .duration1 = 0.9 * config->resolution / 1000000, // T0L=0.9us
+            .duration1 = ns_to_ticks(chip->t0l_ns, config->resolution),
         },
         .bit1 = {
             .level0 = 1,
-            .duration0 = 0.9 * config->resolution / 1000000, // T1H=0.9us
+            .duration0 = ns_to_ticks(chip->t1h_ns, config->resolution),
             .level1 = 0,
-            .duration1 = 0.3 * config->resolution / 1000000, // T1L=0.3us
+            .duration1 = ns_to_ticks(chip->t1l_ns, config->resolution),
         },
-        .flags.msb_first = 1 // WS2812 transfer bit order: G7...G0R7...R0B7...B0
+        .flags.msb_first = 1 // every supported chip takes each byte MSB first, bytes are already in chip order
     };
     ESP_GOTO_ON_ERROR(rmt_new_bytes_encoder(&bytes_encoder_config, &led_encoder->bytes_encoder), err, TAG, "create bytes encoder failed");
     rmt_copy_encoder_config_t copy_encoder_config = {};
     ESP_GOTO_ON_ERROR(rmt_new_copy_encoder(&copy_encoder_config, &led_encoder->copy_encoder), err, TAG, "create copy encoder failed");
 
-    uint32_t reset_ticks = config->resolution / 1000000 * 50 / 2; // reset code duration defaults to 50us
+    uint32_t reset_ticks = config->resolution / 1000000 * chip->reset_us / 2; // split over both halves of one symbol
     led_encoder->reset_code = (rmt_symbol_word_t){
         .level0 = 0,
         .duration0 = reset_ticks,
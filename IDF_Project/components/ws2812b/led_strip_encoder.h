@@ -12,13 +12,57 @@
 extern "C" {
 #endif
 
+/**
+ * @brief LED chips the encoder has timing profiles for
+ */
+typedef enum {
+    LED_STRIP_CHIP_WS2812 = 0,  /*!< WS2812 / WS2812B, 3 bytes per pixel */
+    LED_STRIP_CHIP_SK6812_RGBW, /*!< SK6812 RGBW, 4 bytes per pixel */
+    LED_STRIP_CHIP_WS2811,      /*!< WS2811 in 800 kHz mode, 3 bytes per pixel */
+    LED_STRIP_CHIP_COUNT,
+} led_strip_chip_t;
+
+/**
+ * @brief Colour channels a chip can take, used in led_strip_chip_profile_t::order
+ */
+typedef enum {
+    LED_STRIP_CHANNEL_R = 0,
+    LED_STRIP_CHANNEL_G,
+    LED_STRIP_CHANNEL_B,
+    LED_STRIP_CHANNEL_W,
+    LED_STRIP_CHANNEL_COUNT,
+} led_strip_channel_t;
+
+/**
+ * @brief Bit timings and pixel layout of one LED chip
+ */
+typedef struct {
+    const char *name;        /*!< Chip name, for logs */
+    uint16_t t0h_ns;         /*!< High time of a 0 bit, in ns */
+    uint16_t t0l_ns;         /*!< Low time of a 0 bit, in ns */
+    uint16_t t1h_ns;         /*!< High time of a 1 bit, in ns */
+    uint16_t t1l_ns;         /*!< Low time of a 1 bit, in ns */
+    uint16_t reset_us;       /*!< Low time that latches the frame, in us */
+    uint8_t bytes_per_pixel; /*!< 3 for RGB chips, 4 for RGBW chips */
+    uint8_t order[4];        /*!< Channel sent in each byte of a pixel, see led_strip_channel_t */
+} led_strip_chip_profile_t;
+
 /**
  * @brief Type of led strip encoder configuration
  */
 typedef struct {
-    uint32_t resolution; /*!< Encoder resolution, in Hz */
+    uint32_t resolution;   /*!< Encoder resolution, in Hz */
+    led_strip_chip_t chip; /*!< Timing profile, LED_STRIP_CHIP_WS2812 when zero-initialized */
 } led_strip_encoder_config_t;
 
+/**
+ * @brief Look up the timing profile of a chip
+ *
+ * @param[in] chip LED chip
+ * @return Profile, or NULL for an unknown chip
+ */
+const led_strip_chip_profile_t *led_strip_chip_profile(led_strip_chip_t chip);
+
 /**
  * @brief Create RMT encoder for encoding LED strip pixels into RMT symbols
  *
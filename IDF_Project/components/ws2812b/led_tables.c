@@ -0,0 +1,118 @@
+/**
+ * @file led_tables.c
+ * @brief 灯效渲染用的查找表，由 tools/gen_led_tables.py 生成，不要手改
+ */
+#include "led_tables.h"
+
+const uint16_t led_gamma16[256] = {
+        0,     0,     2,     4,     7,    11,    17,    24,    32,    42,    53,    65,
+       79,    94,   111,   129,   148,   169,   192,   216,   242,   270,   299,   330,
+      362,   396,   432,   469,   508,   549,   591,   635,   681,   729,   779,   830,
+      883,   938,   995,  1053,  1113,  1175,  1239,  1305,  1373,  1443,  1514,  1587,
+     1663,  1740,  1819,  1900,  1983,  2068,  2155,  2243,  2334,  2427,  2521,  2618,
+     2717,  2817,  2920,  3024,  3131,  3240,  3350,  3463,  3578,  3694,  3813,  3934,
+     4057,  4182,  4309,  4438,  4570,  4703,  4838,  4976,  5115,  5257,  5401,  5547,
+     5695,  5845,  5998,  6152,  6309,  6468,  6629,  6792,  6957,  7124,  7294,  7466,
+     7640,  7816,  7994,  8175,  8358,  8543,  8730,  8919,  9111,  9305,  9501,  9699,
+     9900, 10102, 10307, 10515, 10724, 10936, 11150, 11366, 11585, 11806, 12029, 12254,
+    12482, 12712, 12944, 13179, 13416, 13655, 13896, 14140, 14386, 14635, 14885, 15138,
+    15394, 15652, 15912, 16174, 16439, 16706, 16975, 17247, 17521, 17798, 18077, 18358,
+    18642, 18928, 19216, 19507, 19800, 20095, 20393, 20694, 20996, 21301, 21609, 21919,
+    22231, 22546, 22863, 23182, 23504, 23829, 24156, 24485, 24817, 25151, 25487, 25826,
+    26168, 26512, 26858, 27207, 27558, 27912, 28268, 28627, 28988, 29351, 29717, 30086,
+    30457, 30830, 31206, 31585, 31966, 32349, 32735, 33124, 33514, 33908, 34304, 34702,
+    35103, 35507, 35913, 36321, 36732, 37146, 37562, 37981, 38402, 38825, 39252, 39680,
+    40112, 40546, 40982, 41421, 41862, 42306, 42753, 43202, 43654, 44108, 44565, 45025,
+    45487, 45951, 46418, 46888, 47360, 47835, 48313, 48793, 49275, 49761, 50249, 50739,
+    51232, 51728, 52226, 52727, 53230, 53736, 54245, 54756, 55270, 55787, 56306, 56828,
+    57352, 57879, 58409, 58941, 59476, 60014, 60554, 61097, 61642, 62190, 62741, 63295,
+    63851, 64410, 64971, 65535,
+};
+
+const uint16_t led_breath16[LED_BREATH_STEPS] = {
+    65535, 64425, 63326, 62237, 61158, 60090, 59032, 57984, 56947, 55920, 54904, 53897,
+    52901, 51916, 50940, 49975, 49020, 48075, 47140, 46215, 45301, 44397, 43502, 42618,
+    41744, 40880, 40025, 39181, 38347, 37523, 36709, 35904, 35110, 34325, 33550, 32785,
+    32030, 31285, 30549, 29823, 29107, 28401, 27704, 27017, 26339, 25671, 25013, 24364,
+    23725, 23096, 22475, 21865, 21263, 20672, 20089, 19516, 18952, 18398, 17853, 17317,
+    16790, 16273, 15765, 15266, 14776, 14295, 13823, 13360, 12907, 12462, 12026, 11599,
+    11181, 10772, 10372,  9980,  9598,  9224,  8858,  8502,  8154,  7815,  7484,  7161,
+     6848,  6542,  6245,  5957,  5676,  5404,  5140,  4885,  4637,  4398,  4167,  3944,
+     3728,  3521,  3322,  3130,  2946,  2770,  2602,  2441,  2287,  2141,  2003,  1872,
+     1748,  1631,  1522,  1420,  1324,  1236,  1154,  1079,  1011,   949,   893,   844,
+      801,   764,   733,   707,   687,   672,   662,   657,   655,   657,   662,   672,
+      687,   707,   733,   764,   801,   844,   893,   949,  1011,  1079,  1154,  1236,
+     1324,  1420,  1522,  1631,  1748,  1872,  2003,  2141,  2287,  2441,  2602,  2770,
+     2946,  3130,  3322,  3521,  3728,  3944,  4167,  4398,  4637,  4885,  5140,  5404,
+     5676,  5957,  6245,  6542,  6848,  7161,  7484,  7815,  8154,  8502,  8858,  9224,
+     9598,  9980, 10372, 10772, 11181, 11599, 12026, 12462, 12907, 13360, 13823, 14295,
+    14776, 15266, 15765, 16273, 16790, 17317, 17853, 18398, 18952, 19516, 20089, 20672,
+    21263, 21865, 22475, 23096, 23725, 24364, 25013, 25671, 26339, 27017, 27704, 28401,
+    29107, 29823, 30549, 31285, 32030, 32785, 33550, 34325, 35110, 35904, 36709, 37523,
+    38347, 39181, 40025, 40880, 41744, 42618, 43502, 44397, 45301, 46215, 47140, 48075,
+    49020, 49975, 50940, 51916, 52901, 53897, 54904, 55920, 56947, 57984, 59032, 60090,
+    61158, 62237, 63326, 64425,
+};
+
+const led_rgb8_t led_hue_wheel[360] = {
+    {255,   0,   0}, {255,   4,   0}, {255,   8,   0}, {255,  13,   0}, {255,  17,   0}, {255,  21,   0},
+    {255,  25,   0}, {255,  30,   0}, {255,  34,   0}, {255,  38,   0}, {255,  42,   0}, {255,  47,   0},
+    {255,  51,   0}, {255,  55,   0}, {255,  60,   0}, {255,  64,   0}, {255,  68,   0}, {255,  72,   0},
+    {255,  77,   0}, {255,  81,   0}, {255,  85,   0}, {255,  89,   0}, {255,  94,   0}, {255,  98,   0},
+    {255, 102,   0}, {255, 106,   0}, {255, 110,   0}, {255, 115,   0}, {255, 119,   0}, {255, 123,   0},
+    {255, 128,   0}, {255, 132,   0}, {255, 136,   0}, {255, 140,   0}, {255, 144,   0}, {255, 149,   0},
+    {255, 153,   0}, {255, 157,   0}, {255, 162,   0}, {255, 166,   0}, {255, 170,   0}, {255, 174,   0},
+    {255, 178,   0}, {255, 183,   0}, {255, 187,   0}, {255, 191,   0}, {255, 195,   0}, {255, 200,   0},
+    {255, 204,   0}, {255, 208,   0}, {255, 212,   0}, {255, 217,   0}, {255, 221,   0}, {255, 225,   0},
+    {255, 229,   0}, {255, 234,   0}, {255, 238,   0}, {255, 242,   0}, {255, 247,   0}, {255, 251,   0},
+    {255, 255,   0}, {251, 255,   0}, {247, 255,   0}, {242, 255,   0}, {238, 255,   0}, {234, 255,   0},
+    {230, 255,   0}, {225, 255,   0}, {221, 255,   0}, {217, 255,   0}, {212, 255,   0}, {208, 255,   0},
+    {204, 255,   0}, {200, 255,   0}, {195, 255,   0}, {191, 255,   0}, {187, 255,   0}, {183, 255,   0},
+    {178, 255,   0}, {174, 255,   0}, {170, 255,   0}, {166, 255,   0}, {162, 255,   0}, {157, 255,   0},
+    {153, 255,   0}, {149, 255,   0}, {144, 255,   0}, {140, 255,   0}, {136, 255,   0}, {132, 255,   0},
+    {128, 255,   0}, {123, 255,   0}, {119, 255,   0}, {115, 255,   0}, {110, 255,   0}, {106, 255,   0},
+    {102, 255,   0}, { 98, 255,   0}, { 94, 255,   0}, { 89, 255,   0}, { 85, 255,   0}, { 81, 255,   0},
+    { 77, 255,   0}, { 72, 255,   0}, { 68, 255,   0}, { 64, 255,   0}, { 60, 255,   0}, { 55, 255,   0},
+    { 51, 255,   0}, { 47, 255,   0}, { 42, 255,   0}, { 38, 255,   0}, { 34, 255,   0}, { 30, 255,   0},
+    { 26, 255,   0}, { 21, 255,   0}, { 17, 255,   0}, { 13, 255,   0}, {  8, 255,   0}, {  4, 255,   0},
+    {  0, 255,   0}, {  0, 255,   4}, {  0, 255,   8}, {  0, 255,  13}, {  0, 255,  17}, {  0, 255,  21},
+    {  0, 255,  25}, {  0, 255,  30}, {  0, 255,  34}, {  0, 255,  38}, {  0, 255,  42}, {  0, 255,  47},
+    {  0, 255,  51}, {  0, 255,  55}, {  0, 255,  60}, {  0, 255,  64}, {  0, 255,  68}, {  0, 255,  72},
+    {  0, 255,  77}, {  0, 255,  81}, {  0, 255,  85}, {  0, 255,  89}, {  0, 255,  94}, {  0, 255,  98},
+    {  0, 255, 102}, {  0, 255, 106}, {  0, 255, 111}, {  0, 255, 115}, {  0, 255, 119}, {  0, 255, 123},
+    {  0, 255, 128}, {  0, 255, 132}, {  0, 255, 136}, {  0, 255, 140}, {  0, 255, 144}, {  0, 255, 149},
+    {  0, 255, 153}, {  0, 255, 157}, {  0, 255, 162}, {  0, 255, 166}, {  0, 255, 170}, {  0, 255, 174},
+    {  0, 255, 179}, {  0, 255, 183}, {  0, 255, 187}, {  0, 255, 191}, {  0, 255, 195}, {  0, 255, 200},
+    {  0, 255, 204}, {  0, 255, 208}, {  0, 255, 212}, {  0, 255, 217}, {  0, 255, 221}, {  0, 255, 225},
+    {  0, 255, 229}, {  0, 255, 234}, {  0, 255, 238}, {  0, 255, 242}, {  0, 255, 247}, {  0, 255, 251},
+    {  0, 255, 255}, {  0, 251, 255}, {  0, 247, 255}, {  0, 242, 255}, {  0, 238, 255}, {  0, 234, 255},
+    {  0, 229, 255}, {  0, 225, 255}, {  0, 221, 255}, {  0, 217, 255}, {  0, 212, 255}, {  0, 208, 255},
+    {  0, 204, 255}, {  0, 200, 255}, {  0, 195, 255}, {  0, 191, 255}, {  0, 187, 255}, {  0, 183, 255},
+    {  0, 178, 255}, {  0, 174, 255}, {  0, 170, 255}, {  0, 166, 255}, {  0, 162, 255}, {  0, 157, 255},
+    {  0, 153, 255}, {  0, 149, 255}, {  0, 145, 255}, {  0, 140, 255}, {  0, 136, 255}, {  0, 132, 255},
+    {  0, 128, 255}, {  0, 123, 255}, {  0, 119, 255}, {  0, 115, 255}, {  0, 111, 255}, {  0, 106, 255},
+    {  0, 102, 255}, {  0,  98, 255}, {  0,  94, 255}, {  0,  89, 255}, {  0,  85, 255}, {  0,  81, 255},
+    {  0,  76, 255}, {  0,  72, 255}, {  0,  68, 255}, {  0,  64, 255}, {  0,  60, 255}, {  0,  55, 255},
+    {  0,  51, 255}, {  0,  47, 255}, {  0,  43, 255}, {  0,  38, 255}, {  0,  34, 255}, {  0,  30, 255},
+    {  0,  25, 255}, {  0,  21, 255}, {  0,  17, 255}, {  0,  13, 255}, {  0,   8, 255}, {  0,   4, 255},
+    {  0,   0, 255}, {  4,   0, 255}, {  8,   0, 255}, { 13,   0, 255}, { 17,   0, 255}, { 21,   0, 255},
+    { 25,   0, 255}, { 30,   0, 255}, { 34,   0, 255}, { 38,   0, 255}, { 42,   0, 255}, { 47,   0, 255},
+    { 51,   0, 255}, { 55,   0, 255}, { 60,   0, 255}, { 64,   0, 255}, { 68,   0, 255}, { 72,   0, 255},
+    { 76,   0, 255}, { 81,   0, 255}, { 85,   0, 255}, { 89,   0, 255}, { 93,   0, 255}, { 98,   0, 255},
+    {102,   0, 255}, {106,   0, 255}, {111,   0, 255}, {115,   0, 255}, {119,   0, 255}, {123,   0, 255},
+    {128,   0, 255}, {132,   0, 255}, {136,   0, 255}, {140,   0, 255}, {144,   0, 255}, {149,   0, 255},
+    {153,   0, 255}, {157,   0, 255}, {162,   0, 255}, {166,   0, 255}, {170,   0, 255}, {174,   0, 255},
+    {179,   0, 255}, {183,   0, 255}, {187,   0, 255}, {191,   0, 255}, {195,   0, 255}, {200,   0, 255},
+    {204,   0, 255}, {208,   0, 255}, {213,   0, 255}, {217,   0, 255}, {221,   0, 255}, {225,   0, 255},
+    {230,   0, 255}, {234,   0, 255}, {238,   0, 255}, {242,   0, 255}, {247,   0, 255}, {251,   0, 255},
+    {255,   0, 255}, {255,   0, 251}, {255,   0, 247}, {255,   0, 242}, {255,   0, 238}, {255,   0, 234},
+    {255,   0, 230}, {255,   0, 225}, {255,   0, 221}, {255,   0, 217}, {255,   0, 212}, {255,   0, 208},
+    {255,   0, 204}, {255,   0, 200}, {255,   0, 195}, {255,   0, 191}, {255,   0, 187}, {255,   0, 183},
+    {255,   0, 179}, {255,   0, 174}, {255,   0, 170}, {255,   0, 166}, {255,   0, 161}, {255,   0, 157},
+    {255,   0, 153}, {255,   0, 149}, {255,   0, 144}, {255,   0, 140}, {255,   0, 136}, {255,   0, 132},
+    {255,   0, 128}, {255,   0, 123}, {255,   0, 119}, {255,   0, 115}, {255,   0, 111}, {255,   0, 106},
+    {255,   0, 102}, {255,   0,  98}, {255,   0,  94}, {255,   0,  89}, {255,   0,  85}, {255,   0,  81},
+    {255,   0,  77}, {255,   0,  72}, {255,   0,  68}, {255,   0,  64}, {255,   0,  60}, {255,   0,  55},
+    {255,   0,  51}, {255,   0,  47}, {255,   0,  43}, {255,   0,  38}, {255,   0,  34}, {255,   0,  30},
+    {255,   0,  26}, {255,   0,  21}, {255,   0,  17}, {255,   0,  13}, {255,   0,   8}, {255,   0,   4},
+};
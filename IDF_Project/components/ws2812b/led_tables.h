@@ -0,0 +1,40 @@
+#ifndef LED_TABLES_H
+#define LED_TABLES_H
+
+#include <stdint.h>
+
+#define LED_BREATH_STEPS 256 // 呼吸波形一个周期的采样点数，必须是 2 的幂
+
+typedef struct
+{
+    uint8_t red;
+    uint8_t green;
+    uint8_t blue;
+} led_rgb8_t;
+
+/**
+ * @brief 感知亮度曲线（gamma 2.2），线性的亮度进度查表后再去缩放颜色，暗处不会一下子跳到全黑
+ *
+ * 输出是 16 位的，最暗的一段在 8 位里只有几级，低 8 位由合成器的时间抖动补出来
+ */
+extern const uint16_t led_gamma16[256];
+
+/**
+ * @brief 呼吸波形，一个周期从最亮（65535）按 gamma 曲线暗到 1% 再亮回来
+ */
+extern const uint16_t led_breath16[LED_BREATH_STEPS];
+
+/**
+ * @brief HSV 色环，饱和度和亮度都是最大值，按 Hue 0 - 359 索引
+ */
+extern const led_rgb8_t led_hue_wheel[360];
+
+/**
+ * @brief 8 位亮度缩放：value * scale / 255 的近似，scale = 255 时原样返回，只用乘法和移位
+ */
+static inline uint8_t led_scale8(uint8_t value, uint8_t scale)
+{
+    return (uint8_t)(((uint16_t)value * (scale + 1)) >> 8);
+}
+
+#endif // LED_TABLES_H
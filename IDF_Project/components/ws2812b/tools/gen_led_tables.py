@@ -0,0 +1,61 @@
+"""
+生成 led_tables.c：灯效渲染用的查找表
+
+渲染路径里只做整数查表和移位，所有浮点运算都在这里离线算好。改了参数之后在 ws2812b 目录下运行
+
+    python tools/gen_led_tables.py > led_tables.c
+"""
+import colorsys
+
+GAMMA = 2.2                 # 感知亮度曲线的幂次，和原来呼吸灯里的 pow(x, 2.2) 一致
+BREATH_MIN_PERCENT = 1      # 呼吸灯最暗时的亮度，和原来 brightness_min = 1 一致
+BREATH_STEPS = 256          # 呼吸波形一个周期的采样点数
+
+
+def gamma16(i):
+    # 16 位输出：暗处 8 位只剩几级，低 8 位交给时间抖动
+    return round(65535 * (i / 255) ** GAMMA)
+
+
+def breath16(i):
+    # 从最亮开始：前半段按 (1 - 2p)^2.2 变暗，后半段按 (2p - 1)^2.2 变亮
+    p = i / BREATH_STEPS
+    x = (1 - 2 * p) ** GAMMA if p <= 0.5 else (2 * p - 1) ** GAMMA
+    percent = BREATH_MIN_PERCENT + (100 - BREATH_MIN_PERCENT) * x
+    return round(percent * 65535 / 100)
+
+
+def hue_rgb(h):
+    r, g, b = colorsys.hsv_to_rgb(h / 360, 1.0, 1.0)
+    return round(r * 255), round(g * 255), round(b * 255)
+
+
+def rows(values, per_row, fmt):
+    out = []
+    for i in range(0, len(values), per_row):
+        out.append("    " + " ".join(fmt(v) + "," for v in values[i:i + per_row]))
+    return "\n".join(out)
+
+
+def main():
+    print("/**")
+    print(" * @file led_tables.c")
+    print(" * @brief 灯效渲染用的查找表，由 tools/gen_led_tables.py 生成，不要手改")
+    print(" */")
+    print('#include "led_tables.h"')
+    print()
+    print("const uint16_t led_gamma16[256] = {")
+    print(rows([gamma16(i) for i in range(256)], 12, lambda v: "%5d" % v))
+    print("};")
+    print()
+    print("const uint16_t led_breath16[LED_BREATH_STEPS] = {")
+    print(rows([breath16(i) for i in range(BREATH_STEPS)], 12, lambda v: "%5d" % v))
+    print("};")
+    print()
+    print("const led_rgb8_t led_hue_wheel[360] = {")
+    print(rows([hue_rgb(h) for h in range(360)], 6, lambda v: "{%3d, %3d, %3d}" % v))
+    print("};")
+
+
+if __name__ == "__main__":
+    main()
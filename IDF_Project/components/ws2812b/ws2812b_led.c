@@ -9,25 +9,42 @@
 #include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
 #include "esp_mac.h"
 #include "esp_system.h"
+#include "esp_timer.h"
+#include "nvs.h"
 #include "driver/rmt_tx.h"
+#include "soc/soc_caps.h"
 #include "led_strip_encoder.h"
 
 #include "ws2812b_led.h"
 #include "lock_control.h" //T IME_RECOVER_TEMP_OPEN
-#include <math.h>         // 用于指数计算
+#include "led_program.h"
+#include "led_compositor.h"
+#include "led_power.h"
 
 #define RMT_LED_STRIP_RESOLUTION_HZ 10000000 // 10MHz resolution, 1 tick = 0.1us (led strip needs a high resolution)
 #define RMT_LED_STRIP_GPIO_NUM GPIO_NUM_1    // GPIO number for the LED strip
 
-#define WS2812B_LED_NUMBERS 6
-#define EXAMPLE_CHASE_SPEED_MS 50
+#define WS2812B_FRAME_BUFFERS 2     // 帧缓冲数量，一个在 RMT 上发送的同时另一个给效果函数渲染
+#define WS2812B_TRANS_QUEUE_DEPTH 4 // RMT 后台事务队列深度，不能小于帧缓冲数量
+
+#define WS2812B_RMT_MEM_SYMBOLS 64       // 短灯带用的 RMT 内存（符号数），发送中途每 32 个符号（4/3 颗灯）补一次数据
+#define WS2812B_RMT_MEM_SYMBOLS_LONG 192 // 长灯带：C3 上一个 TX 通道最多可以连着占 4 块 48 符号的内存，补数据的中断少到三分之一
+#define WS2812B_RMT_DMA_SYMBOLS 1024     // 支持 RMT DMA 的芯片上，长灯带走 DMA，这是 DMA 缓冲的符号数
+#define WS2812B_LONG_STRIP_LEDS 16       // 超过这么多颗灯算长灯带
 #define ENUM_TO_STRING(name) #name
 
+#define WS2812B_NOTIFY_FRAME (1 << 0)  // 任务通知位：帧时钟到了
+#define WS2812B_NOTIFY_SWITCH (1 << 1) // 任务通知位：切换效果
+#define WS2812B_NOTIFY_OVERLAY (1 << 2) // 任务通知位：叠加层有变化
+#define WS2812B_NOTIFY_PIXELS (1 << 3)  // 任务通知位：ws2812b_pixels_commit() 提交了新的像素
+#define WS2812B_CUSTOM_SLOTS 3          // 下发程序的槽：正在播、正在淡出、新写入的各占一个
+
 // 定义全局变量
-QueueHandle_t effect_queue = NULL;
 TaskHandle_t xLedTaskHandle = NULL; // 初始化为 NULL
 
 // 定义局部变量
@@ -35,239 +52,378 @@ static rmt_channel_handle_t led_chan; // 配置 RMT 通道
 static rmt_encoder_handle_t led_encoder;
 static rmt_transmit_config_t tx_config;
 
-static uint8_t led_strip_pixels[WS2812B_LED_NUMBERS * 3]; // ws2812b LED 灯带的像素数据
+_Static_assert(WS2812B_FRAME_BUFFERS >= 2, "the frame pipeline needs at least two buffers");
+_Static_assert(WS2812B_TRANS_QUEUE_DEPTH >= WS2812B_FRAME_BUFFERS, "every frame buffer must fit in the RMT transaction queue");
 
-static const char *TAG = "WS2812B_LED"; // 定义日志标签
+static ws2812b_strip_config_t strip_config = {.count = WS2812B_LED_NUMBERS}; // 启动时从 NVS 读出来，之后不再变
+static const led_strip_chip_profile_t *strip_chip = NULL;                     // strip_config.chip 的时序和字节顺序
+static size_t led_frame_bytes = WS2812B_LED_NUMBERS * 3;                      // 一帧发到线上的字节数，灯数 * 每颗灯的字节数
 
-static uint32_t notify_count = 0;
+static uint8_t *led_frame_buffers[WS2812B_FRAME_BUFFERS]; // 帧缓冲池，按灯数从堆里分配
+static uint8_t *led_strip_pixels = NULL;                  // 效果函数正在渲染的后台缓冲，RMT 不会读它
+static uint8_t *led_logical_pixels = NULL;                // 灯带不是从顶端正向接线或者不是 WS2812 时，合成器先画在这里再按布局搬到后台缓冲
+static uint8_t *led_last_frame = NULL;                    // 最近一次交给 RMT 的缓冲，也就是灯带上正在显示的画面
 
-static ws2812b_queue_data_t received_effect_queue_data = {
-    // 定义全局参数变量并初始化
-    .effect_args =
-        {
-            .color_rgb = WHITE_RGB, // 默认Freedorm蓝色
-            .direction = LED_DIRECTION_TOP_DOWN,
-            .loop_mode = LED_MODE_LOOP,
-        },
-    .current_effect = DEFAULT_EFFECT,
-};
+// 已经交给 RMT 的缓冲按提交顺序排队，RMT 按同样的顺序发送完成，完成回调从队头取出归还
+static uint8_t *led_inflight_buffers[WS2812B_FRAME_BUFFERS];
+static volatile uint32_t led_inflight_head = 0; // 下一个提交的位置，只在效果任务里修改
+static volatile uint32_t led_inflight_tail = 0; // 下一个完成的位置，只在发送完成中断里修改
+static QueueHandle_t led_free_buffers = NULL;   // 发送完成、可以重新渲染的缓冲
+static ws2812b_pipeline_stats_t led_pipeline_stats = {0};
 
-static ws2812b_state_effect_t current_effect_btn = DEFAULT_EFFECT;
-static ws2812b_queue_data_t effect_data = {
-    .effect_args =
-        {
-            .color_rgb = {255, 0, 0}, // 红色
-            .direction = LED_DIRECTION_TOP_DOWN,
-            .loop_mode = LED_MODE_LOOP,
-        },
-    .current_effect = DEFAULT_EFFECT,
-};
+static const char *TAG = "WS2812B_LED"; // 定义日志标签
 
+static ws2812b_state_effect_t current_effect_btn = DEFAULT_EFFECT;
 static ws2812b_state_effect_t ws2812b_current_effect = DEFAULT_EFFECT;
 
-static esp_err_t res;
+static esp_timer_handle_t frame_clock = NULL;                 // 单次的帧时钟，效果任务每画完一帧按需要重新定时
+static int64_t dither_period_us = WS2812B_DITHER_PERIOD_US; // 时间抖动时的帧间隔，一帧发不完时退回普通帧率
 
-static volatile bool is_switch_effect = false; // 标志位，表示是否需要切换效果
+static led_compositor_t compositor; // 只在效果任务里访问
+static led_power_t power;           // 只在效果任务里访问
+
+// 其它任务设置的叠加层先放在这里，由效果任务在下一次醒来时交给合成器
+typedef struct
+{
+    const led_insn_t *program;
+    led_blend_t blend;
+    uint8_t alpha;
+} ws2812b_overlay_request_t;
+
+static ws2812b_overlay_request_t overlay_requests[LED_COMPOSITOR_OVERLAYS];
+static uint32_t overlay_pending = 0; // 有新请求的叠加层位图
+static portMUX_TYPE overlay_lock = portMUX_INITIALIZER_UNLOCKED; // 保护上面两个：蓝牙等任务写，效果任务取走
+
+// ws2812b_pixels_xxx() 写的像素，按效果顺序、G, B, R 排列；暂存区由 pixels_mutex 保护，提交后效果任务拷贝变化的部分给合成器
+static SemaphoreHandle_t pixels_mutex = NULL;
+static uint8_t *pixels_staging = NULL;
+static uint8_t *pixels_shown = NULL;       // LED_EFFECT_CUSTOM_PIXELS 的底层，只在效果任务里修改
+static uint16_t pixels_dirty_first = 0;    // 暂存区里还没拷贝给效果任务的变化范围 [first, end)
+static uint16_t pixels_dirty_end = 0;
+static volatile bool pixels_updating = false; // 持有 pixels_mutex 的任务正在更新
 
 // 函数声明
 
 /**
- * @brief 在这个函数里切换效果，通过修改 current_effect 的值来切换效果
+ * @brief 效果任务：帧时钟到了或者要切换效果时渲染一帧并交给 RMT 发送，其余时间阻塞不占 CPU
  *
  * @param arg
  */
 static void ws2812b_effect_task(void *arg);
 
 /**
- * @brief 为指定索引的 LED 设置颜色
+ * @brief 帧时钟回调，在 esp_timer 任务里执行，只唤醒效果任务
  *
- * @param index
- * @param r
- * @param g
- * @param b
+ * @param arg
  */
-void ws2812b_set_color(int index, uint8_t r, uint8_t g, uint8_t b);
+static void ws2812b_frame_clock_cb(void *arg);
 
-/**
- * @brief 选择一个颜色，设置所有 LED 为这个颜色
- *
- * @param rgb_color
- * @param time_ms 持续时间，单位 ms，在持续时间内可以切换效果，0 表示立刻设置，之后也会一直保持这个颜色
- */
-static void ws2812b_led_set_color_all(ws2812b_color_rgb_t rgb_color, uint16_t time_ms);
+// 每个状态的灯效程序，按 ws2812b_state_effect_t 索引；原来的效果函数播完一遍会被效果任务重新调用，所以这里默认都是循环播放
+// 颜色和 RED_RGB、BLUE_RGB 这些宏写法一样（红色是 0, 0, 255，蓝色是 255, 0, 0），发到灯带上的字节和原来的效果函数相同
+static const led_insn_t program_debug[] = {
+    LED_INSN(LED_OP_SWEEP, 0, 500, 0, 255, 0, 0),
+    LED_INSN(LED_OP_END, 0, 0, 0, 0, 0, 0),
+};
+static const led_insn_t program_default_state[] = {
+    LED_INSN(LED_OP_RAINBOW, 0, 15 * 1000, 0, 0, 0, 0), // 15秒走完一圈色环
+    LED_INSN(LED_OP_END, 0, 0, 0, 0, 0, 0),
+};
+static const led_insn_t program_single_open_door[] = {
+    LED_INSN(LED_OP_SWEEP, 0, 250, 0, 255, 0, 0),
+    LED_INSN(LED_OP_HOLD, 0, TIME_RECOVER_TEMP_OPEN, 0, 255, 0, 0),
+    LED_INSN(LED_OP_END, 0, 0, 0, 0, 0, 0),
+};
+static const led_insn_t program_always_open_mode[] = {
+    LED_INSN(LED_OP_BREATH, 0, 5600, 0, 255, 0, 0),
+    LED_INSN(LED_OP_END, 0, 0, 0, 0, 0, 0),
+};
+static const led_insn_t program_blink_green[] = {
+    LED_INSN(LED_OP_BLINK, 3, 200, 0, 255, 0, 0),
+    LED_INSN(LED_OP_END, 0, 0, 0, 0, 0, 0),
+};
+static const led_insn_t program_confirm_factory_reset[] = {
+    LED_INSN(LED_OP_METEOR, 3, 300, 0, 0, 255, 0),
+    LED_INSN(LED_OP_HOLD, 0, 1000, 0, 0, 255, 0), // 最后再亮一会
+    LED_INSN(LED_OP_END, 0, 0, 0, 0, 0, 0),
+};
+static const led_insn_t program_factory_resetting[] = {
+    LED_INSN(LED_OP_BREATH, 0, 1000, 0, 0, 255, 0), // 红灯呼吸，直到完成恢复出厂设置后进入下一个状态
+    LED_INSN(LED_OP_END, 0, 0, 0, 0, 0, 0),
+};
+static const led_insn_t program_blink_red[] = {
+    LED_INSN(LED_OP_BLINK, 3, 200, 0, 0, 255, 0),
+    LED_INSN(LED_OP_END, 0, 0, 0, 0, 0, 0),
+};
+static const led_insn_t program_ble_try_pairing[] = {
+    LED_INSN(LED_OP_METEOR, 3, 300, 255, 0, 0, 0),
+    LED_INSN(LED_OP_HOLD, 0, 1000, 255, 0, 0, 0),
+    LED_INSN(LED_OP_END, 0, 0, 0, 0, 0, 0),
+};
+static const led_insn_t program_ble_pairing_mode[] = {
+    LED_INSN(LED_OP_BREATH, 0, 1000, 255, 0, 0, 0),
+    LED_INSN(LED_OP_END, 0, 0, 0, 0, 0, 0),
+};
+static const led_insn_t program_blink_blue[] = {
+    LED_INSN(LED_OP_BLINK, 3, 200, 255, 0, 0, 0),
+    LED_INSN(LED_OP_END, 0, 0, 0, 0, 0, 0),
+};
+static const led_insn_t program_visitor_code_open_door[] = {
+    LED_INSN(LED_OP_SWEEP, 0, 500, 255, 0, 255, 0),
+    LED_INSN(LED_OP_END, 0, 0, 0, 0, 0, 0),
+};
+static const led_insn_t program_blink_purple[] = {
+    LED_INSN(LED_OP_BLINK, 3, 200, 255, 0, 255, 0),
+    LED_INSN(LED_OP_END, 0, 0, 0, 0, 0, 0),
+};
+static const led_insn_t program_open_bluetooth_nearby[] = {
+    LED_INSN(LED_OP_SWEEP, 0, 1000, 255, 0, 0, 0),
+    LED_INSN(LED_OP_HOLD, 0, TIME_BLE_RECOVER_TEMP_OPEN, 255, 0, 0, 0),
+    LED_INSN(LED_OP_END, 0, 0, 0, 0, 0, 0),
+};
+static const led_insn_t program_lock_door[] = {
+    LED_INSN(LED_OP_RANDOM, 10, 100, 0, 0, 0, 0),
+    LED_INSN(LED_OP_END, 0, 0, 0, 0, 0, 0),
+};
+static const led_insn_t program_power_on_animation[] = {
+    LED_INSN(LED_OP_OFF, 0, 1000, 0, 0, 0, 0), // 现在是黑屏
+    LED_INSN(LED_OP_END, 1, 0, 0, 0, 0, 0),
+};
+static const led_insn_t program_first_power_on_activate[] = {
+    LED_INSN(LED_OP_SUNRISE, 0, 6 * 1000, 255, 0, 0, 0),
+    LED_INSN(LED_OP_END, 0, 0, 0, 0, 0, 0),
+};
 
-/**
- * @brief 所有 LED 同时显示相同颜色，并逐渐变换 HSV 色环的 Hue 值
- *
- */
-static void ws2812b_led_rainbow_all(void);
+static const led_insn_t *const effect_programs[LED_EFFECT_COUNT] = {
+    [LED_EFFECT_DEBUG] = program_debug,
+    [LED_EFFECT_DEFAULT_STATE] = program_default_state,
+    [LED_EFFECT_SINGLE_OPEN_DOOR] = program_single_open_door,
+    [LED_EFFECT_ALWAYS_OPEN_MODE] = program_always_open_mode,
+    [LED_EFFECT_OPEN_MODE_END] = program_blink_green,
+    [LED_EFFECT_CONFIRM_FACTORY_RESET] = program_confirm_factory_reset,
+    [LED_EFFECT_FACTORY_RESETTING] = program_factory_resetting,
+    [LED_EFFECT_FINISH_FACTORY_RESET] = program_blink_red,
+    [LED_EFFECT_BLE_TRY_PAIRING] = program_ble_try_pairing,
+    [LED_EFFECT_BLE_PAIRING_MODE] = program_ble_pairing_mode,
+    [LED_EFFECT_BLE_CONNECTED_FIRST_TIME] = program_blink_blue,
+    [LED_EFFECT_VISITOR_CODE_OPEN_DOOR] = program_visitor_code_open_door,
+    [LED_EFFECT_VISITOR_CODE_TIME_EXPIRED] = program_blink_purple,
+    [LED_EFFECT_OPEN_BLUETOOTH_NEARBY] = program_open_bluetooth_nearby,
+    [LED_EFFECT_OPEN_BLUETOOTH_FINISHED] = program_blink_blue,
+    [LED_EFFECT_LOCK_DOOR] = program_lock_door,
+    [LED_EFFECT_POWER_ON_ANIMATION] = program_power_on_animation,
+    [LED_EFFECT_FIRST_POWER_ON_ACTIVATE] = program_first_power_on_activate,
+    // LED_EFFECT_CUSTOM_PROGRAM 的程序在 RAM 里，由 ws2812b_play_program() 设置
+};
 
-/**
- * @brief 彩虹的动态滚动效果，hsv中的h值从0到360，s和v值固定
- *
- */
-static void ws2812b_led_rainbow_wave(void);
+// 状态提示叠加层：蓝牙连上时在当前效果上闪一下蓝色
+const led_insn_t ws2812b_overlay_ble_connected[] = {
+    LED_INSN(LED_OP_FADE, 0, 150, 255, 0, 0, 0),
+    LED_INSN(LED_OP_FADE, 0, 450, 0, 0, 0, 0),
+    LED_INSN(LED_OP_END, 1, 0, 0, 0, 0, 0),
+};
 
-/**
- * @brief 一排led灯呼吸灯效果，从一端到另一端，类似水波，需要预先设置颜色
- *
- * @param color_rgb 呼吸灯颜色
- * @param direction 呼吸灯方向, 从上到下或者从下到上
- * @param loop_mode 循环模式, 循环或者来回
- */
-static void ws2812b_led_breathing_wave(ws2812b_color_rgb_t color_rgb, ws2812b_direction_t direction, ws2812b_loop_mode_t loop_mode);
+// ws2812b_play_program() 下发的程序，几个槽轮流用，写新程序时不会改到效果任务正在播或者正在淡出的那个
+static led_insn_t custom_programs[WS2812B_CUSTOM_SLOTS][LED_PROGRAM_MAX_INSNS];
+static volatile int custom_program_pending = 0;  // 最近写入的槽，切换效果时效果任务从这里取
+static volatile int custom_program_playing = -1; // 效果任务正在播的槽
+static volatile int custom_program_fading = -1;  // 正在交叉淡出的槽
 
-/**
- * @brief 所有led灯同时有呼吸灯效果，亮度颜色都统一，需要设置颜色
- *
- * @param color_rgb 呼吸灯颜色
- * @param breath_time_ms 呼吸灯最小正周期时间，单位 ms
- * @param start_from_max 是否从最大亮度开始
- */
-static void ws2812b_led_breathing_all(ws2812b_color_rgb_t color_rgb, uint16_t breath_time_ms, bool start_from_max);
+// 函数定义
 
 /**
- * @brief 彩虹效果加呼吸灯效果，每个LED颜色亮度统一，不需要设置颜色
- *
- * @param breath_time_ms 呼吸灯跑完一圈huv色环时间，单位 ms
+ * @brief RMT 发送完成中断：这一帧已经离开缓冲区，把缓冲还给空闲队列
  */
-static void ws2812b_led_rainbow_breathing_all(uint16_t loop_time_ms);
+static bool IRAM_ATTR led_strip_tx_done(rmt_channel_handle_t tx_chan, const rmt_tx_done_event_data_t *edata, void *user_ctx)
+{
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    uint8_t *buffer = led_inflight_buffers[led_inflight_tail % WS2812B_FRAME_BUFFERS];
+    led_inflight_tail++;
+    led_pipeline_stats.frames_done++;
+    xQueueSendFromISR(led_free_buffers, &buffer, &higher_priority_task_woken);
+    return higher_priority_task_woken == pdTRUE;
+}
 
 /**
- * @brief 彩虹效果加波浪呼吸灯效果，每个LED颜色亮度统一，不需要设置颜色
- *
+ * @brief 效果里的第 index 颗灯（0 是顶端）在灯带上是第几颗
  */
-static void ws2812b_led_rainbow_breathing_wave(void);
+static int strip_physical_index(int index)
+{
+    int offset = strip_config.reversed ? strip_config.count - index : index;
+    return (strip_config.first + offset) % strip_config.count;
+}
 
 /**
- * @brief 像流星一样的效果，从一端到滑道另一端，亮度逐渐减小，非常快速，需要预先设置颜色
- *
- * @param color_rgb 颜色
- * @param metror_time_ms 流星效果持续时间，单位 ms
- * @param direction 流星方向
- * @param accumulate 是否累积效果，如果为 true，效果会叠加，否则会清除之前的效果
- *
+ * @brief 芯片收的就是合成器的 G, B, R 三个字节，不用重新排列
  */
-static void ws2812b_led_meteor(ws2812b_color_rgb_t color_rgb, uint16_t metror_time_ms, ws2812b_direction_t direction, bool accumulate);
+static bool strip_chip_is_native(void)
+{
+    return strip_chip->bytes_per_pixel == 3 && strip_chip->order[0] == LED_STRIP_CHANNEL_G &&
+           strip_chip->order[1] == LED_STRIP_CHANNEL_B && strip_chip->order[2] == LED_STRIP_CHANNEL_R;
+}
 
 /**
- * @brief 乱闪，最杀马特的一集，用来提示门锁上了
+ * @brief 把合成器按效果顺序画好的一帧（G, B, R）按布局和芯片的字节顺序搬到后台缓冲
  *
+ * RGBW 的灯把三个通道共有的部分交给白色通道，颜色不变，白光更纯也更省电
  */
-static void ws2812b_led_random_color(void);
+static void apply_strip_layout(const uint8_t *logical, uint8_t *physical)
+{
+    uint8_t bytes_per_pixel = strip_chip->bytes_per_pixel;
+    if (strip_chip_is_native())
+    {
+        for (int i = 0; i < strip_config.count; i++)
+        {
+            memcpy(&physical[strip_physical_index(i) * 3], &logical[i * 3], 3);
+        }
+        return;
+    }
 
-/**
- * @brief 闪烁效果
- *
- * @param color_rgb     颜色
- * @param flash_hold_time_ms 最小正周期持续时间, 单位 ms，不超过1分钟
- * @param light_on_duty_cycle 亮灯时间占空比，0-100
- * @param flash_count 闪烁次数
- */
-static void ws2812b_led_blink(ws2812b_color_rgb_t color_rgb, uint16_t flash_hold_time_ms, uint8_t light_on_duty_cycle, uint8_t flash_count);
+    for (int i = 0; i < strip_config.count; i++)
+    {
+        const uint8_t *grb = &logical[i * 3];
+        uint8_t channels[LED_STRIP_CHANNEL_COUNT] = {
+            [LED_STRIP_CHANNEL_R] = grb[2],
+            [LED_STRIP_CHANNEL_G] = grb[0],
+            [LED_STRIP_CHANNEL_B] = grb[1],
+        };
+        if (bytes_per_pixel == 4)
+        {
+            uint8_t white = channels[LED_STRIP_CHANNEL_R];
+            white = channels[LED_STRIP_CHANNEL_G] < white ? channels[LED_STRIP_CHANNEL_G] : white;
+            white = channels[LED_STRIP_CHANNEL_B] < white ? channels[LED_STRIP_CHANNEL_B] : white;
+            channels[LED_STRIP_CHANNEL_R] -= white;
+            channels[LED_STRIP_CHANNEL_G] -= white;
+            channels[LED_STRIP_CHANNEL_B] -= white;
+            channels[LED_STRIP_CHANNEL_W] = white;
+        }
 
-/**
- * @brief 像瀑布一样的效果，一开始都是暗的，然后从顶端向底端LED依次亮起，亮起后的轨迹不会消失
- *
- * @param color_rgb 颜色
- * @param waterfall_hold_time_ms 效果时间，单位 ms
- */
-static void ws2812b_led_waterfall(ws2812b_color_rgb_t color_rgb, uint16_t waterfall_hold_time_ms);
+        uint8_t *out = &physical[strip_physical_index(i) * bytes_per_pixel];
+        for (int c = 0; c < bytes_per_pixel; c++)
+        {
+            out[c] = channels[strip_chip->order[c]];
+        }
+    }
+}
 
-/**
- * @brief 实现日出效果的灯光动态变化，从顶端到底端逐渐增加亮度。
- *
- * 功能描述：
- * - 效果开始时，顶端的 LED 逐渐变亮，而底端的 LED 完全熄灭。
- * - 随着效果进行，每个 LED 的亮度逐步增加，不同 LED 之间保持亮度差。
- * - 当某颗 LED 的亮度达到最大值时，其亮度不再变化，而下方的 LED 继续变亮。
- * - 整体效果是从顶端到底端逐步呈现日出的渐亮效果。
- *
- * @param color_rgb 指定 LED 显示的颜色（RGB 格式）。
- * @param sunrise_hold_time_ms 效果持续的总时间，单位为毫秒 (ms)。
- */
-static void ws2812b_led_sunrise(ws2812b_color_rgb_t color_rgb, uint16_t sunrise_hold_time_ms);
+static bool strip_config_is_valid(const ws2812b_strip_config_t *config)
+{
+    return config->count > 0 && config->count <= WS2812B_LED_NUMBERS_MAX && config->first < config->count && config->reversed <= 1 &&
+           led_strip_chip_profile(config->chip) != NULL;
+}
 
 /**
- * @brief 关闭 LED 灯带，不发光
- *
+ * @brief 从 NVS 读灯带配置，没有配置或者配置不合法时用默认的 WS2812B_LED_NUMBERS 颗、从顶端正向接线
  */
-static void ws2812b_shutdown(void);
+static void load_strip_config(void)
+{
+    ws2812b_strip_config_t config = {0};
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(WS2812B_NVS_NAMESPACE, NVS_READONLY, &nvs_handle);
+    if (err == ESP_OK)
+    {
+        size_t required_size = sizeof(config);
+        err = nvs_get_blob(nvs_handle, WS2812B_NVS_KEY, &config, &required_size);
+        nvs_close(nvs_handle);
+    }
 
-// 函数定义
+    if (err == ESP_ERR_NVS_NOT_FOUND)
+    {
+        ESP_LOGI(TAG, "No strip config in NVS, using %d LEDs", WS2812B_LED_NUMBERS);
+    }
+    else if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to load strip config from NVS: %s", esp_err_to_name(err));
+    }
+    else if (!strip_config_is_valid(&config))
+    {
+        ESP_LOGE(TAG, "Strip config in NVS is corrupted, ignoring it");
+    }
+    else
+    {
+        strip_config = config;
+    }
+}
 
-/**
- * @brief Simple helper function, converting HSV color space to RGB color space
- *
- * Wiki: https://en.wikipedia.org/wiki/HSL_and_HSV
- *
- */
-static void led_strip_hsv2rgb(uint32_t h, uint32_t s, uint32_t v, uint32_t *r, uint32_t *g, uint32_t *b)
+esp_err_t ws2812b_led_set_strip_config(const ws2812b_strip_config_t *config)
 {
-    h %= 360; // h -> [0,360]
-    uint32_t rgb_max = v * 2.55f;
-    uint32_t rgb_min = rgb_max * (100 - s) / 100.0f;
+    if (config == NULL || !strip_config_is_valid(config))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
 
-    uint32_t i = h / 60;
-    uint32_t diff = h % 60;
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(WS2812B_NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
+        return err;
+    }
 
-    // RGB adjustment amount by hue
-    uint32_t rgb_adj = (rgb_max - rgb_min) * diff / 60;
+    err = nvs_set_blob(nvs_handle, WS2812B_NVS_KEY, config, sizeof(*config));
+    if (err == ESP_OK)
+    {
+        err = nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
 
-    switch (i)
+    if (err != ESP_OK)
     {
-    case 0:
-        *r = rgb_max;
-        *g = rgb_min + rgb_adj;
-        *b = rgb_min;
-        break;
-    case 1:
-        *r = rgb_max - rgb_adj;
-        *g = rgb_max;
-        *b = rgb_min;
-        break;
-    case 2:
-        *r = rgb_min;
-        *g = rgb_max;
-        *b = rgb_min + rgb_adj;
-        break;
-    case 3:
-        *r = rgb_min;
-        *g = rgb_max - rgb_adj;
-        *b = rgb_max;
-        break;
-    case 4:
-        *r = rgb_min + rgb_adj;
-        *g = rgb_min;
-        *b = rgb_max;
-        break;
-    default:
-        *r = rgb_max;
-        *g = rgb_min;
-        *b = rgb_max - rgb_adj;
-        break;
+        ESP_LOGE(TAG, "Failed to save strip config to NVS: %s", esp_err_to_name(err));
     }
+    return err;
 }
 
-// 刷入数据到 LED 灯带
-static void flash_led_strip()
+void ws2812b_led_get_strip_config(ws2812b_strip_config_t *config)
 {
-    ESP_ERROR_CHECK(rmt_transmit(led_chan, led_encoder, led_strip_pixels, sizeof(led_strip_pixels), &tx_config));
-    ESP_ERROR_CHECK(rmt_tx_wait_all_done(led_chan, portMAX_DELAY));
+    *config = strip_config;
 }
 
-static ws2812b_color_rgb_t adjust_brightness(ws2812b_color_rgb_t *color_rgb, int brightness)
+// 刷入数据到 LED 灯带：把渲染好的后台缓冲交给 RMT 后台发送，不等发送完成，换一个空闲缓冲继续渲染下一帧
+static void flash_led_strip()
 {
-    ws2812b_color_rgb_t adjusted_color = {
-        .red = color_rgb->red * brightness / 100,
-        .green = color_rgb->green * brightness / 100,
-        .blue = color_rgb->blue * brightness / 100,
-    };
+    uint8_t *front = led_strip_pixels;
+
+    // 只发到最后一颗变化的灯为止，后面的灯收不到数据，复位之后保持上一次锁存的颜色；整帧都没变就不发
+    size_t bytes = led_frame_bytes;
+    if (led_last_frame != NULL)
+    {
+        while (bytes > 0 && front[bytes - 1] == led_last_frame[bytes - 1])
+        {
+            bytes--;
+        }
+        if (bytes == 0)
+        {
+            led_pipeline_stats.frames_unchanged++;
+            return;
+        }
+        bytes = (bytes + strip_chip->bytes_per_pixel - 1) / strip_chip->bytes_per_pixel * strip_chip->bytes_per_pixel;
+    }
+
+    led_inflight_buffers[led_inflight_head % WS2812B_FRAME_BUFFERS] = front;
+    led_inflight_head++;
+    ESP_ERROR_CHECK(rmt_transmit(led_chan, led_encoder, front, bytes, &tx_config));
+    led_pipeline_stats.frames_submitted++;
+    led_pipeline_stats.bytes_transmitted += bytes;
+    led_last_frame = front;
 
-    return adjusted_color;
+    // 只有渲染比线上发送还快时才会等，最多等一帧的发送时间
+    uint8_t *next = NULL;
+    if (xQueueReceive(led_free_buffers, &next, 0) != pdTRUE)
+    {
+        led_pipeline_stats.buffer_waits++;
+        xQueueReceive(led_free_buffers, &next, portMAX_DELAY);
+    }
+
+    // 合成器每一帧都整帧重画，新的后台缓冲不用从刚提交的那一帧拷贝
+    led_strip_pixels = next;
+}
+
+void ws2812b_led_get_pipeline_stats(ws2812b_pipeline_stats_t *stats)
+{
+    *stats = led_pipeline_stats;
 }
 
-static const char *get_effect_name(ws2812b_state_effect_t effect)
+const char *ws2812b_effect_name(ws2812b_state_effect_t effect)
 {
     switch (effect)
     {
@@ -307,6 +463,10 @@ static const char *get_effect_name(ws2812b_state_effect_t effect)
         return ENUM_TO_STRING(LED_EFFECT_POWER_ON_ANIMATION);
     case LED_EFFECT_FIRST_POWER_ON_ACTIVATE:
         return ENUM_TO_STRING(LED_EFFECT_FIRST_POWER_ON_ACTIVATE);
+    case LED_EFFECT_CUSTOM_PROGRAM:
+        return ENUM_TO_STRING(LED_EFFECT_CUSTOM_PROGRAM);
+    case LED_EFFECT_CUSTOM_PIXELS:
+        return ENUM_TO_STRING(LED_EFFECT_CUSTOM_PIXELS);
     default:
         return "Unknown Effect";
     }
@@ -320,799 +480,450 @@ void loop_ws2812b_effect()
 
 void ws2812b_switch_effect(ws2812b_state_effect_t effect)
 {
-    ESP_LOGI(TAG, "Sent! Switch to effect: %s", get_effect_name(effect));
+    ESP_LOGI(TAG, "Sent! Switch to effect: %s", ws2812b_effect_name(effect));
 
     ws2812b_current_effect = effect;
-    is_switch_effect = true;
-    // effect_data = (ws2812b_queue_data_t){
-    //     .current_effect = effect,
-    //     .effect_args = {
-    //         .color_rgb = WHITE_RGB, // 根据需要设置颜色
-    //         .direction = LED_DIRECTION_TOP_DOWN,
-    //         .loop_mode = LED_MODE_LOOP,
-    //     },
-    // };
-
-    // 通知LED线程切换效果
-    // xTaskNotify(xLedTaskHandle, 0, eIncrement);
-    // if (xQueueSend(effect_queue, &effect_data, portMAX_DELAY) == pdPASS)
-    // {
-    //     ESP_LOGI(TAG, "Effect data sent to queue.");
-    // }
-    // else
-    // {
-    //     ESP_LOGI(TAG, "Failed to send effect data to queue.");
-    // }
-}
 
-// 从队列中接收转换效果命令
-static void queue_receive_from_button(void)
-{
-    // if (xTaskNotifyWait(0, 0, &notify_count, pdMS_TO_TICKS(10)) == pdPASS) // 说明需要转换效果了
-    // {
-    //     // 不要打印任何东西，需要低延时
-    //     // 用Notify做通知而不用queue是因为，通知时间开销更小，能够满足无极变色的需求
-    //     if (effect_queue == NULL)
-    //     {
-    //         ESP_LOGE(TAG, "Effect queue not initialized!");
-    //     }
-
-    //     if (xQueueReceive(effect_queue, &received_effect_queue_data, 10) == pdPASS)
-    //     {
-    //         // 更新当前效果
-    //         is_switch_effect = true;
-    //         ws2812b_current_effect = received_effect_queue_data.current_effect;
-    //         ESP_LOGI(TAG, "Received! Switch to effect: %s", get_effect_name(ws2812b_current_effect));
-    //     }
-    // }
-
-    return;
+    // 通知LED线程切换效果，它正阻塞在 xTaskNotifyWait 上，马上就会醒来渲染新效果的第一帧
+    if (xLedTaskHandle != NULL)
+    {
+        xTaskNotify(xLedTaskHandle, WS2812B_NOTIFY_SWITCH, eSetBits);
+    }
 }
 
-// 检查是否需要切换效果
-static bool check_effect_switch(void)
+esp_err_t ws2812b_play_program(const led_insn_t *program, size_t count)
 {
-    if (is_switch_effect)
+    if (led_program_validate(program, count) != ESP_OK)
     {
-        ESP_LOGI(TAG, "Effect switched during transition!");
-        is_switch_effect = false;
-        return true; // 指示需要切换
+        ESP_LOGW(TAG, "Rejected LED program (%u instructions)", (unsigned)count);
+        return ESP_ERR_INVALID_ARG;
     }
-    return false; // 不需要切换
+
+    // 写进效果任务既没在播也没在淡出的槽，切换时效果任务再换过去
+    int slot = 0;
+    while (slot == custom_program_playing || slot == custom_program_fading)
+    {
+        slot++;
+    }
+    memset(custom_programs[slot], 0, sizeof(custom_programs[slot]));
+    memcpy(custom_programs[slot], program, count * sizeof(led_insn_t) < sizeof(custom_programs[slot]) ? count * sizeof(led_insn_t) : sizeof(custom_programs[slot]));
+    custom_program_pending = slot;
+    ws2812b_switch_effect(LED_EFFECT_CUSTOM_PROGRAM);
+    return ESP_OK;
 }
 
-void ws2812b_led_init(void)
+/**
+ * @brief 写暂存区里的一颗灯，颜色真的变了才扩大变化范围
+ */
+static void pixels_store(uint16_t index, uint8_t r, uint8_t g, uint8_t b)
 {
-    ESP_LOGI(TAG, "Create RMT TX channel");
-    led_chan = NULL;
-    rmt_tx_channel_config_t tx_chan_config = {
-        .clk_src = RMT_CLK_SRC_DEFAULT, // select source clock
-        .gpio_num = RMT_LED_STRIP_GPIO_NUM,
-        .mem_block_symbols = 64, // increase the block size can make the LED less flickering
-        .resolution_hz = RMT_LED_STRIP_RESOLUTION_HZ,
-        .trans_queue_depth = 4, // set the number of transactions that can be pending in the background
-    };
-    ESP_ERROR_CHECK(rmt_new_tx_channel(&tx_chan_config, &led_chan));
-
-    ESP_LOGI(TAG, "Install led strip encoder");
-    led_encoder = NULL;
-    led_strip_encoder_config_t encoder_config = {
-        .resolution = RMT_LED_STRIP_RESOLUTION_HZ,
-    };
-    // ESP_ERROR_CHECK(rmt_new_led_strip_encoder(&encoder_config, &led_encoder));
-
-    esp_err_t err = rmt_new_led_strip_encoder(&encoder_config, &led_encoder);
-    if (err != ESP_OK)
+    uint8_t *pixel = &pixels_staging[index * 3];
+    if (pixel[0] == g && pixel[1] == b && pixel[2] == r)
     {
-        ESP_LOGE(TAG, "Failed to install LED strip encoder: %s", esp_err_to_name(err));
-        return; // 提前返回，避免使用未初始化的 encoder
+        return;
     }
+    pixel[0] = g;
+    pixel[1] = b;
+    pixel[2] = r;
 
-    ESP_LOGI(TAG, "Enable RMT TX channel");
-    ESP_ERROR_CHECK(rmt_enable(led_chan));
-
-    ESP_LOGI(TAG, "WB2812B led strip initialized");
-    // 使用复合字面量
-    tx_config = (rmt_transmit_config_t){
-        .loop_count = 0,
-    };
-
-    // 初始化队列
-    effect_queue = xQueueCreate(1, sizeof(ws2812b_queue_data_t));
-
-    // 初始化随机数生成器（如果在主任务中已初始化，可以移除）
-    srand(time(NULL));
-
-    // 创建效果任务
-    xTaskCreate(ws2812b_effect_task, "ws2812b_effect_task", 2048, NULL, 5, &xLedTaskHandle);
+    if (pixels_dirty_first >= pixels_dirty_end)
+    {
+        pixels_dirty_first = index;
+        pixels_dirty_end = index + 1;
+    }
+    else if (index < pixels_dirty_first)
+    {
+        pixels_dirty_first = index;
+    }
+    else if (index >= pixels_dirty_end)
+    {
+        pixels_dirty_end = index + 1;
+    }
 }
 
 /**
- * @brief 主状态机切换函数，根据当前状态切换到新的状态
- *
- * @param arg
+ * @brief 不在更新中或者越界时返回 0，否则返回 [first, first + count) 在灯带范围内的灯数
  */
-static void ws2812b_effect_task(void *arg)
+static uint16_t pixels_clip(uint16_t first, uint16_t count)
 {
-
-    while (1)
+    if (!pixels_updating)
     {
-        // 检查队列是否有新的效果命令
-        queue_receive_from_button();
-
-        // 执行当前效果
-        switch (ws2812b_current_effect)
-        {
-        case LED_EFFECT_DEBUG:
-            // 用于调试
-            ws2812b_led_waterfall((ws2812b_color_rgb_t)GREEN_RGB, 500);
-
-            break;
-        case LED_EFFECT_DEFAULT_STATE:
-            ws2812b_led_rainbow_breathing_all(15 * 1000); // 15秒走完一圈色环
-            break;
-
-        case LED_EFFECT_SINGLE_OPEN_DOOR:
-            ws2812b_led_waterfall((ws2812b_color_rgb_t)GREEN_RGB, 250);
-            ws2812b_led_set_color_all((ws2812b_color_rgb_t)GREEN_RGB, TIME_RECOVER_TEMP_OPEN);
-            break;
-
-        case LED_EFFECT_ALWAYS_OPEN_MODE:
-            ws2812b_led_breathing_all((ws2812b_color_rgb_t)GREEN_RGB, 5600, true);
-            break;
-
-        case LED_EFFECT_OPEN_MODE_END:
-            ws2812b_led_blink((ws2812b_color_rgb_t)GREEN_RGB, 200, 50, 3);
-            break;
-
-        case LED_EFFECT_CONFIRM_FACTORY_RESET:
-            ws2812b_led_meteor((ws2812b_color_rgb_t)RED_RGB, 500, LED_DIRECTION_TOP_DOWN, true);
-            break;
-
-        case LED_EFFECT_FACTORY_RESETTING:
-            // 红灯呼吸，直到完成恢复出厂设置后进入下一个状态
-            ws2812b_led_breathing_all((ws2812b_color_rgb_t)RED_RGB, 1000, true);
-            break;
-
-        case LED_EFFECT_FINISH_FACTORY_RESET:
-            ws2812b_led_blink((ws2812b_color_rgb_t)RED_RGB, 200, 50, 3);
-            break;
-
-        case LED_EFFECT_BLE_TRY_PAIRING:
-            ws2812b_led_meteor((ws2812b_color_rgb_t)BLUE_RGB, 500, LED_DIRECTION_TOP_DOWN, true);
-            break;
-
-        case LED_EFFECT_BLE_PAIRING_MODE:
-            ws2812b_led_breathing_all((ws2812b_color_rgb_t)BLUE_RGB, 1000, true);
-            break;
-
-        case LED_EFFECT_BLE_CONNECTED_FIRST_TIME:
-            ws2812b_led_blink((ws2812b_color_rgb_t)BLUE_RGB, 200, 50, 3);
-            break;
-
-        case LED_EFFECT_OPEN_BLUETOOTH_NEARBY:
-            ws2812b_led_waterfall((ws2812b_color_rgb_t)BLUE_RGB, 1000);
-            ws2812b_led_set_color_all((ws2812b_color_rgb_t)BLUE_RGB, TIME_BLE_RECOVER_TEMP_OPEN);
-            break;
-
-        case LED_EFFECT_OPEN_BLUETOOTH_FINISHED:
-            ws2812b_led_blink((ws2812b_color_rgb_t)BLUE_RGB, 200, 50, 3);
-            break;
-
-        case LED_EFFECT_VISITOR_CODE_OPEN_DOOR:
-            ws2812b_led_waterfall((ws2812b_color_rgb_t)PURPLE_RGB, 500);
-            break;
-
-        case LED_EFFECT_VISITOR_CODE_TIME_EXPIRED:
-            ws2812b_led_blink((ws2812b_color_rgb_t)PURPLE_RGB, 200, 50, 3);
-            break;
-
-        case LED_EFFECT_LOCK_DOOR:
-            ws2812b_led_random_color();
-            break;
-        case LED_EFFECT_POWER_ON_ANIMATION:
-            ws2812b_shutdown();
-            break;
-
-        case LED_EFFECT_FIRST_POWER_ON_ACTIVATE:
-            ws2812b_led_sunrise((ws2812b_color_rgb_t)BLUE_RGB, 6 * 1000);
-            break;
-
-        default:
-            ESP_LOGW(TAG, "Unknown effect: %d", ws2812b_current_effect);
-            ws2812b_current_effect = DEFAULT_EFFECT;
-            break;
-        }
-        // 延迟一小段时间，避免任务占用过多 CPU
-        vTaskDelay(pdMS_TO_TICKS(10));
+        ESP_LOGW(TAG, "Pixels written outside ws2812b_pixels_begin() / ws2812b_pixels_commit()");
+        return 0;
     }
+    if (first >= strip_config.count)
+    {
+        return 0;
+    }
+    return count < strip_config.count - first ? count : strip_config.count - first;
 }
 
-void ws2812b_set_color(int index, uint8_t r, uint8_t g, uint8_t b)
+void ws2812b_pixels_begin(void)
 {
-    // 确保索引在有效范围内
-    if (index < 0 || index >= WS2812B_LED_NUMBERS)
+    if (pixels_mutex == NULL)
     {
-        ESP_LOGE(TAG, "Index %d is out of range", index);
+        ESP_LOGE(TAG, "LED strip is not initialized");
         return;
     }
-
-    // 设置指定索引的 LED 颜色 (RGB)
-    // LED 的 RGB 数据是按照 Green, Blue, Red 顺序存储的
-    led_strip_pixels[index * 3 + 0] = g; // Green
-    led_strip_pixels[index * 3 + 1] = b; // Blue
-    led_strip_pixels[index * 3 + 2] = r; // Red
-
-    // 刷新数据到 LED 灯带
-    flash_led_strip();
+    xSemaphoreTake(pixels_mutex, portMAX_DELAY);
+    pixels_updating = true;
 }
 
-static void ws2812b_led_set_color_all(ws2812b_color_rgb_t rgb_color, uint16_t time_ms)
+void ws2812b_pixels_set(uint16_t index, uint8_t r, uint8_t g, uint8_t b)
 {
-    // 设置所有 LED 的颜色为相同的 RGB
-    for (int i = 0; i < WS2812B_LED_NUMBERS; i++)
+    if (pixels_clip(index, 1) > 0)
     {
-        led_strip_pixels[i * 3 + 0] = rgb_color.green;
-        led_strip_pixels[i * 3 + 1] = rgb_color.blue;
-        led_strip_pixels[i * 3 + 2] = rgb_color.red;
+        pixels_store(index, r, g, b);
     }
+}
 
-    // 刷新颜色到灯带
-    flash_led_strip();
-
-    uint16_t elapsed_time = 0;             // 记录已经持续的时间
-    const uint16_t CHECK_INTERVAL_MS = 10; // 每隔 10ms 检测一次
-
-    while (elapsed_time < time_ms)
+void ws2812b_pixels_fill(uint16_t first, uint16_t count, uint8_t r, uint8_t g, uint8_t b)
+{
+    count = pixels_clip(first, count);
+    for (uint16_t i = 0; i < count; i++)
     {
-        queue_receive_from_button();
-
-        vTaskDelay(pdMS_TO_TICKS(CHECK_INTERVAL_MS));
-        elapsed_time += CHECK_INTERVAL_MS;
-
-        if (check_effect_switch())
-        {
-            return;
-        }
+        pixels_store(first + i, r, g, b);
     }
 }
 
-static void ws2812b_led_rainbow_all(void)
+void ws2812b_pixels_write(uint16_t first, const uint8_t *rgb, uint16_t count)
 {
-    queue_receive_from_button();
-
-    // 可配置变量
-    int hue_start = 0;            // 起始 Hue 值
-    int hue_end = 360;            // 结束 Hue 值
-    int transition_steps = 360;   // 颜色变化的步数（覆盖整个色环）
-    int TRANSITION_DELAY_MS = 20; // 每一步的延迟时间 (ms)
-    int saturation = 100;         // 饱和度
-    int value = 100;              // 亮度
-
-    for (int step = 0; step < transition_steps; step++)
+    count = pixels_clip(first, count);
+    for (uint16_t i = 0; i < count; i++)
     {
-        // 计算当前 Hue 值
-        int current_hue = hue_start + step * (hue_end - hue_start) / transition_steps;
-
-        // 将 HSV 转换为 RGB
-        uint32_t red, green, blue;
-        led_strip_hsv2rgb(current_hue, saturation, value, &red, &green, &blue);
-
-        // 设置所有 LED 的颜色为相同的 RGB
-        for (int i = 0; i < WS2812B_LED_NUMBERS; i++)
-        {
-            led_strip_pixels[i * 3 + 0] = green;
-            led_strip_pixels[i * 3 + 1] = blue;
-            led_strip_pixels[i * 3 + 2] = red;
-        }
-
-        // 刷新颜色到灯带
-        flash_led_strip();
-
-        if (check_effect_switch())
-        {
-            return;
-        }
-
-        // 延迟控制彩虹变化速度
-        vTaskDelay(pdMS_TO_TICKS(TRANSITION_DELAY_MS));
+        pixels_store(first + i, rgb[i * 3 + 0], rgb[i * 3 + 1], rgb[i * 3 + 2]);
     }
 }
 
-static void ws2812b_led_rainbow_wave(void)
+esp_err_t ws2812b_pixels_commit(void)
 {
-    queue_receive_from_button();
-
-    uint32_t hue_start = 0;                            // 起始 Hue 值
-    uint32_t hue_end = 360;                            // 结束 Hue 值
-    uint32_t hue_step = hue_end / WS2812B_LED_NUMBERS; // 每个 LED 的 Hue 步长
-    uint32_t saturation = 100;                         // 饱和度（固定为最大值）
-    uint32_t value = 100;                              // 亮度（固定为最大值）
-
-    for (int i = 0; i < WS2812B_LED_NUMBERS; i++)
+    if (!pixels_updating)
     {
-        // 计算当前 LED 的 Hue 值
-        uint32_t current_hue = hue_start + i * hue_step;
-
-        // 将 HSV 转换为 RGB
-        uint32_t red, green, blue;
-        led_strip_hsv2rgb(current_hue, saturation, value, &red, &green, &blue);
-
-        // 设置 LED 的颜色
-        led_strip_pixels[i * 3 + 0] = green;
-        led_strip_pixels[i * 3 + 1] = blue;
-        led_strip_pixels[i * 3 + 2] = red;
+        return ESP_ERR_INVALID_STATE;
     }
+    pixels_updating = false;
+    bool changed = pixels_dirty_first < pixels_dirty_end;
+    xSemaphoreGive(pixels_mutex);
 
-    // 刷新颜色到灯带
-    flash_led_strip();
+    if (ws2812b_current_effect != LED_EFFECT_CUSTOM_PIXELS)
+    {
+        ws2812b_switch_effect(LED_EFFECT_CUSTOM_PIXELS);
+    }
+    else if (changed && xLedTaskHandle != NULL)
+    {
+        xTaskNotify(xLedTaskHandle, WS2812B_NOTIFY_PIXELS, eSetBits);
+    }
+    // 已经在显示这些像素、也没有灯变化时不重画，更不会重发
+    return ESP_OK;
+}
 
-    if (check_effect_switch())
+/**
+ * @brief 把暂存区里提交过的变化拷贝到合成器的底层
+ *
+ * 拿不到锁说明别的任务又开始了一次更新，它提交时会再通知一次，效果任务不在这里等
+ */
+static void take_committed_pixels(void)
+{
+    if (xSemaphoreTake(pixels_mutex, 0) != pdTRUE)
     {
         return;
     }
-
-    // 延迟控制彩虹的移动速度
-    vTaskDelay(pdMS_TO_TICKS(EXAMPLE_CHASE_SPEED_MS));
-
-    // 更新起始 Hue 值，使彩虹效果动态移动
-    hue_start = (hue_start + hue_step) % hue_end;
+    if (pixels_dirty_first < pixels_dirty_end)
+    {
+        memcpy(&pixels_shown[pixels_dirty_first * 3], &pixels_staging[pixels_dirty_first * 3], (pixels_dirty_end - pixels_dirty_first) * 3);
+    }
+    pixels_dirty_first = 0;
+    pixels_dirty_end = 0;
+    xSemaphoreGive(pixels_mutex);
 }
 
-static void ws2812b_led_breathing_wave(ws2812b_color_rgb_t color_rgb, ws2812b_direction_t direction, ws2812b_loop_mode_t loop_mode)
+void ws2812b_led_init(void)
 {
-    queue_receive_from_button();
-
-    // 可配置变量
-    int brightness_min = 10;       // 最低亮度
-    int brightness_max = 100;      // 最高亮度
-    int transition_steps = 100;    // 亮度变化的步数
-    int TRANSITION_DELAY_MS = 100; // 每一步的延迟时间 (ms)
+    load_strip_config();
+    strip_chip = led_strip_chip_profile(strip_config.chip);
+    led_frame_bytes = strip_config.count * strip_chip->bytes_per_pixel;
+    int64_t wire_us = (int64_t)led_frame_bytes * 8 * (strip_chip->t1h_ns + strip_chip->t1l_ns) / 1000 + strip_chip->reset_us;
+    dither_period_us = wire_us < WS2812B_DITHER_PERIOD_US ? WS2812B_DITHER_PERIOD_US : WS2812B_FRAME_PERIOD_US;
+    uint32_t budget_ma = strip_config.budget_ma ? strip_config.budget_ma : WS2812B_POWER_BUDGET_MA;
+    ESP_LOGI(TAG, "LED strip: %u %s LEDs, first %u, %s, %u mA budget", strip_config.count, strip_chip->name, strip_config.first,
+             strip_config.reversed ? "reversed" : "forward", (unsigned)budget_ma);
 
-    // 根据方向初始化 LED 索引范围
-    int start = (direction == LED_DIRECTION_TOP_DOWN) ? 0 : WS2812B_LED_NUMBERS - 1;
-    int end = (direction == LED_DIRECTION_TOP_DOWN) ? WS2812B_LED_NUMBERS : -1;
-    int step = (direction == LED_DIRECTION_TOP_DOWN) ? 1 : -1;
-
-    // 循环控制（一次完整的波动效果）
-    for (int t = 0; t < WS2812B_LED_NUMBERS; t++) // 每次波动从一个LED开始
+    ESP_LOGI(TAG, "Create RMT TX channel");
+    led_chan = NULL;
+    bool long_strip = strip_config.count > WS2812B_LONG_STRIP_LEDS;
+    rmt_tx_channel_config_t tx_chan_config = {
+        .clk_src = RMT_CLK_SRC_DEFAULT, // select source clock
+        .gpio_num = RMT_LED_STRIP_GPIO_NUM,
+        .mem_block_symbols = long_strip ? WS2812B_RMT_MEM_SYMBOLS_LONG : WS2812B_RMT_MEM_SYMBOLS, // increase the block size can make the LED less flickering
+        .resolution_hz = RMT_LED_STRIP_RESOLUTION_HZ,
+        .trans_queue_depth = WS2812B_TRANS_QUEUE_DEPTH, // set the number of transactions that can be pending in the background
+    };
+#if SOC_RMT_SUPPORT_DMA
+    // 有 DMA 的芯片上长灯带整帧由 DMA 搬运，发送中途完全不需要 CPU
+    if (long_strip)
     {
-        for (int i = start; i != end; i += step)
-        {
-            // 根据当前位置和时间t计算亮度
-            int distance = abs(i - t);
-            int brightness = brightness_max - (brightness_max - brightness_min) * distance / WS2812B_LED_NUMBERS;
-
-            // 限制亮度范围
-            if (brightness < brightness_min)
-                brightness = brightness_min;
-
-            // 根据亮度调整颜色
-            ws2812b_color_rgb_t adjusted_color = {
-                .red = color_rgb.red * brightness / 100,
-                .green = color_rgb.green * brightness / 100,
-                .blue = color_rgb.blue * brightness / 100,
-            };
-
-            // 设置当前LED颜色
-            led_strip_pixels[i * 3 + 0] = adjusted_color.green;
-            led_strip_pixels[i * 3 + 1] = adjusted_color.blue;
-            led_strip_pixels[i * 3 + 2] = adjusted_color.red;
-        }
-
-        // 刷新LED数据
-        flash_led_strip();
-
-        if (check_effect_switch())
-        {
-            return;
-        }
-        // 延迟控制
-        vTaskDelay(pdMS_TO_TICKS(TRANSITION_DELAY_MS));
+        tx_chan_config.flags.with_dma = true;
+        tx_chan_config.mem_block_symbols = WS2812B_RMT_DMA_SYMBOLS;
     }
-
-    // 如果是来回模式，反转方向
-    if (loop_mode == LED_LOOP_MODE_PINGPONG)
+#endif
+    esp_err_t err = rmt_new_tx_channel(&tx_chan_config, &led_chan);
+    if (err != ESP_OK && long_strip)
     {
-        ws2812b_led_breathing_wave(color_rgb, (direction == LED_DIRECTION_TOP_DOWN) ? LED_DIRECTION_TOP_DOWN : LED_DIRECTION_TOP_DOWN, LED_LOOP_MODE_SINGLE);
+        // RMT 内存被别的通道占了，或者 DMA 通道不够，退回到默认配置，只是中途补数据的中断多一些
+        ESP_LOGW(TAG, "Failed to create a %u-symbol RMT channel (%s), falling back to %d symbols",
+                 (unsigned)tx_chan_config.mem_block_symbols, esp_err_to_name(err), WS2812B_RMT_MEM_SYMBOLS);
+        tx_chan_config.flags.with_dma = false;
+        tx_chan_config.mem_block_symbols = WS2812B_RMT_MEM_SYMBOLS;
+        err = rmt_new_tx_channel(&tx_chan_config, &led_chan);
     }
-}
+    ESP_ERROR_CHECK(err);
 
-static void ws2812b_led_breathing_all(ws2812b_color_rgb_t color_rgb, uint16_t breath_time_ms, bool start_from_max)
-{
-    if (breath_time_ms == 0)
+    // 帧缓冲按灯数分配，第一个缓冲直接拿来渲染，其余的放进空闲队列，发送完成回调负责把缓冲还回来
+    bool remapped = strip_config.first != 0 || strip_config.reversed || !strip_chip_is_native();
+    bool allocated = true;
+    for (int i = 0; i < WS2812B_FRAME_BUFFERS; i++)
     {
-        ESP_LOGE(TAG, "Breath time is 0, no effect will be shown!");
+        led_frame_buffers[i] = calloc(1, led_frame_bytes);
+        allocated = allocated && led_frame_buffers[i] != NULL;
+    }
+    led_logical_pixels = remapped ? calloc(strip_config.count, 3) : NULL;
+    pixels_staging = calloc(strip_config.count, 3);
+    pixels_shown = calloc(strip_config.count, 3);
+    allocated = allocated && pixels_staging != NULL && pixels_shown != NULL;
+    if (!allocated || (remapped && led_logical_pixels == NULL))
+    {
+        ESP_LOGE(TAG, "Failed to allocate frame buffers for %u LEDs", strip_config.count);
         return;
     }
+    led_free_buffers = xQueueCreate(WS2812B_FRAME_BUFFERS, sizeof(uint8_t *));
+    led_strip_pixels = led_frame_buffers[0];
+    for (int i = 1; i < WS2812B_FRAME_BUFFERS; i++)
+    {
+        uint8_t *buffer = led_frame_buffers[i];
+        xQueueSend(led_free_buffers, &buffer, 0);
+    }
+    rmt_tx_event_callbacks_t tx_callbacks = {
+        .on_trans_done = led_strip_tx_done,
+    };
+    ESP_ERROR_CHECK(rmt_tx_register_event_callbacks(led_chan, &tx_callbacks, NULL));
 
-    // 可配置变量
-    int brightness_min = 1;     // 最低亮度
-    int brightness_max = 100;   // 最高亮度
-    int transition_steps = 600; // 亮度变化的步数
-
-    // 调整亮度（呼吸效果）
-    for (int step = 0; step <= transition_steps; step++) // 根据步数控制变化
+    ESP_LOGI(TAG, "Install led strip encoder");
+    led_encoder = NULL;
+    led_strip_encoder_config_t encoder_config = {
+        .resolution = RMT_LED_STRIP_RESOLUTION_HZ,
+        .chip = strip_config.chip,
+    };
+    err = rmt_new_led_strip_encoder(&encoder_config, &led_encoder);
+    if (err != ESP_OK)
     {
-        queue_receive_from_button();
+        ESP_LOGE(TAG, "Failed to install LED strip encoder: %s", esp_err_to_name(err));
+        return; // 提前返回，避免使用未初始化的 encoder
+    }
 
-        int brightness;
-        float progress = (float)step / transition_steps; // 当前进度
-        float power = 2.2;                               // 非线性变化的幂次
+    ESP_LOGI(TAG, "Enable RMT TX channel");
+    ESP_ERROR_CHECK(rmt_enable(led_chan));
 
-        if (progress <= 0.5)
-        {
-            // 前半段
-            if (start_from_max)
-            {
-                // 从最亮变到最暗
-                progress = pow((1 - 2 * progress), power); // 非线性变化
-                brightness = brightness_min + (int)((brightness_max - brightness_min) * progress);
-            }
-            else
-            {
-                // 从最暗变到最亮
-                progress = pow(progress, power); // 非线性变化
-                brightness = brightness_min + (int)((brightness_max - brightness_min) * progress);
-            }
-        }
-        else
-        {
-            // 后半段
-            if (start_from_max)
-            {
-                // 从最暗变到最亮
-                progress = pow((2 * progress - 1), power); // 非线性变化
-                brightness = brightness_min + (int)((brightness_max - brightness_min) * progress);
-            }
-            else
-            {
-                // 从最亮变到最暗
-                progress = pow((0.5 - (progress - 0.5)), power); // 非线性变化
-                brightness = brightness_min + (int)((brightness_max - brightness_min) * progress);
-            }
-        }
+    ESP_LOGI(TAG, "WB2812B led strip initialized");
+    // 使用复合字面量
+    tx_config = (rmt_transmit_config_t){
+        .loop_count = 0,
+    };
 
-        // 根据亮度调整颜色
-        ws2812b_color_rgb_t adjusted_color = adjust_brightness(&color_rgb, brightness);
-        ws2812b_led_set_color_all(adjusted_color, 0);
+    ESP_ERROR_CHECK(led_compositor_init(&compositor, strip_config.count));
+    ESP_ERROR_CHECK(led_power_init(&power, strip_config.count, budget_ma));
+    pixels_mutex = xSemaphoreCreateMutex();
 
-        if (check_effect_switch())
-        {
-            return;
-        }
+    // 帧时钟由效果任务自己按需启动，先建好定时器再建任务
+    const esp_timer_create_args_t frame_clock_args = {
+        .callback = ws2812b_frame_clock_cb,
+        .name = "ws2812b_frame",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&frame_clock_args, &frame_clock));
 
-        vTaskDelay(pdMS_TO_TICKS(15)); // 每次更新延时，调整变化速度
-    }
+    // 创建效果任务
+    xTaskCreate(ws2812b_effect_task, "ws2812b_effect_task", 2048, NULL, 5, &xLedTaskHandle);
 }
 
-static void ws2812b_led_rainbow_breathing_all(uint16_t loop_time_ms)
+static void ws2812b_frame_clock_cb(void *arg)
 {
+    xTaskNotify(xLedTaskHandle, WS2812B_NOTIFY_FRAME, eSetBits);
+}
 
-    // 可配置变量
-    int hue_start = 0;                                         // 起始颜色的 Hue 值
-    int hue_end = 360;                                         // 结束颜色的 Hue 值
-    int brightness_min = 10;                                   // 最低亮度
-    int brightness_max = 100;                                  // 最高亮度
-    int transition_steps = 1000;                               // 颜色和亮度变化的步数
-    int TRANSITION_DELAY_MS = loop_time_ms / transition_steps; // 每一步的延迟时间 (ms)
-
-    // HSV 和 RGB 颜色结构体
-    ws2812b_color_hsv_t hsv_color = {0, 100, 0}; // 初始化 HSV 颜色
-    ws2812b_color_rgb_t rgb_color = {0, 0, 0};   // 初始化 RGB 颜色
+const led_insn_t *ws2812b_effect_program(ws2812b_state_effect_t effect)
+{
+    return effect < LED_EFFECT_COUNT ? effect_programs[effect] : NULL;
+}
 
-    // 同时改变颜色和亮度
-    for (int step = 0; step <= transition_steps; step++) // 根据步数控制变化
+esp_err_t ws2812b_set_overlay(uint8_t layer, const led_insn_t *program, led_blend_t blend, uint8_t alpha)
+{
+    if (layer >= LED_COMPOSITOR_OVERLAYS || (program != NULL && led_program_validate(program, LED_PROGRAM_MAX_INSNS) != ESP_OK))
     {
-        queue_receive_from_button();
-
-        // 计算当前 Hue 和亮度值
-        hsv_color.hue = hue_start + step * (hue_end - hue_start) / transition_steps;                                                              // 线性插值计算 Hue
-        hsv_color.value = (step <= transition_steps / 2) ? (brightness_min + step * (brightness_max - brightness_min) / (transition_steps / 2)) : // 前半段亮度增加
-                              (brightness_max - (step - transition_steps / 2) * (brightness_max - brightness_min) / (transition_steps / 2));      // 后半段亮度减少
-
-        // 将 HSV 转换为 RGB
-        led_strip_hsv2rgb(hsv_color.hue, hsv_color.saturation, hsv_color.value, &rgb_color.red, &rgb_color.green, &rgb_color.blue);
-
-        // 设置整排灯带为相同颜色
-        for (int i = 0; i < WS2812B_LED_NUMBERS; i++)
-        {
-            led_strip_pixels[i * 3 + 0] = rgb_color.green;
-            led_strip_pixels[i * 3 + 1] = rgb_color.blue;
-            led_strip_pixels[i * 3 + 2] = rgb_color.red;
-        }
-
-        // 刷新颜色到灯带
-        flash_led_strip();
-
-        if (check_effect_switch())
-        {
-            return;
-        }
+        return ESP_ERR_INVALID_ARG;
+    }
 
-        // 等待一段时间，展现动态效果
-        vTaskDelay(pdMS_TO_TICKS(TRANSITION_DELAY_MS)); // 每次更新延时，调整变化速度
+    portENTER_CRITICAL(&overlay_lock);
+    overlay_requests[layer] = (ws2812b_overlay_request_t){
+        .program = program,
+        .blend = blend,
+        .alpha = alpha,
+    };
+    overlay_pending |= 1u << layer;
+    portEXIT_CRITICAL(&overlay_lock);
+    if (xLedTaskHandle != NULL)
+    {
+        xTaskNotify(xLedTaskHandle, WS2812B_NOTIFY_OVERLAY, eSetBits);
     }
+    return ESP_OK;
 }
 
-static void ws2812b_led_rainbow_breathing_wave(void)
+/**
+ * @brief 按 ws2812b_current_effect 找到要播放的程序，LED_EFFECT_CUSTOM_PIXELS 返回 NULL，底层直接画 pixels_shown
+ */
+static const led_insn_t *select_effect_program(void)
 {
-    queue_receive_from_button();
-
-    if (check_effect_switch())
+    // 上一个下发的程序接下来要淡出，下一次写入不能用它的槽
+    custom_program_fading = custom_program_playing;
+    if (ws2812b_current_effect == LED_EFFECT_CUSTOM_PROGRAM)
     {
-        return;
+        custom_program_playing = custom_program_pending;
+        return custom_programs[custom_program_playing];
     }
+    custom_program_playing = -1;
+    if (ws2812b_current_effect == LED_EFFECT_CUSTOM_PIXELS)
+    {
+        return NULL;
+    }
+    const led_insn_t *program = ws2812b_effect_program(ws2812b_current_effect);
+    if (program != NULL)
+    {
+        return program;
+    }
+    ESP_LOGW(TAG, "Unknown effect: %d", ws2812b_current_effect);
+    ws2812b_current_effect = DEFAULT_EFFECT;
+    return effect_programs[DEFAULT_EFFECT];
 }
 
-static void ws2812b_led_meteor(ws2812b_color_rgb_t color_rgb, uint16_t metror_time_ms, ws2812b_direction_t direction, bool accumulate)
+static void ws2812b_effect_task(void *arg)
 {
-    // 初始化 LED 数据
-    memset(led_strip_pixels, 0, sizeof(led_strip_pixels));
-
-    // 配置参数
-    const int TAIL_LENGTH = 2;                                                // 流星尾巴长度
-    const int TRANSITION_DELAY_MS = 50;                                       // 每帧的延迟时间 (ms)
-    const int METEOR_ACCUMULATE_TIME = metror_time_ms / WS2812B_LED_NUMBERS;  // 每课流星累积时间
-    const int METEOR_ACCUMULATE_COUNT = metror_time_ms / TRANSITION_DELAY_MS; // 流星效果循环次数
-
-    // 计算方向
-    const int start = (direction == LED_DIRECTION_TOP_DOWN) ? 0 : WS2812B_LED_NUMBERS - 1;
-    const int end = (direction == LED_DIRECTION_TOP_DOWN) ? WS2812B_LED_NUMBERS : -1;
-    const int step = (direction == LED_DIRECTION_TOP_DOWN) ? 1 : -1;
-
-    int accumulate_leds[WS2812B_LED_NUMBERS] = {0}; // 累积效果的 LED 数组
-    int accumulate_threshold = 3;                   // 累积效果的阈值，流星次数
-    ws2812b_color_rgb_t adjusted_color = {};
-    ws2812b_color_rgb_t tail_color = {};
-
-    for (int meteor_accumulate_count = WS2812B_LED_NUMBERS; meteor_accumulate_count >= 0; meteor_accumulate_count--)
+    int64_t frame_due_us = 0;                // 帧时钟这一次应该到的时间
+    uint32_t events = WS2812B_NOTIFY_SWITCH; // 启动时先把当前效果画出来
+
+    while (1)
     {
+        int64_t now_us = esp_timer_get_time();
+        int64_t render_us = now_us;
 
-        for (int meteor_loop_count = 0; meteor_loop_count < accumulate_threshold; meteor_loop_count++)
+        if (events & WS2812B_NOTIFY_OVERLAY)
         {
-            queue_receive_from_button();
-
-            for (int meteor_head_pos = start; meteor_head_pos != end; meteor_head_pos += step)
+            // 取走请求和清位图要在同一个临界区里，不然中间新设置的叠加层会被清掉
+            ws2812b_overlay_request_t requests[LED_COMPOSITOR_OVERLAYS];
+            portENTER_CRITICAL(&overlay_lock);
+            uint32_t pending = overlay_pending;
+            overlay_pending = 0;
+            memcpy(requests, overlay_requests, sizeof(requests));
+            portEXIT_CRITICAL(&overlay_lock);
+            for (uint8_t layer = 0; layer < LED_COMPOSITOR_OVERLAYS; layer++)
             {
-                memset(led_strip_pixels, 0, sizeof(led_strip_pixels));
-                // 每次更新 LED 带
-                for (int led_index = 0; led_index < WS2812B_LED_NUMBERS; led_index++)
+                if (pending & (1u << layer))
                 {
-                    // 计算亮度衰减
-                    int distance_from_meteor = abs(meteor_head_pos - led_index);
-                    int brightness = 0;
-                    if (meteor_head_pos == led_index)
-                    {
-                        brightness = 100;
-                    }
-
-                    // 调整颜色
-                    adjusted_color = adjust_brightness(&color_rgb, brightness);
-
-                    led_strip_pixels[led_index * 3 + 0] = MIN(255, led_strip_pixels[led_index * 3 + 0] + adjusted_color.green);
-                    led_strip_pixels[led_index * 3 + 1] = MIN(255, led_strip_pixels[led_index * 3 + 1] + adjusted_color.blue);
-                    led_strip_pixels[led_index * 3 + 2] = MIN(255, led_strip_pixels[led_index * 3 + 2] + adjusted_color.red);
-
-                    // 为流星尾巴添加效果
-                    for (int tail_pos = 1; tail_pos <= TAIL_LENGTH; tail_pos++)
-                    {
-                        int tail_index = led_index - tail_pos * step;
-                        brightness = brightness / (tail_pos * 3);
-
-                        tail_color = adjust_brightness(&color_rgb, brightness);
-
-                        if (tail_index < 0)
-                        {
-                            break;
-                        }
-                        else
-                        {
-                            led_strip_pixels[tail_index * 3 + 0] = MIN(255, led_strip_pixels[tail_index * 3 + 0] + tail_color.green);
-                            led_strip_pixels[tail_index * 3 + 1] = MIN(255, led_strip_pixels[tail_index * 3 + 1] + tail_color.blue);
-                            led_strip_pixels[tail_index * 3 + 2] = MIN(255, led_strip_pixels[tail_index * 3 + 2] + tail_color.red);
-                        }
-                    }
+                    led_compositor_set_overlay(&compositor, layer, requests[layer].program, requests[layer].blend, requests[layer].alpha, now_us);
                 }
-
-                for (int i = 0; i <= WS2812B_LED_NUMBERS; i++)
-                {
-                    if (accumulate_leds[i] == 1)
-                    {
-                        led_strip_pixels[i * 3 + 0] = color_rgb.green;
-                        led_strip_pixels[i * 3 + 1] = color_rgb.blue;
-                        led_strip_pixels[i * 3 + 2] = color_rgb.red;
-                    }
-                }
-
-                // 刷新颜色到灯带
-                flash_led_strip();
-
-                if (check_effect_switch())
-                {
-                    return;
-                }
-
-                // 延迟控制速度
-                vTaskDelay(pdMS_TO_TICKS(TRANSITION_DELAY_MS));
             }
         }
 
-        accumulate_leds[meteor_accumulate_count] = 1;
-
-        if (meteor_accumulate_count == 0)
+        if (events & (WS2812B_NOTIFY_SWITCH | WS2812B_NOTIFY_PIXELS))
         {
-            ws2812b_led_set_color_all(color_rgb, 0);
+            take_committed_pixels();
         }
-    }
-    // 最后再亮一会
-    vTaskDelay(pdMS_TO_TICKS(1000));
-}
 
-static void ws2812b_led_random_color(void)
-{
-    queue_receive_from_button();
-
-    // 设置 LED 随机闪烁效果
-    for (int i = 0; i < WS2812B_LED_NUMBERS; i++)
-    {
-        // 生成随机的 RGB 颜色
-        uint8_t r = rand() % 256; // 随机生成 0-255 的红色分量
-        uint8_t g = rand() % 256; // 随机生成 0-255 的绿色分量
-        uint8_t b = rand() % 256; // 随机生成 0-255 的蓝色分量
-
-        // 随机熄灭这次的LED
-        if (rand() % 4 == 0)
+        if (events & WS2812B_NOTIFY_SWITCH)
         {
-            r = 0;
-            g = 0;
-            b = 0;
+            const led_insn_t *program = select_effect_program();
+            if (program != NULL)
+            {
+                led_compositor_set_base(&compositor, program, now_us, WS2812B_CROSSFADE_MS * 1000);
+            }
+            else
+            {
+                led_compositor_set_base_pixels(&compositor, pixels_shown, now_us, WS2812B_CROSSFADE_MS * 1000);
+            }
         }
-
-        // 设置 LED 的颜色到 led_strip_pixels 数组 WS2812B 的数据顺序是 G -> R -> B
-        led_strip_pixels[i * 3 + 0] = g; // Green
-        led_strip_pixels[i * 3 + 1] = r; // Red
-        led_strip_pixels[i * 3 + 2] = b; // Blue
-    }
-
-    // 刷新 LED 数据到灯带
-    flash_led_strip();
-
-    vTaskDelay(pdMS_TO_TICKS(100)); // 延迟控制速度
-
-    if (check_effect_switch())
-    {
-        return;
-    }
-}
-
-static void ws2812b_led_blink(ws2812b_color_rgb_t color_rgb, uint16_t flash_hold_time_ms, uint8_t light_on_duty_cycle, uint8_t flash_count)
-{
-    queue_receive_from_button();
-
-    // 可配置变量
-    int TRANSITION_DELAY_MS = 1000 / 60;                                // 闪烁频率 (60Hz)
-    int light_on_time = flash_hold_time_ms * light_on_duty_cycle / 100; // 亮灯时间
-    int light_off_time = flash_hold_time_ms - light_on_time;            // 灭灯时间
-
-    // 闪烁次数
-    for (int i = 0; i < flash_count; i++)
-    {
-        // 亮灯
-        ws2812b_led_set_color_all(color_rgb, 0);
-        vTaskDelay(pdMS_TO_TICKS(light_on_time));
-
-        // 灭灯
-        ws2812b_led_set_color_all((ws2812b_color_rgb_t){0, 0, 0}, 0);
-        vTaskDelay(pdMS_TO_TICKS(light_off_time));
-
-        if (check_effect_switch())
+        else if (events & (WS2812B_NOTIFY_OVERLAY | WS2812B_NOTIFY_PIXELS))
         {
-            return;
+            // 叠加层或者像素变了马上重画，不等帧时钟
         }
-    }
-}
-
-static void ws2812b_led_waterfall(ws2812b_color_rgb_t color_rgb, uint16_t waterfall_hold_time_ms)
-{
-
-    int TRANSITION_DELAY_MS = waterfall_hold_time_ms / WS2812B_LED_NUMBERS;
-
-    // 初始化 LED 数据
-    memset(led_strip_pixels, 0, sizeof(led_strip_pixels));
-
-    // 从顶端到底端逐个点亮
-    for (int i = 0; i < WS2812B_LED_NUMBERS; i++)
-    {
-        queue_receive_from_button();
+        else if (now_us < frame_due_us)
+        {
+            // 切换效果之前就已经触发、这时才处理的旧帧时钟，新的帧时钟已经定好了
+            xTaskNotifyWait(0, UINT32_MAX, &events, portMAX_DELAY);
+            continue;
+        }
+        else
+        {
+            int64_t latency_us = now_us - frame_due_us;
+            if (latency_us > WS2812B_FRAME_LATE_US)
+            {
+                led_pipeline_stats.frames_late++;
+            }
+            if (latency_us > led_pipeline_stats.max_latency_us)
+            {
+                led_pipeline_stats.max_latency_us = latency_us;
+            }
 
-        // 设置当前 LED 为指定颜色
-        led_strip_pixels[i * 3 + 0] = color_rgb.green;
-        led_strip_pixels[i * 3 + 1] = color_rgb.blue;
-        led_strip_pixels[i * 3 + 2] = color_rgb.red;
+            // 用帧时钟计划的时间而不是醒来的时间，任务调度的抖动不会体现在动画上；晚了一整帧以上就跳过，直接画现在的
+            if (latency_us >= WS2812B_FRAME_PERIOD_US)
+            {
+                led_pipeline_stats.frames_dropped += latency_us / WS2812B_FRAME_PERIOD_US;
+            }
+            else
+            {
+                render_us = frame_due_us;
+            }
+        }
 
-        // 刷新颜色到灯带
-        flash_led_strip();
+        uint8_t *rendered = led_logical_pixels != NULL ? led_logical_pixels : led_strip_pixels;
+        int64_t change_us = led_compositor_render(&compositor, render_us, rendered);
 
-        if (check_effect_switch())
+        // 限流放在合成之后、发送之前，叠加层和交叉淡化叠出来的亮度也算在内
+        if (led_power_limit(&power, rendered))
         {
-            return;
+            led_pipeline_stats.frames_limited++;
         }
-
-        // 延迟控制速度
-        vTaskDelay(pdMS_TO_TICKS(TRANSITION_DELAY_MS));
-
-        if (check_effect_switch())
+        if (power.estimate_ma > led_pipeline_stats.peak_ma)
         {
-            return;
+            led_pipeline_stats.peak_ma = power.estimate_ma;
         }
-    }
-}
-
-static void ws2812b_led_sunrise(ws2812b_color_rgb_t color_rgb, uint16_t sunrise_hold_time_ms)
-{
-    if (sunrise_hold_time_ms == 0)
-    {
-        ESP_LOGE(TAG, "Sunrise hold time is 0, no effect will be shown!");
-        return;
-    }
-
-    // 配置参数
-    int total_steps = 100;                                  // 亮度渐变的总步数
-    int step_delay_ms = sunrise_hold_time_ms / total_steps; // 每步的延迟时间
-    int led_count = WS2812B_LED_NUMBERS;                    // 总的 LED 数量
-
-    // 初始化 LED 亮度数组
-    float brightness[WS2812B_LED_NUMBERS] = {0};
-
-    for (int step = 0; step < total_steps; step++)
-    {
-        queue_receive_from_button();
-        for (int i = 0; i < led_count; i++)
+        if (led_logical_pixels != NULL)
         {
-            // brightness[i] 增加逻辑
-            float progress = (float)(step - i * (total_steps / led_count)) / (total_steps / led_count);
-            if (progress < 0)
-                progress = 0; // 确保亮度不低于0
-            if (progress > 1.0f)
-                progress = 1.0f; // 确保亮度不高于1.0
-            brightness[i] = progress;
-
-            if (brightness[i] > 1.0f) // 限制最大亮度
-                brightness[i] = 1.0f;
-
-            // 根据亮度调整颜色
-            ws2812b_color_rgb_t adjusted_color = {
-                .red = (uint32_t)(color_rgb.red * brightness[i]),
-                .green = (uint32_t)(color_rgb.green * brightness[i]),
-                .blue = (uint32_t)(color_rgb.blue * brightness[i]),
-            };
-
-            // 设置 LED 的颜色
-            led_strip_pixels[i * 3 + 0] = adjusted_color.green;
-            led_strip_pixels[i * 3 + 1] = adjusted_color.blue;
-            led_strip_pixels[i * 3 + 2] = adjusted_color.red;
+            apply_strip_layout(led_logical_pixels, led_strip_pixels);
         }
-
-        // print brightness
-        // ESP_LOGI(TAG, "Brightness: %f, %f, %f, %f, %f, %f, %f, %f, %f, %f", brightness[0], brightness[1], brightness[2], brightness[3], brightness[4], brightness[5], brightness[6], brightness[7], brightness[8], brightness[9]);
-
-        // 刷新灯带
         flash_led_strip();
+        led_pipeline_stats.frames_rendered++;
+        if (compositor.fade_us == 0)
+        {
+            custom_program_fading = -1;
+        }
 
-        if (check_effect_switch())
+        // 动画在进行就按帧率定下一帧；画面静止（纯色保持、闪烁的亮段）就一直睡到它变化的那一刻；再也不变就不定时
+        // 用到低 8 位的画面要靠连续的帧抖动出来，静止时也按抖动的帧率接着画
+        int64_t period_us = compositor.dithering ? dither_period_us : WS2812B_FRAME_PERIOD_US;
+        if (compositor.dithering && change_us > render_us + period_us)
         {
-            return;
+            change_us = render_us + period_us;
+        }
+        esp_timer_stop(frame_clock);
+        if (change_us != LED_PROGRAM_STATIC)
+        {
+            frame_due_us = render_us + period_us;
+            if (change_us > frame_due_us)
+            {
+                frame_due_us = change_us;
+            }
+            int64_t delay_us = frame_due_us - esp_timer_get_time();
+            ESP_ERROR_CHECK(esp_timer_start_once(frame_clock, delay_us > 0 ? delay_us : 1));
         }
 
-        // 延迟
-        vTaskDelay(pdMS_TO_TICKS(step_delay_ms));
+        // 没有帧时钟也没有切换就一直阻塞，静止的画面不占任何唤醒
+        xTaskNotifyWait(0, UINT32_MAX, &events, portMAX_DELAY);
     }
 }
-
-static void ws2812b_shutdown(void)
-{
-    // 关闭 LED 灯带，不发光
-    memset(led_strip_pixels, 0, sizeof(led_strip_pixels));
-    flash_led_strip();
-}
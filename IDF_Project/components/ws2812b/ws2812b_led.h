@@ -1,9 +1,42 @@
 #ifndef WS2812B_LED_H
 #define WS2812B_LED_H
 
+#include "led_program.h"
+#include "led_compositor.h"
+
 // 默认效果（可选）
 #define DEFAULT_EFFECT LED_EFFECT_POWER_ON_ANIMATION
 #define WS2812B_NUMBER_OF_EFFECTS LED_EFFECT_COUNT + 1
+
+#define WS2812B_FRAME_RATE_HZ 50                                // 动画在进行时的帧率，画面静止时效果任务不醒来
+#define WS2812B_FRAME_PERIOD_US (1000000 / WS2812B_FRAME_RATE_HZ)
+#define WS2812B_FRAME_LATE_US (WS2812B_FRAME_PERIOD_US / 2)     // 效果任务醒来时比帧时钟晚这么多就算迟到
+#define WS2812B_CROSSFADE_MS 250                                // 切换效果时新旧效果交叉淡化的时长
+#define WS2812B_DITHER_RATE_HZ 100                              // 画面用到 8 位以下的亮度（暗处的呼吸）时的帧率，时间抖动靠帧数补出精度
+#define WS2812B_DITHER_PERIOD_US (1000000 / WS2812B_DITHER_RATE_HZ)
+
+#define WS2812B_OVERLAY_STATUS 0 // 状态提示叠加层（蓝牙连接等）
+
+#define WS2812B_LED_NUMBERS 6          // NVS 里没有灯带配置时的灯数
+#define WS2812B_LED_NUMBERS_MAX 300    // 灯带配置允许的最大灯数，帧缓冲按实际灯数从堆里分配
+#define WS2812B_POWER_BUDGET_MA 300    // 灯带配置里没写电流预算时整条灯带允许的电流，6 颗灯全白时会被调暗
+#define WS2812B_NVS_NAMESPACE "storage" // 和白名单、定时计划放在同一个命名空间
+#define WS2812B_NVS_KEY "led_strip"
+
+/**
+ * @brief 灯带长度和布局，安装时按门框写进 NVS，重启后生效，不用重新编译固件
+ *
+ * 效果里的第 0 颗灯是顶端，从顶端往下数；数据线不是从顶端接入时用 first / reversed 映射到实际的灯
+ * 效果和合成都按 3 个通道算，换成 RGBW 或者字节顺序不同的灯时只在发送前按 chip 重新排列
+ */
+typedef struct __attribute__((packed))
+{
+    uint16_t count;     // 灯的数量，1 - WS2812B_LED_NUMBERS_MAX
+    uint16_t first;     // 效果的顶端是灯带上的第几颗
+    uint8_t reversed;   // 1: 从顶端往下数时灯带上的序号递减
+    uint8_t chip;       // led_strip_chip_t，旧版本写的配置这里是 0，即 WS2812
+    uint16_t budget_ma; // 整条灯带允许的电流，0 表示用 WS2812B_POWER_BUDGET_MA（旧版本写的配置这里都是 0）
+} ws2812b_strip_config_t;
 typedef enum
 {
     LED_EFFECT_DEBUG = 0,
@@ -25,22 +58,11 @@ typedef enum
     LED_EFFECT_LOCK_DOOR,                 // open_锁门
     LED_EFFECT_POWER_ON_ANIMATION,        // 默认上电动画, 现在是黑屏
     LED_EFFECT_FIRST_POWER_ON_ACTIVATE,   // 第一次上电激活
+    LED_EFFECT_CUSTOM_PROGRAM,            // 运行时通过 ws2812b_play_program() 下发的灯效程序
+    LED_EFFECT_CUSTOM_PIXELS,             // 通过 ws2812b_pixels_begin() / ws2812b_pixels_commit() 直接写的像素
     /*!没有效果，一定要放在最后，用来判断效果数量!*/
     LED_EFFECT_COUNT,
 } ws2812b_state_effect_t;
-typedef enum
-{
-    LED_MODE_LOOP = 0,
-    LED_LOOP_MODE_PINGPONG,
-    LED_LOOP_MODE_SINGLE,
-} ws2812b_loop_mode_t;
-
-typedef enum
-{
-    LED_DIRECTION_TOP_DOWN = 0,
-    LED_DIRECTION_BOTTOM_UP,
-} ws2812b_direction_t;
-
 typedef struct
 {
     uint32_t hue;
@@ -55,20 +77,6 @@ typedef struct
     uint32_t blue;
 } ws2812b_color_rgb_t;
 
-typedef struct
-{
-    ws2812b_color_rgb_t color_rgb;
-    ws2812b_direction_t direction;
-    ws2812b_loop_mode_t loop_mode;
-} ws2812b_effect_args_t;
-
-// 用来传递参数的结构体
-typedef struct
-{
-    ws2812b_effect_args_t effect_args;
-    ws2812b_state_effect_t current_effect;
-} ws2812b_queue_data_t;
-
 #define FREEDORM_BLUE {0, 0, 255}
 #define WHITE_RGB {255, 255, 255}
 #define RED_RGB {0, 0, 255}
@@ -78,12 +86,111 @@ typedef struct
 #define CYAN_RGB {255, 255, 0}
 #define PURPLE_RGB {255, 0, 255}
 
-// 效果队列句柄
-extern QueueHandle_t effect_queue;
+/**
+ * @brief 帧时钟和帧流水线统计，用来确认动画按固定帧率渲染、渲染和 RMT 发送是并行的
+ */
+typedef struct
+{
+    uint32_t frames_rendered;   // 渲染的帧数
+    uint32_t frames_late;       // 醒来时已经比帧时钟晚了 WS2812B_FRAME_LATE_US 以上的帧数
+    uint32_t frames_dropped;    // 效果任务忙不过来、直接跳过的帧数
+    int64_t max_latency_us;     // 帧时钟触发到效果任务开始渲染的最大延迟
+    uint32_t frames_submitted;  // 交给 RMT 的帧数
+    uint32_t frames_done;       // RMT 发送完成的帧数
+    uint32_t buffer_waits;      // 没有空闲缓冲、效果任务只能等上一帧发完的次数，正常应该接近 0
+    uint32_t frames_unchanged;  // 和灯带上正在显示的一帧完全一样、没有发送的帧数
+    uint32_t bytes_transmitted; // 交给 RMT 的字节数，只发到最后一颗变化的灯为止
+    uint32_t frames_limited;    // 估算电流超过预算、整帧被调暗的帧数
+    uint32_t peak_ma;           // 限流之前估算的最大电流
+} ws2812b_pipeline_stats_t;
+
 extern TaskHandle_t xLedTaskHandle; // 声明任务句柄
 
 void ws2812b_led_init(void);
 void ws2812b_switch_effect(ws2812b_state_effect_t effect);
 void loop_ws2812b_effect();
 
+/**
+ * @brief 播放一段运行时下发的灯效程序（BLE / MQTT 等），检查通过后拷贝一份并切换到 LED_EFFECT_CUSTOM_PROGRAM
+ *
+ * @param program 以 LED_OP_END 结尾的指令，最多 LED_PROGRAM_MAX_INSNS 条
+ * @param count program 里的指令数
+ * @return 程序不合法返回 ESP_ERR_INVALID_ARG，当前效果不变
+ */
+esp_err_t ws2812b_play_program(const led_insn_t *program, size_t count);
+
+/**
+ * @brief 开始一次像素更新，之后的 ws2812b_pixels_set / fill / write 只改暂存区，ws2812b_pixels_commit() 时一起显示
+ *
+ * 像素按效果顺序编号（0 是顶端），和灯带布局无关；暂存区在两次更新之间保留，只需要写变化的部分
+ * 会阻塞到其它任务的更新提交为止，不能在中断里调用
+ */
+void ws2812b_pixels_begin(void);
+
+/**
+ * @brief 设置一颗灯，超出灯带长度的部分忽略
+ */
+void ws2812b_pixels_set(uint16_t index, uint8_t r, uint8_t g, uint8_t b);
+
+/**
+ * @brief 从 first 开始的 count 颗灯设成同一种颜色
+ */
+void ws2812b_pixels_fill(uint16_t first, uint16_t count, uint8_t r, uint8_t g, uint8_t b);
+
+/**
+ * @brief 从 first 开始写 count 颗灯，rgb 按 R, G, B 顺序排列
+ */
+void ws2812b_pixels_write(uint16_t first, const uint8_t *rgb, uint16_t count);
+
+/**
+ * @brief 结束这次更新：没有灯真正变化时什么都不发，否则切换到 LED_EFFECT_CUSTOM_PIXELS 并只重画一帧
+ *
+ * @return 没有调用 ws2812b_pixels_begin() 或者灯带没有初始化时返回 ESP_ERR_INVALID_STATE
+ */
+esp_err_t ws2812b_pixels_commit(void);
+
+/**
+ * @brief 检查并保存灯带配置到 NVS，下次启动时 ws2812b_led_init() 按它分配帧缓冲和 RMT 内存
+ *
+ * @return 配置不合法返回 ESP_ERR_INVALID_ARG，写 NVS 失败返回对应的错误码
+ */
+esp_err_t ws2812b_led_set_strip_config(const ws2812b_strip_config_t *config);
+
+/**
+ * @brief 当前生效的灯带配置
+ */
+void ws2812b_led_get_strip_config(ws2812b_strip_config_t *config);
+
+/**
+ * @brief 效果的枚举名，如 "LED_EFFECT_DEFAULT_STATE"，用于日志和主机上的抓帧工具
+ */
+const char *ws2812b_effect_name(ws2812b_state_effect_t effect);
+
+/**
+ * @brief 效果对应的内置灯效程序，LED_EFFECT_CUSTOM_PROGRAM / LED_EFFECT_CUSTOM_PIXELS 和未知效果返回 NULL
+ */
+const led_insn_t *ws2812b_effect_program(ws2812b_state_effect_t effect);
+
+/**
+ * @brief 在当前效果上叠加一段程序，程序播完后自动移除，切换效果时叠加层保留
+ *
+ * program 不会被拷贝，必须一直有效（放在 flash 里的常量表）；program 为 NULL 时清空这一层
+ *
+ * @param layer 叠加层编号，如 WS2812B_OVERLAY_STATUS
+ * @param blend LED_BLEND_ADD 时程序里黑色的部分是透明的
+ * @param alpha 这一层的不透明度，255 为完全不透明
+ * @return 编号或程序不合法返回 ESP_ERR_INVALID_ARG
+ */
+esp_err_t ws2812b_set_overlay(uint8_t layer, const led_insn_t *program, led_blend_t blend, uint8_t alpha);
+
+/**
+ * @brief 蓝牙连上时的提示：蓝色淡入再淡出，配合 LED_BLEND_ADD 叠加在当前效果上
+ */
+extern const led_insn_t ws2812b_overlay_ble_connected[];
+
+/**
+ * @brief 读取帧时钟和帧流水线统计
+ */
+void ws2812b_led_get_pipeline_stats(ws2812b_pipeline_stats_t *stats);
+
 #endif // WS2812B_LED_H
\ No newline at end of file
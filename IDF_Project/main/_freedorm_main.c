@@ -24,6 +24,10 @@
 #include "ws2812b_led.h"
 #include "lock_control.h"
 #include "freedorm_mqtt.h"
+#include "audit_log.h"
+#include "lock_schedule.h"
+#include "telemetry.h"
+#include "offline_queue.h"
 
 /**
  * Brief:
@@ -61,19 +65,25 @@ void app_main(void)
     }
     ESP_ERROR_CHECK(ret);
 
+    audit_log_init(); // 要在状态机之前初始化，上电那条状态切换也要记下来
+    telemetry_init(); // 没连上 MQTT 之前记录先攒在 RAM 里
+    offline_queue_init(); // 上次断线时存下、还没送到的消息，连上之后补发
     ble_module_init();
     ws2812b_led_init(); // 按键在之后初始化，因为按键依赖ws2812b中的消息队列，TODO: 好像后面没用到消息队列来传递效果了，可以看看是否有这个顺序要求
     freedorm_button_init();
     lock_control_init(); // 为了主函数不是太拥挤，大部分状态机都放到了lock_control.c中
+    lock_schedule_init(); // 计划要往状态机的队列里发事件，所以放在状态机之后
     xTaskCreate(&button_task, "button_task", 2048, NULL, 1, NULL);
 
-    // esp_err_t err = mqtt_start();
-    // if (err != ESP_OK)
-    // {
-    //     ESP_LOGE("APP", "Failed to start MQTT: %s", esp_err_to_name(err));
-    // }
-    // else
-    // {
-    //     ESP_LOGI("APP", "MQTT started successfully");
-    // }
+#if FREEDORM_MQTT_ENABLE
+    esp_err_t err = mqtt_start();
+    if (err != ESP_OK)
+    {
+        ESP_LOGE("APP", "Failed to start MQTT: %s", esp_err_to_name(err));
+    }
+    else
+    {
+        ESP_LOGI("APP", "MQTT started successfully");
+    }
+#endif
 }
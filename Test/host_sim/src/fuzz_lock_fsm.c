@@ -0,0 +1,497 @@
+/**
+ * @file fuzz_lock_fsm.c
+ * @brief lock_control 状态机的模糊测试入口
+ *
+ * 输入是一串 2 字节的记录 {动作, 延时}：
+ *   动作 % 9：按下 / 松开 / 单击 80ms / 蓝牙靠近开门 / 直接注入 SINGLE、DOUBLE、MULTI、NONE_UPDATE 事件 / MQTT 远程命令
+ *            远程命令是 (动作 / 9) % 5 对应的 lock_command_t，请求号是第几步，用仿真密钥签名之后通过 broker 替身发到命令 topic
+ *   延时：0~127 -> code * 10ms，128~223 -> (code - 127) * 250ms，224~255 -> (code - 223) * 30s
+ * 长按相关的事件只能由真实的按键时序产生，这样 LONG_PRESS_START / END 总是成对出现，和硬件一致。
+ *
+ * 每个输入都从上电激活开始，每一步之后检查不变量：
+ *   1. CTL_LOCK、CTL_D0 的电平和当前状态一致（*_END 这类过渡状态除外）
+ *   2. 同名的软件定时器最多一个，总数有上限；常开状态下 CTL_LOCK 不能还带着临时开门的保持时间
+ *   3. 只有在恢复出厂设置状态下才允许重启
+ *   4. 配对广播只能和进入 STATE_BLE_PAIRING_IN_PROGRESS 在同一个事件里打开：开的时候状态机必须已经在配对中，
+ *      每次新进入配对中也必须开过一次新的广播（以前另起一个 6s 定时器去开广播，松手早一点就会在正常状态下开）
+ * 输入跑完后松开按键再等 FUZZ_SETTLE_MS，状态机必须回到正常或常开状态，不能卡死在中间状态。
+ * 违反不变量时把输入翻译成场景脚本打印出来（可以直接交给 freedorm_sim 复现），然后 abort()。
+ *
+ * 固件里全是静态变量，没法在同一个进程里复位，所以每个输入都要一个新进程：
+ *   fuzz_lock_fsm <input>                 跑一个输入文件，兼容 afl-fuzz 的 @@ 用法
+ *   fuzz_lock_fsm -r <count> [-s seed] [-l max_records] [-o crash_dir]
+ *                                         自己生成随机输入，每个输入 fork 一次，最后打印吞吐量
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "button.h"
+#include "lock_control.h"
+#include "lock_actuator.h"
+#include "mqtt_command.h"
+#include "sim_app.h"
+#include "sim_ble.h"
+#include "sim_hal.h"
+#include "sim_kernel.h"
+#include "sim_mqtt.h"
+
+#define FUZZ_MAX_RECORDS 512
+#define FUZZ_DEFAULT_RECORDS 64
+#define FUZZ_CLICK_MS 80
+#define FUZZ_MAX_LIVE_TIMERS 8
+#define FUZZ_SETTLE_MS (TIME_RECOVER_TEMP_OPEN + 150 * 1000) // 比最长的恢复定时器再多等一会
+
+typedef enum
+{
+    FUZZ_PRESS,
+    FUZZ_RELEASE,
+    FUZZ_CLICK,
+    FUZZ_BLE_UNLOCK,
+    FUZZ_EVENT_SINGLE_CLICK,
+    FUZZ_EVENT_DOUBLE_CLICK,
+    FUZZ_EVENT_MULTI_CLICK,
+    FUZZ_EVENT_NONE_UPDATE,
+    FUZZ_REMOTE_COMMAND,
+    FUZZ_ACTION_COUNT,
+} fuzz_action_t;
+
+static const uint8_t *fuzz_data;
+static size_t fuzz_records;
+static size_t fuzz_step; // 正在执行的记录，打印复现脚本时用来标记出错的位置
+static bool restarted = false;
+static lock_status_t last_checked_state = STATE_POWER_ON_BLACK; // 上一次检查不变量时的状态
+static uint32_t last_pairing_sessions;                           // 上一次检查时开过几次配对广播
+
+static int64_t decode_delay_ms(uint8_t code)
+{
+    if (code < 128)
+    {
+        return code * 10LL;
+    }
+    else if (code < 224)
+    {
+        return (code - 127) * 250LL;
+    }
+    return (code - 223) * 30000LL;
+}
+
+/**
+ * @brief 远程命令动作对应的命令
+ */
+static const char *remote_verb(uint8_t code)
+{
+    return mqtt_command_name((lock_command_t)(code / FUZZ_ACTION_COUNT % (LOCK_CMD_STATUS + 1)));
+}
+
+static void print_action(FILE *fp, uint8_t code, size_t step)
+{
+    fuzz_action_t action = code % FUZZ_ACTION_COUNT;
+    switch (action)
+    {
+    case FUZZ_PRESS:
+        fprintf(fp, "press\n");
+        break;
+    case FUZZ_RELEASE:
+        fprintf(fp, "release\n");
+        break;
+    case FUZZ_CLICK:
+        fprintf(fp, "click %d\n", FUZZ_CLICK_MS);
+        break;
+    case FUZZ_BLE_UNLOCK:
+        fprintf(fp, "ble_unlock\n");
+        break;
+    case FUZZ_EVENT_SINGLE_CLICK:
+        fprintf(fp, "event BUTTON_EVENT_SINGLE_CLICK\n");
+        break;
+    case FUZZ_EVENT_DOUBLE_CLICK:
+        fprintf(fp, "event BUTTON_EVENT_DOUBLE_CLICK\n");
+        break;
+    case FUZZ_EVENT_MULTI_CLICK:
+        fprintf(fp, "event BUTTON_EVENT_MULTI_CLICK\n");
+        break;
+    case FUZZ_REMOTE_COMMAND:
+        fprintf(fp, "mqtt cmd %s %zu\n", remote_verb(code), step);
+        break;
+    default:
+        fprintf(fp, "event BUTTON_EVENT_NONE_UPDATE_LOCK_CONTROL\n");
+        break;
+    }
+}
+
+/**
+ * @brief 把输入翻译成 freedorm_sim 的场景脚本
+ */
+static void print_reproducer(FILE *fp)
+{
+    fprintf(fp, "# fuzz_lock_fsm reproducer\npress\nwait 4500\nrelease\nwait 8000\nmqtt connect\nwait 10\nmqtt provision\n");
+    for (size_t i = 0; i < fuzz_records; i++)
+    {
+        if (i == fuzz_step)
+        {
+            fprintf(fp, "# ---- violation detected in this step ----\n");
+        }
+        print_action(fp, fuzz_data[2 * i], i);
+        int64_t delay_ms = decode_delay_ms(fuzz_data[2 * i + 1]);
+        if (delay_ms > 0)
+        {
+            fprintf(fp, "wait %lld\n", (long long)delay_ms);
+        }
+    }
+    if (fuzz_step >= fuzz_records)
+    {
+        fprintf(fp, "# ---- violation detected while settling ----\n");
+    }
+    fprintf(fp, "release\nwait %d\n", FUZZ_SETTLE_MS);
+}
+
+static void violation(const char *fmt, const char *detail)
+{
+    fprintf(stderr, "[%10.3f ms] INVARIANT VIOLATION in state %s: ", sim_now_us() / 1000.0, sim_lock_state_name(get_current_lock_state()));
+    fprintf(stderr, fmt, detail);
+    fprintf(stderr, "\n");
+    print_reproducer(stderr);
+    abort();
+}
+
+static void check_pins(lock_status_t state)
+{
+    int lock = sim_gpio_level(CTL_LOCK);
+    int d0 = sim_gpio_level(CTL_D0);
+    switch (state)
+    {
+    case STATE_POWER_ON_BLACK:
+    case STATE_NORAML_DEFAULT:
+    case STATE_BLE_PAIRING_PREPARE:
+    case STATE_BLE_PAIRING_IN_PROGRESS:
+    case STATE_BLE_PAIRING_TIME_OUT:
+    case STATE_RESTORY_FACTORY_SETTINGS_PREPARE:
+    case STATE_RESTORY_FACTORY_SETTINGS:
+        if (lock != 1 || d0 != 0)
+        {
+            violation("door should be in normal mode (CTL_LOCK=1, CTL_D0=0)%s", "");
+        }
+        break;
+    case STATE_TEMP_OPEN:
+    case STATE_ALWAYS_OPEN:
+    case STATE_BLE_TEMP_OPEN:
+        if (lock != 0 || d0 != 0)
+        {
+            violation("door should be open (CTL_LOCK=0, CTL_D0=0)%s", "");
+        }
+        break;
+    case STATE_LOCKED:
+        if (lock != 1 || d0 != 1)
+        {
+            violation("door should be locked (CTL_LOCK=1, CTL_D0=1)%s", "");
+        }
+        break;
+    default:
+        break; // *_END 状态正在播放结束灯效，引脚随后才恢复
+    }
+}
+
+static void check_timers(lock_status_t state)
+{
+    static const char *const names[] = {"PairingTimer"};
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+    {
+        if (sim_timer_count(names[i], false) > 1)
+        {
+            violation("more than one live %s, a timer handle leaked", names[i]);
+        }
+    }
+    if (sim_timer_count(NULL, false) > FUZZ_MAX_LIVE_TIMERS)
+    {
+        violation("too many live software timers%s", "");
+    }
+    lock_actuator_status_t status;
+    lock_actuator_get_status(LOCK_ACTUATOR_LINE_LOCK, &status);
+    if (state == STATE_ALWAYS_OPEN && (status.deadline_us != 0 || sim_esp_timer_count("CTL_LOCK", true)))
+    {
+        violation("always-open mode still has a temporary-open hold timeout%s", "");
+    }
+}
+
+static void check_pairing(lock_status_t state)
+{
+    lock_status_t stray_state;
+    uint32_t sessions = sim_ble_pairing_sessions();
+    if (sim_ble_stray_pairing_sessions(&stray_state) != 0)
+    {
+        violation("pairing advertising started in %s instead of together with entering pairing", sim_lock_state_name(stray_state));
+    }
+    if (state == STATE_BLE_PAIRING_IN_PROGRESS && last_checked_state != STATE_BLE_PAIRING_IN_PROGRESS && sessions == last_pairing_sessions)
+    {
+        violation("entered pairing without starting pairing advertising%s", "");
+    }
+    last_checked_state = state;
+    last_pairing_sessions = sessions;
+}
+
+static void check_invariants(void)
+{
+    lock_status_t state = get_current_lock_state();
+    if (restarted)
+    {
+        return;
+    }
+    check_pins(state);
+    check_timers(state);
+    check_pairing(state);
+}
+
+static void run_for_ms(int64_t ms)
+{
+    if (restarted)
+    {
+        return;
+    }
+    if (!sim_run_until(sim_now_us() + ms * 1000))
+    {
+        // 重启时固件停在调用 esp_restart() 的那一刻，状态还是重启前的状态
+        restarted = true;
+        if (get_current_lock_state() != STATE_RESTORY_FACTORY_SETTINGS)
+        {
+            violation("esp_restart() outside of factory reset%s", "");
+        }
+    }
+}
+
+static void apply_action(uint8_t code, size_t step, const char *command_topic)
+{
+    fuzz_action_t action = code % FUZZ_ACTION_COUNT;
+    switch (action)
+    {
+    case FUZZ_PRESS:
+        sim_gpio_drive(PAIRING_BUTTON_GPIO, 1);
+        break;
+    case FUZZ_RELEASE:
+        sim_gpio_drive(PAIRING_BUTTON_GPIO, 0);
+        break;
+    case FUZZ_CLICK:
+        sim_gpio_drive(PAIRING_BUTTON_GPIO, 1);
+        run_for_ms(FUZZ_CLICK_MS);
+        check_invariants();
+        sim_gpio_drive(PAIRING_BUTTON_GPIO, 0);
+        break;
+    case FUZZ_BLE_UNLOCK:
+        send_button_event(BLE_BUTTON_EVENT_SINGLE_CLICK);
+        break;
+    case FUZZ_EVENT_SINGLE_CLICK:
+        send_button_event(BUTTON_EVENT_SINGLE_CLICK);
+        break;
+    case FUZZ_EVENT_DOUBLE_CLICK:
+        send_button_event(BUTTON_EVENT_DOUBLE_CLICK);
+        break;
+    case FUZZ_EVENT_MULTI_CLICK:
+        send_button_event(BUTTON_EVENT_MULTI_CLICK);
+        break;
+    case FUZZ_REMOTE_COMMAND:
+    {
+        char request_id[12];
+        snprintf(request_id, sizeof(request_id), "%zu", step); // 请求号就是第几步，和复现脚本里一样
+        sim_mqtt_publish(command_topic, sim_mqtt_sign_command(remote_verb(code), request_id));
+        break;
+    }
+    default:
+        send_button_event(BUTTON_EVENT_NONE_UPDATE_LOCK_CONTROL);
+        break;
+    }
+}
+
+/**
+ * @brief 在当前进程里跑一个输入，只能调用一次
+ */
+static void run_input(const uint8_t *data, size_t size)
+{
+    fuzz_data = data;
+    fuzz_records = size / 2 < FUZZ_MAX_RECORDS ? size / 2 : FUZZ_MAX_RECORDS;
+    fuzz_step = 0;
+
+    sim_trace_gpio = false;
+    sim_trace_mqtt = false;
+    sim_app_start();
+
+    // 上电激活，和 scenarios/power_on_activate.txt 一样
+    sim_gpio_drive(PAIRING_BUTTON_GPIO, 1);
+    run_for_ms(4500);
+    sim_gpio_drive(PAIRING_BUTTON_GPIO, 0);
+    run_for_ms(8000);
+    if (get_current_lock_state() != STATE_NORAML_DEFAULT)
+    {
+        violation("activation did not reach the normal state%s", "");
+    }
+    sim_mqtt_connect();
+    run_for_ms(10); // 等 MQTT 任务处理完 CONNECTED、订阅上命令 topic，和场景脚本一样
+    sim_mqtt_provision_key();
+
+    uint8_t mac[6];
+    char command_topic[MQTT_TOPIC_MAX_LEN];
+    esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    mqtt_command_topic(command_topic, sizeof(command_topic), mac, "cmd");
+
+    for (fuzz_step = 0; fuzz_step < fuzz_records && !restarted; fuzz_step++)
+    {
+        apply_action(data[2 * fuzz_step], fuzz_step, command_topic);
+        run_for_ms(decode_delay_ms(data[2 * fuzz_step + 1]));
+        check_invariants();
+    }
+
+    sim_gpio_drive(PAIRING_BUTTON_GPIO, 0);
+    run_for_ms(FUZZ_SETTLE_MS);
+    check_invariants();
+    lock_status_t state = get_current_lock_state();
+    if (!restarted && state != STATE_NORAML_DEFAULT && state != STATE_ALWAYS_OPEN)
+    {
+        violation("state machine is stuck after %s of idle time", "the settle period");
+    }
+}
+
+static int64_t input_sim_ms(const uint8_t *data, size_t records)
+{
+    int64_t total = 4500 + 8000 + 10 + FUZZ_SETTLE_MS;
+    for (size_t i = 0; i < records; i++)
+    {
+        total += decode_delay_ms(data[2 * i + 1]) + (data[2 * i] % FUZZ_ACTION_COUNT == FUZZ_CLICK ? FUZZ_CLICK_MS : 0);
+    }
+    return total;
+}
+
+static int run_file(const char *path)
+{
+    static uint8_t buf[FUZZ_MAX_RECORDS * 2];
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        perror(path);
+        return 2;
+    }
+    size_t size = fread(buf, 1, sizeof(buf), fp);
+    fclose(fp);
+    run_input(buf, size);
+    return 0;
+}
+
+static double wall_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void save_crash(const char *dir, unsigned seed, int index, const uint8_t *data, size_t size)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/crash-%u-%d.bin", dir, seed, index);
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL)
+    {
+        perror(path);
+        return;
+    }
+    fwrite(data, 1, size, fp);
+    fclose(fp);
+    fprintf(stderr, "fuzz: saved failing input to %s\n", path);
+}
+
+/**
+ * @brief 随机模式：父进程生成输入，每个输入 fork 一个子进程去跑，子进程崩溃就把输入存下来
+ */
+static int run_random(int count, unsigned seed, int max_records, const char *crash_dir)
+{
+    static uint8_t buf[FUZZ_MAX_RECORDS * 2];
+    uint64_t total_events = 0;
+    int64_t total_sim_ms = 0;
+    int crashes = 0;
+    double wall_start = wall_ms();
+
+    srandom(seed);
+    for (int i = 0; i < count; i++)
+    {
+        size_t records = 1 + random() % max_records;
+        for (size_t j = 0; j < records * 2; j++)
+        {
+            buf[j] = (uint8_t)random();
+        }
+        total_events += records;
+        total_sim_ms += input_sim_ms(buf, records);
+
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            run_input(buf, records * 2);
+            _exit(0);
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            crashes++;
+            save_crash(crash_dir, seed, i, buf, records * 2);
+        }
+    }
+
+    double wall = wall_ms() - wall_start;
+    printf("fuzz: %d inputs, %llu events, %d failing, %.0f events/s, %.0f inputs/s, simulated %.1f h in %.1f s\n",
+           count, (unsigned long long)total_events, crashes, total_events / (wall / 1000.0), count / (wall / 1000.0),
+           total_sim_ms / 3600000.0, wall / 1000.0);
+    return crashes ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    int count = 0;
+    unsigned seed = 1;
+    int max_records = FUZZ_DEFAULT_RECORDS;
+    const char *crash_dir = ".";
+    const char *path = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-v") == 0)
+        {
+            sim_log_level = ESP_LOG_INFO;
+        }
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+        {
+            count = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+        {
+            seed = (unsigned)strtoul(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+        {
+            max_records = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            crash_dir = argv[++i];
+        }
+        else
+        {
+            path = argv[i];
+        }
+    }
+
+    if (max_records < 1 || max_records > FUZZ_MAX_RECORDS)
+    {
+        max_records = FUZZ_DEFAULT_RECORDS;
+    }
+    if (count > 0)
+    {
+        return run_random(count, seed, max_records, crash_dir);
+    }
+    if (path == NULL)
+    {
+        fprintf(stderr, "usage: %s [-v] <input>\n       %s -r <count> [-s seed] [-l max_records] [-o crash_dir]\n", argv[0], argv[0]);
+        return 2;
+    }
+    return run_file(path);
+}
@@ -0,0 +1,521 @@
+/**
+ * @file led_capture.c
+ * @brief 灯效抓帧工具：只启动 ws2812b（不跑状态机），在虚拟时钟上把 RMT 发出去的每一帧记下来
+ *
+ * 固件里的 flash_led_strip() 不用改，sim_rmt.c 就是抓帧的出口：帧发完的虚拟时刻回调一次，
+ * 记下的是灯带上真正显示出来的画面，双缓冲、帧时钟、交叉淡化和静止画面不重画都会反映在里面。
+ *
+ * 用法：
+ *   led_capture -e <LED_EFFECT_xxx> [-d ms]            打印切到这个效果之后 ms（默认 3000）内的每一帧，每颗灯一个 #rrggbb
+ *   led_capture -e <LED_EFFECT_xxx> [-d ms] -o <file>  写成二进制帧日志
+ *   led_capture -u <golden_dir> [-d ms]                给所有内置效果重新生成基准帧 <golden_dir>/<LED_EFFECT_xxx>.bin
+ *   led_capture -c <golden_dir>                        逐帧比对所有内置效果和基准帧，单色效果再核对原来的颜色，有差别时打印第一处不同并返回 1
+ *   led_capture -b [-n frames]                         每个效果打印实际渲染帧率和每帧 CPU 时间
+ *
+ * 加上 -l <count> [-f first] [-r] [-p mA] [-k chip] 时先把这个灯带配置写进 NVS 再启动，用来看长灯带、反向接线、限流和别的芯片；
+ * 这时抓到的每一帧都必须正好是 count * 每颗灯的字节数，否则返回 1。chip 是芯片名，空格写成下划线，如 SK6812_RGBW，
+ * RGBW 的灯打印成 #rrggbbww。基准帧都是默认的 WS2812B_LED_NUMBERS 颗 WS2812。
+ *
+ * 帧日志格式（小端）：文件头 "FDLC" + uint16 版本 + uint16 保留 + uint32 抓帧时长 ms，
+ * 然后每帧是 int64 时间（从切换效果开始的 us，取帧发完锁存的时刻）+ uint16 字节数 + 按 G, B, R 顺序的像素。
+ *
+ * 和 fuzz_lock_fsm 一样，固件里全是静态变量，每个效果都 fork 一个子进程从头启动。
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "ws2812b_led.h"
+#include "led_compositor.h"
+#include "led_strip_encoder.h"
+#include "sim_hal.h"
+#include "sim_kernel.h"
+
+#define CAPTURE_MAGIC "FDLC"
+#define CAPTURE_VERSION 1
+#define CAPTURE_DEFAULT_MS 3000
+#define CAPTURE_SETTLE_MS (WS2812B_CROSSFADE_MS * 2) // 初始化后先等上电效果的淡入结束、画面静止下来再切效果
+#define CAPTURE_MAX_FRAMES 4096
+#define BENCH_DEFAULT_FRAMES 20000
+#define BENCH_FRAME_US WS2812B_FRAME_PERIOD_US
+
+typedef struct
+{
+    int64_t t_us;
+    uint16_t size;
+    uint8_t data[SIM_LED_FRAME_MAX_BYTES];
+} capture_frame_t;
+
+typedef struct
+{
+    uint32_t window_ms;
+    size_t count;
+    capture_frame_t *frames;
+} capture_log_t;
+
+static int64_t switch_us;
+static ws2812b_strip_config_t strip_config; // count 为 0 时用固件的默认配置
+
+static void capture_on_frame(const sim_led_frame_t *frame, void *user_ctx)
+{
+    capture_log_t *log = user_ctx;
+    if (log->count >= CAPTURE_MAX_FRAMES)
+    {
+        return;
+    }
+    capture_frame_t *out = &log->frames[log->count++];
+    out->t_us = frame->done_us - switch_us;
+    out->size = (uint16_t)frame->size;
+    memcpy(out->data, frame->data, frame->size);
+}
+
+static void capture_main(void *arg)
+{
+    (void)arg;
+    if (strip_config.count > 0 && ws2812b_led_set_strip_config(&strip_config) != ESP_OK)
+    {
+        fprintf(stderr, "invalid strip config\n");
+        exit(2);
+    }
+    ws2812b_led_init();
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief 在当前（子）进程里启动 ws2812b，切到 effect，抓 window_ms 内的帧
+ */
+static void capture_effect(ws2812b_state_effect_t effect, uint32_t window_ms, capture_log_t *log)
+{
+    log->window_ms = window_ms;
+    log->count = 0;
+    log->frames = calloc(CAPTURE_MAX_FRAMES, sizeof(capture_frame_t));
+
+    sim_trace_gpio = false;
+    sim_kernel_init();
+    xTaskCreate(capture_main, "main", 3584, NULL, 1, NULL);
+    sim_run_until(CAPTURE_SETTLE_MS * 1000);
+
+    sim_led_set_frame_callback(capture_on_frame, log);
+    switch_us = sim_now_us();
+    ws2812b_switch_effect(effect);
+    sim_run_until(switch_us + (int64_t)window_ms * 1000);
+    sim_led_set_frame_callback(NULL, NULL);
+}
+
+static bool write_log(const char *path, const capture_log_t *log)
+{
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL)
+    {
+        perror(path);
+        return false;
+    }
+    uint16_t version = CAPTURE_VERSION, reserved = 0;
+    fwrite(CAPTURE_MAGIC, 1, 4, fp);
+    fwrite(&version, sizeof(version), 1, fp);
+    fwrite(&reserved, sizeof(reserved), 1, fp);
+    fwrite(&log->window_ms, sizeof(log->window_ms), 1, fp);
+    for (size_t i = 0; i < log->count; i++)
+    {
+        fwrite(&log->frames[i].t_us, sizeof(int64_t), 1, fp);
+        fwrite(&log->frames[i].size, sizeof(uint16_t), 1, fp);
+        fwrite(log->frames[i].data, 1, log->frames[i].size, fp);
+    }
+    fclose(fp);
+    return true;
+}
+
+static bool read_log(const char *path, capture_log_t *log)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        perror(path);
+        return false;
+    }
+    char magic[4];
+    uint16_t version = 0, reserved;
+    if (fread(magic, 1, 4, fp) != 4 || memcmp(magic, CAPTURE_MAGIC, 4) != 0 ||
+        fread(&version, sizeof(version), 1, fp) != 1 || version != CAPTURE_VERSION ||
+        fread(&reserved, sizeof(reserved), 1, fp) != 1 || fread(&log->window_ms, sizeof(log->window_ms), 1, fp) != 1)
+    {
+        fprintf(stderr, "%s: not a frame log\n", path);
+        fclose(fp);
+        return false;
+    }
+    log->count = 0;
+    log->frames = calloc(CAPTURE_MAX_FRAMES, sizeof(capture_frame_t));
+    capture_frame_t *frame = &log->frames[0];
+    while (log->count < CAPTURE_MAX_FRAMES && fread(&frame->t_us, sizeof(int64_t), 1, fp) == 1)
+    {
+        if (fread(&frame->size, sizeof(uint16_t), 1, fp) != 1 || frame->size > SIM_LED_FRAME_MAX_BYTES ||
+            fread(frame->data, 1, frame->size, fp) != frame->size)
+        {
+            fprintf(stderr, "%s: truncated frame %zu\n", path, log->count);
+            fclose(fp);
+            return false;
+        }
+        frame = &log->frames[++log->count];
+    }
+    fclose(fp);
+    return true;
+}
+
+static void print_frame(FILE *fp, const char *prefix, const capture_frame_t *frame)
+{
+    const led_strip_chip_profile_t *chip = led_strip_chip_profile(strip_config.chip);
+    fprintf(fp, "%s%10.3f ms ", prefix, frame->t_us / 1000.0);
+    for (uint16_t i = 0; i + chip->bytes_per_pixel <= frame->size; i += chip->bytes_per_pixel)
+    {
+        uint8_t channels[LED_STRIP_CHANNEL_COUNT] = {0};
+        for (int c = 0; c < chip->bytes_per_pixel; c++)
+        {
+            channels[chip->order[c]] = frame->data[i + c];
+        }
+        fprintf(fp, " #%02x%02x%02x", channels[LED_STRIP_CHANNEL_R], channels[LED_STRIP_CHANNEL_G], channels[LED_STRIP_CHANNEL_B]);
+        if (chip->bytes_per_pixel == 4)
+        {
+            fprintf(fp, "%02x", channels[LED_STRIP_CHANNEL_W]);
+        }
+    }
+    fprintf(fp, "\n");
+}
+
+// 改成灯效程序之前（user-034 以前）每个效果函数用的颜色，效果程序里的颜色写反的话逐帧基准重新生成也发现不了，这里单独比对；彩虹、随机和黑屏不是单色，不在表里
+static const ws2812b_color_rgb_t legacy_colors[LED_EFFECT_COUNT] = {
+    [LED_EFFECT_DEBUG] = GREEN_RGB,
+    [LED_EFFECT_SINGLE_OPEN_DOOR] = GREEN_RGB,
+    [LED_EFFECT_ALWAYS_OPEN_MODE] = GREEN_RGB,
+    [LED_EFFECT_OPEN_MODE_END] = GREEN_RGB,
+    [LED_EFFECT_CONFIRM_FACTORY_RESET] = RED_RGB,
+    [LED_EFFECT_FACTORY_RESETTING] = RED_RGB,
+    [LED_EFFECT_FINISH_FACTORY_RESET] = RED_RGB,
+    [LED_EFFECT_BLE_TRY_PAIRING] = BLUE_RGB,
+    [LED_EFFECT_BLE_PAIRING_MODE] = BLUE_RGB,
+    [LED_EFFECT_BLE_CONNECTED_FIRST_TIME] = BLUE_RGB,
+    [LED_EFFECT_VISITOR_CODE_OPEN_DOOR] = PURPLE_RGB,
+    [LED_EFFECT_VISITOR_CODE_TIME_EXPIRED] = PURPLE_RGB,
+    [LED_EFFECT_OPEN_BLUETOOTH_NEARBY] = BLUE_RGB,
+    [LED_EFFECT_OPEN_BLUETOOTH_FINISHED] = BLUE_RGB,
+    [LED_EFFECT_FIRST_POWER_ON_ACTIVATE] = BLUE_RGB,
+};
+
+/**
+ * @brief 单色效果只能点亮原来那个颜色用到的字节，而且每个用到的字节都要亮过；字节位置和原来的效果函数一样是 .green, .blue, .red
+ */
+static bool check_legacy_color(ws2812b_state_effect_t effect, const capture_log_t *log)
+{
+    const ws2812b_color_rgb_t *legacy = &legacy_colors[effect];
+    const bool expected[3] = {legacy->green != 0, legacy->blue != 0, legacy->red != 0};
+    bool lit[3] = {false, false, false};
+    if (!expected[0] && !expected[1] && !expected[2])
+    {
+        return true;
+    }
+    for (size_t i = 0; i < log->count; i++)
+    {
+        const capture_frame_t *frame = &log->frames[i];
+        for (uint16_t j = 0; j < frame->size; j++)
+        {
+            if (frame->data[j] != 0 && !expected[j % 3])
+            {
+                printf("FAIL: %s frame %zu lights byte %d, the colour used before the effect programs never did\n", ws2812b_effect_name(effect), i, j % 3);
+                print_frame(stdout, "  actual ", frame);
+                return false;
+            }
+            lit[j % 3] |= frame->data[j] != 0;
+        }
+    }
+    for (int c = 0; c < 3; c++)
+    {
+        if (expected[c] && !lit[c])
+        {
+            printf("FAIL: %s never lights byte %d of its colour\n", ws2812b_effect_name(effect), c);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool frames_equal(const capture_frame_t *a, const capture_frame_t *b)
+{
+    return a->t_us == b->t_us && a->size == b->size && memcmp(a->data, b->data, a->size) == 0;
+}
+
+/**
+ * @brief 子进程：抓一个效果和基准帧比对，返回进程退出码
+ */
+static int check_effect(ws2812b_state_effect_t effect, const char *golden_dir)
+{
+    char path[512];
+    capture_log_t golden, actual;
+    snprintf(path, sizeof(path), "%s/%s.bin", golden_dir, ws2812b_effect_name(effect));
+    if (!read_log(path, &golden))
+    {
+        return 1;
+    }
+    capture_effect(effect, golden.window_ms, &actual);
+    if (!check_legacy_color(effect, &actual))
+    {
+        return 1;
+    }
+
+    size_t n = golden.count < actual.count ? golden.count : actual.count;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (!frames_equal(&golden.frames[i], &actual.frames[i]))
+        {
+            printf("FAIL: %s frame %zu differs\n", ws2812b_effect_name(effect), i);
+            print_frame(stdout, "  golden ", &golden.frames[i]);
+            print_frame(stdout, "  actual ", &actual.frames[i]);
+            return 1;
+        }
+    }
+    if (golden.count != actual.count)
+    {
+        printf("FAIL: %s rendered %zu frames, golden has %zu\n", ws2812b_effect_name(effect), actual.count, golden.count);
+        return 1;
+    }
+    printf("PASS: %s, %zu frames in %u ms\n", ws2812b_effect_name(effect), actual.count, actual.window_ms);
+    return 0;
+}
+
+/**
+ * @brief 子进程：抓一个效果写成基准帧
+ */
+static int update_effect(ws2812b_state_effect_t effect, const char *golden_dir, uint32_t window_ms)
+{
+    char path[512];
+    capture_log_t log;
+    snprintf(path, sizeof(path), "%s/%s.bin", golden_dir, ws2812b_effect_name(effect));
+    capture_effect(effect, window_ms, &log);
+    if (!write_log(path, &log))
+    {
+        return 1;
+    }
+    printf("wrote %s (%zu frames)\n", path, log.count);
+    return 0;
+}
+
+static double thread_cpu_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/**
+ * @brief 子进程：实际渲染帧率来自虚拟时钟上的抓帧，每帧 CPU 时间是在本机上直接跑 frames 次合成的平均值
+ */
+static int bench_effect(ws2812b_state_effect_t effect, uint32_t window_ms, int frames)
+{
+    capture_log_t log;
+    capture_effect(effect, window_ms, &log);
+    uint16_t count = log.count > 0 ? log.frames[0].size / 3 : 0;
+
+    led_compositor_t comp;
+    uint8_t pixels[SIM_LED_FRAME_MAX_BYTES];
+    if (led_compositor_init(&comp, count) != ESP_OK)
+    {
+        return 1;
+    }
+    led_compositor_set_base(&comp, ws2812b_effect_program(effect), 0, 0);
+    double start = thread_cpu_us();
+    for (int i = 0; i < frames; i++)
+    {
+        led_compositor_render(&comp, (int64_t)i * BENCH_FRAME_US, pixels);
+    }
+    double cpu_us = (thread_cpu_us() - start) / frames;
+
+    printf("%-40s %8.1f fps %8zu frames %10.3f us/frame\n", ws2812b_effect_name(effect), log.count * 1000.0 / window_ms, log.count, cpu_us);
+    return 0;
+}
+
+static bool parse_effect(const char *name, ws2812b_state_effect_t *effect)
+{
+    for (int i = 0; i < LED_EFFECT_COUNT; i++)
+    {
+        if (strcmp(ws2812b_effect_name(i), name) == 0)
+        {
+            *effect = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parse_chip(const char *name, uint8_t *chip)
+{
+    for (int i = 0; i < LED_STRIP_CHIP_COUNT; i++)
+    {
+        const char *expected = led_strip_chip_profile(i)->name;
+        size_t n = 0;
+        while (name[n] != '\0' && (name[n] == expected[n] || (name[n] == '_' && expected[n] == ' ')))
+        {
+            n++;
+        }
+        if (name[n] == '\0' && expected[n] == '\0')
+        {
+            *chip = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+typedef enum
+{
+    MODE_NONE,
+    MODE_CHECK,
+    MODE_UPDATE,
+    MODE_BENCH,
+} capture_mode_t;
+
+/**
+ * @brief 每个内置效果 fork 一个子进程，返回失败的个数
+ */
+static int run_all(capture_mode_t mode, const char *golden_dir, uint32_t window_ms, int frames)
+{
+    int failures = 0;
+    if (mode == MODE_BENCH)
+    {
+        printf("%-40s %12s %15s %19s\n", "effect", "rendered", "", "host CPU");
+    }
+    for (int i = 0; i < LED_EFFECT_COUNT; i++)
+    {
+        if (ws2812b_effect_program(i) == NULL)
+        {
+            continue;
+        }
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            int rc = mode == MODE_CHECK    ? check_effect(i, golden_dir)
+                     : mode == MODE_UPDATE ? update_effect(i, golden_dir, window_ms)
+                                           : bench_effect(i, window_ms, frames);
+            fflush(stdout);
+            _exit(rc);
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            failures++;
+        }
+    }
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    capture_mode_t mode = MODE_NONE;
+    const char *golden_dir = NULL;
+    const char *out_path = NULL;
+    const char *effect_name = NULL;
+    uint32_t window_ms = CAPTURE_DEFAULT_MS;
+    int frames = BENCH_DEFAULT_FRAMES;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-e") == 0 && i + 1 < argc)
+        {
+            effect_name = argv[++i];
+        }
+        else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc)
+        {
+            window_ms = strtoul(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            out_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+        {
+            mode = MODE_CHECK;
+            golden_dir = argv[++i];
+        }
+        else if (strcmp(argv[i], "-u") == 0 && i + 1 < argc)
+        {
+            mode = MODE_UPDATE;
+            golden_dir = argv[++i];
+        }
+        else if (strcmp(argv[i], "-b") == 0)
+        {
+            mode = MODE_BENCH;
+        }
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+        {
+            frames = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+        {
+            strip_config.count = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+        {
+            strip_config.first = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-r") == 0)
+        {
+            strip_config.reversed = 1;
+        }
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+        {
+            strip_config.budget_ma = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc && parse_chip(argv[i + 1], &strip_config.chip))
+        {
+            i++;
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s -e <LED_EFFECT_xxx> [-d ms] [-o file] | -c <golden_dir> | -u <golden_dir> [-d ms] | -b [-n frames]  [-l count [-f first] [-r] [-p mA] [-k chip]]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (mode != MODE_NONE)
+    {
+        int failures = run_all(mode, golden_dir, window_ms, frames > 0 ? frames : 1);
+        if (mode == MODE_CHECK)
+        {
+            printf("%s: %d effects differ from %s\n", failures ? "FAIL" : "PASS", failures, golden_dir);
+        }
+        return failures ? 1 : 0;
+    }
+
+    ws2812b_state_effect_t effect;
+    if (effect_name == NULL || !parse_effect(effect_name, &effect))
+    {
+        fprintf(stderr, "unknown effect '%s'\n", effect_name ? effect_name : "");
+        return 2;
+    }
+    capture_log_t log;
+    capture_effect(effect, window_ms, &log);
+    int rc = 0;
+    for (size_t i = 0; i < log.count && strip_config.count > 0; i++)
+    {
+        uint16_t expected = strip_config.count * led_strip_chip_profile(strip_config.chip)->bytes_per_pixel;
+        if (log.frames[i].size != expected)
+        {
+            fprintf(stderr, "frame %zu has %u bytes, expected %u\n", i, log.frames[i].size, expected);
+            rc = 1;
+            break;
+        }
+    }
+    if (out_path != NULL)
+    {
+        return write_log(out_path, &log) ? rc : 1;
+    }
+    for (size_t i = 0; i < log.count; i++)
+    {
+        print_frame(stdout, "", &log.frames[i]);
+    }
+    return rc;
+}
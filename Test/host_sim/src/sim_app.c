@@ -0,0 +1,136 @@
+/**
+ * @file sim_app.c
+ * @brief 仿真程序共用的固件启动、状态名和事件名工具
+ */
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "button.h"
+#include "lock_control.h"
+#include "ws2812b_led.h"
+#include "ble_module.h"
+#include "audit_log.h"
+#include "lock_schedule.h"
+#include "freedorm_mqtt.h"
+#include "telemetry.h"
+#include "offline_queue.h"
+#include "sim_app.h"
+#include "sim_kernel.h"
+
+#define SIM_NAME(name) {name, #name}
+
+static const struct
+{
+    lock_status_t state;
+    const char *name;
+} lock_state_names[] = {
+    SIM_NAME(STATE_POWER_ON_BLACK),
+    SIM_NAME(STATE_NORAML_DEFAULT),
+    SIM_NAME(STATE_TEMP_OPEN),
+    SIM_NAME(STATE_ALWAYS_OPEN),
+    SIM_NAME(STATE_LOCKED),
+    SIM_NAME(STATE_TEMP_OPEN_END),
+    SIM_NAME(STATE_LOCK_END),
+    SIM_NAME(STATE_BLE_TEMP_OPEN),
+    SIM_NAME(STATE_BLE_TEMP_OPEN_END),
+    SIM_NAME(STATE_BLE_PAIRING_PREPARE),
+    SIM_NAME(STATE_BLE_PAIRING_IN_PROGRESS),
+    SIM_NAME(STATE_BLE_PAIRING_TIME_OUT),
+    SIM_NAME(STATE_RESTORY_FACTORY_SETTINGS_PREPARE),
+    SIM_NAME(STATE_RESTORY_FACTORY_SETTINGS),
+};
+
+static const struct
+{
+    button_event_t event;
+    const char *name;
+} button_event_names[] = {
+    SIM_NAME(BUTTON_EVENT_SINGLE_CLICK),
+    SIM_NAME(BUTTON_EVENT_DOUBLE_CLICK),
+    SIM_NAME(BUTTON_EVENT_MULTI_CLICK),
+    SIM_NAME(BUTTON_EVENT_LONG_PRESS_START),
+    SIM_NAME(BUTTON_EVENT_LONG_PRESS_HOLD_3S),
+    SIM_NAME(BUTTON_EVENT_LONG_PRESS_HOLD_4S),
+    SIM_NAME(BUTTON_EVENT_LONG_PRESS_HOLD_6S),
+    SIM_NAME(BUTTON_EVENT_LONG_PRESS_END),
+    SIM_NAME(BUTTON_EVENT_PRESS_DOWN),
+    SIM_NAME(BUTTON_EVENT_PRESS_UP),
+    SIM_NAME(BLE_BUTTON_EVENT_SINGLE_CLICK),
+    SIM_NAME(BUTTON_EVENT_NONE_UPDATE_LOCK_CONTROL),
+    SIM_NAME(SCHEDULE_EVENT_UPDATE),
+    SIM_NAME(ACTUATOR_EVENT_HOLD_EXPIRED),
+    SIM_NAME(PAIRING_EVENT_TIMEOUT),
+    SIM_NAME(BUTTON_EVENT_SPECULATIVE_CLICK),
+    SIM_NAME(BUTTON_EVENT_SPECULATION_CANCEL),
+    SIM_NAME(REMOTE_EVENT_NORMAL),
+    SIM_NAME(REMOTE_EVENT_OPEN),
+    SIM_NAME(REMOTE_EVENT_LOCK),
+    SIM_NAME(REMOTE_EVENT_ALWAYS_OPEN),
+    SIM_NAME(REMOTE_EVENT_STATUS),
+};
+
+const char *sim_lock_state_name(lock_status_t state)
+{
+    for (size_t i = 0; i < sizeof(lock_state_names) / sizeof(lock_state_names[0]); i++)
+    {
+        if (lock_state_names[i].state == state)
+        {
+            return lock_state_names[i].name;
+        }
+    }
+    return "?";
+}
+
+const char *sim_button_event_name(button_event_t event)
+{
+    for (size_t i = 0; i < sizeof(button_event_names) / sizeof(button_event_names[0]); i++)
+    {
+        if (button_event_names[i].event == event)
+        {
+            return button_event_names[i].name;
+        }
+    }
+    return "?";
+}
+
+bool sim_button_event_parse(const char *name, button_event_t *event)
+{
+    for (size_t i = 0; i < sizeof(button_event_names) / sizeof(button_event_names[0]); i++)
+    {
+        if (strcmp(button_event_names[i].name, name) == 0)
+        {
+            *event = button_event_names[i].event;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief 和 _freedorm_main.c 里 app_main 的初始化顺序保持一致（NVS 是内存里的），跑在优先级为 1 的 main 任务里
+ *
+ * 板子上还没有配网，MQTT 没打开；仿真里总是启动客户端，连不连 broker 由脚本的 mqtt connect 决定
+ */
+static void sim_app_main(void *arg)
+{
+    (void)arg;
+    audit_log_init();
+    telemetry_init();
+    offline_queue_init();
+    ble_module_init();
+    ws2812b_led_init();
+    freedorm_button_init();
+    lock_control_init();
+    lock_schedule_init();
+    xTaskCreate(&button_task, "button_task", 2048, NULL, 1, NULL);
+    mqtt_start();
+    vTaskDelete(NULL);
+}
+
+void sim_app_start(void)
+{
+    sim_kernel_init();
+    xTaskCreate(sim_app_main, "main", 3584, NULL, 1, NULL);
+    sim_run_until(0);
+}
@@ -0,0 +1,26 @@
+/**
+ * @file sim_app.h
+ * @brief 仿真程序共用的固件启动、状态名和事件名工具
+ */
+#ifndef SIM_APP_H
+#define SIM_APP_H
+
+#include <stdbool.h>
+
+#include "button.h"
+#include "lock_control.h"
+
+/**
+ * @brief 初始化内核并按 app_main 的顺序启动固件，返回时所有初始化任务都已经跑完
+ */
+void sim_app_start(void);
+
+const char *sim_lock_state_name(lock_status_t state);
+const char *sim_button_event_name(button_event_t event);
+
+/**
+ * @brief 按枚举名（例如 BUTTON_EVENT_DOUBLE_CLICK）查找按键事件，找不到返回 false
+ */
+bool sim_button_event_parse(const char *name, button_event_t *event);
+
+#endif // SIM_APP_H
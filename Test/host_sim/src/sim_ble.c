@@ -0,0 +1,61 @@
+/**
+ * @file sim_ble.c
+ * @brief bsp_ble 的仿真替身：提供状态机依赖的配对信号量和一个不开广播的 pairing_mode_task，靠近开门由脚本直接注入事件
+ */
+#include "ble_module.h"
+#include "lock_control.h"
+#include "sim_ble.h"
+
+#define SIM_PAIRING_TASK_PRIORITY 5   // 和 ble_module.c 里 pairing_mode_task 的优先级一致
+#define SIM_PAIRING_MODE_MS 60 * 1000 // 配对模式持续的时间，和 ble_module.c 一致
+
+SemaphoreHandle_t pairing_semaphore = NULL;
+
+static uint32_t pairing_sessions;    // 开过几次配对广播
+static uint32_t stray_sessions;      // 其中有几次开的时候状态机不在配对中
+static lock_status_t stray_state;    // 最近一次不该开的时候状态机在哪个状态
+
+/**
+ * @brief 和 ble_module.c 里的 pairing_mode_task 一样等信号量、保持 60s，只是不碰广播，顺便记下开广播那一刻状态机在哪
+ *
+ * 优先级比 lock_control_task 低，信号量给出来之后要等锁控任务把这个事件处理完才轮到这里，
+ * 所以只要给信号量和进入配对状态在同一个事件里，这里看到的一定是 STATE_BLE_PAIRING_IN_PROGRESS。
+ */
+static void pairing_mode_task(void *arg)
+{
+    (void)arg;
+    while (1)
+    {
+        if (xSemaphoreTake(pairing_semaphore, portMAX_DELAY) == pdTRUE)
+        {
+            lock_status_t state = get_current_lock_state();
+            pairing_sessions++;
+            if (state != STATE_BLE_PAIRING_IN_PROGRESS)
+            {
+                stray_sessions++;
+                stray_state = state;
+            }
+            vTaskDelay(SIM_PAIRING_MODE_MS / portTICK_PERIOD_MS);
+        }
+    }
+}
+
+void ble_module_init(void)
+{
+    pairing_semaphore = xSemaphoreCreateBinary();
+    xTaskCreate(&pairing_mode_task, "pairing_mode_task", 2048, NULL, SIM_PAIRING_TASK_PRIORITY, NULL);
+}
+
+uint32_t sim_ble_pairing_sessions(void)
+{
+    return pairing_sessions;
+}
+
+uint32_t sim_ble_stray_pairing_sessions(lock_status_t *state)
+{
+    if (state != NULL)
+    {
+        *state = stray_state;
+    }
+    return stray_sessions;
+}
@@ -0,0 +1,22 @@
+/**
+ * @file sim_ble.h
+ * @brief 蓝牙替身的观察接口：配对广播什么时候开、开的时候状态机在哪
+ */
+#ifndef SIM_BLE_H
+#define SIM_BLE_H
+
+#include <stdint.h>
+
+#include "lock_control.h"
+
+/**
+ * @brief 上电以来开过几次配对广播（pairing_mode_task 拿到过几次 pairing_semaphore）
+ */
+uint32_t sim_ble_pairing_sessions(void);
+
+/**
+ * @brief 开配对广播的时候状态机不在 STATE_BLE_PAIRING_IN_PROGRESS 的次数，state 不为 NULL 时带回最近一次的状态
+ */
+uint32_t sim_ble_stray_pairing_sessions(lock_status_t *state);
+
+#endif // SIM_BLE_H
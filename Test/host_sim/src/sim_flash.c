@@ -0,0 +1,170 @@
+/**
+ * @file sim_flash.c
+ * @brief esp_partition 的仿真：分区放在内存里，按 NOR flash 的规则检查擦写
+ *
+ * 写入只能把 1 改成 0，往没擦过的地方写会直接报错退出；擦除必须按扇区对齐。
+ * 每个扇区的擦除次数都记下来，方便检查磨损是否均匀。
+ * 分区内容可以存成文件，下一次仿真读回来，相当于断电重启之后 flash 里的东西还在。
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_partition.h"
+#include "sim_hal.h"
+
+#define SIM_FLASH_SECTOR_SIZE 4096
+
+typedef struct
+{
+    esp_partition_t info;
+    uint8_t *data;
+    uint32_t *erase_counts;
+    uint32_t failing_erases; // 接下来还要失败的擦除次数
+} sim_partition_t;
+
+// 和 IDF_Project/partitions.csv 保持一致，只列出固件会用到的 data 分区
+static sim_partition_t partitions[] = {
+    {.info = {.type = ESP_PARTITION_TYPE_DATA, .subtype = 0x99, .address = 0x190000, .size = 64 * 1024, .erase_size = SIM_FLASH_SECTOR_SIZE, .label = "audit"}},
+    {.info = {.type = ESP_PARTITION_TYPE_DATA, .subtype = 0x9a, .address = 0x1a0000, .size = 64 * 1024, .erase_size = SIM_FLASH_SECTOR_SIZE, .label = "outbox"}},
+};
+
+#define SIM_PARTITION_COUNT (sizeof(partitions) / sizeof(partitions[0]))
+
+static sim_partition_t *lookup(const esp_partition_t *partition)
+{
+    for (size_t i = 0; i < SIM_PARTITION_COUNT; i++)
+    {
+        if (&partitions[i].info == partition)
+        {
+            if (partitions[i].data == NULL)
+            {
+                partitions[i].data = malloc(partition->size);
+                memset(partitions[i].data, 0xff, partition->size);
+                partitions[i].erase_counts = calloc(partition->size / partition->erase_size, sizeof(uint32_t));
+            }
+            return &partitions[i];
+        }
+    }
+    return NULL;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label)
+{
+    for (size_t i = 0; i < SIM_PARTITION_COUNT; i++)
+    {
+        esp_partition_t *info = &partitions[i].info;
+        if ((type == ESP_PARTITION_TYPE_ANY || info->type == type) &&
+            (subtype == ESP_PARTITION_SUBTYPE_ANY || info->subtype == subtype) &&
+            (label == NULL || strcmp(info->label, label) == 0))
+        {
+            return info;
+        }
+    }
+    return NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+    sim_partition_t *p = lookup(partition);
+    if (p == NULL || dst == NULL || src_offset + size > partition->size)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(dst, p->data + src_offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size)
+{
+    sim_partition_t *p = lookup(partition);
+    if (p == NULL || src == NULL || dst_offset + size > partition->size)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const uint8_t *bytes = src;
+    for (size_t i = 0; i < size; i++)
+    {
+        if ((p->data[dst_offset + i] & bytes[i]) != bytes[i])
+        {
+            fprintf(stderr, "sim: write to non-erased flash in partition '%s' at 0x%zx\n", partition->label, dst_offset + i);
+            abort();
+        }
+        p->data[dst_offset + i] &= bytes[i];
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size)
+{
+    sim_partition_t *p = lookup(partition);
+    if (p == NULL || offset % partition->erase_size || size % partition->erase_size || offset + size > partition->size)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (p->failing_erases > 0)
+    {
+        p->failing_erases--;
+        return ESP_FAIL;
+    }
+    memset(p->data + offset, 0xff, size);
+    for (size_t sector = offset / partition->erase_size; sector < (offset + size) / partition->erase_size; sector++)
+    {
+        p->erase_counts[sector]++;
+    }
+    return ESP_OK;
+}
+
+uint32_t sim_flash_erase_count(const char *label, uint32_t sector)
+{
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_ANY, ESP_PARTITION_SUBTYPE_ANY, label);
+    sim_partition_t *p = partition ? lookup(partition) : NULL;
+    if (p == NULL || sector >= partition->size / partition->erase_size)
+    {
+        return 0;
+    }
+    return p->erase_counts[sector];
+}
+
+void sim_flash_fail_erases(const char *label, uint32_t count)
+{
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_ANY, ESP_PARTITION_SUBTYPE_ANY, label);
+    sim_partition_t *p = partition ? lookup(partition) : NULL;
+    if (p != NULL)
+    {
+        p->failing_erases = count;
+    }
+}
+
+bool sim_flash_load(const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        return false;
+    }
+    bool ok = true;
+    for (size_t i = 0; i < SIM_PARTITION_COUNT; i++)
+    {
+        sim_partition_t *p = lookup(&partitions[i].info);
+        ok = ok && fread(p->data, 1, p->info.size, fp) == p->info.size;
+    }
+    fclose(fp);
+    return ok;
+}
+
+bool sim_flash_save(const char *path)
+{
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL)
+    {
+        return false;
+    }
+    bool ok = true;
+    for (size_t i = 0; i < SIM_PARTITION_COUNT; i++)
+    {
+        sim_partition_t *p = lookup(&partitions[i].info);
+        ok = ok && fwrite(p->data, 1, p->info.size, fp) == p->info.size;
+    }
+    return fclose(fp) == 0 && ok;
+}
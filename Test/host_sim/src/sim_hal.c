@@ -0,0 +1,385 @@
+/**
+ * @file sim_hal.c
+ * @brief GPIO、日志、esp_restart、time() 和 settimeofday() 的仿真实现
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "driver/gpio.h"
+#include "esp_mac.h"
+#include "esp_rom_crc.h"
+#include "esp_system.h"
+#include "soc/gpio_reg.h"
+#include "sim_hal.h"
+#include "sim_kernel.h"
+
+esp_log_level_t sim_log_level = ESP_LOG_WARN;
+bool sim_trace_gpio = true;
+
+static int gpio_levels[SIM_GPIO_COUNT];
+static int64_t gpio_change_us[SIM_GPIO_COUNT];
+static gpio_mode_t gpio_modes[SIM_GPIO_COUNT];
+static gpio_int_type_t gpio_intr_types[SIM_GPIO_COUNT];
+static bool gpio_intr_enabled[SIM_GPIO_COUNT];
+static gpio_isr_t gpio_isr_handlers[SIM_GPIO_COUNT];
+static void *gpio_isr_args[SIM_GPIO_COUNT];
+static bool gpio_isr_service_installed = false;
+
+static sim_led_frame_t last_frame;
+static uint32_t frame_count = 0;
+static sim_led_frame_cb_t frame_cb = NULL;
+static void *frame_cb_ctx = NULL;
+
+static int64_t epoch_s = 0;
+
+/* ---------------------------------------------------------------- 日志 */
+
+void sim_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    static const char letters[] = {'N', 'E', 'W', 'I', 'D', 'V'};
+    if (level > sim_log_level)
+    {
+        return;
+    }
+    printf("%c (%lld) %s: ", letters[level], (long long)(sim_now_us() / 1000), tag);
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    printf("\n");
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    (void)tag;
+    (void)level;
+}
+
+void sim_log_buffer_hex(const char *tag, const void *buffer, uint16_t buff_len)
+{
+    if (ESP_LOG_INFO > sim_log_level)
+    {
+        return;
+    }
+    printf("I (%lld) %s:", (long long)(sim_now_us() / 1000), tag);
+    for (uint16_t i = 0; i < buff_len; i++)
+    {
+        printf(" %02x", ((const uint8_t *)buffer)[i]);
+    }
+    printf("\n");
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code)
+    {
+    case ESP_OK:
+        return "ESP_OK";
+    case ESP_FAIL:
+        return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:
+        return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:
+        return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:
+        return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:
+        return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:
+        return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED:
+        return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT:
+        return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_INVALID_CRC:
+        return "ESP_ERR_INVALID_CRC";
+    case ESP_ERR_INVALID_VERSION:
+        return "ESP_ERR_INVALID_VERSION";
+    default:
+        return "UNKNOWN ERROR";
+    }
+}
+
+/* ---------------------------------------------------------------- 系统 */
+
+void esp_restart(void)
+{
+    printf("[%10.3f ms] esp_restart() from %s\n", sim_now_us() / 1000.0, sim_current_task_name());
+    sim_request_restart();
+}
+
+esp_reset_reason_t esp_reset_reason(void)
+{
+    return ESP_RST_POWERON; // 每次仿真都是一次全新的上电
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+    return 180 * 1024;
+}
+
+uint32_t esp_get_minimum_free_heap_size(void)
+{
+    return 150 * 1024;
+}
+
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len)
+{
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; i++)
+    {
+        crc ^= buf[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320u & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type)
+{
+    static const uint8_t sim_mac[6] = {0x34, 0x85, 0x18, 0x46, 0x44, 0x52};
+    memcpy(mac, sim_mac, sizeof(sim_mac));
+    mac[5] += type; // 和芯片一样，各个接口的 MAC 依次加 1
+    return ESP_OK;
+}
+
+void sim_set_epoch(int64_t seconds)
+{
+    epoch_s = seconds;
+}
+
+// 覆盖 libc 的 time()，让 srand(time(NULL)) 和时间相关逻辑都跑在虚拟时钟上，保证每次运行结果一致
+time_t time(time_t *t)
+{
+    time_t now = (time_t)(epoch_s + sim_now_us() / 1000000);
+    if (t)
+    {
+        *t = now;
+    }
+    return now;
+}
+
+// 覆盖 libc 的 settimeofday()，固件对时只改仿真的 epoch，不碰主机时钟
+int settimeofday(const struct timeval *tv, const struct timezone *tz)
+{
+    (void)tz;
+    epoch_s = tv->tv_sec - sim_now_us() / 1000000;
+    return 0;
+}
+
+/* ---------------------------------------------------------------- GPIO */
+
+esp_err_t gpio_config(const gpio_config_t *pGPIOConfig)
+{
+    for (int i = 0; i < SIM_GPIO_COUNT; i++)
+    {
+        if (pGPIOConfig->pin_bit_mask & (1ULL << i))
+        {
+            gpio_modes[i] = pGPIOConfig->mode;
+            gpio_intr_types[i] = pGPIOConfig->intr_type;
+            gpio_intr_enabled[i] = pGPIOConfig->intr_type != GPIO_INTR_DISABLE; // 和 IDF 一样，配置了中断类型就顺便打开
+        }
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief 电平跳变时按中断类型决定要不要进中断；电平触发只在变成那个电平的时刻进一次，没有模拟一直触发
+ */
+static bool edge_triggers(int gpio_num, int level)
+{
+    if (!gpio_isr_service_installed || !gpio_intr_enabled[gpio_num] || gpio_isr_handlers[gpio_num] == NULL)
+    {
+        return false;
+    }
+    switch (gpio_intr_types[gpio_num])
+    {
+    case GPIO_INTR_POSEDGE:
+    case GPIO_INTR_HIGH_LEVEL:
+        return level == 1;
+    case GPIO_INTR_NEGEDGE:
+    case GPIO_INTR_LOW_LEVEL:
+        return level == 0;
+    case GPIO_INTR_ANYEDGE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void set_level(int gpio_num, int level, bool trace)
+{
+    level = level ? 1 : 0;
+    if (gpio_levels[gpio_num] == level)
+    {
+        return;
+    }
+    gpio_levels[gpio_num] = level;
+    gpio_change_us[gpio_num] = sim_now_us();
+    if (edge_triggers(gpio_num, level))
+    {
+        sim_schedule_isr(sim_now_us(), gpio_isr_handlers[gpio_num], gpio_isr_args[gpio_num]);
+    }
+    if (trace && sim_trace_gpio)
+    {
+        printf("[%10.3f ms] GPIO%d -> %d (%s)\n", sim_now_us() / 1000.0, gpio_num, level, sim_current_task_name());
+    }
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    if (gpio_num < 0 || gpio_num >= SIM_GPIO_COUNT)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    set_level(gpio_num, level, true);
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num)
+{
+    if (gpio_num < 0 || gpio_num >= SIM_GPIO_COUNT)
+    {
+        return 0;
+    }
+    return gpio_levels[gpio_num];
+}
+
+static bool valid_gpio(gpio_num_t gpio_num)
+{
+    return gpio_num >= 0 && gpio_num < SIM_GPIO_COUNT;
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t gpio_num, gpio_int_type_t intr_type)
+{
+    if (!valid_gpio(gpio_num))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    gpio_intr_types[gpio_num] = intr_type;
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_enable(gpio_num_t gpio_num)
+{
+    if (!valid_gpio(gpio_num))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    gpio_intr_enabled[gpio_num] = true;
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_disable(gpio_num_t gpio_num)
+{
+    if (!valid_gpio(gpio_num))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    gpio_intr_enabled[gpio_num] = false;
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags)
+{
+    (void)intr_alloc_flags;
+    if (gpio_isr_service_installed)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    gpio_isr_service_installed = true;
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args)
+{
+    if (!gpio_isr_service_installed)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!valid_gpio(gpio_num))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    gpio_isr_handlers[gpio_num] = isr_handler;
+    gpio_isr_args[gpio_num] = args;
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_remove(gpio_num_t gpio_num)
+{
+    if (!valid_gpio(gpio_num))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    gpio_isr_handlers[gpio_num] = NULL;
+    return ESP_OK;
+}
+
+uint32_t sim_reg_read(uint32_t reg)
+{
+    if (reg != GPIO_IN_REG)
+    {
+        fprintf(stderr, "sim: REG_READ(0x%08x) is not simulated\n", (unsigned)reg);
+        return 0;
+    }
+    uint32_t inputs = 0;
+    for (int i = 0; i < SIM_GPIO_COUNT; i++)
+    {
+        inputs |= (uint32_t)gpio_levels[i] << i;
+    }
+    return inputs;
+}
+
+void sim_gpio_drive(int gpio_num, int level)
+{
+    set_level(gpio_num, level, false);
+}
+
+int sim_gpio_level(int gpio_num)
+{
+    return gpio_levels[gpio_num];
+}
+
+int64_t sim_gpio_last_change_us(int gpio_num)
+{
+    return gpio_change_us[gpio_num];
+}
+
+/* ---------------------------------------------------------------- 灯带 */
+
+void sim_led_frame_done(const void *payload, size_t size, int64_t start_us, int64_t done_us)
+{
+    // 只发了前面一段时，后面的灯收不到数据，保持上一帧的颜色
+    size = size < SIM_LED_FRAME_MAX_BYTES ? size : SIM_LED_FRAME_MAX_BYTES;
+    last_frame.start_us = start_us;
+    last_frame.done_us = done_us;
+    last_frame.size = size > last_frame.size ? size : last_frame.size;
+    memcpy(last_frame.data, payload, size);
+    frame_count++;
+    if (frame_cb)
+    {
+        frame_cb(&last_frame, frame_cb_ctx);
+    }
+}
+
+const sim_led_frame_t *sim_led_last_frame(void)
+{
+    return &last_frame;
+}
+
+uint32_t sim_led_frame_count(void)
+{
+    return frame_count;
+}
+
+void sim_led_set_frame_callback(sim_led_frame_cb_t cb, void *user_ctx)
+{
+    frame_cb = cb;
+    frame_cb_ctx = user_ctx;
+}
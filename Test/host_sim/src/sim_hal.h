@@ -0,0 +1,79 @@
+/**
+ * @file sim_hal.h
+ * @brief 仿真外设：GPIO 电平、RMT 灯带输出、flash 分区、日志和系统调用
+ */
+#ifndef SIM_HAL_H
+#define SIM_HAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "esp_log.h"
+
+#define SIM_GPIO_COUNT 22
+#define SIM_LED_FRAME_MAX_BYTES 1200 // WS2812B_LED_NUMBERS_MAX 颗 RGBW 的灯
+
+/**
+ * @brief 灯带上实际显示出来的一帧（RMT 发送完成、复位码之后锁存）
+ */
+typedef struct
+{
+    int64_t start_us; // 开始上线的虚拟时间
+    int64_t done_us;  // 发送完成（锁存）的虚拟时间
+    size_t size;
+    uint8_t data[SIM_LED_FRAME_MAX_BYTES];
+} sim_led_frame_t;
+
+typedef void (*sim_led_frame_cb_t)(const sim_led_frame_t *frame, void *user_ctx);
+
+extern esp_log_level_t sim_log_level;  // 固件日志输出级别，默认只打印警告和错误
+extern bool sim_trace_gpio;            // 是否打印输出引脚的电平跳变
+
+/**
+ * @brief 外部输入（按键等）驱动一个输入引脚的电平
+ */
+void sim_gpio_drive(int gpio_num, int level);
+
+/**
+ * @brief 引脚当前电平和最近一次跳变的虚拟时间
+ */
+int sim_gpio_level(int gpio_num);
+int64_t sim_gpio_last_change_us(int gpio_num);
+
+/**
+ * @brief 灯带最近显示的一帧和累计帧数
+ */
+const sim_led_frame_t *sim_led_last_frame(void);
+uint32_t sim_led_frame_count(void);
+void sim_led_set_frame_callback(sim_led_frame_cb_t cb, void *user_ctx);
+
+/**
+ * @brief 由 sim_rmt.c 在发送完成时调用
+ */
+void sim_led_frame_done(const void *payload, size_t size, int64_t start_us, int64_t done_us);
+
+/**
+ * @brief 分区 label 里第 sector 个扇区被擦除的次数
+ */
+uint32_t sim_flash_erase_count(const char *label, uint32_t sector);
+
+/**
+ * @brief 分区 label 接下来的 count 次擦除都返回 ESP_FAIL，内容不变，模拟坏块或者擦除超时
+ */
+void sim_flash_fail_erases(const char *label, uint32_t count);
+
+/**
+ * @brief 把所有分区按分区表的顺序存进文件 / 从文件读回来，要在固件初始化之前读
+ *
+ * 擦除次数不存，只有内容
+ */
+bool sim_flash_load(const char *path);
+bool sim_flash_save(const char *path);
+
+/**
+ * @brief 设置仿真开始时刻对应的 UNIX 时间，time() 返回 epoch + 虚拟时间
+ */
+void sim_set_epoch(int64_t epoch_s);
+
+#endif // SIM_HAL_H
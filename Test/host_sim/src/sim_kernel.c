@@ -0,0 +1,903 @@
+/**
+ * @file sim_kernel.c
+ * @brief 虚拟时钟上的协作式 FreeRTOS 仿真内核，实现 stubs/freertos/FreeRTOS.h 里声明的 API
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "sim_kernel.h"
+
+#define SIM_TASK_STACK_SIZE (256 * 1024)
+#define SIM_TICK_US (1000000LL / configTICK_RATE_HZ)
+#define SIM_TIMER_TASK_PRIORITY 1      // CONFIG_FREERTOS_TIMER_TASK_PRIORITY
+#define SIM_ESP_TIMER_TASK_PRIORITY 22 // ESP_TASK_TIMER_PRIO，比所有应用任务都高
+
+typedef enum
+{
+    TASK_READY,
+    TASK_BLOCKED,
+    TASK_DEAD,
+} sim_task_state_t;
+
+struct sim_task
+{
+    ucontext_t ctx;
+    void *stack;
+    TaskFunction_t fn;
+    void *arg;
+    char name[24];
+    UBaseType_t prio;
+    sim_task_state_t state;
+    int64_t wake_us;      // 阻塞超时的绝对时间
+    const void *wait_obj; // 阻塞等待的对象，NULL 表示纯延时
+    bool woken;           // 是被对象唤醒的（而不是超时）
+    uint64_t last_run;    // 同优先级轮转
+    uint32_t runs;        // 被调度运行的次数，也就是唤醒次数
+    uint32_t notify_value;
+    bool notify_pending;
+    struct sim_task *next;
+};
+
+struct sim_queue
+{
+    uint8_t *buf;
+    UBaseType_t item_size;
+    UBaseType_t length;
+    UBaseType_t count;
+    UBaseType_t head;
+    uint8_t space_obj; // 等待队列有空位的任务阻塞在这个地址上
+};
+
+struct sim_timer
+{
+    const char *name;
+    TickType_t period;
+    bool auto_reload;
+    bool active;
+    int64_t expiry_us;
+    void *id;
+    TimerCallbackFunction_t cb;
+    struct sim_timer *next;
+};
+
+struct esp_timer
+{
+    const char *name;
+    esp_timer_cb_t cb;
+    void *arg;
+    bool active;
+    int64_t expiry_us;
+    uint64_t period_us; // 0 表示单次
+    struct esp_timer *next;
+};
+
+typedef struct sim_isr
+{
+    int64_t at_us;
+    uint64_t seq;
+    sim_isr_fn_t fn;
+    void *arg;
+    struct sim_isr *next;
+} sim_isr_t;
+
+static int64_t now_us = 0;
+static ucontext_t sched_ctx;
+static struct sim_task *task_list = NULL;
+static struct sim_task *current = NULL;
+static uint64_t run_seq = 0;
+static sim_isr_t *isr_list = NULL;
+static uint64_t isr_seq = 0;
+static struct sim_timer *timer_list = NULL;
+static uint8_t timer_list_obj; // 定时器服务任务阻塞在这个地址上
+static struct esp_timer *esp_timer_list = NULL;
+static uint8_t esp_timer_list_obj; // esp_timer 任务阻塞在这个地址上
+static bool restart_requested = false;
+
+/* ---------------------------------------------------------------- 内核工具函数 */
+
+int64_t sim_now_us(void)
+{
+    return now_us;
+}
+
+bool sim_in_task(void)
+{
+    return current != NULL;
+}
+
+const char *sim_current_task_name(void)
+{
+    return current ? current->name : "isr";
+}
+
+bool sim_restart_requested(void)
+{
+    return restart_requested;
+}
+
+static int64_t ticks_to_deadline(TickType_t ticks)
+{
+    if (ticks == portMAX_DELAY)
+    {
+        return SIM_TIME_NEVER;
+    }
+    // 和 FreeRTOS 一样以 tick 边界为准：当前 tick + ticks
+    return ((int64_t)xTaskGetTickCount() + ticks) * SIM_TICK_US;
+}
+
+static void switch_to_scheduler(void)
+{
+    struct sim_task *self = current;
+    swapcontext(&self->ctx, &sched_ctx);
+}
+
+static bool block_until(const void *obj, int64_t deadline_us)
+{
+    if (current == NULL)
+    {
+        fprintf(stderr, "sim: blocking call outside of a task\n");
+        abort();
+    }
+    current->state = TASK_BLOCKED;
+    current->wait_obj = obj;
+    current->wake_us = deadline_us;
+    current->woken = false;
+    switch_to_scheduler();
+    return current->woken;
+}
+
+bool sim_block_on(const void *obj, int64_t timeout_us)
+{
+    return block_until(obj, timeout_us == SIM_TIME_NEVER ? SIM_TIME_NEVER : now_us + timeout_us);
+}
+
+static void yield_if_preempted(UBaseType_t woken_prio)
+{
+    if (current != NULL && woken_prio > current->prio)
+    {
+        current->state = TASK_READY;
+        switch_to_scheduler();
+    }
+}
+
+void sim_wake_all(const void *obj)
+{
+    UBaseType_t max_prio = 0;
+    for (struct sim_task *t = task_list; t; t = t->next)
+    {
+        if (t->state == TASK_BLOCKED && t->wait_obj == obj && obj != NULL)
+        {
+            t->state = TASK_READY;
+            t->woken = true;
+            t->wait_obj = NULL;
+            if (t->prio > max_prio)
+            {
+                max_prio = t->prio;
+            }
+        }
+    }
+    yield_if_preempted(max_prio);
+}
+
+void sim_schedule_isr(int64_t at_us, sim_isr_fn_t fn, void *arg)
+{
+    sim_isr_t *isr = calloc(1, sizeof(sim_isr_t));
+    isr->at_us = at_us < now_us ? now_us : at_us;
+    isr->seq = isr_seq++;
+    isr->fn = fn;
+    isr->arg = arg;
+
+    sim_isr_t **pp = &isr_list;
+    while (*pp && ((*pp)->at_us < isr->at_us || ((*pp)->at_us == isr->at_us && (*pp)->seq < isr->seq)))
+    {
+        pp = &(*pp)->next;
+    }
+    isr->next = *pp;
+    *pp = isr;
+}
+
+static void reap_dead_tasks(void)
+{
+    struct sim_task **pp = &task_list;
+    while (*pp)
+    {
+        struct sim_task *t = *pp;
+        if (t->state == TASK_DEAD && t != current)
+        {
+            *pp = t->next;
+            free(t->stack);
+            free(t);
+        }
+        else
+        {
+            pp = &t->next;
+        }
+    }
+}
+
+bool sim_run_until(int64_t until_us)
+{
+    while (!restart_requested)
+    {
+        // 1. 到期的“中断”
+        while (isr_list && isr_list->at_us <= now_us)
+        {
+            sim_isr_t *isr = isr_list;
+            isr_list = isr->next;
+            isr->fn(isr->arg);
+            free(isr);
+        }
+
+        // 2. 超时的任务
+        for (struct sim_task *t = task_list; t; t = t->next)
+        {
+            if (t->state == TASK_BLOCKED && t->wake_us <= now_us)
+            {
+                t->state = TASK_READY;
+                t->wait_obj = NULL;
+            }
+        }
+
+        // 3. 选出优先级最高的就绪任务，同优先级轮转
+        struct sim_task *best = NULL;
+        for (struct sim_task *t = task_list; t; t = t->next)
+        {
+            if (t->state == TASK_READY && (best == NULL || t->prio > best->prio || (t->prio == best->prio && t->last_run < best->last_run)))
+            {
+                best = t;
+            }
+        }
+
+        if (best != NULL)
+        {
+            current = best;
+            best->last_run = ++run_seq;
+            best->runs++;
+            swapcontext(&sched_ctx, &best->ctx);
+            current = NULL;
+            reap_dead_tasks();
+            continue;
+        }
+
+        // 4. 没有任务就绪，虚拟时钟跳到下一个事件
+        int64_t next_us = isr_list ? isr_list->at_us : SIM_TIME_NEVER;
+        for (struct sim_task *t = task_list; t; t = t->next)
+        {
+            if (t->state == TASK_BLOCKED && t->wake_us < next_us)
+            {
+                next_us = t->wake_us;
+            }
+        }
+        if (next_us > until_us)
+        {
+            now_us = until_us;
+            return true;
+        }
+        now_us = next_us;
+    }
+    return false;
+}
+
+void sim_request_restart(void)
+{
+    restart_requested = true;
+    if (current != NULL)
+    {
+        current->state = TASK_DEAD;
+        switch_to_scheduler();
+    }
+    abort(); // 不会执行到这里
+}
+
+/* ---------------------------------------------------------------- 任务 */
+
+static void task_entry(void)
+{
+    current->fn(current->arg);
+    vTaskDelete(NULL); // FreeRTOS 任务不允许返回
+}
+
+BaseType_t xTaskCreate(TaskFunction_t pxTaskCode, const char *pcName, uint32_t usStackDepth, void *pvParameters, UBaseType_t uxPriority, TaskHandle_t *pxCreatedTask)
+{
+    (void)usStackDepth;
+    struct sim_task *t = calloc(1, sizeof(struct sim_task));
+    t->stack = malloc(SIM_TASK_STACK_SIZE);
+    t->fn = pxTaskCode;
+    t->arg = pvParameters;
+    t->prio = uxPriority;
+    t->state = TASK_READY;
+    snprintf(t->name, sizeof(t->name), "%s", pcName ? pcName : "");
+
+    getcontext(&t->ctx);
+    t->ctx.uc_stack.ss_sp = t->stack;
+    t->ctx.uc_stack.ss_size = SIM_TASK_STACK_SIZE;
+    t->ctx.uc_link = NULL;
+    makecontext(&t->ctx, task_entry, 0);
+
+    // 挂到链表尾部，保证创建顺序就是同优先级的首次运行顺序
+    struct sim_task **pp = &task_list;
+    while (*pp)
+    {
+        pp = &(*pp)->next;
+    }
+    *pp = t;
+
+    if (pxCreatedTask)
+    {
+        *pxCreatedTask = t;
+    }
+    yield_if_preempted(uxPriority);
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t xTaskToDelete)
+{
+    struct sim_task *t = xTaskToDelete ? xTaskToDelete : current;
+    t->state = TASK_DEAD;
+    if (t == current)
+    {
+        switch_to_scheduler();
+        abort(); // 已删除的任务不会再被调度
+    }
+}
+
+void vTaskDelay(TickType_t xTicksToDelay)
+{
+    if (xTicksToDelay == 0)
+    {
+        current->state = TASK_READY;
+        switch_to_scheduler();
+        return;
+    }
+    block_until(NULL, ticks_to_deadline(xTicksToDelay));
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(now_us / SIM_TICK_US);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return current;
+}
+
+BaseType_t xTaskNotify(TaskHandle_t xTaskToNotify, uint32_t ulValue, eNotifyAction eAction)
+{
+    struct sim_task *t = xTaskToNotify;
+    BaseType_t ret = pdPASS;
+    switch (eAction)
+    {
+    case eSetBits:
+        t->notify_value |= ulValue;
+        break;
+    case eIncrement:
+        t->notify_value++;
+        break;
+    case eSetValueWithOverwrite:
+        t->notify_value = ulValue;
+        break;
+    case eSetValueWithoutOverwrite:
+        if (t->notify_pending)
+        {
+            ret = pdFAIL;
+        }
+        else
+        {
+            t->notify_value = ulValue;
+        }
+        break;
+    default:
+        break;
+    }
+    t->notify_pending = true;
+    sim_wake_all(&t->notify_value);
+    return ret;
+}
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t xTaskToNotify, uint32_t ulValue, eNotifyAction eAction, BaseType_t *pxHigherPriorityTaskWoken)
+{
+    if (pxHigherPriorityTaskWoken)
+    {
+        *pxHigherPriorityTaskWoken = pdFALSE;
+    }
+    return xTaskNotify(xTaskToNotify, ulValue, eAction);
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify, BaseType_t *pxHigherPriorityTaskWoken)
+{
+    xTaskNotifyFromISR(xTaskToNotify, 0, eIncrement, pxHigherPriorityTaskWoken);
+}
+
+BaseType_t xTaskNotifyWait(uint32_t ulBitsToClearOnEntry, uint32_t ulBitsToClearOnExit, uint32_t *pulNotificationValue, TickType_t xTicksToWait)
+{
+    struct sim_task *t = current;
+    if (!t->notify_pending)
+    {
+        t->notify_value &= ~ulBitsToClearOnEntry;
+        if (xTicksToWait > 0)
+        {
+            block_until(&t->notify_value, ticks_to_deadline(xTicksToWait));
+        }
+    }
+    if (pulNotificationValue)
+    {
+        *pulNotificationValue = t->notify_value;
+    }
+    if (!t->notify_pending)
+    {
+        return pdFALSE;
+    }
+    t->notify_value &= ~ulBitsToClearOnExit;
+    t->notify_pending = false;
+    return pdTRUE;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait)
+{
+    struct sim_task *t = current;
+    if (t->notify_value == 0 && xTicksToWait > 0)
+    {
+        int64_t deadline = ticks_to_deadline(xTicksToWait);
+        while (t->notify_value == 0 && block_until(&t->notify_value, deadline))
+        {
+        }
+    }
+    uint32_t value = t->notify_value;
+    if (value != 0)
+    {
+        t->notify_value = xClearCountOnExit ? 0 : value - 1;
+    }
+    t->notify_pending = false;
+    return value;
+}
+
+/* ---------------------------------------------------------------- 队列 / 信号量 */
+
+QueueHandle_t xQueueCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize)
+{
+    struct sim_queue *q = calloc(1, sizeof(struct sim_queue));
+    q->length = uxQueueLength;
+    q->item_size = uxItemSize;
+    q->buf = uxItemSize ? calloc(uxQueueLength, uxItemSize) : NULL;
+    return q;
+}
+
+void vQueueDelete(QueueHandle_t xQueue)
+{
+    free(xQueue->buf);
+    free(xQueue);
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *pvItemToQueue, TickType_t xTicksToWait)
+{
+    int64_t deadline = ticks_to_deadline(xTicksToWait);
+    while (q->count >= q->length)
+    {
+        if (xTicksToWait == 0 || !sim_in_task() || !block_until(&q->space_obj, deadline))
+        {
+            if (q->count >= q->length)
+            {
+                return errQUEUE_FULL;
+            }
+        }
+    }
+    if (q->item_size)
+    {
+        memcpy(q->buf + ((q->head + q->count) % q->length) * q->item_size, pvItemToQueue, q->item_size);
+    }
+    q->count++;
+    sim_wake_all(q);
+    return pdPASS;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t xQueue, const void *pvItemToQueue, BaseType_t *pxHigherPriorityTaskWoken)
+{
+    if (pxHigherPriorityTaskWoken)
+    {
+        *pxHigherPriorityTaskWoken = pdFALSE;
+    }
+    return xQueueSend(xQueue, pvItemToQueue, 0);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *pvBuffer, TickType_t xTicksToWait)
+{
+    int64_t deadline = ticks_to_deadline(xTicksToWait);
+    while (q->count == 0)
+    {
+        if (xTicksToWait == 0 || !block_until(q, deadline))
+        {
+            if (q->count == 0)
+            {
+                return pdFALSE;
+            }
+        }
+    }
+    if (q->item_size && pvBuffer)
+    {
+        memcpy(pvBuffer, q->buf + q->head * q->item_size, q->item_size);
+    }
+    q->head = (q->head + 1) % q->length;
+    q->count--;
+    sim_wake_all(&q->space_obj);
+    return pdPASS;
+}
+
+BaseType_t xQueueReset(QueueHandle_t xQueue)
+{
+    xQueue->count = 0;
+    xQueue->head = 0;
+    sim_wake_all(&xQueue->space_obj);
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t xQueue)
+{
+    return xQueue->count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return xQueueCreate(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    SemaphoreHandle_t sem = xQueueCreate(1, 0);
+    sem->count = 1;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t uxMaxCount, UBaseType_t uxInitialCount)
+{
+    SemaphoreHandle_t sem = xQueueCreate(uxMaxCount, 0);
+    sem->count = uxInitialCount;
+    return sem;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t xSemaphore)
+{
+    return xQueueSend(xSemaphore, NULL, 0);
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t xSemaphore, BaseType_t *pxHigherPriorityTaskWoken)
+{
+    return xQueueSendFromISR(xSemaphore, NULL, pxHigherPriorityTaskWoken);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t xSemaphore, TickType_t xTicksToWait)
+{
+    return xQueueReceive(xSemaphore, NULL, xTicksToWait);
+}
+
+/* ---------------------------------------------------------------- 软件定时器 */
+
+static void timer_service_task(void *arg)
+{
+    (void)arg;
+    while (1)
+    {
+        struct sim_timer *next = NULL;
+        for (struct sim_timer *t = timer_list; t; t = t->next)
+        {
+            if (t->active && (next == NULL || t->expiry_us < next->expiry_us))
+            {
+                next = t;
+            }
+        }
+
+        if (next == NULL)
+        {
+            block_until(&timer_list_obj, SIM_TIME_NEVER);
+            continue;
+        }
+        if (next->expiry_us > now_us)
+        {
+            block_until(&timer_list_obj, next->expiry_us);
+            continue;
+        }
+
+        // 先处理重载，回调里可能会删除这个定时器
+        if (next->auto_reload)
+        {
+            next->expiry_us += (int64_t)next->period * SIM_TICK_US;
+        }
+        else
+        {
+            next->active = false;
+        }
+        next->cb(next);
+    }
+}
+
+TimerHandle_t xTimerCreate(const char *pcTimerName, TickType_t xTimerPeriodInTicks, UBaseType_t uxAutoReload, void *pvTimerID, TimerCallbackFunction_t pxCallbackFunction)
+{
+    if (xTimerPeriodInTicks == 0)
+    {
+        return NULL;
+    }
+    struct sim_timer *t = calloc(1, sizeof(struct sim_timer));
+    t->name = pcTimerName;
+    t->period = xTimerPeriodInTicks;
+    t->auto_reload = uxAutoReload;
+    t->id = pvTimerID;
+    t->cb = pxCallbackFunction;
+    t->next = timer_list;
+    timer_list = t;
+    return t;
+}
+
+/**
+ * @brief 真机上对已经删除的定时器调用 API 是未定义行为，仿真里直接报错退出，方便模糊测试发现悬空句柄
+ */
+static void check_timer_handle(TimerHandle_t xTimer, const char *api)
+{
+    for (struct sim_timer *t = timer_list; t; t = t->next)
+    {
+        if (t == xTimer)
+        {
+            return;
+        }
+    }
+    fprintf(stderr, "sim: %s() on a deleted or invalid timer handle %p (task %s)\n", api, (void *)xTimer, sim_current_task_name());
+    abort();
+}
+
+BaseType_t xTimerStart(TimerHandle_t xTimer, TickType_t xTicksToWait)
+{
+    (void)xTicksToWait;
+    check_timer_handle(xTimer, "xTimerStart");
+    xTimer->active = true;
+    xTimer->expiry_us = ticks_to_deadline(xTimer->period);
+    sim_wake_all(&timer_list_obj);
+    return pdPASS;
+}
+
+BaseType_t xTimerReset(TimerHandle_t xTimer, TickType_t xTicksToWait)
+{
+    return xTimerStart(xTimer, xTicksToWait);
+}
+
+BaseType_t xTimerStop(TimerHandle_t xTimer, TickType_t xTicksToWait)
+{
+    (void)xTicksToWait;
+    check_timer_handle(xTimer, "xTimerStop");
+    xTimer->active = false;
+    sim_wake_all(&timer_list_obj);
+    return pdPASS;
+}
+
+BaseType_t xTimerDelete(TimerHandle_t xTimer, TickType_t xTicksToWait)
+{
+    (void)xTicksToWait;
+    check_timer_handle(xTimer, "xTimerDelete");
+    for (struct sim_timer **pp = &timer_list; *pp; pp = &(*pp)->next)
+    {
+        if (*pp == xTimer)
+        {
+            *pp = xTimer->next;
+            free(xTimer);
+            break;
+        }
+    }
+    sim_wake_all(&timer_list_obj);
+    return pdPASS;
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t xTimer, TickType_t xNewPeriod, TickType_t xTicksToWait)
+{
+    check_timer_handle(xTimer, "xTimerChangePeriod");
+    xTimer->period = xNewPeriod;
+    return xTimerStart(xTimer, xTicksToWait);
+}
+
+BaseType_t xTimerIsTimerActive(TimerHandle_t xTimer)
+{
+    return xTimer->active ? pdTRUE : pdFALSE;
+}
+
+void *pvTimerGetTimerID(TimerHandle_t xTimer)
+{
+    return xTimer->id;
+}
+
+uint32_t sim_task_run_count(const char *name)
+{
+    uint32_t runs = 0;
+    for (struct sim_task *t = task_list; t; t = t->next)
+    {
+        if (strcmp(t->name, name) == 0)
+        {
+            runs += t->runs;
+        }
+    }
+    return runs;
+}
+
+int sim_timer_count(const char *name, bool active_only)
+{
+    int count = 0;
+    for (struct sim_timer *t = timer_list; t; t = t->next)
+    {
+        if ((name == NULL || strcmp(t->name, name) == 0) && (!active_only || t->active))
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+/* ---------------------------------------------------------------- esp_timer */
+
+/**
+ * @brief 和 IDF 的 esp_timer 任务一样：按 us 精度到期，不对齐 tick，在优先级 22 的任务里依次回调
+ */
+static void esp_timer_task(void *arg)
+{
+    (void)arg;
+    while (1)
+    {
+        struct esp_timer *next = NULL;
+        for (struct esp_timer *t = esp_timer_list; t; t = t->next)
+        {
+            if (t->active && (next == NULL || t->expiry_us < next->expiry_us))
+            {
+                next = t;
+            }
+        }
+
+        if (next == NULL)
+        {
+            block_until(&esp_timer_list_obj, SIM_TIME_NEVER);
+            continue;
+        }
+        if (next->expiry_us > now_us)
+        {
+            block_until(&esp_timer_list_obj, next->expiry_us);
+            continue;
+        }
+
+        if (next->period_us > 0)
+        {
+            next->expiry_us += next->period_us;
+        }
+        else
+        {
+            next->active = false;
+        }
+        next->cb(next->arg);
+    }
+}
+
+static void check_esp_timer_handle(esp_timer_handle_t timer, const char *api)
+{
+    for (struct esp_timer *t = esp_timer_list; t; t = t->next)
+    {
+        if (t == timer)
+        {
+            return;
+        }
+    }
+    fprintf(stderr, "sim: %s() on a deleted or invalid esp_timer handle %p (task %s)\n", api, (void *)timer, sim_current_task_name());
+    abort();
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle)
+{
+    if (create_args == NULL || create_args->callback == NULL || out_handle == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct esp_timer *t = calloc(1, sizeof(struct esp_timer));
+    t->name = create_args->name ? create_args->name : "";
+    t->cb = create_args->callback;
+    t->arg = create_args->arg;
+    t->next = esp_timer_list;
+    esp_timer_list = t;
+    *out_handle = t;
+    return ESP_OK;
+}
+
+static esp_err_t esp_timer_arm(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period_us)
+{
+    if (timer->active)
+    {
+        return ESP_ERR_INVALID_STATE; // 和 IDF 一样，正在计时的定时器要先停掉才能再启动
+    }
+    timer->active = true;
+    timer->expiry_us = now_us + (int64_t)timeout_us;
+    timer->period_us = period_us;
+    sim_wake_all(&esp_timer_list_obj);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    check_esp_timer_handle(timer, "esp_timer_start_once");
+    return esp_timer_arm(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period)
+{
+    check_esp_timer_handle(timer, "esp_timer_start_periodic");
+    return esp_timer_arm(timer, period, period);
+}
+
+esp_err_t esp_timer_restart(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    check_esp_timer_handle(timer, "esp_timer_restart");
+    if (!timer->active)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->active = false;
+    return esp_timer_arm(timer, timeout_us, timer->period_us > 0 ? timeout_us : 0);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    check_esp_timer_handle(timer, "esp_timer_stop");
+    if (!timer->active)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->active = false;
+    sim_wake_all(&esp_timer_list_obj);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    check_esp_timer_handle(timer, "esp_timer_delete");
+    if (timer->active)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    for (struct esp_timer **pp = &esp_timer_list; *pp; pp = &(*pp)->next)
+    {
+        if (*pp == timer)
+        {
+            *pp = timer->next;
+            free(timer);
+            break;
+        }
+    }
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer)
+{
+    check_esp_timer_handle(timer, "esp_timer_is_active");
+    return timer->active;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return now_us;
+}
+
+int sim_esp_timer_count(const char *name, bool active_only)
+{
+    int count = 0;
+    for (struct esp_timer *t = esp_timer_list; t; t = t->next)
+    {
+        if ((name == NULL || strcmp(t->name, name) == 0) && (!active_only || t->active))
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+/* ---------------------------------------------------------------- 初始化 */
+
+void sim_kernel_init(void)
+{
+    xTaskCreate(timer_service_task, "Tmr Svc", 2048, NULL, SIM_TIMER_TASK_PRIORITY, NULL);
+    xTaskCreate(esp_timer_task, "esp_timer", 3584, NULL, SIM_ESP_TIMER_TASK_PRIORITY, NULL);
+}
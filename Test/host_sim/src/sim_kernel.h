@@ -0,0 +1,84 @@
+/**
+ * @file sim_kernel.h
+ * @brief 虚拟时钟上的协作式 FreeRTOS 仿真内核
+ *
+ * 每个 xTaskCreate 出来的任务是一个 ucontext 协程，只在阻塞调用（vTaskDelay、xQueueReceive……）处让出 CPU。
+ * 没有任务就绪时，虚拟时钟直接跳到下一个唤醒时间点，所以 10 分钟的定时器在主机上只需要几毫秒。
+ * 同一个输入脚本每次运行的调度顺序完全一样，结果可复现。
+ */
+#ifndef SIM_KERNEL_H
+#define SIM_KERNEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SIM_TIME_NEVER INT64_MAX
+
+typedef void (*sim_isr_fn_t)(void *arg);
+
+/**
+ * @brief 创建定时器服务任务和 esp_timer 任务，必须在创建其它任务之前调用
+ */
+void sim_kernel_init(void);
+
+/**
+ * @brief 当前虚拟时间，单位 us，从仿真开始计时
+ */
+int64_t sim_now_us(void);
+
+/**
+ * @brief 运行调度器，直到虚拟时间到达 until_us（所有任务都阻塞到 until_us 之后）
+ *
+ * @return false 表示固件调用了 esp_restart()，仿真已经停止
+ */
+bool sim_run_until(int64_t until_us);
+
+/**
+ * @brief 在虚拟时间 at_us 以“中断上下文”执行 fn，用来模拟 RMT 发送完成、GPIO 边沿等硬件事件
+ */
+void sim_schedule_isr(int64_t at_us, sim_isr_fn_t fn, void *arg);
+
+/**
+ * @brief 当前任务阻塞在 obj 上，直到被 sim_wake_all(obj) 唤醒或超时
+ *
+ * @param timeout_us 相对超时，SIM_TIME_NEVER 表示永久等待
+ * @return true 被唤醒，false 超时
+ */
+bool sim_block_on(const void *obj, int64_t timeout_us);
+
+/**
+ * @brief 唤醒所有阻塞在 obj 上的任务；如果唤醒了更高优先级的任务，当前任务会让出 CPU
+ */
+void sim_wake_all(const void *obj);
+
+/**
+ * @brief 是否在任务上下文里（脚本驱动和 ISR 回调都不在任务上下文）
+ */
+bool sim_in_task(void);
+
+const char *sim_current_task_name(void);
+
+/**
+ * @brief 名字为 name 的任务累计被调度运行了多少次（每次从阻塞中醒来或者被抢占后继续都算一次）
+ */
+uint32_t sim_task_run_count(const char *name);
+
+/**
+ * @brief 统计还没删除的软件定时器数量，name 为 NULL 时统计全部
+ *
+ * @param active_only 只统计正在计时的定时器
+ */
+int sim_timer_count(const char *name, bool active_only);
+
+/**
+ * @brief 同上，统计 esp_timer
+ */
+int sim_esp_timer_count(const char *name, bool active_only);
+
+/**
+ * @brief 标记固件请求了重启，当前任务不再被调度
+ */
+void sim_request_restart(void) __attribute__((noreturn));
+bool sim_restart_requested(void);
+
+#endif // SIM_KERNEL_H
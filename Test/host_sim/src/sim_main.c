@@ -0,0 +1,610 @@
+/**
+ * @file sim_main.c
+ * @brief 主机仿真入口：按 app_main 的顺序初始化固件，然后逐行执行场景脚本
+ *
+ * -l <image> 在初始化之前读回 flash 分区，-s <image> 在脚本结束后存下来，两次仿真接起来就是一次断电重启
+ *
+ * 脚本格式（每行一条命令，# 开头为注释）：
+ *   press / release              按下 / 松开按键（PAIRING_BUTTON_GPIO 高电平有效）
+ *   click [hold_ms]              按下 hold_ms（默认 80ms）后松开
+ *   wait <ms>                    虚拟时间前进 ms
+ *   ble_unlock                   模拟 RSSI 达标（固定的测试手机地址，RSSI -50），发送 BLE_BUTTON_EVENT_SINGLE_CLICK
+ *   event <BUTTON_EVENT_xxx>     绕过按键直接往状态机队列里发一个事件（fuzz_lock_fsm 输出的复现脚本会用到）
+ *   clock <unix_seconds>         对时，和手机通过 BLE 写计划时一样走 settimeofday()
+ *   schedule <OPEN|LOCK> <weekdays> <HH:MM> <HH:MM>
+ *                                往定时计划里加一个 UTC 时间窗口并马上生效，weekdays 是 bit0 = 周日的位图（如 0x3e 为工作日）
+ *   schedule clear               清空定时计划
+ *   pixels <first> <count> <r> <g> <b>
+ *                                用 ws2812b_pixels_begin / fill / commit 把一段灯设成同一种颜色
+ *   mqtt connect                 MQTT 客户端连上本机 broker 替身，固件订阅命令 topic 并回报一次状态
+ *   mqtt provision               把仿真的命令签名密钥写进 NVS，和产线烧录一样，之前设备不执行任何远程命令
+ *   mqtt cmd <verb> <request_id> 往这台设备的 freedorm/<MAC>/cmd 发一条用仿真密钥签名的命令，例如 mqtt cmd unlock 42，
+ *                                计数器从 1 开始每条加 1；字段原样签名，不合法的命令和请求号也会带签名发出去
+ *   mqtt replay                  把上一条 mqtt cmd 原样再发一次
+ *   mqtt counter <n>             下一条 mqtt cmd 的计数器从 n + 1 开始，模拟后端的计数器往前跳
+ *   mqtt raw <payload...>        不签名，原样往命令 topic 上发
+ *   mqtt disconnect             MQTT 断线，之后的遥测存进 flash 里的离线队列，下次 mqtt connect 之后补发
+ *   mqtt link <bytes_per_s>      往 broker 的链路限速，0 是断流，-1 是不限速（默认）
+ *   mqtt expire <leaf> <count>   接下来往 freedorm/<MAC>/<leaf> 发的 count 条 QoS 1 消息在客户端的发送队列里过期，
+ *                                不回 PUBACK 也没有 PUBLISHED 事件
+ *   flash fail_erase <label> <count>
+ *                                分区 label 接下来的 count 次擦除都失败
+ *   rssi <dbm> [count]           给遥测记 count 个（默认 1 个）蓝牙 RSSI 样本
+ *   telemetry <TYPE> <count> [interval_ms]
+ *                                直接记 count 条遥测记录（HEAP / RSSI / LATENCY / TRANSITION），每条之间虚拟时间前进 interval_ms（默认 1ms）
+ *   expect state <STATE_xxx>     检查 lock_control 当前状态
+ *   expect gpio <num> <level>    检查引脚电平
+ *   expect pixel <index> <r> <g> <b>
+ *                                检查灯带上最后锁存的一帧里第 index 颗灯的颜色
+ *   expect restart               检查固件调用了 esp_restart()
+ *   expect audit <FROM> <TO> <CAUSE>
+ *                                检查最新一条审计记录，状态用 STATE_xxx，来源用 BOOT/BUTTON/BLE/TIMER/REMOTE/SCHEDULE
+ *   expect mqtt <leaf> <text>    检查固件最近一次往 freedorm/<MAC>/<leaf> 发的消息里包含 text
+ *   expect retained <leaf> <text|none>
+ *                                检查 broker 在 freedorm/<MAC>/<leaf> 上留着的 retain 消息里包含 text，none 表示不应该有
+ *   expect telemetry <TYPE> <sent> <shed>
+ *                                检查开始以来这类遥测记录发出去的条数和因为缓冲满了丢掉的条数
+ *   expect batch <first_seq> <count>
+ *                                检查固件最近一次往 freedorm/<MAC>/telemetry 发的批次：第一条记录的序号和记录数
+ *   expect offline <stored> <acked> <pending>
+ *                                检查离线队列开机以来写进 flash 和收到 PUBACK 的消息数，以及现在还没送到的消息数
+ *   expect hold <LOCK|D0> <ms>   检查这条控制线最近一次完整的保持时间（切到有效电平到恢复）正好是 ms
+ *   measure gpio <num> <level> <max_ms>
+ *                                从现在开始计时，直到引脚变成 level，超过 max_ms 算失败，打印实际耗时
+ *   measure led_frames <ms> <max>
+ *                                虚拟时间前进 ms，期间灯带刷新超过 max 帧算失败，打印实际帧数（用来确认静止的画面不占唤醒）
+ *   measure wakeups <task> <ms> <max>
+ *                                虚拟时间前进 ms，期间任务 task 被唤醒超过 max 次算失败，打印实际次数（用来确认空闲的任务不轮询）
+ *   measure latency <kind> <max_ms>
+ *                                打印 lock_latency 里 kind（SINGLE_CLICK / DOUBLE_CLICK / MULTI_CLICK / LONG_PRESS / BLE / REMOTE）的延迟分布，
+ *                                没有记录或者按下到动作的最大延迟超过 max_ms 算失败
+ *   measure mqtt <leaf> <ms> <max>
+ *                                虚拟时间前进 ms，期间往 freedorm/<MAC>/<leaf> 发的消息超过 max 条算失败，打印条数、字节数和吞吐量
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "audit_log.h"
+#include "button.h"
+#include "lock_control.h"
+#include "lock_schedule.h"
+#include "lock_actuator.h"
+#include "lock_latency.h"
+#include "mqtt_command.h"
+#include "telemetry.h"
+#include "offline_queue.h"
+#include "ws2812b_led.h"
+#include "sim_app.h"
+#include "sim_hal.h"
+#include "sim_kernel.h"
+#include "sim_mqtt.h"
+
+#define SIM_DEFAULT_CLICK_MS 80
+#define SIM_BLE_RSSI -50
+
+static const uint8_t sim_phone_bda[6] = {0x02, 0x46, 0x44, 0x52, 0x4d, 0x01};
+static const char *const audit_cause_names[] = {"BOOT", "BUTTON", "BLE", "TIMER", "REMOTE", "SCHEDULE"};
+static const char *const telemetry_type_names[] = {"HEAP", "RSSI", "LATENCY", "TRANSITION"};
+
+static int failures = 0;
+static bool restarted = false;
+static schedule_config_t schedule = {0};
+
+static void run_for_ms(double ms)
+{
+    if (restarted)
+    {
+        return;
+    }
+    if (!sim_run_until(sim_now_us() + (int64_t)(ms * 1000)))
+    {
+        restarted = true;
+    }
+}
+
+static void fail(int line_no, const char *fmt, const char *detail)
+{
+    printf("[%10.3f ms] FAIL line %d: ", sim_now_us() / 1000.0, line_no);
+    printf(fmt, detail);
+    printf("\n");
+    failures++;
+}
+
+static bool telemetry_type_parse(const char *name, telemetry_type_t *type)
+{
+    for (int i = 0; i < TELEMETRY_TYPE_COUNT; i++)
+    {
+        if (strcmp(telemetry_type_names[i], name) == 0)
+        {
+            *type = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief 这台设备的 topic，和 freedorm_mqtt.c 一样按 MAC 拼出来
+ */
+static const char *device_topic(const char *leaf)
+{
+    static char topic[MQTT_TOPIC_MAX_LEN];
+    uint8_t mac[6];
+    esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    mqtt_command_topic(topic, sizeof(topic), mac, leaf);
+    return topic;
+}
+
+static char last_command[MQTT_COMMAND_MAX_LEN * 2]; // mqtt replay 重发的上一条签好名的命令
+
+static void run_command(int line_no, char *line)
+{
+    char *argv[8] = {0};
+    int argc = 0;
+    for (char *tok = strtok(line, " \t\r\n"); tok && argc < 8; tok = strtok(NULL, " \t\r\n"))
+    {
+        argv[argc++] = tok;
+    }
+    if (argc == 0 || argv[0][0] == '#')
+    {
+        return;
+    }
+
+    if (strcmp(argv[0], "press") == 0)
+    {
+        sim_gpio_drive(PAIRING_BUTTON_GPIO, 1);
+    }
+    else if (strcmp(argv[0], "release") == 0)
+    {
+        sim_gpio_drive(PAIRING_BUTTON_GPIO, 0);
+    }
+    else if (strcmp(argv[0], "click") == 0)
+    {
+        sim_gpio_drive(PAIRING_BUTTON_GPIO, 1);
+        run_for_ms(argc > 1 ? atof(argv[1]) : SIM_DEFAULT_CLICK_MS);
+        sim_gpio_drive(PAIRING_BUTTON_GPIO, 0);
+    }
+    else if (strcmp(argv[0], "wait") == 0 && argc > 1)
+    {
+        run_for_ms(atof(argv[1]));
+    }
+    else if (strcmp(argv[0], "ble_unlock") == 0)
+    {
+        audit_log_note_ble_unlock(sim_phone_bda, SIM_BLE_RSSI);
+        send_button_event(BLE_BUTTON_EVENT_SINGLE_CLICK);
+    }
+    else if (strcmp(argv[0], "event") == 0 && argc > 1)
+    {
+        button_event_t event;
+        if (sim_button_event_parse(argv[1], &event))
+        {
+            send_button_event(event);
+        }
+        else
+        {
+            fail(line_no, "unknown button event '%s'", argv[1]);
+        }
+    }
+    else if (strcmp(argv[0], "mqtt") == 0 && argc > 1 && strcmp(argv[1], "connect") == 0)
+    {
+        sim_mqtt_connect();
+    }
+    else if (strcmp(argv[0], "mqtt") == 0 && argc > 1 && strcmp(argv[1], "provision") == 0)
+    {
+        sim_mqtt_provision_key();
+    }
+    else if (strcmp(argv[0], "mqtt") == 0 && argc > 3 && strcmp(argv[1], "cmd") == 0)
+    {
+        snprintf(last_command, sizeof(last_command), "%s", sim_mqtt_sign_command(argv[2], argv[3]));
+        sim_mqtt_publish(device_topic("cmd"), last_command);
+    }
+    else if (strcmp(argv[0], "mqtt") == 0 && argc > 2 && strcmp(argv[1], "counter") == 0)
+    {
+        sim_mqtt_set_command_counter((uint32_t)strtoul(argv[2], NULL, 10));
+    }
+    else if (strcmp(argv[0], "mqtt") == 0 && argc > 1 && strcmp(argv[1], "replay") == 0)
+    {
+        sim_mqtt_publish(device_topic("cmd"), last_command);
+    }
+    else if (strcmp(argv[0], "mqtt") == 0 && argc > 2 && strcmp(argv[1], "raw") == 0)
+    {
+        char payload[MQTT_COMMAND_MAX_LEN * 2] = "";
+        for (int i = 2; i < argc; i++)
+        {
+            snprintf(payload + strlen(payload), sizeof(payload) - strlen(payload), i > 2 ? " %s" : "%s", argv[i]);
+        }
+        sim_mqtt_publish(device_topic("cmd"), payload);
+    }
+    else if (strcmp(argv[0], "mqtt") == 0 && argc > 1 && strcmp(argv[1], "disconnect") == 0)
+    {
+        sim_mqtt_disconnect();
+    }
+    else if (strcmp(argv[0], "mqtt") == 0 && argc > 3 && strcmp(argv[1], "expire") == 0)
+    {
+        sim_mqtt_expire_outbox(device_topic(argv[2]), (uint32_t)atoi(argv[3]));
+    }
+    else if (strcmp(argv[0], "mqtt") == 0 && argc > 2 && strcmp(argv[1], "link") == 0)
+    {
+        sim_mqtt_set_link_rate(atoi(argv[2]));
+    }
+    else if (strcmp(argv[0], "rssi") == 0 && argc > 1)
+    {
+        for (int i = argc > 2 ? atoi(argv[2]) : 1; i > 0; i--)
+        {
+            telemetry_note_rssi(atoi(argv[1]));
+        }
+    }
+    else if (strcmp(argv[0], "telemetry") == 0 && argc > 2)
+    {
+        telemetry_type_t type;
+        if (!telemetry_type_parse(argv[1], &type))
+        {
+            fail(line_no, "unknown telemetry type '%s'", argv[1]);
+            return;
+        }
+        for (int i = 0; i < atoi(argv[2]); i++)
+        {
+            telemetry_record(type, 0, i);
+            run_for_ms(argc > 3 ? atof(argv[3]) : 1);
+        }
+    }
+    else if (strcmp(argv[0], "clock") == 0 && argc > 1)
+    {
+        struct timeval tv = {.tv_sec = strtoll(argv[1], NULL, 0), .tv_usec = 0};
+        settimeofday(&tv, NULL);
+    }
+    else if (strcmp(argv[0], "schedule") == 0 && argc > 1 && strcmp(argv[1], "clear") == 0)
+    {
+        memset(&schedule, 0, sizeof(schedule));
+        lock_schedule_set(&schedule);
+    }
+    else if (strcmp(argv[0], "schedule") == 0 && argc > 4 && schedule.num_windows < SCHEDULE_MAX_WINDOWS)
+    {
+        unsigned start_h, start_m, end_h, end_m;
+        schedule_window_t *window = &schedule.windows[schedule.num_windows];
+        window->action = strcmp(argv[1], "LOCK") == 0 ? SCHEDULE_ACTION_LOCK : SCHEDULE_ACTION_ALWAYS_OPEN;
+        window->weekdays = strtol(argv[2], NULL, 0);
+        if (sscanf(argv[3], "%u:%u", &start_h, &start_m) != 2 || sscanf(argv[4], "%u:%u", &end_h, &end_m) != 2)
+        {
+            fail(line_no, "bad schedule window time '%s'", argv[3]);
+            return;
+        }
+        window->start_min = start_h * 60 + start_m;
+        window->end_min = end_h * 60 + end_m;
+        schedule.num_windows++;
+        if (lock_schedule_set(&schedule) != ESP_OK)
+        {
+            schedule.num_windows--;
+            fail(line_no, "schedule rejected the window%s", "");
+        }
+    }
+    else if (strcmp(argv[0], "flash") == 0 && argc > 3 && strcmp(argv[1], "fail_erase") == 0)
+    {
+        sim_flash_fail_erases(argv[2], (uint32_t)atoi(argv[3]));
+    }
+    else if (strcmp(argv[0], "pixels") == 0 && argc > 5)
+    {
+        ws2812b_pixels_begin();
+        ws2812b_pixels_fill(atoi(argv[1]), atoi(argv[2]), atoi(argv[3]), atoi(argv[4]), atoi(argv[5]));
+        if (ws2812b_pixels_commit() != ESP_OK)
+        {
+            fail(line_no, "pixel update was not committed%s", "");
+        }
+    }
+    else if (strcmp(argv[0], "expect") == 0 && argc > 1)
+    {
+        if (strcmp(argv[1], "restart") == 0)
+        {
+            if (!restarted)
+            {
+                fail(line_no, "expected esp_restart()%s", "");
+            }
+        }
+        else if (strcmp(argv[1], "state") == 0 && argc > 2)
+        {
+            const char *actual = sim_lock_state_name(get_current_lock_state());
+            if (strcmp(actual, argv[2]) != 0)
+            {
+                fail(line_no, "lock state is %s", actual);
+            }
+        }
+        else if (strcmp(argv[1], "audit") == 0 && argc > 4)
+        {
+            audit_record_t record;
+            uint32_t next = audit_log_next_seq();
+            if (next == 0 || audit_log_read(next - 1, &record, 1) != 1)
+            {
+                fail(line_no, "audit log is empty%s", "");
+            }
+            else if (strcmp(sim_lock_state_name(record.from_state), argv[2]) != 0 ||
+                     strcmp(sim_lock_state_name(record.to_state), argv[3]) != 0 ||
+                     record.cause >= sizeof(audit_cause_names) / sizeof(audit_cause_names[0]) ||
+                     strcmp(audit_cause_names[record.cause], argv[4]) != 0)
+            {
+                char detail[160];
+                snprintf(detail, sizeof(detail), "%s -> %s (cause %u)", sim_lock_state_name(record.from_state), sim_lock_state_name(record.to_state), record.cause);
+                fail(line_no, "last audit record is %s", detail);
+            }
+            else if (record.cause == AUDIT_CAUSE_BLE && record.rssi != SIM_BLE_RSSI)
+            {
+                fail(line_no, "BLE audit record has the wrong RSSI%s", "");
+            }
+        }
+        else if (strcmp(argv[1], "retained") == 0 && argc > 3)
+        {
+            const char *payload = sim_mqtt_retained_payload(device_topic(argv[2]));
+            if (strcmp(argv[3], "none") == 0 ? payload[0] != '\0' : strstr(payload, argv[3]) == NULL)
+            {
+                fail(line_no, "retained message is '%s'", payload);
+            }
+        }
+        else if (strcmp(argv[1], "mqtt") == 0 && argc > 3)
+        {
+            const char *payload = sim_mqtt_last_payload(device_topic(argv[2]));
+            if (payload == NULL)
+            {
+                fail(line_no, "nothing has been published on %s", argv[2]);
+            }
+            else if (strstr(payload, argv[3]) == NULL)
+            {
+                fail(line_no, "last message is %s", payload);
+            }
+        }
+        else if (strcmp(argv[1], "telemetry") == 0 && argc > 4)
+        {
+            telemetry_type_t type;
+            telemetry_stats_t stats;
+            telemetry_get_stats(&stats);
+            if (!telemetry_type_parse(argv[2], &type))
+            {
+                fail(line_no, "unknown telemetry type '%s'", argv[2]);
+            }
+            else if (stats.sent[type] != strtoul(argv[3], NULL, 0) || stats.shed[type] != strtoul(argv[4], NULL, 0))
+            {
+                char detail[64];
+                snprintf(detail, sizeof(detail), "%lu sent, %lu shed", (unsigned long)stats.sent[type], (unsigned long)stats.shed[type]);
+                fail(line_no, "telemetry has %s", detail);
+            }
+        }
+        else if (strcmp(argv[1], "batch") == 0 && argc > 3)
+        {
+            const uint8_t *payload = (const uint8_t *)sim_mqtt_last_payload(device_topic("telemetry"));
+            telemetry_batch_header_t header;
+            telemetry_record_t first;
+            if (payload == NULL)
+            {
+                fail(line_no, "no telemetry batch has been published%s", "");
+                return;
+            }
+            memcpy(&header, payload, sizeof(header));
+            memcpy(&first, payload + sizeof(header), sizeof(first));
+            if (header.version != TELEMETRY_BATCH_VERSION || first.seq != strtoul(argv[2], NULL, 0) || header.count != strtoul(argv[3], NULL, 0))
+            {
+                char detail[64];
+                snprintf(detail, sizeof(detail), "version %u, first seq %u, %u records", header.version, first.seq, header.count);
+                fail(line_no, "last batch is %s", detail);
+            }
+        }
+        else if (strcmp(argv[1], "offline") == 0 && argc > 4)
+        {
+            offline_queue_stats_t stats;
+            offline_queue_get_stats(&stats);
+            if (stats.stored != strtoul(argv[2], NULL, 0) || stats.acked != strtoul(argv[3], NULL, 0) || stats.pending != strtoul(argv[4], NULL, 0))
+            {
+                char detail[96];
+                snprintf(detail, sizeof(detail), "%lu stored, %lu acked, %lu pending (%lu sent, %lu dropped)", (unsigned long)stats.stored,
+                         (unsigned long)stats.acked, (unsigned long)stats.pending, (unsigned long)stats.sent, (unsigned long)stats.dropped);
+                fail(line_no, "offline queue has %s", detail);
+            }
+        }
+        else if (strcmp(argv[1], "hold") == 0 && argc > 3)
+        {
+            lock_actuator_status_t status;
+            lock_actuator_get_status(strcmp(argv[2], "D0") == 0 ? LOCK_ACTUATOR_LINE_D0 : LOCK_ACTUATOR_LINE_LOCK, &status);
+            int64_t held_us = status.released_us - status.asserted_us;
+            if (status.asserted || held_us != (int64_t)(atof(argv[3]) * 1000))
+            {
+                char detail[64];
+                snprintf(detail, sizeof(detail), "%.3f ms%s", held_us / 1000.0, status.asserted ? " (still asserted)" : "");
+                fail(line_no, "last hold lasted %s", detail);
+            }
+        }
+        else if (strcmp(argv[1], "gpio") == 0 && argc > 3)
+        {
+            if (sim_gpio_level(atoi(argv[2])) != atoi(argv[3]))
+            {
+                fail(line_no, "GPIO%s has the wrong level", argv[2]);
+            }
+        }
+        else if (strcmp(argv[1], "pixel") == 0 && argc > 5)
+        {
+            const sim_led_frame_t *frame = sim_led_last_frame();
+            size_t offset = (size_t)atoi(argv[2]) * 3;
+            if (offset + 3 > frame->size)
+            {
+                fail(line_no, "LED %s has never been transmitted", argv[2]);
+            }
+            else if (frame->data[offset + 2] != atoi(argv[3]) || frame->data[offset + 0] != atoi(argv[4]) || frame->data[offset + 1] != atoi(argv[5]))
+            {
+                char detail[64];
+                snprintf(detail, sizeof(detail), "%u %u %u", frame->data[offset + 2], frame->data[offset + 0], frame->data[offset + 1]);
+                fail(line_no, "LED shows %s", detail);
+            }
+        }
+        else
+        {
+            fail(line_no, "unknown expectation '%s'", argv[1]);
+        }
+    }
+    else if (strcmp(argv[0], "measure") == 0 && argc > 4 && strcmp(argv[1], "gpio") == 0)
+    {
+        int gpio_num = atoi(argv[2]);
+        int level = atoi(argv[3]);
+        int64_t start_us = sim_now_us();
+        int64_t limit_us = start_us + (int64_t)(atof(argv[4]) * 1000);
+        while (!restarted && sim_gpio_level(gpio_num) != level && sim_now_us() < limit_us)
+        {
+            run_for_ms(1);
+        }
+        if (sim_gpio_level(gpio_num) != level)
+        {
+            fail(line_no, "GPIO%s did not reach the level in time", argv[2]);
+        }
+        else
+        {
+            int64_t latency_us = sim_gpio_last_change_us(gpio_num) - start_us;
+            printf("[%10.3f ms] measure GPIO%d -> %d: %.3f ms\n", sim_now_us() / 1000.0, gpio_num, level, latency_us / 1000.0);
+        }
+    }
+    else if (strcmp(argv[0], "measure") == 0 && argc > 3 && strcmp(argv[1], "led_frames") == 0)
+    {
+        uint32_t start_frames = sim_led_frame_count();
+        run_for_ms(atof(argv[2]));
+        uint32_t frames = sim_led_frame_count() - start_frames;
+        if (frames > (uint32_t)atoi(argv[3]))
+        {
+            fail(line_no, "LED strip refreshed too often (%s)", argv[2]);
+        }
+        printf("[%10.3f ms] measure led_frames over %s ms: %u\n", sim_now_us() / 1000.0, argv[2], frames);
+    }
+    else if (strcmp(argv[0], "measure") == 0 && argc > 4 && strcmp(argv[1], "wakeups") == 0)
+    {
+        uint32_t start_runs = sim_task_run_count(argv[2]);
+        run_for_ms(atof(argv[3]));
+        uint32_t runs = sim_task_run_count(argv[2]) - start_runs;
+        if (runs > (uint32_t)atoi(argv[4]))
+        {
+            fail(line_no, "task %s woke up too often", argv[2]);
+        }
+        printf("[%10.3f ms] measure wakeups %s over %s ms: %u\n", sim_now_us() / 1000.0, argv[2], argv[3], runs);
+    }
+    else if (strcmp(argv[0], "measure") == 0 && argc > 3 && strcmp(argv[1], "latency") == 0)
+    {
+        lock_latency_kind_t kind = 0;
+        while (kind < LOCK_LATENCY_KIND_COUNT && strcmp(lock_latency_kind_name(kind), argv[2]) != 0)
+        {
+            kind++;
+        }
+        lock_latency_stats_t stats;
+        lock_latency_get(kind, &stats);
+        if (stats.actuate.count == 0)
+        {
+            fail(line_no, "no %s latency recorded", argv[2]);
+            return;
+        }
+        printf("[%10.3f ms] measure latency %s: n=%lu, detect mean %.3f ms, actuate min %.3f / mean %.3f / max %.3f ms\n", sim_now_us() / 1000.0,
+               argv[2], (unsigned long)stats.actuate.count, stats.detect.sum_us / 1000.0 / stats.detect.count, stats.actuate.min_us / 1000.0,
+               stats.actuate.sum_us / 1000.0 / stats.actuate.count, stats.actuate.max_us / 1000.0);
+        if (stats.actuate.max_us > atof(argv[3]) * 1000)
+        {
+            fail(line_no, "%s press-to-actuation latency over the limit", argv[2]);
+        }
+    }
+    else if (strcmp(argv[0], "measure") == 0 && argc > 4 && strcmp(argv[1], "mqtt") == 0)
+    {
+        uint32_t start_messages, start_bytes, messages, bytes;
+        sim_mqtt_topic_stats(device_topic(argv[2]), &start_messages, &start_bytes);
+        run_for_ms(atof(argv[3]));
+        sim_mqtt_topic_stats(device_topic(argv[2]), &messages, &bytes);
+        messages -= start_messages;
+        bytes -= start_bytes;
+        printf("[%10.3f ms] measure mqtt %s over %s ms: %u messages, %u bytes (%.1f bytes/s)\n", sim_now_us() / 1000.0, argv[2], argv[3],
+               messages, bytes, bytes * 1000.0 / atof(argv[3]));
+        if (messages > (uint32_t)atoi(argv[4]))
+        {
+            fail(line_no, "too many messages on %s", argv[2]);
+        }
+    }
+    else
+    {
+        fail(line_no, "unknown command '%s'", argv[0]);
+    }
+}
+
+static double wall_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = NULL;
+    const char *load_image = NULL;
+    const char *save_image = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+        {
+            load_image = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+        {
+            save_image = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "-v") == 0)
+        {
+            sim_log_level = ESP_LOG_INFO;
+        }
+        else if (strcmp(argv[i], "-q") == 0)
+        {
+            sim_trace_gpio = false;
+            sim_trace_mqtt = false;
+        }
+        else
+        {
+            path = argv[i];
+        }
+    }
+    if (path == NULL)
+    {
+        fprintf(stderr, "usage: %s [-v] [-q] [-l flash.bin] [-s flash.bin] <scenario.txt>\n", argv[0]);
+        return 2;
+    }
+
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL)
+    {
+        perror(path);
+        return 2;
+    }
+
+    if (load_image != NULL && !sim_flash_load(load_image))
+    {
+        perror(load_image);
+        return 2;
+    }
+
+    double wall_start = wall_ms();
+    sim_app_start();
+
+    char line[256];
+    int line_no = 0;
+    while (fgets(line, sizeof(line), fp))
+    {
+        run_command(++line_no, line);
+    }
+    fclose(fp);
+    if (save_image != NULL && !sim_flash_save(save_image))
+    {
+        perror(save_image);
+        failures++;
+    }
+
+    double wall = wall_ms() - wall_start;
+    double simulated = sim_now_us() / 1000.0;
+    ws2812b_pipeline_stats_t pipeline;
+    ws2812b_led_get_pipeline_stats(&pipeline);
+    printf("%s: %s, simulated %.1f ms in %.1f ms wall (%.0fx real time), %u LED frames (%u late, %u dropped, %u unchanged, %u waits for a free buffer)\n",
+           failures ? "FAIL" : "PASS", path, simulated, wall, wall > 0 ? simulated / wall : 0.0, sim_led_frame_count(),
+           pipeline.frames_late, pipeline.frames_dropped, pipeline.frames_unchanged, pipeline.buffer_waits);
+    return failures ? 1 : 0;
+}
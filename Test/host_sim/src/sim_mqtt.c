@@ -0,0 +1,451 @@
+/**
+ * @file sim_mqtt.c
+ * @brief ESP-MQTT 客户端和本机 broker 的仿真替身，见 sim_mqtt.h
+ */
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_mac.h"
+#include "mbedtls/md.h"
+#include "mqtt_client.h"
+#include "mqtt_command.h"
+#include "nvs.h"
+#include "sim_kernel.h"
+#include "sim_mqtt.h"
+
+#define SIM_MQTT_TASK_PRIORITY 5 // CONFIG_MQTT_TASK_PRIORITY 的默认值
+#define SIM_MQTT_QUEUE_LEN 8     // 还没交给回调的事件
+#define SIM_MQTT_TOPICS 8        // 订阅和发出去的 topic 各自最多记多少个
+#define SIM_MQTT_TOPIC_LEN 64
+#define SIM_MQTT_PAYLOAD_LEN 512  // 一批遥测最多 396 字节
+#define SIM_MQTT_PENDING_ACKS 32  // 还在链路上、等 PUBACK 的 QoS 1 消息
+#define SIM_MQTT_HEADER_BYTES 4   // 每条 PUBLISH 除了 topic 和负载之外的固定头、topic 长度和 msg_id
+#define SIM_MQTT_RTT_US 1000      // broker 在本机，消息发完到 PUBACK 回来只有一个很短的往返
+
+bool sim_trace_mqtt = true;
+
+/**
+ * @brief 排队等 mqtt_task 交给回调的一个事件
+ */
+typedef struct
+{
+    esp_mqtt_event_id_t event_id;
+    int msg_id;
+    char topic[SIM_MQTT_TOPIC_LEN];
+    char data[SIM_MQTT_PAYLOAD_LEN];
+    int data_len;
+} sim_mqtt_event_t;
+
+struct esp_mqtt_client
+{
+    esp_event_handler_t handler;
+    void *handler_arg;
+    QueueHandle_t events;
+    bool connected;
+    int next_msg_id;
+    int num_subscriptions;
+    char subscriptions[SIM_MQTT_TOPICS][SIM_MQTT_TOPIC_LEN];
+};
+
+static struct esp_mqtt_client sim_client; // 固件只有一个客户端
+static bool client_created = false;
+
+static struct
+{
+    char topic[SIM_MQTT_TOPIC_LEN];
+    char payload[SIM_MQTT_PAYLOAD_LEN + 1];
+    char retained[SIM_MQTT_PAYLOAD_LEN + 1]; // broker 留着给新订阅者的最后一条 retain 消息，空串表示没有
+    uint32_t messages;
+    uint32_t bytes;
+} published[SIM_MQTT_TOPICS];
+static int num_published_topics = 0;
+
+// 链路模型：发送队列里的字节按 link_rate 的速度发出去，QoS 1 消息发完之后再过一个往返才回 PUBACK
+static int32_t link_rate = -1;   // 字节/秒，负数表示不限速
+static int64_t queued_bytes = 0; // 开始以来放进发送队列的总字节数
+static double drained_bytes = 0; // 其中已经发出去的
+static int64_t last_drain_us = 0;
+static struct
+{
+    int msg_id;
+    int64_t end_bytes; // 这条消息最后一个字节在 queued_bytes 里的位置
+    int64_t ack_us;    // PUBACK 回来的时刻，还没发完时为 0
+} pending_acks[SIM_MQTT_PENDING_ACKS];
+static int pending_head = 0;
+static int pending_count = 0;
+static char expiring_topic[SIM_MQTT_TOPIC_LEN];
+static uint32_t expiring_messages = 0; // 接下来这个 topic 上要在发送队列里过期的 QoS 1 消息条数
+
+static esp_mqtt_error_codes_t no_error = {0};
+
+static void post_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event_id, int msg_id, const char *topic, const char *data, int data_len)
+{
+    if (client->events == NULL)
+    {
+        return; // 还没 start
+    }
+    sim_mqtt_event_t event = {.event_id = event_id, .msg_id = msg_id};
+    if (topic != NULL)
+    {
+        snprintf(event.topic, sizeof(event.topic), "%s", topic);
+    }
+    if (data != NULL)
+    {
+        event.data_len = data_len < SIM_MQTT_PAYLOAD_LEN ? data_len : SIM_MQTT_PAYLOAD_LEN;
+        memcpy(event.data, data, event.data_len);
+    }
+    xQueueSend(client->events, &event, 0);
+}
+
+/**
+ * @brief 按经过的虚拟时间把发送队列往链路上推，整条发完的 QoS 1 消息记下 PUBACK 回来的时刻
+ */
+static void drain_link(void)
+{
+    int64_t now_us = sim_now_us();
+    if (link_rate < 0)
+    {
+        drained_bytes = queued_bytes;
+    }
+    else
+    {
+        drained_bytes += (double)link_rate * (now_us - last_drain_us) / 1e6;
+        if (drained_bytes > queued_bytes)
+        {
+            drained_bytes = queued_bytes;
+        }
+    }
+    last_drain_us = now_us;
+
+    for (int i = 0; i < pending_count; i++)
+    {
+        int index = (pending_head + i) % SIM_MQTT_PENDING_ACKS;
+        if (pending_acks[index].ack_us == 0 && pending_acks[index].end_bytes <= drained_bytes)
+        {
+            pending_acks[index].ack_us = now_us + SIM_MQTT_RTT_US;
+        }
+    }
+}
+
+/**
+ * @brief 只在 mqtt_task 里调用：把到时间的 PUBACK 交给回调，和 IDF 一样不会在发消息的任务里直接回调
+ */
+static void deliver_acks(void)
+{
+    while (pending_count > 0 && pending_acks[pending_head].ack_us != 0 && pending_acks[pending_head].ack_us <= sim_now_us())
+    {
+        int msg_id = pending_acks[pending_head].msg_id;
+        pending_head = (pending_head + 1) % SIM_MQTT_PENDING_ACKS;
+        pending_count--;
+        post_event(&sim_client, MQTT_EVENT_PUBLISHED, msg_id, NULL, NULL, 0);
+    }
+}
+
+/**
+ * @brief 下一个 PUBACK 回来之前 mqtt_task 最多等多久
+ */
+static TickType_t next_ack_ticks(void)
+{
+    if (pending_count == 0)
+    {
+        return portMAX_DELAY;
+    }
+    int64_t wait_us;
+    if (pending_acks[pending_head].ack_us != 0)
+    {
+        wait_us = pending_acks[pending_head].ack_us - sim_now_us();
+    }
+    else if (link_rate > 0)
+    {
+        wait_us = (int64_t)((pending_acks[pending_head].end_bytes - drained_bytes) * 1e6 / link_rate) + SIM_MQTT_RTT_US;
+    }
+    else
+    {
+        return portMAX_DELAY; // 链路堵住了，等限速改了再说
+    }
+    return wait_us > 0 ? pdMS_TO_TICKS((wait_us + 999) / 1000) + 1 : 0;
+}
+
+static void mqtt_task(void *arg)
+{
+    esp_mqtt_client_handle_t client = arg;
+    sim_mqtt_event_t queued;
+    while (1)
+    {
+        bool received = xQueueReceive(client->events, &queued, next_ack_ticks());
+        drain_link();
+        deliver_acks();
+        if (received && queued.event_id != MQTT_EVENT_ANY && client->handler != NULL)
+        {
+            esp_mqtt_event_t event = {
+                .event_id = queued.event_id,
+                .client = client,
+                .msg_id = queued.msg_id,
+                .error_handle = &no_error,
+            };
+            if (queued.event_id == MQTT_EVENT_DATA)
+            {
+                event.topic = queued.topic;
+                event.topic_len = strlen(queued.topic);
+                event.data = queued.data;
+                event.data_len = queued.data_len;
+                event.total_data_len = queued.data_len;
+            }
+            client->handler(client->handler_arg, "MQTT_EVENTS", queued.event_id, &event);
+        }
+    }
+}
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config)
+{
+    (void)config;
+    memset(&sim_client, 0, sizeof(sim_client));
+    sim_client.next_msg_id = 1;
+    client_created = true;
+    return &sim_client;
+}
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event, esp_event_handler_t event_handler, void *event_handler_arg)
+{
+    (void)event;
+    client->handler = event_handler;
+    client->handler_arg = event_handler_arg;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client)
+{
+    client->events = xQueueCreate(SIM_MQTT_QUEUE_LEN, sizeof(sim_mqtt_event_t));
+    xTaskCreate(mqtt_task, "mqtt_task", 6144, client, SIM_MQTT_TASK_PRIORITY, NULL);
+    return ESP_OK;
+}
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos)
+{
+    (void)qos;
+    if (!client->connected || client->num_subscriptions >= SIM_MQTT_TOPICS)
+    {
+        return -1;
+    }
+    snprintf(client->subscriptions[client->num_subscriptions++], SIM_MQTT_TOPIC_LEN, "%s", topic);
+    int msg_id = client->next_msg_id++;
+    post_event(client, MQTT_EVENT_SUBSCRIBED, msg_id, NULL, NULL, 0);
+    return msg_id;
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos, int retain)
+{
+    if (!client->connected)
+    {
+        return -1;
+    }
+    if (len <= 0)
+    {
+        len = strlen(data);
+    }
+
+    int slot = 0;
+    while (slot < num_published_topics && strcmp(published[slot].topic, topic) != 0)
+    {
+        slot++;
+    }
+    if (slot == num_published_topics && num_published_topics < SIM_MQTT_TOPICS)
+    {
+        snprintf(published[num_published_topics++].topic, SIM_MQTT_TOPIC_LEN, "%s", topic);
+    }
+    if (slot < num_published_topics)
+    {
+        int copy = len < SIM_MQTT_PAYLOAD_LEN ? len : SIM_MQTT_PAYLOAD_LEN;
+        memcpy(published[slot].payload, data, copy);
+        published[slot].payload[copy] = '\0';
+        if (retain)
+        {
+            memcpy(published[slot].retained, data, copy);
+            published[slot].retained[copy] = '\0';
+        }
+        published[slot].messages++;
+        published[slot].bytes += len;
+    }
+
+    bool printable = true;
+    for (int i = 0; i < len && printable; i++)
+    {
+        printable = isprint((unsigned char)data[i]);
+    }
+    if (sim_trace_mqtt && printable)
+    {
+        printf("[%10.3f ms] MQTT %s <- %.*s (%s)\n", sim_now_us() / 1000.0, topic, len, data, sim_current_task_name());
+    }
+    else if (sim_trace_mqtt)
+    {
+        printf("[%10.3f ms] MQTT %s <- %d bytes qos %d (%s)\n", sim_now_us() / 1000.0, topic, len, qos, sim_current_task_name());
+    }
+
+    drain_link();
+    queued_bytes += SIM_MQTT_HEADER_BYTES + strlen(topic) + len;
+    int msg_id = qos > 0 ? client->next_msg_id++ : 0;
+    if (qos > 0 && expiring_messages > 0 && strcmp(topic, expiring_topic) == 0)
+    {
+        expiring_messages--; // 过期的消息不会有 PUBACK
+    }
+    else if (qos > 0 && pending_count < SIM_MQTT_PENDING_ACKS)
+    {
+        int tail = (pending_head + pending_count++) % SIM_MQTT_PENDING_ACKS;
+        pending_acks[tail].msg_id = msg_id;
+        pending_acks[tail].end_bytes = queued_bytes;
+        pending_acks[tail].ack_us = 0;
+        drain_link();
+        post_event(client, MQTT_EVENT_ANY, 0, NULL, NULL, 0); // 让 mqtt_task 按新的队尾重新算等待时间
+    }
+    return msg_id;
+}
+
+int esp_mqtt_client_enqueue(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos, int retain, bool store)
+{
+    (void)store;
+    return esp_mqtt_client_publish(client, topic, data, len, qos, retain);
+}
+
+int esp_mqtt_client_get_outbox_size(esp_mqtt_client_handle_t client)
+{
+    (void)client;
+    drain_link();
+    return (int)(queued_bytes - drained_bytes);
+}
+
+void sim_mqtt_connect(void)
+{
+    if (!client_created)
+    {
+        return;
+    }
+    sim_client.connected = true;
+    sim_client.num_subscriptions = 0; // 和 clean session 一样，重连之后要重新订阅
+    post_event(&sim_client, MQTT_EVENT_CONNECTED, 0, NULL, NULL, 0);
+}
+
+void sim_mqtt_disconnect(void)
+{
+    if (!client_created || !sim_client.connected)
+    {
+        return;
+    }
+    sim_client.connected = false;
+    // 链路上还没发完的消息和它们的 PUBACK 都丢了
+    drain_link();
+    queued_bytes = (int64_t)drained_bytes;
+    pending_count = 0;
+    post_event(&sim_client, MQTT_EVENT_DISCONNECTED, 0, NULL, NULL, 0);
+}
+
+void sim_mqtt_publish(const char *topic, const char *payload)
+{
+    if (!client_created || !sim_client.connected)
+    {
+        return;
+    }
+    for (int i = 0; i < sim_client.num_subscriptions; i++)
+    {
+        if (strcmp(sim_client.subscriptions[i], topic) == 0)
+        {
+            post_event(&sim_client, MQTT_EVENT_DATA, 0, topic, payload, strlen(payload));
+            return;
+        }
+    }
+}
+
+void sim_mqtt_set_link_rate(int32_t bytes_per_s)
+{
+    drain_link();
+    link_rate = bytes_per_s;
+    drain_link();
+    post_event(&sim_client, MQTT_EVENT_ANY, 0, NULL, NULL, 0);
+}
+
+void sim_mqtt_expire_outbox(const char *topic, uint32_t count)
+{
+    snprintf(expiring_topic, sizeof(expiring_topic), "%s", topic);
+    expiring_messages = count;
+}
+
+const char *sim_mqtt_last_payload(const char *topic)
+{
+    for (int i = 0; i < num_published_topics; i++)
+    {
+        if (strcmp(published[i].topic, topic) == 0)
+        {
+            return published[i].payload;
+        }
+    }
+    return NULL;
+}
+
+const char *sim_mqtt_retained_payload(const char *topic)
+{
+    for (int i = 0; i < num_published_topics; i++)
+    {
+        if (strcmp(published[i].topic, topic) == 0)
+        {
+            return published[i].retained;
+        }
+    }
+    return "";
+}
+
+void sim_mqtt_topic_stats(const char *topic, uint32_t *messages, uint32_t *bytes)
+{
+    *messages = 0;
+    *bytes = 0;
+    for (int i = 0; i < num_published_topics; i++)
+    {
+        if (strcmp(published[i].topic, topic) == 0)
+        {
+            *messages = published[i].messages;
+            *bytes = published[i].bytes;
+        }
+    }
+}
+
+// 仿真的命令签名密钥，sim_mqtt_provision_key 写进 NVS，sim_mqtt_sign_command 用它签名
+static const uint8_t sim_command_key[MQTT_COMMAND_KEY_LEN] = {
+    0x46, 0x72, 0x65, 0x65, 0x64, 0x6f, 0x72, 0x6d, 0x2d, 0x73, 0x69, 0x6d, 0x2d, 0x6b, 0x65, 0x79,
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+};
+static uint32_t sim_command_counter = 0;
+
+void sim_mqtt_provision_key(void)
+{
+    nvs_handle_t handle;
+    ESP_ERROR_CHECK(nvs_open(MQTT_COMMAND_NVS_NAMESPACE, NVS_READWRITE, &handle));
+    ESP_ERROR_CHECK(nvs_set_blob(handle, MQTT_COMMAND_NVS_KEY, sim_command_key, sizeof(sim_command_key)));
+    ESP_ERROR_CHECK(nvs_commit(handle));
+    nvs_close(handle);
+}
+
+const char *sim_mqtt_sign_command(const char *verb, const char *request_id)
+{
+    static char command[MQTT_COMMAND_MAX_LEN * 2];
+    uint8_t mac[6];
+    esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    int body_len = snprintf(command, sizeof(command), "%s %s %lu", verb, request_id, (unsigned long)++sim_command_counter);
+    char message[sizeof(command) + 16];
+    int len = snprintf(message, sizeof(message), "%02x%02x%02x%02x%02x%02x %s", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], command);
+    uint8_t hmac[MQTT_COMMAND_MAC_LEN];
+    mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), sim_command_key, sizeof(sim_command_key), (const unsigned char *)message, len, hmac);
+    char *out = command + body_len;
+    *out++ = ' ';
+    for (int i = 0; i < MQTT_COMMAND_MAC_LEN; i++)
+    {
+        out += sprintf(out, "%02x", hmac[i]);
+    }
+    return command;
+}
+
+void sim_mqtt_set_command_counter(uint32_t counter)
+{
+    sim_command_counter = counter;
+}
@@ -0,0 +1,80 @@
+/**
+ * @file sim_mqtt.h
+ * @brief ESP-MQTT 客户端和本机 broker 的仿真替身
+ *
+ * 客户端和 IDF 一样有自己的 mqtt_task（优先级 5），事件回调都在这个任务里执行。
+ * broker 替身相当于同一台机器上的 mosquitto：只做精确匹配的订阅转发，不模拟网络延迟，
+ * 脚本发的消息在同一个虚拟时刻进入客户端，测出来的命令到动作延迟就是固件自己的排队和处理时间。
+ * 客户端发出去的消息按 topic 记下最后一条和累计的条数、字节数，脚本用它检查回报和吞吐量。
+ *
+ * 往上的链路默认不限速，发送队列（outbox）马上清空；限速之后按字节数慢慢发，
+ * esp_mqtt_client_get_outbox_size 返回还没发出去的字节，QoS 1 的消息整条发完、再过一个往返才在 mqtt_task 里回 PUBACK。
+ */
+#ifndef SIM_MQTT_H
+#define SIM_MQTT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+extern bool sim_trace_mqtt; // 是否打印客户端发出去的消息
+
+/**
+ * @brief 客户端连上 broker（相当于 Wi-Fi 连上、CONNACK 回来），客户端收到 MQTT_EVENT_CONNECTED
+ */
+void sim_mqtt_connect(void);
+
+/**
+ * @brief 客户端和 broker 断开（Wi-Fi 掉线），链路上还没发完的消息丢掉，客户端收到 MQTT_EVENT_DISCONNECTED
+ */
+void sim_mqtt_disconnect(void);
+
+/**
+ * @brief 其它客户端往 topic 发了一条消息，固件订阅了这个 topic 的话转发给它
+ */
+void sim_mqtt_publish(const char *topic, const char *payload);
+
+/**
+ * @brief 设置往 broker 的链路速度（字节/秒），0 表示链路堵住了，负数表示不限速
+ */
+void sim_mqtt_set_link_rate(int32_t bytes_per_s);
+
+/**
+ * @brief 接下来往 topic 发的 count 条 QoS 1 消息在发送队列里过期：和 ESP-MQTT 一样悄悄丢掉，不回 PUBACK，也没有 MQTT_EVENT_PUBLISHED
+ */
+void sim_mqtt_expire_outbox(const char *topic, uint32_t count);
+
+/**
+ * @brief 固件最近一次往 topic 发的消息，没有的话返回 NULL
+ */
+const char *sim_mqtt_last_payload(const char *topic);
+
+/**
+ * @brief broker 在 topic 上留着的 retain 消息，新订阅者一订阅就会收到；没有的话返回空串
+ */
+const char *sim_mqtt_retained_payload(const char *topic);
+
+/**
+ * @brief 固件开始以来往 topic 发了多少条消息、多少字节负载
+ */
+void sim_mqtt_topic_stats(const char *topic, uint32_t *messages, uint32_t *bytes);
+
+/**
+ * @brief 像产线一样把仿真的命令签名密钥写进 NVS
+ */
+void sim_mqtt_provision_key(void);
+
+/**
+ * @brief 像后端一样用仿真密钥签一条命令：<verb> <request_id> <计数器> <签名>，计数器每次加 1
+ *
+ * 签名的拼法在这里单独写一遍，和固件里的 mqtt_command_verify 对照；字段原样签名，不合法的也照签
+ *
+ * @return 静态缓冲里的负载，下一次调用会覆盖
+ */
+const char *sim_mqtt_sign_command(const char *verb, const char *request_id);
+
+/**
+ * @brief 下一条签名命令的计数器从 counter + 1 开始
+ */
+void sim_mqtt_set_command_counter(uint32_t counter);
+
+#endif // SIM_MQTT_H
@@ -0,0 +1,220 @@
+/**
+ * @file sim_nvs.c
+ * @brief NVS 的仿真：键值对放在内存里，每次仿真都从空的 NVS 开始
+ *
+ * 只实现固件用到的 blob 和 u32，类型和真机一样分开存，用错类型读会返回 ESP_ERR_NVS_NOT_FOUND。
+ * 只读句柄写入会报错退出，方便发现 nvs_open 的模式写错了。
+ * 真机上每次写都要写 flash，有时还要擦一页，任务里的 nvs_set_* 会阻塞 SIM_NVS_WRITE_US，
+ * 写在开门路径上的话，测出来的命令到动作延迟能看出来；脚本直接调用的不算时间。
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nvs_flash.h"
+#include "sim_hal.h"
+#include "sim_kernel.h"
+
+#define SIM_NVS_MAX_ENTRIES 32
+#define SIM_NVS_MAX_HANDLES 8
+#define SIM_NVS_KEY_LEN 16 // 和真机一样，命名空间和键最长 15 个字符
+#define SIM_NVS_WRITE_US 3000 // 写一条记录的时间，按偶尔要擦一页的情况估
+
+typedef enum
+{
+    SIM_NVS_TYPE_U32,
+    SIM_NVS_TYPE_BLOB,
+} sim_nvs_type_t;
+
+typedef struct
+{
+    char namespace_name[SIM_NVS_KEY_LEN];
+    char key[SIM_NVS_KEY_LEN];
+    sim_nvs_type_t type;
+    size_t length;
+    uint8_t *data;
+} sim_nvs_entry_t;
+
+typedef struct
+{
+    char namespace_name[SIM_NVS_KEY_LEN];
+    nvs_open_mode_t mode;
+    bool in_use;
+} sim_nvs_handle_t;
+
+static sim_nvs_entry_t entries[SIM_NVS_MAX_ENTRIES];
+static sim_nvs_handle_t handles[SIM_NVS_MAX_HANDLES];
+
+static sim_nvs_handle_t *get_handle(nvs_handle_t handle)
+{
+    if (handle == 0 || handle > SIM_NVS_MAX_HANDLES || !handles[handle - 1].in_use)
+    {
+        return NULL;
+    }
+    return &handles[handle - 1];
+}
+
+static sim_nvs_entry_t *find_entry(const char *namespace_name, const char *key)
+{
+    for (int i = 0; i < SIM_NVS_MAX_ENTRIES; i++)
+    {
+        if (entries[i].data != NULL && strcmp(entries[i].namespace_name, namespace_name) == 0 && strcmp(entries[i].key, key) == 0)
+        {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+static esp_err_t get_value(nvs_handle_t handle, const char *key, sim_nvs_type_t type, void *out_value, size_t *length)
+{
+    sim_nvs_handle_t *h = get_handle(handle);
+    if (h == NULL)
+    {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    sim_nvs_entry_t *entry = find_entry(h->namespace_name, key);
+    if (entry == NULL || entry->type != type)
+    {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (out_value == NULL)
+    {
+        *length = entry->length;
+        return ESP_OK;
+    }
+    if (*length < entry->length)
+    {
+        *length = entry->length;
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    memcpy(out_value, entry->data, entry->length);
+    *length = entry->length;
+    return ESP_OK;
+}
+
+static esp_err_t set_value(nvs_handle_t handle, const char *key, sim_nvs_type_t type, const void *value, size_t length)
+{
+    sim_nvs_handle_t *h = get_handle(handle);
+    if (h == NULL)
+    {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    if (h->mode != NVS_READWRITE)
+    {
+        fprintf(stderr, "sim: NVS write to key '%s' through a read-only handle\n", key);
+        abort();
+    }
+    sim_nvs_entry_t *entry = find_entry(h->namespace_name, key);
+    for (int i = 0; entry == NULL && i < SIM_NVS_MAX_ENTRIES; i++)
+    {
+        if (entries[i].data == NULL)
+        {
+            entry = &entries[i];
+            snprintf(entry->namespace_name, SIM_NVS_KEY_LEN, "%s", h->namespace_name);
+            snprintf(entry->key, SIM_NVS_KEY_LEN, "%s", key);
+        }
+    }
+    if (entry == NULL)
+    {
+        return ESP_ERR_NVS_NO_FREE_PAGES;
+    }
+    if (sim_in_task())
+    {
+        sim_block_on(entries, SIM_NVS_WRITE_US); // 没有人唤醒，到时间才返回
+    }
+    free(entry->data);
+    entry->data = malloc(length > 0 ? length : 1);
+    memcpy(entry->data, value, length);
+    entry->length = length;
+    entry->type = type;
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    for (int i = 0; i < SIM_NVS_MAX_ENTRIES; i++)
+    {
+        free(entries[i].data);
+        entries[i].data = NULL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *namespace_name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    if (strlen(namespace_name) >= SIM_NVS_KEY_LEN)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (int i = 0; i < SIM_NVS_MAX_HANDLES; i++)
+    {
+        if (!handles[i].in_use)
+        {
+            snprintf(handles[i].namespace_name, SIM_NVS_KEY_LEN, "%s", namespace_name);
+            handles[i].mode = open_mode;
+            handles[i].in_use = true;
+            *out_handle = i + 1;
+            return ESP_OK;
+        }
+    }
+    fprintf(stderr, "sim: out of NVS handles, missing nvs_close()?\n");
+    abort();
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    sim_nvs_handle_t *h = get_handle(handle);
+    if (h != NULL)
+    {
+        h->in_use = false;
+    }
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    return get_handle(handle) != NULL ? ESP_OK : ESP_ERR_NVS_INVALID_HANDLE;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    return get_value(handle, key, SIM_NVS_TYPE_BLOB, out_value, length);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    return set_value(handle, key, SIM_NVS_TYPE_BLOB, value, length);
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out_value)
+{
+    size_t length = sizeof(uint32_t);
+    return get_value(handle, key, SIM_NVS_TYPE_U32, out_value, &length);
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value)
+{
+    return set_value(handle, key, SIM_NVS_TYPE_U32, &value, sizeof(value));
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    sim_nvs_handle_t *h = get_handle(handle);
+    if (h == NULL)
+    {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    sim_nvs_entry_t *entry = find_entry(h->namespace_name, key);
+    if (entry == NULL)
+    {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    free(entry->data);
+    entry->data = NULL;
+    return ESP_OK;
+}
@@ -0,0 +1,260 @@
+/**
+ * @file sim_rmt.c
+ * @brief RMT TX 通道和 bytes/copy 编码器的仿真
+ *
+ * 编码器会真正把像素编码成 RMT 符号，只是不写进硬件内存，而是累加每个符号的时长，
+ * 由此算出这一帧在线上的传输时间。发送完成以“中断”的形式在虚拟时间上触发，
+ * 这时才从 payload 指针读出数据交给灯带 —— 和硬件一样，如果发送期间缓冲区被改写，看到的就是撕裂的一帧。
+ *
+ * 通道的内存按 C3 的规则检查：没有 DMA，mem_block_symbols 至少一块，所有通道加起来不能超过 4 块。
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "driver/rmt_tx.h"
+#include "soc/soc_caps.h"
+#include "sim_hal.h"
+#include "sim_kernel.h"
+
+struct rmt_channel_t
+{
+    rmt_tx_channel_config_t config;
+    bool enabled;
+    size_t pending;         // 已提交还没发送完成的事务数
+    int64_t busy_until_us;  // 线上最后一个事务完成的时间
+    uint64_t encoded_ticks; // 编码过程中累加的符号时长（RMT tick）
+    size_t encoded_symbols;
+    rmt_tx_done_callback_t on_trans_done;
+    void *user_ctx;
+};
+
+static size_t mem_blocks_used = 0; // 已经分给通道的 RMT 内存块
+
+typedef struct
+{
+    rmt_channel_handle_t channel;
+    const void *payload;
+    size_t size;
+    size_t num_symbols;
+    int64_t start_us;
+    int64_t done_us;
+} sim_rmt_transaction_t;
+
+typedef struct
+{
+    rmt_encoder_t base;
+    rmt_bytes_encoder_config_t config;
+    uint32_t byte_ticks[256]; // 每个字节值编码后的总时长，编码时查表，不用逐位累加
+} sim_bytes_encoder_t;
+
+static size_t symbol_ticks(rmt_symbol_word_t symbol)
+{
+    return symbol.duration0 + symbol.duration1;
+}
+
+static size_t bytes_encode(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data, size_t data_size, rmt_encode_state_t *ret_state)
+{
+    sim_bytes_encoder_t *bytes_encoder = (sim_bytes_encoder_t *)encoder;
+    const uint8_t *data = primary_data;
+    for (size_t i = 0; i < data_size; i++)
+    {
+        channel->encoded_ticks += bytes_encoder->byte_ticks[data[i]];
+    }
+    channel->encoded_symbols += data_size * 8;
+    *ret_state = RMT_ENCODING_COMPLETE;
+    return data_size * 8;
+}
+
+static size_t copy_encode(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data, size_t data_size, rmt_encode_state_t *ret_state)
+{
+    (void)encoder;
+    const rmt_symbol_word_t *symbols = primary_data;
+    size_t count = data_size / sizeof(rmt_symbol_word_t);
+    for (size_t i = 0; i < count; i++)
+    {
+        channel->encoded_ticks += symbol_ticks(symbols[i]);
+    }
+    channel->encoded_symbols += count;
+    *ret_state = RMT_ENCODING_COMPLETE;
+    return count;
+}
+
+static esp_err_t sim_encoder_reset(rmt_encoder_t *encoder)
+{
+    (void)encoder;
+    return ESP_OK;
+}
+
+static esp_err_t sim_encoder_del(rmt_encoder_t *encoder)
+{
+    free(encoder);
+    return ESP_OK;
+}
+
+esp_err_t rmt_new_bytes_encoder(const rmt_bytes_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder)
+{
+    sim_bytes_encoder_t *encoder = calloc(1, sizeof(sim_bytes_encoder_t));
+    encoder->config = *config;
+    for (int value = 0; value < 256; value++)
+    {
+        for (int bit = 0; bit < 8; bit++)
+        {
+            rmt_symbol_word_t symbol = (value >> bit) & 1 ? config->bit1 : config->bit0;
+            encoder->byte_ticks[value] += symbol_ticks(symbol);
+        }
+    }
+    encoder->base.encode = bytes_encode;
+    encoder->base.reset = sim_encoder_reset;
+    encoder->base.del = sim_encoder_del;
+    *ret_encoder = &encoder->base;
+    return ESP_OK;
+}
+
+esp_err_t rmt_new_copy_encoder(const rmt_copy_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder)
+{
+    (void)config;
+    rmt_encoder_t *encoder = calloc(1, sizeof(rmt_encoder_t));
+    encoder->encode = copy_encode;
+    encoder->reset = sim_encoder_reset;
+    encoder->del = sim_encoder_del;
+    *ret_encoder = encoder;
+    return ESP_OK;
+}
+
+esp_err_t rmt_del_encoder(rmt_encoder_handle_t encoder)
+{
+    return encoder->del(encoder);
+}
+
+esp_err_t rmt_encoder_reset(rmt_encoder_handle_t encoder)
+{
+    return encoder->reset(encoder);
+}
+
+void *rmt_alloc_encoder_mem(size_t size)
+{
+    return calloc(1, size);
+}
+
+esp_err_t rmt_new_tx_channel(const rmt_tx_channel_config_t *config, rmt_channel_handle_t *ret_chan)
+{
+    if (config == NULL || ret_chan == NULL || config->resolution_hz == 0 || config->trans_queue_depth == 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (config->flags.with_dma && !SOC_RMT_SUPPORT_DMA)
+    {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (config->mem_block_symbols < SOC_RMT_MEM_WORDS_PER_CHANNEL || config->mem_block_symbols % 2 != 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    size_t blocks = (config->mem_block_symbols + SOC_RMT_MEM_WORDS_PER_CHANNEL - 1) / SOC_RMT_MEM_WORDS_PER_CHANNEL;
+    if (mem_blocks_used + blocks > SOC_RMT_CHANNELS_PER_GROUP)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    mem_blocks_used += blocks;
+
+    rmt_channel_handle_t channel = calloc(1, sizeof(struct rmt_channel_t));
+    channel->config = *config;
+    *ret_chan = channel;
+    return ESP_OK;
+}
+
+esp_err_t rmt_del_channel(rmt_channel_handle_t channel)
+{
+    mem_blocks_used -= (channel->config.mem_block_symbols + SOC_RMT_MEM_WORDS_PER_CHANNEL - 1) / SOC_RMT_MEM_WORDS_PER_CHANNEL;
+    free(channel);
+    return ESP_OK;
+}
+
+esp_err_t rmt_enable(rmt_channel_handle_t channel)
+{
+    channel->enabled = true;
+    return ESP_OK;
+}
+
+esp_err_t rmt_disable(rmt_channel_handle_t channel)
+{
+    channel->enabled = false;
+    return ESP_OK;
+}
+
+esp_err_t rmt_tx_register_event_callbacks(rmt_channel_handle_t tx_channel, const rmt_tx_event_callbacks_t *cbs, void *user_data)
+{
+    tx_channel->on_trans_done = cbs->on_trans_done;
+    tx_channel->user_ctx = user_data;
+    return ESP_OK;
+}
+
+static void transaction_done_isr(void *arg)
+{
+    sim_rmt_transaction_t *t = arg;
+    rmt_channel_handle_t channel = t->channel;
+
+    channel->pending--;
+    sim_led_frame_done(t->payload, t->size, t->start_us, t->done_us);
+    if (channel->on_trans_done)
+    {
+        rmt_tx_done_event_data_t edata = {.num_symbols = t->num_symbols};
+        channel->on_trans_done(channel, &edata, channel->user_ctx);
+    }
+    free(t);
+    sim_wake_all(channel);
+}
+
+esp_err_t rmt_transmit(rmt_channel_handle_t tx_channel, rmt_encoder_handle_t encoder, const void *payload, size_t payload_bytes, const rmt_transmit_config_t *config)
+{
+    if (!tx_channel->enabled)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // 事务队列满了就等前面的发送完成，和驱动里的行为一致
+    while (tx_channel->pending >= tx_channel->config.trans_queue_depth)
+    {
+        if (config->flags.queue_nonblocking || !sim_in_task())
+        {
+            return ESP_ERR_INVALID_STATE;
+        }
+        sim_block_on(tx_channel, SIM_TIME_NEVER);
+    }
+
+    tx_channel->encoded_ticks = 0;
+    tx_channel->encoded_symbols = 0;
+    rmt_encode_state_t state = RMT_ENCODING_RESET;
+    for (int guard = 0; guard < 64 && !(state & RMT_ENCODING_COMPLETE); guard++)
+    {
+        encoder->encode(encoder, tx_channel, payload, payload_bytes, &state);
+    }
+
+    int64_t wire_us = (int64_t)(tx_channel->encoded_ticks * 1000000ULL / tx_channel->config.resolution_hz);
+    sim_rmt_transaction_t *t = calloc(1, sizeof(sim_rmt_transaction_t));
+    t->channel = tx_channel;
+    t->payload = payload;
+    t->size = payload_bytes;
+    t->num_symbols = tx_channel->encoded_symbols;
+    t->start_us = tx_channel->busy_until_us > sim_now_us() ? tx_channel->busy_until_us : sim_now_us();
+    t->done_us = t->start_us + wire_us;
+    tx_channel->busy_until_us = t->done_us;
+    tx_channel->pending++;
+    sim_schedule_isr(t->done_us, transaction_done_isr, t);
+    return ESP_OK;
+}
+
+esp_err_t rmt_tx_wait_all_done(rmt_channel_handle_t tx_channel, int timeout_ms)
+{
+    int64_t timeout_us = timeout_ms < 0 ? SIM_TIME_NEVER : (int64_t)timeout_ms * 1000;
+    int64_t deadline = timeout_us == SIM_TIME_NEVER ? SIM_TIME_NEVER : sim_now_us() + timeout_us;
+    while (tx_channel->pending > 0)
+    {
+        if (!sim_in_task() || sim_now_us() >= deadline)
+        {
+            return ESP_ERR_TIMEOUT;
+        }
+        sim_block_on(tx_channel, deadline == SIM_TIME_NEVER ? SIM_TIME_NEVER : deadline - sim_now_us());
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,15 @@
+/**
+ * @file ble_module.h
+ * @brief bsp_ble 的仿真替身，蓝牙协议栈不进入主机仿真，只保留状态机用到的符号
+ */
+#ifndef BLE_MODULE_H
+#define BLE_MODULE_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+extern SemaphoreHandle_t pairing_semaphore;
+
+void ble_module_init(void);
+
+#endif // BLE_MODULE_H
@@ -0,0 +1,16 @@
+/**
+ * @file esp_event.h
+ * @brief esp_event 的仿真替身，只保留 MQTT 客户端注册回调用到的类型
+ */
+#ifndef SIM_ESP_EVENT_H
+#define SIM_ESP_EVENT_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef const char *esp_event_base_t;
+typedef void (*esp_event_handler_t)(void *event_handler_arg, esp_event_base_t event_base, int32_t event_id, void *event_data);
+
+#define ESP_EVENT_ANY_ID -1
+
+#endif // SIM_ESP_EVENT_H
@@ -0,0 +1,5 @@
+#pragma once
+#include <stdint.h>
+
+// 和 ROM 里的实现一样：反射的 CRC32（多项式 0xEDB88320），进出都取反，crc 传上一段的结果可以接着算，见 sim_hal.c
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len);
@@ -0,0 +1,21 @@
+#ifndef SIM_MBEDTLS_MD_H
+#define SIM_MBEDTLS_MD_H
+
+#include <stddef.h>
+
+// mbedtls 消息摘要接口的仿真替身，只实现 HMAC-SHA256，见 sim_mbedtls.c
+
+typedef enum
+{
+    MBEDTLS_MD_NONE = 0,
+    MBEDTLS_MD_SHA256 = 9, // 和 mbedtls 3.x 的取值一样
+} mbedtls_md_type_t;
+
+typedef struct mbedtls_md_info_t mbedtls_md_info_t;
+
+const mbedtls_md_info_t *mbedtls_md_info_from_type(mbedtls_md_type_t md_type);
+
+int mbedtls_md_hmac(const mbedtls_md_info_t *md_info, const unsigned char *key, size_t keylen, const unsigned char *input, size_t ilen,
+                    unsigned char *output);
+
+#endif // SIM_MBEDTLS_MD_H
@@ -0,0 +1,10 @@
+#ifndef SIM_SOC_GPIO_REG_H
+#define SIM_SOC_GPIO_REG_H
+
+#include "soc/soc.h"
+
+// 和 ESP32-C3 一致：GPIO_IN_REG 的 bit n 是 GPIOn 的输入电平
+#define DR_REG_GPIO_BASE 0x60004000
+#define GPIO_IN_REG (DR_REG_GPIO_BASE + 0x3c)
+
+#endif // SIM_SOC_GPIO_REG_H
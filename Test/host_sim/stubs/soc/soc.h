@@ -0,0 +1,13 @@
+#ifndef SIM_SOC_SOC_H
+#define SIM_SOC_SOC_H
+
+#include <stdint.h>
+
+/**
+ * @brief 外设寄存器读，只实现了固件用到的寄存器（见 sim_hal.c）
+ */
+uint32_t sim_reg_read(uint32_t reg);
+
+#define REG_READ(_r) sim_reg_read((uint32_t)(_r))
+
+#endif // SIM_SOC_SOC_H
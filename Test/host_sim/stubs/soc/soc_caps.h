@@ -0,0 +1,9 @@
+#ifndef SIM_SOC_CAPS_H
+#define SIM_SOC_CAPS_H
+
+// 和 ESP32-C3 一致：RMT 没有 DMA，4 个通道（2 TX + 2 RX）共用 4 块、每块 48 个符号的内存
+#define SOC_RMT_SUPPORT_DMA 0
+#define SOC_RMT_CHANNELS_PER_GROUP 4
+#define SOC_RMT_MEM_WORDS_PER_CHANNEL 48
+
+#endif // SIM_SOC_CAPS_H